@@ -0,0 +1,54 @@
+#ifndef _BENCH_FIXTURE_H
+#define _BENCH_FIXTURE_H
+
+
+#include <csignal>
+#include <sys/ptrace.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+/**
+ * @brief: 速度测试共用的被调试进程
+ *         fork出的子进程以PTRACE_TRACEME跟踪自己，停在SIGSTOP处，恢复后循环调用同一个热点函数。
+ *         子进程与父进程的地址相同（fork），测试直接使用&bench_hot与&g_bench_counter。
+ */
+
+
+// 每次调用热点函数之前递增，条件断点的条件可以读取它
+inline volatile long g_bench_counter = 0;
+
+// 被测的热点函数：有条件分支、调用与返回
+__attribute__((noinline)) inline long bench_hot(long x) {
+    return (x & 1) ? x * 3 + 1 : x / 2;
+}
+
+inline void bench_workload(long iterations) {
+    volatile long sum = 0;
+    for (long i = 0; i < iterations; i++) {
+        g_bench_counter = g_bench_counter + 1;
+        sum = sum + bench_hot(i);
+    }
+}
+
+
+/**
+ * @brief: fork出被跟踪的子进程，返回时它停在SIGSTOP处；恢复后执行[child]，然后_exit(0)
+ */
+template <typename F>
+pid_t spawn_traced(F child) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        ptrace(PTRACE_TRACEME, 0, nullptr, nullptr);
+        raise(SIGSTOP);
+        child();
+        _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    return pid;
+}
+
+
+#endif /* _BENCH_FIXTURE_H */
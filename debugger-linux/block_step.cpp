@@ -0,0 +1,67 @@
+#include "block_step.h"
+#include <algorithm>
+#include <sys/ptrace.h>
+
+
+bool ptrace_block_step(pid_t pid, int signal) {
+    return ptrace(PTRACE_SINGLEBLOCK, pid, nullptr, signal) == 0;
+}
+
+
+
+void branch_trace::record(std::uintptr_t from, std::uintptr_t to) {
+    if (m_records.empty()) return;
+    m_records[m_total % m_records.size()] = branch_record{from, to};
+    m_total++;
+}
+
+
+
+void branch_trace::clear() {
+    m_total = 0;
+}
+
+
+
+std::vector<branch_record> branch_trace::last(std::size_t n) const {
+    n = std::min(n, size());
+    std::vector<branch_record> out;
+    out.reserve(n);
+    for (auto i = m_total - n; i < m_total; i++) {
+        out.push_back(m_records[i % m_records.size()]);
+    }
+    return out;
+}
+
+
+
+std::uintptr_t find_branch_source(std::uintptr_t start, std::uintptr_t to,
+                                  const std::function<const x86_insn*(std::uintptr_t)>& decode) {
+    // 一个块最多解码的指令数，超过时认为[start]与[to]无关
+    constexpr int max_insns = 4096;
+
+    auto addr = start;
+    for (int i = 0; i < max_insns; i++) {
+        auto insn = decode(addr);
+        if (insn == nullptr) return 0;
+        auto branch = insn->branch;
+        auto next = addr + insn->length;
+        auto target = next + insn->rel;
+
+        switch (branch) {
+        case x86_branch::none:
+        case x86_branch::syscall:
+            // rep前缀的串操作每次迭代都会停下，pc不变
+            if (next == to || addr == to) return 0;
+            break;
+        case x86_branch::cond_jump:
+            if (target == to) return addr;
+            if (next == to) return 0;
+            break;
+        default:
+            return addr;
+        }
+        addr = next;
+    }
+    return 0;
+}
@@ -0,0 +1,68 @@
+#ifndef _BLOCK_STEP_H
+#define _BLOCK_STEP_H
+
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <sys/types.h>
+
+#include "x86_decoder.h"
+
+
+/**
+ * @brief: PTRACE_SINGLEBLOCK让被调试进程执行到下一条发生跳转的分支指令之后才停下
+ *         （x86的DEBUGCTL.BTF），停下的次数通常只有PTRACE_SINGLESTEP的几分之一。
+ *         内核不支持时请求失败；部分虚拟机接受请求但忽略BTF，此时行为与单步相同，
+ *         只能在运行时通过停下的位置判断。
+ */
+enum class block_step_support {
+    unknown,        // 还没有遇到可以判断的块单步
+    supported,
+    unsupported,    // 请求失败或BTF被忽略，退化为单步
+};
+
+// 块单步，[signal]为恢复执行时交给程序的信号；请求失败时返回false
+bool ptrace_block_step(pid_t pid, int signal = 0);
+
+
+
+// 一次发生跳转的分支：[from]为分支指令的地址，不能确定时为0
+struct branch_record {
+    std::uintptr_t from;
+    std::uintptr_t to;
+};
+
+/**
+ * @brief: 块单步得到的分支记录，保留最近的[capacity]条
+ */
+class branch_trace {
+public:
+    explicit branch_trace(std::size_t capacity = 4096) : m_records(capacity) {}
+
+    void record(std::uintptr_t from, std::uintptr_t to);
+    void clear();
+    // 最近的[n]条，按时间顺序
+    std::vector<branch_record> last(std::size_t n) const;
+
+    auto size() const -> std::size_t {return std::min(m_total, m_records.size());}
+    auto get_total() const -> std::size_t {return m_total;}
+
+private:
+    std::vector<branch_record> m_records;
+    std::size_t m_total = 0;
+};
+
+
+/**
+ * @brief: 一个块从[start]开始，执行后停在[to]，从[start]向后解码找到发生跳转的分支指令：
+ *         无条件的分支（jmp/call/ret/间接跳转）一定跳转；jcc只有目标为[to]时才是它。
+ *         [to]是顺序执行到达的（单步的退化情况）或不能解码时返回0。
+ */
+std::uintptr_t find_branch_source(std::uintptr_t start, std::uintptr_t to,
+                                  const std::function<const x86_insn*(std::uintptr_t)>& decode);
+
+
+#endif /* _BLOCK_STEP_H */
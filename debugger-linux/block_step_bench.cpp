@@ -0,0 +1,113 @@
+/**
+ * @brief: 单步与块单步的速度对比
+ *         fork出的子进程停在一段固定的循环之前，分别用PTRACE_SINGLESTEP与PTRACE_SINGLEBLOCK
+ *         执行到退出。单步的停止次数就是执行的指令数，以此计算两种方式每秒执行的指令数。
+ *         块单步时还对每次停下解码出发生跳转的分支，检查BTF是否生效。
+ *
+ *         block_step_bench [iterations] [runs]
+ */
+#include "bench_fixture.h"
+#include "block_step.h"
+#include "x86_decoder.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <sys/ptrace.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+
+struct run_result {
+    uint64_t stops = 0;
+    uint64_t branches = 0;      // 块单步时解码确认的分支数
+    double ms = 0;
+    bool failed = false;
+    int error = 0;
+};
+
+
+static run_result run(long iterations, bool block) {
+    auto pid = spawn_traced([iterations]() { bench_workload(iterations); });
+    int status;
+
+    // 解码子进程的代码：与调试器一样按页缓存
+    x86_decode_cache cache;
+    auto reader = [pid](std::uintptr_t addr, uint8_t* buf, std::size_t len) -> std::size_t {
+        iovec local {buf, len};
+        iovec remote {reinterpret_cast<void*>(addr), len};
+        auto n = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+        return n > 0 ? n : 0;
+    };
+    auto decode = [&](std::uintptr_t addr) { return cache.decode(addr, reader); };
+    auto get_pc = [pid]() -> std::uintptr_t {
+        return ptrace(PTRACE_PEEKUSER, pid, offsetof(user_regs_struct, rip), nullptr);
+    };
+
+    run_result result;
+    auto start = std::chrono::steady_clock::now();
+    std::uintptr_t pc = block ? get_pc() : 0;
+    while (true) {
+        if (block) {
+            if (!ptrace_block_step(pid)) {
+                result.failed = true;
+                result.error = errno;
+                kill(pid, SIGKILL);
+                waitpid(pid, &status, 0);
+                break;
+            }
+        } else {
+            ptrace(PTRACE_SINGLESTEP, pid, nullptr, nullptr);
+        }
+        waitpid(pid, &status, 0);
+        if (WIFEXITED(status) || WIFSIGNALED(status)) break;
+        result.stops++;
+        if (block) {
+            auto to = get_pc();
+            if (find_branch_source(pc, to, decode) != 0) result.branches++;
+            pc = to;
+        }
+    }
+    result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+
+
+int main(int argc, char* argv[]) {
+    long iterations = argc > 1 ? std::stol(argv[1]) : 20000;
+    int runs = argc > 2 ? std::stoi(argv[2]) : 3;
+
+    run_result step, block;
+    step.ms = block.ms = 1e30;
+    for (int i = 0; i < runs; i++) {
+        auto r = run(iterations, false);
+        if (r.ms < step.ms) step = r;
+        r = run(iterations, true);
+        if (r.failed || r.ms < block.ms) block = r;
+        if (r.failed) break;
+    }
+
+    // 单步的停止次数即指令数（包括raise返回与_exit中的指令）
+    auto insns = step.stops;
+    std::cout << "workload: " << iterations << " iterations, " << insns << " instructions" << std::endl;
+    std::cout << "single-step: " << step.stops << " stops, " << step.ms << " ms, "
+              << insns / step.ms / 1000 << " M insn/s" << std::endl;
+    if (block.failed) {
+        std::cout << "block-step:  PTRACE_SINGLEBLOCK not supported (" << std::strerror(block.error) << ")" << std::endl;
+        return 0;
+    }
+    std::cout << "block-step:  " << block.stops << " stops (" << block.branches << " taken branches), "
+              << block.ms << " ms, " << insns / block.ms / 1000 << " M insn/s, "
+              << static_cast<double>(step.stops) / std::max<uint64_t>(block.stops, 1) << "x fewer stops" << std::endl;
+    if (block.stops >= step.stops) {
+        std::cout << "block-step:  BTF is ignored (e.g. in a VM), stops after every instruction" << std::endl;
+    }
+    return 0;
+}
@@ -11,13 +11,19 @@
 // #include <sstream>
 #include <cstdint>
 #include <stdint.h>
+#include <memory>
 #include <sys/ptrace.h>
 
 
+class compiled_expr;
+class dprintf_format;
+
+
 class breakpoint {
 public:
     breakpoint(pid_t pid, std::intptr_t addr) 
-        : m_pid{pid}, m_addr{addr}, m_enabled{false}, m_saved_data{}
+        : m_pid{pid}, m_addr{addr}, m_enabled{false}, m_saved_data{}, m_number{0},
+          m_trap_count{0}, m_hit_count{0}, m_ignore_count{0}, m_thread{0}
     {}
 
     // Enalbe, set a breakpoint iat address [m_addr] of process [m_pid] and save the data
@@ -30,6 +36,49 @@ public:
     // return the address of the breakpoint
     auto get_address() const -> std::intptr_t {return m_addr;}
 
+    // 由[breakpoint_manager]批量写入内存后，同步断点的状态
+    auto get_saved_data() const -> uint8_t {return m_saved_data;}
+    void set_saved_data(uint8_t data) {m_saved_data = data;}
+    void set_enabled(bool enabled) {m_enabled = enabled;}
+    void set_pid(pid_t pid) {m_pid = pid;}
+
+    // 用户可见的编号，0表示调试器内部使用的临时断点
+    void set_number(int number) {m_number = number;}
+    auto get_number() const -> int {return m_number;}
+
+    // 触发次数，包括条件不满足的情况，用于判断是否为热点断点
+    void trap() {m_trap_count++;}
+    auto get_trap_count() const -> uint64_t {return m_trap_count;}
+    // 命中次数：条件满足的触发
+    void hit() {m_hit_count++;}
+    auto get_hit_count() const -> uint64_t {return m_hit_count;}
+
+    // 忽略接下来的[count]次命中
+    void set_ignore_count(uint64_t count) {m_ignore_count = count;}
+    auto get_ignore_count() const -> uint64_t {return m_ignore_count;}
+    // 仍需忽略时计数减一并返回true
+    bool consume_ignore() {
+        if (m_ignore_count == 0) return false;
+        m_ignore_count--;
+        return true;
+    }
+
+    // 命中后执行的命令；以continue结尾时执行完自动继续运行
+    void set_commands(std::vector<std::string> commands) {m_commands = std::move(commands);}
+    auto get_commands() const -> const std::vector<std::string>& {return m_commands;}
+
+    // dprintf：命中后打印并继续运行，不返回命令行
+    void set_dprintf(std::shared_ptr<dprintf_format> format) {m_dprintf = std::move(format);}
+    auto get_dprintf() const -> const std::shared_ptr<dprintf_format>& {return m_dprintf;}
+
+    // 线程断点：只在编号为[thread]的线程中停下，其他线程经过时不计数、自动继续运行；0表示所有线程
+    void set_thread(int thread) {m_thread = thread;}
+    auto get_thread() const -> int {return m_thread;}
+
+    // 条件断点：命中时执行编译好的表达式，为0时自动继续运行
+    void set_condition(std::shared_ptr<compiled_expr> cond) {m_condition = std::move(cond);}
+    auto get_condition() const -> const std::shared_ptr<compiled_expr>& {return m_condition;}
+
 
 
 private:
@@ -37,6 +86,14 @@ private:
     std::intptr_t m_addr;
     bool m_enabled;
     uint8_t m_saved_data; // breakpoint地址原本的数据
+    int m_number;
+    uint64_t m_trap_count;
+    uint64_t m_hit_count;
+    uint64_t m_ignore_count;
+    int m_thread;
+    std::shared_ptr<compiled_expr> m_condition;
+    std::vector<std::string> m_commands;
+    std::shared_ptr<dprintf_format> m_dprintf;
 };
 
 
@@ -0,0 +1,176 @@
+#include "breakpoint_manager.h"
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+
+
+
+breakpoint_manager::breakpoint_manager(pid_t pid) : m_pid{pid}, m_mem_fd{-1} {
+    set_pid(pid);
+}
+
+
+breakpoint_manager::~breakpoint_manager() {
+    if (m_mem_fd >= 0) close(m_mem_fd);
+}
+
+
+
+void breakpoint_manager::set_pid(pid_t pid) {
+    if (m_mem_fd >= 0) close(m_mem_fd);
+    m_pid = pid;
+    m_mem_fd = open(("/proc/" + std::to_string(pid) + "/mem").c_str(), O_RDWR);
+
+    for (auto& [addr, bp] : m_breakpoints) {
+        bp.set_pid(pid);
+    }
+}
+
+
+
+breakpoint& breakpoint_manager::add(std::intptr_t addr) {
+    auto it = m_breakpoints.find(addr);
+    if (it == m_breakpoints.end()) {
+        it = m_breakpoints.emplace(addr, breakpoint{m_pid, addr}).first;
+    }
+    m_pending[addr] = true;
+    return it->second;
+}
+
+
+
+void breakpoint_manager::remove(std::intptr_t addr) {
+    if (!m_breakpoints.count(addr)) return;
+    m_pending[addr] = false;
+    m_pending_erase.push_back(addr);
+}
+
+
+
+void breakpoint_manager::enable(std::intptr_t addr) {
+    if (m_breakpoints.count(addr)) m_pending[addr] = true;
+}
+
+
+void breakpoint_manager::disable(std::intptr_t addr) {
+    if (m_breakpoints.count(addr)) m_pending[addr] = false;
+}
+
+
+
+std::vector<std::intptr_t> breakpoint_manager::disable_all() {
+    // 先写入待处理的修改，[is_enabled]才是最终的状态
+    flush();
+    std::vector<std::intptr_t> disabled;
+    for (auto& [addr, bp] : m_breakpoints) {
+        if (!bp.is_enabled()) continue;
+        m_pending[addr] = false;
+        disabled.push_back(addr);
+    }
+    flush();
+    return disabled;
+}
+
+
+void breakpoint_manager::enable_all(const std::vector<std::intptr_t>& addrs) {
+    // 期间被删除的断点由[enable]跳过
+    for (auto addr : addrs) enable(addr);
+    flush();
+}
+
+
+
+/**
+ * @brief: [m_pending]按地址排序，相邻且位于同一页的修改合并为一次读写
+ */
+void breakpoint_manager::flush() {
+    auto first = m_pending.begin();
+    while (first != m_pending.end()) {
+        auto page = static_cast<std::uintptr_t>(first->first) & ~(g_page_size - 1);
+        auto last = first;
+        while (last != m_pending.end() && (static_cast<std::uintptr_t>(last->first) & ~(g_page_size - 1)) == page) {
+            ++last;
+        }
+
+        if (!patch_page(first, last)) {
+            // 退化为逐个断点的PEEKDATA+POKEDATA
+            for (auto it = first; it != last; ++it) {
+                auto& bp = m_breakpoints.at(it->first);
+                if (it->second && !bp.is_enabled()) bp.bp_enable();
+                if (!it->second && bp.is_enabled()) bp.bp_disable();
+            }
+        }
+        first = last;
+    }
+    m_pending.clear();
+
+    for (auto addr : m_pending_erase) {
+        // 删除后又被重新添加的断点需要保留
+        auto it = m_breakpoints.find(addr);
+        if (it != m_breakpoints.end() && !it->second.is_enabled()) m_breakpoints.erase(it);
+    }
+    m_pending_erase.clear();
+}
+
+
+
+bool breakpoint_manager::patch_page(std::map<std::intptr_t, bool>::iterator first,
+                                    std::map<std::intptr_t, bool>::iterator last) {
+    if (m_mem_fd < 0) return false;
+
+    // 只读写本页中第一个到最后一个修改之间的字节
+    auto low = static_cast<std::uintptr_t>(first->first);
+    auto high = static_cast<std::uintptr_t>(std::prev(last)->first) + 1;
+    uint8_t buf[g_page_size];
+    auto size = high - low;
+    if (pread(m_mem_fd, buf, size, low) != (ssize_t)size) return false;
+
+    bool changed = false;
+    for (auto it = first; it != last; ++it) {
+        auto& bp = m_breakpoints.at(it->first);
+        auto& byte = buf[it->first - low];
+        if (it->second && !bp.is_enabled()) {
+            bp.set_saved_data(byte);
+            byte = 0xcc;
+            changed = true;
+        } else if (!it->second && bp.is_enabled()) {
+            byte = bp.get_saved_data();
+            changed = true;
+        }
+    }
+
+    if (changed && pwrite(m_mem_fd, buf, size, low) != (ssize_t)size) return false;
+
+    for (auto it = first; it != last; ++it) {
+        m_breakpoints.at(it->first).set_enabled(it->second);
+    }
+    return true;
+}
+
+
+
+void breakpoint_manager::write_original_code(pid_t pid) const {
+    auto fd = open(("/proc/" + std::to_string(pid) + "/mem").c_str(), O_RDWR);
+    for (const auto& [addr, bp] : m_breakpoints) {
+        if (!bp.is_enabled()) continue;
+        auto data = bp.get_saved_data();
+        if (fd >= 0 && pwrite(fd, &data, 1, addr) == 1) continue;
+        // 退化为PEEKDATA+POKEDATA
+        auto word = ptrace(PTRACE_PEEKDATA, pid, addr, nullptr);
+        ptrace(PTRACE_POKEDATA, pid, addr, (word & ~0xffL) | data);
+    }
+    if (fd >= 0) close(fd);
+}
+
+
+
+void breakpoint_manager::rearm(pid_t pid) {
+    set_pid(pid);
+    // 已有的待处理修改（例如待删除的断点）保持不变
+    for (auto& [addr, bp] : m_breakpoints) {
+        if (!bp.is_enabled()) continue;
+        bp.set_enabled(false);
+        m_pending.emplace(addr, true);
+    }
+    flush();
+}
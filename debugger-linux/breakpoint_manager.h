@@ -0,0 +1,81 @@
+#ifndef _BREAKPOINT_MANAGER_H
+#define _BREAKPOINT_MANAGER_H
+
+
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+
+#include "breakpoint.h"
+
+
+// 被调试进程的页大小
+constexpr std::size_t g_page_size = 4096;
+
+
+
+/**
+ * @brief: 管理进程[m_pid]中的所有断点
+ *         断点的插入与移除先放入待处理队列，[flush]时按页分组：
+ *         每页只读取一次，修改该页中所有的int3字节后，再通过一次[pwrite]写回
+ *         /proc/<pid>/mem。无法打开/proc/<pid>/mem时退化为PEEKDATA+POKEDATA。
+ */
+class breakpoint_manager {
+public:
+    explicit breakpoint_manager(pid_t pid);
+    ~breakpoint_manager();
+    breakpoint_manager(const breakpoint_manager&) = delete;
+    breakpoint_manager& operator=(const breakpoint_manager&) = delete;
+
+    // 切换被调试的进程，重新打开/proc/<pid>/mem
+    void set_pid(pid_t pid);
+
+    // 与[std::unordered_map]一致的查询接口
+    auto count(std::intptr_t addr) const -> std::size_t {return m_breakpoints.count(addr);}
+    auto at(std::intptr_t addr) -> breakpoint& {return m_breakpoints.at(addr);}
+    auto find(std::intptr_t addr) {return m_breakpoints.find(addr);}
+    auto begin() {return m_breakpoints.begin();}
+    auto end() {return m_breakpoints.end();}
+    auto size() const -> std::size_t {return m_breakpoints.size();}
+
+    // 添加断点，在下一次[flush]时写入int3
+    breakpoint& add(std::intptr_t addr);
+    // 移除断点，在下一次[flush]时恢复原数据并删除
+    void remove(std::intptr_t addr);
+    // 启用/禁用单个断点，在下一次[flush]时生效
+    void enable(std::intptr_t addr);
+    void disable(std::intptr_t addr);
+
+    // 禁用所有已启用的断点并立即生效，返回被禁用的地址；
+    // [enable_all]只重新启用这些地址，用户禁用的断点保持禁用
+    std::vector<std::intptr_t> disable_all();
+    void enable_all(const std::vector<std::intptr_t>& addrs);
+
+    // 把所有待处理的修改写入被调试进程
+    void flush();
+
+    // 在另一个进程[pid]（例如fork出的检查点）中把已写入的int3恢复为原数据，不改变断点的状态
+    void write_original_code(pid_t pid) const;
+    // 切换到内存中没有int3的进程[pid]（干净的检查点fork出的进程），重新写入所有已启用的断点
+    void rearm(pid_t pid);
+
+private:
+    // 按页写入修改，失败时返回false
+    bool patch_page(std::map<std::intptr_t, bool>::iterator first,
+                    std::map<std::intptr_t, bool>::iterator last);
+
+    pid_t m_pid;
+    int m_mem_fd;
+
+    std::unordered_map<std::intptr_t, breakpoint> m_breakpoints;
+    // 待处理的修改：地址 -> 期望的状态(true: 写入int3)，按地址排序便于按页分组
+    std::map<std::intptr_t, bool> m_pending;
+    // [flush]之后需要删除的断点
+    std::vector<std::intptr_t> m_pending_erase;
+};
+
+
+
+#endif /* _BREAKPOINT_MANAGER_H */
@@ -0,0 +1,147 @@
+/**
+ * @brief: 条件断点的速度测试
+ *         fork出的子进程循环调用同一个函数，函数入口处是条件不满足的断点，只在最后一次调用时满足。
+ *         每次命中与调试器相同：PTRACE_GETREGS一次构造[expr_eval_context]，执行编译后的字节码，
+ *         再越过断点继续执行。分别测试位移单步（默认）、移除int3后单步，
+ *         以及转换为硬件断点后设置RF继续执行（"hbreak auto"，不需要单步），
+ *         报告每秒处理的命中数（目标至少50k/s）与字节码每次求值的耗时。
+ *
+ *         cond_bench [iterations] [runs]
+ */
+#include "bench_fixture.h"
+#include "displaced_step.h"
+#include "expression.h"
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <sys/ptrace.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+
+struct run_result {
+    uint64_t hits = 0;
+    uint64_t matches = 0;
+    double ms = 0;
+    double eval_ns = 0;
+};
+
+
+// 越过断点的方式
+enum class step_mode {displaced, reinsert, hardware};
+
+
+static run_result run(long iterations, step_mode mode) {
+    auto pid = spawn_traced([iterations]() { bench_workload(iterations); });
+    int status;
+
+    // 条件与"break bench_hot if i == N-1 && counter > 0"相同：i是第一个参数（rdi），counter是全局变量
+    auto resolver = [](const std::string& name, variable_info& var) {
+        if (name == "i") {
+            var = variable_info{variable_info::kind::in_register, 0, reg_x86_64::rdi, 8, true, std::nullopt};
+            return true;
+        }
+        if (name == "counter") {
+            var = variable_info{variable_info::kind::absolute, reinterpret_cast<int64_t>(&g_bench_counter),
+                                reg_x86_64::rax, 8, true, std::nullopt};
+            return true;
+        }
+        return false;
+    };
+    auto cond = compiled_expr::compile("i == " + std::to_string(iterations - 1) + " && counter > 0", resolver);
+
+    auto addr = reinterpret_cast<std::uintptr_t>(&bench_hot);
+    uint8_t code[16];
+    for (int i = 0; i < 16; i += 8) {
+        auto word = ptrace(PTRACE_PEEKDATA, pid, addr + i, nullptr);
+        std::memcpy(code + i, &word, 8);
+    }
+    uint64_t original;
+    std::memcpy(&original, code, 8);
+    auto with_int3 = (original & ~0xffUL) | 0xcc;
+    if (mode == step_mode::hardware) {
+        // DR0 = addr，DR7: L0，执行断点（R/W0 = 00，LEN0 = 00）
+        ptrace(PTRACE_POKEUSER, pid, offsetof(user, u_debugreg), addr);
+        ptrace(PTRACE_POKEUSER, pid, offsetof(user, u_debugreg) + 7 * sizeof(long), 1);
+    } else {
+        ptrace(PTRACE_POKEDATA, pid, addr, with_int3);
+    }
+
+    displaced_stepper stepper {pid};
+    run_result result;
+    auto start = std::chrono::steady_clock::now();
+    while (true) {
+        ptrace(PTRACE_CONT, pid, nullptr, nullptr);
+        waitpid(pid, &status, 0);
+        if (WIFEXITED(status) || WIFSIGNALED(status)) break;
+        result.hits++;
+
+        expr_eval_context ctx {pid};
+        if (cond.evaluate(ctx)) result.matches++;
+
+        auto regs = ctx.get_regs();
+        if (mode == step_mode::hardware) {
+            // 硬件执行断点在指令执行前触发，RF使恢复执行时不再触发一次
+            regs.eflags |= 1 << 16;
+            ptrace(PTRACE_SETREGS, pid, nullptr, &regs);
+            continue;
+        }
+        regs.rip = addr;
+        if (mode == step_mode::displaced) {
+            if (!stepper.prepare(addr, code, sizeof(code), regs)) {
+                std::cerr << "Can't displace the instruction at bench_hot()" << std::endl;
+                kill(pid, SIGKILL);
+                waitpid(pid, &status, 0);
+                break;
+            }
+            ptrace(PTRACE_SINGLESTEP, pid, nullptr, nullptr);
+            waitpid(pid, &status, 0);
+            stepper.finish();
+        } else {
+            ptrace(PTRACE_SETREGS, pid, nullptr, &regs);
+            ptrace(PTRACE_POKEDATA, pid, addr, original);
+            ptrace(PTRACE_SINGLESTEP, pid, nullptr, nullptr);
+            waitpid(pid, &status, 0);
+            ptrace(PTRACE_POKEDATA, pid, addr, with_int3);
+        }
+    }
+    result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    result.eval_ns = cond.get_eval_count() ? static_cast<double>(cond.get_eval_time_ns()) / cond.get_eval_count() : 0;
+    return result;
+}
+
+
+
+int main(int argc, char* argv[]) {
+    long iterations = argc > 1 ? std::stol(argv[1]) : 20000;
+    int runs = argc > 2 ? std::stoi(argv[2]) : 3;
+
+    run_result displaced, reinsert, hardware;
+    displaced.ms = reinsert.ms = hardware.ms = 1e30;
+    for (int i = 0; i < runs; i++) {
+        auto r = run(iterations, step_mode::displaced);
+        if (r.ms < displaced.ms) displaced = r;
+        r = run(iterations, step_mode::reinsert);
+        if (r.ms < reinsert.ms) reinsert = r;
+        r = run(iterations, step_mode::hardware);
+        if (r.ms < hardware.ms) hardware = r;
+    }
+
+    std::cout << "condition: i == " << iterations - 1 << " && counter > 0, " << iterations << " calls" << std::endl;
+    auto print = [](const char* name, const run_result& r) {
+        auto rate = r.hits / r.ms * 1000;
+        std::cout << name << r.hits << " hits (" << r.matches << " true), " << r.ms << " ms, "
+                  << static_cast<uint64_t>(rate) << " hits/s, " << r.eval_ns << " ns/eval"
+                  << (rate >= 50000 ? "" : "  (below 50k/s)") << std::endl;
+    };
+    print("displaced step:      ", displaced);
+    print("remove int3:         ", reinsert);
+    print("hardware breakpoint: ", hardware);
+    return 0;
+}
@@ -0,0 +1,167 @@
+#include "debug_registers.h"
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <sys/ptrace.h>
+#include <sys/user.h>
+
+
+#ifdef __x86_64__
+
+
+uint64_t get_debug_register(pid_t pid, int index) {
+    auto offset = offsetof(struct user, u_debugreg) + index * sizeof(uint64_t);
+    return ptrace(PTRACE_PEEKUSER, pid, offset, nullptr);
+}
+
+
+void set_debug_register(pid_t pid, int index, uint64_t value) {
+    auto offset = offsetof(struct user, u_debugreg) + index * sizeof(uint64_t);
+    if (ptrace(PTRACE_POKEUSER, pid, offset, value) < 0) {
+        throw std::runtime_error{"Failed to set debug register DR" + std::to_string(index)};
+    }
+}
+
+
+
+void debug_registers::set_pid(pid_t pid) {
+    m_threads = {pid};
+    write_thread(pid);
+}
+
+
+
+void debug_registers::add_thread(pid_t tid) {
+    m_threads.insert(tid);
+    write_thread(tid);
+}
+
+
+
+void debug_registers::rewrite() {
+    for (auto tid : m_threads) write_thread(tid);
+}
+
+
+
+void debug_registers::write_thread(pid_t tid) {
+    for (int i = 0; i < n_debug_slots; i++) {
+        if (m_slots[i].used) set_debug_register(tid, i, m_slots[i].addr);
+    }
+    set_debug_register(tid, 7, compute_dr7());
+}
+
+
+
+int debug_registers::set(std::uintptr_t addr, dr_condition cond, int len) {
+    if (len != 1 && len != 2 && len != 4 && len != 8) {
+        throw std::invalid_argument{"Hardware breakpoint length must be 1, 2, 4 or 8"};
+    }
+    if (cond == dr_condition::execute && len != 1) {
+        throw std::invalid_argument{"Hardware execute breakpoint length must be 1"};
+    }
+    if (addr % len != 0) {
+        throw std::invalid_argument{"Hardware watchpoint address must be aligned to its length"};
+    }
+
+    for (int i = 0; i < n_debug_slots; i++) {
+        if (!m_slots[i].used) {
+            // 先写地址再启用，避免在旧地址上触发
+            for (auto tid : m_threads) set_debug_register(tid, i, addr);
+            m_slots[i] = slot{true, addr, cond, len};
+            try {
+                write_dr7();
+            } catch (std::runtime_error&) {
+                m_slots[i].used = false;
+                throw;
+            }
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+
+void debug_registers::clear(int slot) {
+    m_slots[slot].used = false;
+    write_dr7();
+}
+
+
+
+int debug_registers::find(std::uintptr_t addr, dr_condition cond) const {
+    for (int i = 0; i < n_debug_slots; i++) {
+        if (m_slots[i].used && m_slots[i].addr == addr && m_slots[i].cond == cond) return i;
+    }
+    return -1;
+}
+
+
+
+int debug_registers::free_slots() const {
+    int n = 0;
+    for (const auto& s : m_slots) {
+        if (!s.used) n++;
+    }
+    return n;
+}
+
+
+
+int debug_registers::get_triggered_slot(pid_t tid) {
+    auto dr6 = get_debug_register(tid, 6);
+    // DR6不会被CPU自动清零
+    set_debug_register(tid, 6, 0);
+
+    for (int i = 0; i < n_debug_slots; i++) {
+        if ((dr6 & (1 << i)) && m_slots[i].used) return i;
+    }
+    return -1;
+}
+
+
+bool debug_registers::has_data_hit(pid_t tid) const {
+    auto dr6 = get_debug_register(tid, 6);
+    for (int i = 0; i < n_debug_slots; i++) {
+        if ((dr6 & (1 << i)) && m_slots[i].used && m_slots[i].cond != dr_condition::execute) return true;
+    }
+    return false;
+}
+
+
+
+/**
+ * @brief: DR7的格式
+ *         bit 2*i:         L_i，启用slot i
+ *         bit 16+4*i:      RW_i，触发条件
+ *         bit 18+4*i:      LEN_i，长度(00: 1字节, 01: 2字节, 11: 4字节, 10: 8字节)
+ */
+uint64_t debug_registers::compute_dr7() const {
+    uint64_t dr7 = 0;
+    for (int i = 0; i < n_debug_slots; i++) {
+        if (!m_slots[i].used) continue;
+
+        uint64_t len_bits = 0;
+        switch (m_slots[i].len) {
+            case 1: len_bits = 0b00; break;
+            case 2: len_bits = 0b01; break;
+            case 4: len_bits = 0b11; break;
+            case 8: len_bits = 0b10; break;
+        }
+        dr7 |= uint64_t{1} << (2 * i);
+        dr7 |= uint64_t(m_slots[i].cond) << (16 + 4 * i);
+        dr7 |= len_bits << (18 + 4 * i);
+    }
+    return dr7;
+}
+
+
+
+void debug_registers::write_dr7() {
+    auto dr7 = compute_dr7();
+    for (auto tid : m_threads) set_debug_register(tid, 7, dr7);
+}
+
+
+#endif /* __x86_64__ */
@@ -0,0 +1,95 @@
+#ifndef _DEBUG_REGISTERS_H
+#define _DEBUG_REGISTERS_H
+
+
+#include <array>
+#include <cstdint>
+#include <set>
+#include <sys/types.h>
+
+
+#ifdef __x86_64__
+
+// 地址寄存器DR0-DR3的数量
+constexpr int n_debug_slots = 4;
+
+// DR7中RW字段的取值：触发条件
+enum class dr_condition : uint8_t {
+    execute = 0,        // 执行指令
+    write = 1,          // 写数据
+    read_write = 3,     // 读或写数据
+};
+
+// DR6的状态位
+constexpr uint64_t dr6_trap_bits = 0xf;      // B0-B3: 触发的slot
+constexpr uint64_t dr6_single_step = 1 << 14;   // BS: 单步
+
+
+// 读写进程[pid]的调试寄存器DR[index]
+uint64_t get_debug_register(pid_t pid, int index);
+void set_debug_register(pid_t pid, int index, uint64_t value);
+
+
+
+/**
+ * @brief: 管理x86的四个调试寄存器DR0-DR3与控制寄存器DR7
+ *         通过 PTRACE_POKEUSER 写入 offsetof(struct user, u_debugreg)
+ *         每个slot可以是指令断点(长度必须为1)或数据断点(长度为1/2/4/8，且地址按长度对齐)
+ *         调试寄存器是每个线程独立的，设置写入进程中所有被跟踪的线程
+ */
+class debug_registers {
+public:
+    explicit debug_registers(pid_t pid) : m_threads{pid}, m_slots{} {}
+
+    // 切换到新的进程（只有一个线程），并把当前的设置写入其调试寄存器
+    void set_pid(pid_t pid);
+    // 新线程：写入当前的设置（clone出的线程不继承ptrace设置的调试寄存器）
+    void add_thread(pid_t tid);
+    // 线程已退出
+    void remove_thread(pid_t tid) {m_threads.erase(tid);}
+    // 调试寄存器被其他组件改写后（伪共享采样），把当前的设置重新写入所有线程
+    void rewrite();
+
+    // 占用一个空闲的slot，返回其下标；没有空闲slot时返回-1
+    int set(std::uintptr_t addr, dr_condition cond, int len);
+    // 释放slot
+    void clear(int slot);
+    // 查找与[addr]和[cond]相同的slot，找不到时返回-1
+    int find(std::uintptr_t addr, dr_condition cond) const;
+    // 空闲slot的数量
+    int free_slots() const;
+
+    // 读取线程[tid]的DR6并清零，返回触发的slot，没有时返回-1
+    int get_triggered_slot(pid_t tid);
+    // 线程[tid]的DR6中是否有数据断点触发，不清零
+    bool has_data_hit(pid_t tid) const;
+
+    auto get_address(int slot) const -> std::uintptr_t {return m_slots[slot].addr;}
+    auto get_condition(int slot) const -> dr_condition {return m_slots[slot].cond;}
+    auto get_length(int slot) const -> int {return m_slots[slot].len;}
+    auto is_used(int slot) const -> bool {return m_slots[slot].used;}
+
+private:
+    struct slot {
+        bool used;
+        std::uintptr_t addr;
+        dr_condition cond;
+        int len;
+    };
+
+    // 根据[m_slots]计算DR7
+    uint64_t compute_dr7() const;
+    // 把所有slot与DR7写入线程[tid]
+    void write_thread(pid_t tid);
+    // 写入所有线程的DR7
+    void write_dr7();
+
+    std::set<pid_t> m_threads;
+    std::array<slot, n_debug_slots> m_slots;
+};
+
+
+#endif /* __x86_64__ */
+
+
+#endif /* _DEBUG_REGISTERS_H */
@@ -2,7 +2,11 @@
 #include "ptrace_expr_context.h"
 #include "register.h"
 #include <algorithm>
+#include <chrono>
 #include <bits/types/siginfo_t.h>
+#include <cctype>
+#include <climits>
+#include <csignal>
 #include <cstdint>
 #include <cstring>
 #include <fstream>
@@ -12,10 +16,15 @@
 #include <iterator>
 #include <libelfin/elf/data.hh>
 #include <ostream>
+#include <regex>
 #include <stdexcept>
 #include <stdio.h>
 #include <string>
+#include <set>
+#include <sys/mman.h>
 #include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 #include <vector>
 
@@ -53,6 +62,49 @@ bool is_suffix(const std::string& s, const std::string& of) {
 
 
 
+// 通配符 "*"/"?" 转为完整匹配的正则表达式
+static std::regex glob_to_regex(const std::string& pattern) {
+    std::string glob;
+    for (auto c : pattern) {
+        if (c == '*') glob += ".*";
+        else if (c == '?') glob += '.';
+        else if (std::strchr("\\^$.|+()[]{}", c)) glob += std::string{'\\', c};
+        else glob += c;
+    }
+    return std::regex{"^" + glob + "$", std::regex::optimize};
+}
+
+
+
+// 让被调试进程执行代码的命令：继续、单步、检查点与记录、注入系统调用、采样
+static bool is_execution_command(const std::string& line) {
+    static const std::set<std::string> commands {
+        "c", "continue", "s", "step", "n", "next", "stepi", "finish", "checkpoint", "restart",
+        "record", "reverse-stepi", "reverse-next", "reverse-continue", "bisect", "falseshare", "ftrace",
+    };
+    std::istringstream ss {line};
+    std::string command, arg;
+    ss >> command >> arg;
+    if (command == "btrace") return arg != "show" && arg != "clear";
+    return commands.count(command);
+}
+
+
+
+// 命令参数中的非负十进制整数。std::stoul接受"-1"（回绕）与"3x"（只解析"3"），这里都视为无效
+static bool parse_count(const std::string& s, std::size_t& value) {
+    if (s.empty() || !std::isdigit(static_cast<unsigned char>(s[0]))) return false;
+    try {
+        std::size_t pos;
+        value = std::stoul(s, &pos);
+        return pos == s.size();
+    } catch (std::exception&) {
+        return false;
+    }
+}
+
+
+
 std::string to_string(symbol_type st) {
     switch (st) {
         case symbol_type::notype:   return "notype";
@@ -79,8 +131,19 @@ symbol_type to_symbol_type(elf::stt sym) {
 
 
 
+/**
+ * @brief: 子进程停在SIGSTOP时被PTRACE_SEIZE附加，SIGCONT之后到exec之前的停止
+ *         （group-stop、SIGCONT的信号停止）都直接恢复，停在exec之后
+ */
 void debugger::run() {
-    wait_for_signal();
+    int status;
+    while (waitpid(m_pid, &status, __WALL) == m_pid && WIFSTOPPED(status)
+           && status >> 8 != (SIGTRAP | (PTRACE_EVENT_EXEC << 8))) {
+        ptrace(PTRACE_CONT, m_pid, nullptr, nullptr);
+    }
+    add_thread(m_pid, false);
+    m_reported_tid = m_pid;
+    m_last_stop = stop_event{stop_reason::signal, m_pid, get_pc(), 0, SIGTRAP, false};
     initialise_load_address();
     // std::cout << "loaded address 0x" << std::hex << m_load_address << std::endl;
     // auto func = get_function_from_pc(get_current_pc_offset_address());
@@ -96,6 +159,7 @@ void debugger::run() {
     // 在循环中处理用户的命令
     char* line = nullptr;
     while ((line = linenoise("minidbg> ")) != nullptr) {
+        poll_debug_info();          // 后台下载的调试信息是否已经就绪
         handle_command(line);       // 处理命令行
         linenoiseHistoryAdd(line);  // 添加到历史记录中
         linenoiseFree(line);        // 释放内存
@@ -110,7 +174,7 @@ void debugger::handle_command(const std::string& line) {
 
     if (is_prefix(command, "c") || is_prefix(command, "continue")) {
 
-        continue_execution();
+        report_stop(continue_execution());
 
     // 处理与断点有关的命令
     } else if (is_prefix(command, "b") || is_prefix(command, "break")) {
@@ -118,7 +182,48 @@ void debugger::handle_command(const std::string& line) {
         // input command: "b 0xADDRESS" or "break 0xADDRESS"
         // stol(addr, nullptr, 16) 即把16进制的地址转为10进制的long
 
-        if (args[1][0] == '0' && args[1][0] == 'x') {
+        auto if_pos = line.find(" if ");
+        auto thread_pos = line.find(" thread ");
+        // 条件表达式中的"thread"不算
+        if (if_pos != std::string::npos && thread_pos > if_pos) thread_pos = std::string::npos;
+        if (if_pos != std::string::npos || thread_pos != std::string::npos) {
+            // 0. 条件断点与线程断点: b <location> [thread <N>] [if <expr>]
+            std::string condition = if_pos != std::string::npos ? line.substr(if_pos + 4) : "";
+            int thread = 0;
+            if (thread_pos != std::string::npos) {
+                try {
+                    thread = std::stoi(line.substr(thread_pos + 8));
+                } catch (std::exception&) {
+                    std::cerr << "Invalid thread number: " << line.substr(thread_pos + 8) << std::endl;
+                    return;
+                }
+                if (!find_thread_by_number(thread)) {
+                    std::cerr << "Unknown thread " << thread << "." << std::endl;
+                    return;
+                }
+            }
+            for (auto addr : resolve_location(args[1])) {
+                // 只删除本命令新建的断点，已有的断点保持不变
+                bool created = !m_breakpoints.count(addr);
+                set_breakpoint_at_address(addr);
+                if (!m_breakpoints.count(addr)) continue;
+                if (!condition.empty()) {
+                    try {
+                        set_breakpoint_condition(addr, condition);
+                    } catch (std::exception& e) {
+                        if (created) remove_breakpoint_at_address(addr);
+                        std::cerr << "Invalid condition: " << e.what() << std::endl;
+                        return;
+                    }
+                }
+                m_breakpoints.at(addr).set_thread(thread);
+                std::cout << "set breakpoint at 0x" << std::hex << addr << std::dec;
+                if (thread) std::cout << " thread " << thread;
+                if (!condition.empty()) std::cout << " if " << condition;
+                std::cout << std::endl;
+            }
+
+        } else if (args[1][0] == '0' && args[1][1] == 'x') {
             // 1. 根据地址设置断点: b 0xADDRESS
             std::string addr{args[1], 2};
             set_breakpoint_at_address(std::stol(addr, nullptr, 16)); // x86系统地址长度为8字节
@@ -137,6 +242,87 @@ void debugger::handle_command(const std::string& line) {
         }
 
 
+    // 伪共享检测: "falseshare <var|0xADDRESS>... [for <ms>]"
+    } else if (is_prefix(command, "falseshare") && args.size() > 1) {
+        std::vector<std::string> targets;
+        std::chrono::milliseconds duration {1000};
+        for (size_t i = 1; i < args.size(); i++) {
+            if (args[i] == "for" && i + 1 < args.size()) {
+                std::size_t ms = 0;
+                if (!parse_count(args[++i], ms) || ms == 0) {
+                    std::cerr << "Invalid duration: " << args[i] << std::endl;
+                    return;
+                }
+                duration = std::chrono::milliseconds{ms};
+            } else if (!args[i].empty()) {
+                targets.push_back(args[i]);
+            }
+        }
+        detect_false_sharing(targets, duration);
+
+    // 正则表达式断点: "rbreak <regex>"
+    } else if (is_prefix(command, "rbreak") && args.size() > 1) {
+        set_regex_breakpoints(line.substr(line.find(args[1], command.size())));
+
+    // 硬件断点: "hbreak <location>", "hbreak auto <N>|off", "hbreak delete 0xADDRESS"
+    } else if (is_prefix(command, "hbreak") && args.size() > 1) {
+        if ((is_prefix(args[1], "auto") || is_prefix(args[1], "delete")) && args.size() < 3) {
+            std::cerr << "Usage: hbreak auto <N>|off, hbreak delete 0xADDRESS" << std::endl;
+        } else if (is_prefix(args[1], "auto")) {
+            try {
+                m_hw_promote_threshold = is_prefix(args[2], "off") ? 0 : std::stoul(args[2]);
+            } catch (std::exception&) {
+                std::cerr << "Invalid hit count: " << args[2] << std::endl;
+            }
+        } else if (is_prefix(args[1], "delete")) {
+            try {
+                remove_hw_breakpoint_at_address(std::stol(args[2], nullptr, 16));
+            } catch (std::exception&) {
+                std::cerr << "Invalid address: " << args[2] << std::endl;
+            }
+        } else {
+            for (auto addr : resolve_location(args[1])) {
+                if (set_hw_breakpoint_at_address(addr)) {
+                    std::cout << "Hardware breakpoint at 0x" << std::hex << addr << std::endl;
+                } else {
+                    std::cerr << "No free debug register for 0x" << std::hex << addr << std::endl;
+                }
+            }
+        }
+
+    // 数据断点: "watch <var|0xADDRESS> [len] [r|w|rw] [soft]", "watch delete <var|0xADDRESS>"
+    } else if (is_prefix(command, "watch")) {
+        if (args.size() < 2 || (is_prefix(args[1], "delete") && args.size() < 3)) {
+            std::cerr << "Usage: watch <var|0xADDRESS> [len] [r|w|rw] [soft], watch delete <var|0xADDRESS>" << std::endl;
+        } else if (is_prefix(args[1], "delete")) {
+            remove_watchpoint(args[2]);
+        } else {
+            int len = 0;
+            bool soft = false;
+            auto cond = dr_condition::write;
+            for (size_t i = 2; i < args.size(); i++) {
+                if (is_prefix(args[i], "soft")) {
+                    soft = true;
+                } else if (is_prefix(args[i], "w")) {
+                    cond = dr_condition::write;
+                } else if (is_prefix(args[i], "r") || is_prefix(args[i], "rw")) {
+                    // x86不支持只读断点，读断点也会在写入时触发
+                    cond = dr_condition::read_write;
+                } else {
+                    try {
+                        len = std::stoi(args[i]);
+                    } catch (std::exception&) {
+                        len = -1;
+                    }
+                    if (len <= 0) {
+                        std::cerr << "Invalid length: " << args[i] << std::endl;
+                        return;
+                    }
+                }
+            }
+            set_watchpoint(args[1], len, cond, soft);
+        }
+
     // 处理与寄存器有关的命令
     } else if (is_prefix(command, "reg") || is_prefix(command, "register")) {
         if (is_prefix(args[1], "dump")) {
@@ -146,12 +332,13 @@ void debugger::handle_command(const std::string& line) {
             // "register read rax" or "reg read rax" 
             std::cout << "0x"
                       << std::hex
-                      << get_register_value(m_pid, get_register_from_name(args[2])) << std::endl;
+                      << get_current_register(get_register_from_name(args[2])) << std::endl;
         
         } else if (is_prefix(args[1], "write")) {
             // "register write rax 0x22" or "reg write rax 0x22"
             std::string val {args[3], 2};
-            set_register_value(m_pid, get_register_from_name(args[2]), std::stol(val, 0, 16));
+            set_current_register(get_register_from_name(args[2]), std::stol(val, 0, 16));
+            invalidate_frames();
         }
 
     // 处理与内存有关的命令
@@ -168,23 +355,172 @@ void debugger::handle_command(const std::string& line) {
 
     // 指令级单步步进
     }  else if (is_prefix(command, "stepi")) {
-        single_step_instruction_with_breakpoint_check();
-        auto line_entry = get_line_entry_from_pc(get_pc());
-        print_source(line_entry->file->path, line_entry->line);
+        report_stop(single_step_instruction_with_breakpoint_check());
+
+    // 块单步: "blockstep [on|off]"
+    } else if (is_prefix(command, "blockstep")) {
+        if (args.size() > 1) m_block_step_enabled = is_prefix(args[1], "on");
+        static const char* support[] = {"not detected yet", "supported", "not supported, using single-step"};
+        std::cout << "Block stepping is " << (m_block_step_enabled ? "on" : "off") << " ("
+                  << support[static_cast<int>(m_block_step_support)] << ")" << std::endl;
+
+    // 分支记录: "btrace <n>" 块单步n次并记录分支, "btrace show [n]", "btrace clear"
+    } else if (is_prefix(command, "btrace") && args.size() > 1) {
+        std::size_t n = 20;
+        if (is_prefix(args[1], "show")) {
+            if (args.size() > 2 && !parse_count(args[2], n)) std::cerr << "Invalid count: " << args[2] << std::endl;
+            else print_branch_trace(n);
+        } else if (is_prefix(args[1], "clear")) {
+            m_branch_trace.clear();
+        } else if (!parse_count(args[1], n)) {
+            std::cerr << "Invalid count: " << args[1] << std::endl;
+        } else {
+            auto event = record_branches(n);
+            if (event.reason != stop_reason::single_step) report_stop(event);
+        }
+
+    // step跳过的代码: "skip", "skip file|function|library <pattern>", "skip delete [num]"
+    } else if (is_prefix(command, "skip")) {
+        if (args.size() < 2) {
+            print_skips();
+        } else if (is_prefix(args[1], "delete")) {
+            // 不带编号时删除全部；编号无效时不能退化为删除全部
+            std::size_t number = 0;
+            if (args.size() > 2 && (!parse_count(args[2], number) || number == 0 || number > INT_MAX)) {
+                std::cerr << "Invalid skip number: " << args[2] << std::endl;
+            } else {
+                remove_skip(static_cast<int>(number));
+            }
+        } else if (args.size() > 2 && is_prefix(args[1], "file")) {
+            add_skip(skip_kind::file, args[2]);
+        } else if (args.size() > 2 && is_prefix(args[1], "function")) {
+            add_skip(skip_kind::function, args[2]);
+        } else if (args.size() > 2 && is_prefix(args[1], "library")) {
+            add_skip(skip_kind::library, args[2]);
+        } else {
+            std::cerr << "Usage: skip [file|function|library <pattern>] [delete [num]]" << std::endl;
+        }
+
+    // 反汇编: "disas [func|0xADDR[,len]] [att|intel]"，语法选择会被记住
+    } else if (is_prefix(command, "disas") || is_prefix(command, "disassemble")) {
+        std::vector<std::string> rest(args.begin() + 1, args.end());
+        if (!rest.empty() && (rest.back() == "att" || rest.back() == "intel")) {
+            m_disas_syntax = rest.back() == "att" ? asm_syntax::att : asm_syntax::intel;
+            rest.pop_back();
+        }
+        try {
+            std::uintptr_t low, high;
+            parse_code_range(rest.empty() ? "" : rest[0], low, high);
+            disassemble(low, high);
+        } catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+        }
+
+    // 控制流图: "cfg [func|0xADDR]"
+    } else if (is_prefix(command, "cfg")) {
+        try {
+            std::uintptr_t low, high;
+            parse_code_range(args.size() > 1 ? args[1] : "", low, high);
+            print_cfg(low);
+        } catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+        }
+
+    // 线程: "info threads", "thread <N>"
+    } else if (is_prefix(command, "info") && args.size() > 1 && is_prefix(args[1], "threads")) {
+        print_threads();
+    } else if (is_prefix(command, "thread") && args.size() > 1) {
+        try {
+            select_thread(std::stoi(args[1]));
+        } catch (std::exception&) {
+            std::cerr << "Invalid thread number: " << args[1] << std::endl;
+        }
+
+    // 检查点: "checkpoint", "checkpoint delete <id>", "info checkpoints", "restart <id>"
+    } else if (is_prefix(command, "checkpoint")) {
+        if (args.size() > 2 && is_prefix(args[1], "delete")) {
+            try {
+                delete_checkpoint(std::stoi(args[2]));
+            } catch (std::exception&) {
+                std::cerr << "Invalid checkpoint number: " << args[2] << std::endl;
+            }
+        } else {
+            create_checkpoint();
+        }
+    } else if (is_prefix(command, "info") && args.size() > 1 && is_prefix(args[1], "checkpoints")) {
+        print_checkpoints();
+    } else if (is_prefix(command, "restart") && args.size() > 1) {
+        int id;
+        try {
+            id = std::stoi(args[1]);
+        } catch (std::exception&) {
+            std::cerr << "Invalid checkpoint number: " << args[1] << std::endl;
+            return;
+        }
+        restart_checkpoint(id);
+
+    // 反向执行: "record", "record stop", "record latency <ms>", "info record",
+    //           "reverse-stepi", "reverse-next", "reverse-continue"
+    } else if (is_prefix(command, "record")) {
+        if (args.size() > 2 && is_prefix(args[1], "latency")) {
+            unsigned long ms = 0;
+            try {
+                // stoul接受负数并回绕
+                if (args[2][0] != '-') ms = std::stoul(args[2]);
+            } catch (std::exception&) {}
+            if (ms == 0) {
+                std::cerr << "Invalid latency: " << args[2] << " (expected a positive number of milliseconds)" << std::endl;
+                return;
+            }
+            m_exec_log.set_latency_bound(std::chrono::milliseconds{ms});
+        } else if (args.size() > 1 && is_prefix(args[1], "stop")) {
+            stop_recording();
+        } else {
+            start_recording();
+        }
+    } else if (is_prefix(command, "info") && args.size() > 1 && is_prefix(args[1], "record")) {
+        print_record_status();
+    } else if (is_prefix(command, "reverse-stepi") || is_prefix(command, "reverse-next")
+               || is_prefix(command, "reverse-continue")) {
+        if (!m_recording) {
+            std::cerr << "Target is not being recorded; use \"record\" first." << std::endl;
+            return;
+        }
+        try {
+            if (is_prefix(command, "reverse-stepi")) report_stop(reverse_stepi());
+            else if (is_prefix(command, "reverse-next")) report_stop(reverse_next());
+            else report_stop(reverse_continue());
+        } catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+        }
+
+    // 时间旅行二分: "bisect [first] <expr>"
+    } else if (is_prefix(command, "bisect") && args.size() > 1) {
+        try {
+            bool first = args[1] == "first" && args.size() > 2;
+            auto& expr = args[first ? 2 : 1];
+            bisect(line.substr(line.find(expr, line.find(args[1]) + (first ? args[1].size() : 0))), first);
+        } catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+        }
 
     // 逐过程
     } else if (is_prefix(command, "next") || is_prefix(command, "n")) {
-        step_over();
+        report_stop(step_over());
 
 
     // 逐语句
     } else if (is_prefix(command, "step") || is_prefix(command, "s")) {
         // std::cout << "step in" << std::endl;
-        step_in();
+        report_stop(step_in());
 
     // 跳出
     } else if (is_prefix(command, "finish")) {
-        step_out();
+        try {
+            report_stop(step_out());
+        } catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+        }
 
     } else if (is_prefix(command, "symbol")) {
         auto syms = lookup_symbol(args[1]);
@@ -197,10 +533,114 @@ void debugger::handle_command(const std::string& line) {
 
     } else if (is_prefix(command, "backtrace")) {
         print_backtrace();
+
+    // 选择栈帧: "frame [N]", "up [N]", "down [N]"
+    } else if (is_prefix(command, "frame") || is_prefix(command, "up") || is_prefix(command, "down")) {
+        std::size_t n = is_prefix(command, "frame") ? m_selected_frame : 1;
+        if (args.size() > 1 && !parse_count(args[1], n)) {
+            std::cerr << "Invalid frame count: " << args[1] << std::endl;
+        } else if (is_prefix(command, "frame")) {
+            if (args.size() > 1) select_frame(n);
+            else print_frame(m_selected_frame);
+        } else if (is_prefix(command, "up")) {
+            // 超出最外层时由[select_frame]停在最外层
+            select_frame(n > SIZE_MAX - m_selected_frame ? SIZE_MAX : m_selected_frame + n);
+        } else if (n > m_selected_frame) {
+            std::cerr << "Bottom (innermost) frame selected; you cannot go down." << std::endl;
+        } else {
+            select_frame(m_selected_frame - n);
+        }
     
 
     } else if (is_prefix(command, "variables")) {
         read_variables();
+
+    } else if (is_prefix(command, "debuginfo")) {
+        print_debug_info_status();
+
+    // "info breakpoints"
+    } else if (is_prefix(command, "info") && args.size() > 1 && is_prefix(args[1], "breakpoints")) {
+        print_breakpoints();
+
+    // 快速tracepoint: "ftrace <location> [collect <var|$reg+off|0xADDRESS>[@len]]", "ftrace delete <num>"
+    } else if (is_prefix(command, "ftrace") && args.size() > 1) {
+        if (is_prefix(args[1], "delete") && args.size() > 2) {
+            try {
+                auto id = std::stoi(args[2]);
+                auto it = m_tracepoints.get_tracepoints().find(id);
+                if (it != m_tracepoints.get_tracepoints().end()) {
+                    invalidate_code(it->second.addr, it->second.saved.size());
+                }
+                m_tracepoints.remove(id);
+            } catch (std::exception& e) {
+                std::cerr << e.what() << std::endl;
+            }
+        } else {
+            std::string collect;
+            if (args.size() > 3 && is_prefix(args[2], "collect")) collect = args[3];
+            set_fast_tracepoint(args[1], collect);
+        }
+
+    // "tstatus": tracepoint的命中次数; "tdump [n]": 最近的n条记录
+    } else if (is_prefix(command, "tstatus")) {
+        print_trace_status();
+    } else if (is_prefix(command, "tdump")) {
+        std::size_t n = 10;
+        if (args.size() > 1 && !parse_count(args[1], n)) std::cerr << "Invalid count: " << args[1] << std::endl;
+        else print_trace_records(n);
+
+    // "ignore <num> <count>": 忽略断点接下来的count次命中
+    } else if (is_prefix(command, "ignore") && args.size() > 2) {
+        breakpoint* bp = nullptr;
+        uint64_t count = 0;
+        try {
+            bp = find_breakpoint_by_number(std::stoi(args[1]));
+        } catch (std::exception&) {
+            std::cerr << "Invalid breakpoint number: " << args[1] << std::endl;
+            return;
+        }
+        try {
+            // stoull接受负数并回绕
+            if (args[2][0] == '-') throw std::invalid_argument{args[2]};
+            count = std::stoull(args[2]);
+        } catch (std::exception&) {
+            std::cerr << "Invalid ignore count: " << args[2] << std::endl;
+            return;
+        }
+        if (!bp) {
+            std::cerr << "No breakpoint number " << args[1] << std::endl;
+        } else {
+            bp->set_ignore_count(count);
+            std::cout << "Will ignore next " << count << " crossings of breakpoint " << args[1] << std::endl;
+        }
+
+    // "commands <num>": 读取命中后执行的命令，直到"end"
+    } else if (is_prefix(command, "commands") && args.size() > 1) {
+        int number;
+        try {
+            number = std::stoi(args[1]);
+        } catch (std::exception&) {
+            std::cerr << "Invalid breakpoint number: " << args[1] << std::endl;
+            return;
+        }
+        read_breakpoint_commands(number);
+
+    // dprintf <location> "format", args...
+    } else if (is_prefix(command, "dprintf") && args.size() > 2) {
+        auto format_pos = line.find(args[1], command.size()) + args[1].size();
+        try {
+            set_dprintf(args[1], line.substr(format_pos));
+        } catch (std::exception& e) {
+            std::cerr << "Invalid dprintf: " << e.what() << std::endl;
+        }
+
+    // print <expr>
+    } else if ((is_prefix(command, "print") || is_prefix(command, "p")) && args.size() > 1) {
+        try {
+            print_expression(line.substr(line.find(args[1], command.size())));
+        } catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+        }
     }
 
 
@@ -212,19 +652,44 @@ void debugger::handle_command(const std::string& line) {
 
 
 
-void debugger::continue_execution() {
-    step_over_breakpoint();
-    ptrace(PTRACE_CONT, m_pid, nullptr, nullptr);
-    wait_for_signal();
+/**
+ * @brief: all-stop：当前线程先单独越过断点，再恢复所有已停止的线程。与用户无关的停止只恢复停下的线程，
+ *         其他线程仍在运行，越过断点依靠位移单步使int3留在原处（不能位移执行时先停下其他线程）；
+ *         需要报告的停止会停下其他所有线程，当前线程切换为停下的线程。
+ */
+stop_event debugger::continue_execution() {
+    if (m_recording) return recorded_continue();
+    // 与用户无关的停止（例如页保护断点范围外的写入）不返回调用者
+    while (true) {
+        // 当前线程退出后切换到的线程可能仍在运行
+        if (current_thread().stopped && step_over_breakpoint()) {
+            // 越过断点的单步本身也可能停下（数据断点、信号、退出）
+            if (m_last_stop.reason != stop_reason::single_step && !m_last_stop.resume) {
+                if (m_last_stop.reason != stop_reason::exited) stop_all_threads();
+                return m_last_stop;
+            }
+        }
+        // 有挂起的停止时直接报告，不恢复其他线程
+        if (!find_pending_stop()) resume_all_threads();
+        auto event = wait_for_any_thread();
+        if (!event.resume) {
+            if (event.reason != stop_reason::exited) stop_all_threads();
+            return event;
+        }
+    }
 }
 
 
 
 void debugger::set_breakpoint_at_address(std::intptr_t addr) {
     // std::cout << "Set breakpoint at address 0x" << std::hex << addr << std::endl;
-    breakpoint bp (m_pid, addr);
-    bp.bp_enable();
-    m_breakpoints.insert(std::make_pair(addr, bp));
+    if (m_tracepoints.overlaps(addr, 1)) {
+        std::cerr << "Can't set a breakpoint inside the jump of a fast tracepoint" << std::endl;
+        return;
+    }
+    auto& bp = m_breakpoints.add(addr);
+    if (bp.get_number() == 0) bp.set_number(m_next_breakpoint_number++);
+    m_breakpoints.flush();
 };
 
 
@@ -233,6 +698,106 @@ void debugger::set_breakpoint_at_address(std::intptr_t addr) {
  *         设置断点
  */
 void debugger::set_breakpoint_at_function(const std::string& name) {
+    for (auto addr : get_function_addresses(name)) {
+        set_breakpoint_at_address(addr);
+    }
+}
+
+/*
+ * @brief: 根据[.debug_line]中的信息，在对应的地址出打上断点。
+ */
+void debugger::set_breakpoint_at_source_line(const std::string& file, uint64_t line) {
+    for (auto addr : get_source_line_addresses(file, line)) {
+        set_breakpoint_at_address(addr);
+    }
+}
+
+
+
+/**
+ * @brief: rbreak，分三步并分别计时：
+ *         1. 解析：在函数名索引上并行匹配[pattern]（索引只在第一次使用时构建）
+ *         2. 通过行号表跳过序言得到断点地址
+ *         3. 插入：所有断点先放入[m_breakpoints]的队列，最后一次[flush]按页批量写入
+ *         [pattern]不是合法的正则表达式时按通配符处理，例如 "*_kernel"
+ */
+void debugger::set_regex_breakpoints(const std::string& pattern) {
+    using clock = std::chrono::steady_clock;
+    auto ms = [](clock::duration d) {return std::chrono::duration<double, std::milli>(d).count();};
+
+    std::regex re;
+    try {
+        re = std::regex{pattern, std::regex::optimize};
+    } catch (std::regex_error&) {
+        re = glob_to_regex(pattern);
+    }
+
+    auto t0 = clock::now();
+    bool cached = m_function_names.is_built();
+    if (!cached) {
+        if (!m_symbol_index.is_built()) m_symbol_index.build(m_elf);
+        m_function_names.build(m_dwarf, m_symbol_index);
+    }
+    auto t1 = clock::now();
+    auto matches = m_function_names.match(re);
+    auto t2 = clock::now();
+
+    // 按地址排序，插入时同一页的断点相邻
+    std::vector<std::pair<std::intptr_t, const function_name*>> targets;
+    const auto* units = m_dwarf.valid() ? &m_dwarf.compilation_units() : nullptr;
+    for (auto func : matches) {
+        std::intptr_t addr = func->low_pc + m_load_address;
+        if (func->cu >= 0 && units != nullptr) {
+            const auto& table = (*units)[func->cu].get_line_table();
+            auto entry = table.find_address(func->low_pc);
+            if (entry != table.end() && ++entry != table.end()) {
+                addr = offset_dwarf_address(entry->address);
+            }
+        }
+        targets.emplace_back(addr, func);
+    }
+    std::sort(targets.begin(), targets.end());
+    auto t3 = clock::now();
+
+    std::size_t inserted = 0, existing = 0, skipped = 0;
+    std::unordered_set<std::intptr_t> pages;
+    for (const auto& [addr, func] : targets) {
+        if (m_breakpoints.count(addr)) {
+            existing++;
+            continue;
+        }
+        if (m_tracepoints.overlaps(addr, 1)) {
+            skipped++;
+            continue;
+        }
+        auto& bp = m_breakpoints.add(addr);
+        bp.set_number(m_next_breakpoint_number++);
+        pages.insert(addr & ~static_cast<std::intptr_t>(0xfff));
+        inserted++;
+        if (targets.size() <= 50) {
+            std::cout << "Breakpoint " << bp.get_number() << " at 0x" << std::hex << addr
+                      << std::dec << ": " << func->name << std::endl;
+        }
+    }
+    m_breakpoints.flush();
+    auto t4 = clock::now();
+
+    std::cout << matches.size() << " of " << m_function_names.size() << " functions matched, "
+              << inserted << " breakpoints set";
+    if (existing) std::cout << ", " << existing << " already set";
+    if (skipped) std::cout << ", " << skipped << " inside fast tracepoints";
+    std::cout << std::endl << std::fixed << std::setprecision(3)
+              << "  index:   " << ms(t1 - t0) << " ms" << (cached ? " (cached)" : "") << std::endl
+              << "  resolve: " << ms(t2 - t1) + ms(t3 - t2) << " ms (match " << ms(t2 - t1) << " ms)" << std::endl
+              << "  insert:  " << ms(t4 - t3) << " ms (" << pages.size() << " pages)" << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+}
+
+
+
+std::vector<std::intptr_t> debugger::get_function_addresses(const std::string& name) {
+    std::vector<std::intptr_t> addrs;
+    if (!m_dwarf.valid()) return addrs;
     for (const auto& cu : m_dwarf.compilation_units()) {
         for (const auto& die : cu.root()) {
             if (die.has(dwarf::DW_AT::name) && dwarf::at_name(die) == name) {
@@ -240,17 +805,19 @@ void debugger::set_breakpoint_at_function(const std::string& name) {
                 auto low_pc = dwarf::at_low_pc(die);
                 auto entry = get_line_entry_from_pc(low_pc);
                 entry ++; // skpi prologue
-                set_breakpoint_at_address(offset_dwarf_address(entry->address));
+                addrs.push_back(offset_dwarf_address(entry->address));
             }
         }
 
     }
+    return addrs;
 }
 
-/*
- * @brief: 根据[.debug_line]中的信息，在对应的地址出打上断点。
- */
-void debugger::set_breakpoint_at_source_line(const std::string& file, uint64_t line) {
+
+
+std::vector<std::intptr_t> debugger::get_source_line_addresses(const std::string& file, uint64_t line) {
+    std::vector<std::intptr_t> addrs;
+    if (!m_dwarf.valid()) return addrs;
     // 遍历[DWARF]中的编译单元
     for (const auto& cu : m_dwarf.compilation_units()) {
         // 编译单元含中有名字信息，调用[is_suffix]函数，比较CU中的文件名与[file]
@@ -259,110 +826,1692 @@ void debugger::set_breakpoint_at_source_line(const std::string& file, uint64_t l
             const auto& it = cu.get_line_table();
             for (const auto& entry : it) {
                 if (entry.is_stmt && entry.line == line) {
-                    // 若行数与[line]相匹配，则在对应地址设置断点
-                    set_breakpoint_at_address(offset_dwarf_address(entry.address));
-                    return;
+                    // 若行数与[line]相匹配，则返回对应地址
+                    addrs.push_back(offset_dwarf_address(entry.address));
+                    return addrs;
                 }
             }
         }
         
     }
+    return addrs;
+}
+
 
+
+std::vector<std::intptr_t> debugger::resolve_location(const std::string& location) {
+    if (location.size() > 2 && location[0] == '0' && location[1] == 'x') {
+        return {std::stol(location, nullptr, 16)};
+    } else if (location.find(':') != std::string::npos) {
+        auto file_and_line = split(location, ':');
+        return get_source_line_addresses(file_and_line[0], std::stol(file_and_line[1]));
+    }
+    return get_function_addresses(location);
 }
 
 
 
+/**
+ * @brief: 数据断点使用DR0-DR3，长度只能为1/2/4/8字节且地址按长度对齐。
+ *         变量的地址通过DWARF的location表达式求值得到。
+ *         没有空闲slot时，先释放自动转换的硬件断点。
+ */
+void debugger::set_watchpoint(const std::string& expr, int len, dr_condition cond, bool soft) {
+    std::uintptr_t addr;
+    if (expr.size() > 2 && expr[0] == '0' && expr[1] == 'x') {
+        try {
+            addr = std::stoul(expr, nullptr, 16);
+        } catch (std::exception&) {
+            std::cerr << "Invalid address: " << expr << std::endl;
+            return;
+        }
+        if (len == 0) len = 8;
+    } else {
+        std::size_t size = 0;
+        if (!find_variable(expr, addr, size)) {
+            std::cerr << "No variable named " << expr << std::endl;
+            return;
+        }
+        if (len == 0) len = size;
+    }
+
+    // 调试寄存器最多只能监视8字节
+    if (soft || len > 8) {
+        set_page_watchpoint(expr, addr, len);
+        return;
+    }
+    if (len == 3) len = 4;
+    if (len > 4 && len < 8) len = 8;
 
+    if (m_debug_registers.free_slots() == 0 && !m_auto_hw_breakpoints.empty()) {
+        remove_hw_breakpoint_at_address(*m_auto_hw_breakpoints.begin());
+    }
 
-void debugger::remove_breakpoint_at_address(std::intptr_t addr) {
-    if (m_breakpoints.at(addr).is_enabled()) {
-        m_breakpoints.at(addr).bp_disable();
+    int slot;
+    try {
+        slot = m_debug_registers.set(addr, cond, len);
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return;
     }
-    // 删除断点后，擦出数据中的数据
-    m_breakpoints.erase(addr);
+    if (slot < 0) {
+        std::cerr << "No free debug register for watchpoint" << std::endl;
+        return;
+    }
+
+    uint64_t mask = len == 8 ? ~uint64_t{0} : (uint64_t{1} << (len * 8)) - 1;
+    m_watchpoints.push_back(watchpoint{expr, addr, len, cond, slot, read_memory(addr) & mask});
+    std::cout << (cond == dr_condition::write ? "Hardware watchpoint " : "Hardware access watchpoint ")
+              << std::dec << slot << ": " << expr << " (0x" << std::hex << addr << ", "
+              << std::dec << len << " bytes)" << std::endl;
 }
 
 
 
-void debugger::dump_register() {
-    for (const auto& rd : g_register_descriptors) {
-        std::cout << std::setw(10) << std::setfill(' ')
-                  << rd.reg_name 
-                  << " 0x"
-                  << std::setfill('0') << std::setw(16) << std::hex
-                  << get_register_value(m_pid, rd.reg_index) << std::endl; 
+/**
+ * @brief: 变量跨越多个cache line时（例如按线程划分的计数器数组）采样其所有行，最多16行，
+ *         每10ms轮换一次调试寄存器监视的半行。
+ *         采样期间程序全速运行，软件断点暂时禁用，调试寄存器被占用，结束后恢复。
+ */
+void debugger::detect_false_sharing(const std::vector<std::string>& targets, std::chrono::milliseconds duration) {
+    constexpr std::size_t max_lines = 16;
+    constexpr std::chrono::milliseconds slice {10};
+
+    if (!m_page_watchpoints.empty()) {
+        std::cerr << "Remove page watchpoints before sampling false sharing" << std::endl;
+        return;
+    }
+    if (m_recording) {
+        std::cerr << "Stop recording before sampling false sharing" << std::endl;
+        return;
+    }
+
+    std::vector<std::tuple<std::string, std::uintptr_t, std::size_t>> resolved;
+    std::vector<std::uintptr_t> lines;
+    for (const auto& expr : targets) {
+        std::uintptr_t addr;
+        std::size_t size = 1;
+        if (expr.size() > 2 && expr[0] == '0' && expr[1] == 'x') {
+            try {
+                addr = std::stoul(expr, nullptr, 16);
+            } catch (std::exception&) {
+                std::cerr << "Invalid address: " << expr << std::endl;
+                return;
+            }
+        } else if (!find_variable(expr, addr, size)) {
+            std::cerr << "No variable named " << expr << std::endl;
+            return;
+        }
+        resolved.emplace_back(expr, addr, size);
+        auto last = (addr + std::max<std::size_t>(size, 1) - 1) & ~(cache_line_size - 1);
+        for (auto line = addr & ~(cache_line_size - 1); line <= last && lines.size() < max_lines; line += cache_line_size) {
+            if (std::find(lines.begin(), lines.end(), line) == lines.end()) lines.push_back(line);
+        }
+    }
+    if (lines.empty()) return;
+
+    auto enabled = m_breakpoints.disable_all();
+
+    std::cout << "Sampling " << lines.size() << " cache line(s) for " << duration.count() << " ms..." << std::endl;
+    false_sharing_sampler sampler {m_pid};
+    std::map<pid_t, int> threads;
+    for (const auto& [tid, thread] : m_threads) threads[tid] = thread.pending_signal;
+    bool alive;
+    try {
+        alive = sampler.run(lines, duration, slice, threads);
+    } catch (std::exception& e) {
+        std::cerr << "False sharing sampling failed: " << e.what() << std::endl;
+        alive = true;
+    }
+
+    if (alive) {
+        // 采样期间退出与新建的线程
+        std::vector<pid_t> exited;
+        for (const auto& [tid, thread] : m_threads) {
+            if (!threads.count(tid)) exited.push_back(tid);
+        }
+        for (auto tid : exited) remove_thread(tid);
+        for (const auto& [tid, signal] : threads) {
+            auto it = m_threads.find(tid);
+            auto& thread = it != m_threads.end() ? it->second : add_thread(tid, true);
+            thread.pending_signal = signal;
+            thread.regs_valid = false;
+        }
+        if (!m_threads.count(m_tid)) m_tid = m_threads.begin()->first;
+        m_breakpoints.enable_all(enabled);
+        m_debug_registers.rewrite();
+        invalidate_frames();
+    }
+    print_false_sharing(sampler, resolved);
+    if (!alive) {
+        // 与[handle_wait_status]相同：线程组长最后退出，线程表中只留下它
+        std::vector<pid_t> exited;
+        for (const auto& [tid, thread] : m_threads) {
+            if (tid != m_pid) exited.push_back(tid);
+        }
+        for (auto tid : exited) remove_thread(tid);
+        m_tid = m_pid;
+        auto status = sampler.get_exit_status();
+        int code = WIFSIGNALED(status) ? -WTERMSIG(status) : WEXITSTATUS(status);
+        m_last_stop = stop_event{stop_reason::exited, m_pid, 0, 0, code, false};
+        invalidate_frames();
+        report_stop(m_last_stop);
     }
 }
 
 
 
-uint64_t debugger::read_memory(std::intptr_t addr) {
-   return ptrace(PTRACE_PEEKDATA, m_pid, addr, nullptr);
-}
+/**
+ * @brief: 每个cache line打印一个矩阵：行为8字节的字段，列为线程，值为采样到的写入次数；
+ *         随后列出每个(线程, 字段, 源代码行)的写入次数。
+ *         多个线程写入同一行的不同字段即为伪共享，写入同一字段为真共享。
+ */
+void debugger::print_false_sharing(const false_sharing_sampler& sampler,
+                                   const std::vector<std::tuple<std::string, std::uintptr_t, std::size_t>>& targets) {
+    auto field_name = [&targets](std::uintptr_t addr) -> std::string {
+        for (const auto& [name, base, size] : targets) {
+            if (addr < base || addr >= base + std::max<std::size_t>(size, 1)) continue;
+            if (addr == base) return name;
+            std::ostringstream out;
+            out << name << "+" << (addr - base);
+            return out.str();
+        }
+        return "";
+    };
+    auto source_line = [this](std::uintptr_t pc) -> std::string {
+        std::ostringstream out;
+        try {
+            // 数据断点在写入指令之后触发，pc - 1 仍在写入指令中
+            auto entry = get_line_entry_from_pc(offset_load_address(pc - 1));
+            auto path = entry->file->path;
+            out << path.substr(path.find_last_of('/') + 1) << ":" << entry->line;
+        } catch (std::out_of_range&) {
+            function_symbol func;
+            if (symbolize_pc(pc - 1, func)) out << func.name << "+" << (pc - func.low_pc);
+            else out << "0x" << std::hex << pc;
+        }
+        return out.str();
+    };
+
+    std::cout << sampler.get_hit_count() << " writes sampled" << std::endl;
+    for (const auto& sample : sampler.get_samples()) {
+        std::cout << std::endl << "Cache line 0x" << std::hex << sample.addr << std::dec
+                  << " (watched " << sample.watched[0].count() / 1000000 << " ms + "
+                  << sample.watched[1].count() / 1000000 << " ms)" << std::endl;
+        if (sample.writes.empty()) {
+            std::cout << "  no writes" << std::endl;
+            continue;
+        }
 
+        std::cout << "  " << std::left << std::setw(8) << "offset" << std::setw(20) << "field";
+        for (const auto& [tid, counts] : sample.writes) {
+            auto& name = sampler.get_thread_names().at(tid);
+            std::cout << std::right << std::setw(16) << (std::to_string(tid) + " " + name.substr(0, 8));
+        }
+        std::cout << std::endl;
+
+        std::size_t writers_per_field[false_share_fields] = {};
+        for (std::size_t f = 0; f < false_share_fields; f++) {
+            bool any = false;
+            for (const auto& [tid, counts] : sample.writes) {
+                if (counts[f]) {
+                    any = true;
+                    writers_per_field[f]++;
+                }
+            }
+            if (!any) continue;
+            std::cout << "  +0x" << std::left << std::setw(5) << std::hex << f * false_share_field_size << std::dec
+                      << std::setw(20) << field_name(sample.addr + f * false_share_field_size);
+            for (const auto& [tid, counts] : sample.writes) {
+                std::cout << std::right << std::setw(16) << counts[f];
+            }
+            std::cout << std::endl;
+        }
 
-void debugger::write_memory(std::intptr_t addr, uint64_t value) {
-    ptrace(PTRACE_POKEDATA, m_pid, addr, value);
+        bool true_sharing = std::any_of(std::begin(writers_per_field), std::end(writers_per_field),
+                                        [](std::size_t n) { return n > 1; });
+        if (sample.writes.size() > 1) {
+            std::cout << "  => " << sample.writes.size() << " threads write this line: "
+                      << (true_sharing ? "true sharing on some fields" : "false sharing (disjoint fields)")
+                      << std::endl;
+        }
+
+        std::vector<std::pair<uint64_t, std::tuple<pid_t, int, std::uintptr_t>>> writers;
+        for (const auto& [key, count] : sample.writers) writers.emplace_back(count, key);
+        std::sort(writers.rbegin(), writers.rend());
+        for (std::size_t i = 0; i < writers.size() && i < 10; i++) {
+            const auto& [tid, field, pc] = writers[i].second;
+            std::cout << "    " << std::left << std::setw(8) << tid << "+0x" << std::setw(4) << std::hex
+                      << field * false_share_field_size << std::dec << std::setw(28) << source_line(pc)
+                      << std::right << writers[i].first << std::endl;
+        }
+    }
 }
 
 
 
+void debugger::remove_watchpoint(const std::string& expr) {
+    auto page_it = std::find_if(m_page_watchpoints.begin(), m_page_watchpoints.end(),
+                                [&expr](const page_watchpoint& wp) { return wp.expr == expr; });
+    if (page_it != m_page_watchpoints.end()) {
+        m_page_watchpoints.erase(page_it);
+        update_page_protection();
+        return;
+    }
 
-uint64_t debugger::get_pc() {
-    return get_register_value(m_pid, reg_x86_64::rip);
+    auto it = std::find_if(m_watchpoints.begin(), m_watchpoints.end(),
+                           [&expr](const watchpoint& wp) { return wp.expr == expr; });
+    if (it == m_watchpoints.end()) {
+        std::cerr << "No watchpoint on " << expr << std::endl;
+        return;
+    }
+    m_debug_registers.clear(it->slot);
+    m_watchpoints.erase(it);
 }
 
-void debugger::set_pc(std::intptr_t pc) {
-    set_register_value(m_pid, reg_x86_64::rip, pc);
+
+
+/**
+ * @brief: 调试寄存器只能覆盖4x8字节，大块内存（例如环形缓冲区）使用页保护：
+ *         在程序中注入mprotect，把相关的页设置为只读，写入时会产生SIGSEGV，
+ *         在[handle_page_fault]中判断写入是否位于被监视的范围内。
+ *         两次命中之间程序全速运行。
+ * @note:  内核代替程序写入只读页（例如read系统调用）时返回EFAULT而不是SIGSEGV，
+ *         这类写入无法被监视。
+ */
+void debugger::set_page_watchpoint(const std::string& expr, std::uintptr_t addr, std::size_t len) {
+    if (m_recording) {
+        std::cerr << "Page watchpoints are not supported while recording." << std::endl;
+        return;
+    }
+    m_page_watchpoints.push_back(page_watchpoint{expr, addr, len, read_memory_block(addr, len)});
+    update_page_protection();
+    std::cout << "Software watchpoint on " << expr << " (0x" << std::hex << addr << ", "
+              << std::dec << len << " bytes, " << m_protected_pages.size() << " pages protected)" << std::endl;
 }
 
 
 
-void debugger::step_over_breakpoint() {
-    uint64_t possiable_breakpoint_location = get_pc();
-    // std::cout << "possiable_breakpoint_location - 0x" 
-    //           << std::hex << possiable_breakpoint_location << std::endl;
-    if (m_breakpoints.count(possiable_breakpoint_location)) {
-        auto& bp = m_breakpoints.at(possiable_breakpoint_location);
-        // std::cout << "Step over breakpoint at 0x" << std::hex << bp.get_address() << std::endl;
+void debugger::update_page_protection() {
+    std::set<std::uintptr_t> pages;
+    for (const auto& wp : m_page_watchpoints) {
+        auto first = wp.addr & ~(g_page_size - 1);
+        for (auto page = first; page < wp.addr + wp.len; page += g_page_size) {
+            pages.insert(page);
+        }
+    }
 
-        if (bp.is_enabled()) {
-            bp.bp_disable();
-            ptrace(PTRACE_SINGLESTEP, m_pid, nullptr, nullptr);
-            wait_for_signal();
-            // std::cout << "Parent process recieve the signal." << std::endl;
-            bp.bp_enable();
+    // 恢复不再需要监视的页
+    for (auto it = m_protected_pages.begin(); it != m_protected_pages.end(); ) {
+        if (!pages.count(it->first)) {
+            inject_syscall(m_tid, SYS_mprotect, {it->first, g_page_size, (uint64_t)it->second});
+            it = m_protected_pages.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (auto page : pages) {
+        if (m_protected_pages.count(page)) continue;
+        int prot = get_page_protection(page);
+        auto ret = inject_syscall(m_tid, SYS_mprotect, {page, g_page_size, (uint64_t)(prot & ~PROT_WRITE)});
+        if (ret < 0) {
+            std::cerr << "mprotect failed on page 0x" << std::hex << page << ": " << strerror(-ret) << std::endl;
+            continue;
         }
+        m_protected_pages[page] = prot;
     }
 }
 
-void debugger::wait_for_signal() {
-    int wait_status;
-    int options = 0;
-    waitpid(m_pid, &wait_status, options);
 
-    auto siginfo = get_signal_info();
 
-    switch (siginfo.si_signo) {
-        case SIGTRAP:
-            handle_sigtrap(siginfo);
-            break;
+int debugger::get_page_protection(std::uintptr_t page) {
+    std::ifstream maps("/proc/" + std::to_string(m_pid) + "/maps");
+    std::string line;
+    while (std::getline(maps, line)) {
+        std::istringstream ss {line};
+        std::string range, perms;
+        ss >> range >> perms;
+        auto addrs = split(range, '-');
+        if (page >= std::stoul(addrs[0], nullptr, 16) && page < std::stoul(addrs[1], nullptr, 16)) {
+            int prot = PROT_NONE;
+            if (perms[0] == 'r') prot |= PROT_READ;
+            if (perms[1] == 'w') prot |= PROT_WRITE;
+            if (perms[2] == 'x') prot |= PROT_EXEC;
+            return prot;
+        }
+    }
+    return PROT_READ | PROT_WRITE;
+}
 
-        case SIGSEGV:
-            std::cout << "Yay, segfalut. Reason: " << siginfo.si_code << std::endl;
-            break;
 
-        default:
-            std::cout << "Got Signal" << strsignal(siginfo.si_signo) << std::endl;
+
+/**
+ * @brief: 1. 出错地址不在被保护的页中：与断点无关，交给程序处理
+ *         2. 临时恢复这次访问可能涉及的所有被保护的页的权限，单步执行出错的指令，再重新保护。
+ *            si_addr是第一个出错的字节，跨页的写入只会继续涉及之后的页
+ *         3. 单步没有正常完成（又收到其他信号或线程退出）时，按该状态处理
+ *         4. 写入位于被监视的范围内且内容发生变化时，报告新旧值并停止；
+ *            否则继续执行
+ */
+bool debugger::handle_page_fault(const siginfo_t& info, stop_event& event) {
+    // 一条指令最多写入的字节数（AVX-512的64字节存储）
+    constexpr std::uintptr_t max_access = 64;
+
+    auto fault_addr = reinterpret_cast<std::uintptr_t>(info.si_addr);
+    auto page = fault_addr & ~(g_page_size - 1);
+    if (!m_protected_pages.count(page)) return false;
+
+    std::vector<std::pair<std::uintptr_t, int>> pages;
+    for (auto p = page; p < fault_addr + max_access; p += g_page_size) {
+        auto it = m_protected_pages.find(p);
+        if (it != m_protected_pages.end()) pages.emplace_back(it->first, it->second);
+    }
+
+    // 其他线程可能仍在运行，页恢复权限期间它们的写入不会被发现
+    for (const auto& [p, prot] : pages) {
+        inject_syscall(m_tid, SYS_mprotect, {p, g_page_size, (uint64_t)prot});
+    }
+    ptrace(PTRACE_SINGLESTEP, m_tid, nullptr, nullptr);
+    invalidate_current_regs();
+    int wait_status;
+    waitpid(m_tid, &wait_status, __WALL);
+    if (!WIFSTOPPED(wait_status)) {
+        event = handle_wait_status(m_tid, wait_status, false);
+        return true;
+    }
+    for (const auto& [p, prot] : pages) {
+        inject_syscall(m_tid, SYS_mprotect, {p, g_page_size, (uint64_t)(prot & ~PROT_WRITE)});
     }
 
+    auto sig = WSTOPSIG(wait_status);
+    if (sig != SIGTRAP) {
+        // 指令没有执行完：与页保护断点无关的SIGSEGV报告给用户，其他信号在继续执行时交给程序，
+        // 之后重新执行该指令时会再次进入这里
+        current_thread().pending_signal = sig;
+        event.reason = stop_reason::signal;
+        event.signal = sig;
+        event.resume = sig != SIGSEGV;
+        return true;
+    }
+
+    bool stopped = false;
+    for (auto& wp : m_page_watchpoints) {
+        if (fault_addr + 8 <= wp.addr || fault_addr >= wp.addr + wp.len) continue;
+
+        auto new_data = read_memory_block(wp.addr, wp.len);
+        auto diff = std::mismatch(wp.old_data.begin(), wp.old_data.end(), new_data.begin());
+        if (diff.first == wp.old_data.end()) continue;
+
+        // 打印第一处变化开始的最多8个字节
+        auto offset = diff.first - wp.old_data.begin();
+        auto n = std::min<std::size_t>(8, wp.len - offset);
+        std::cout << "\nSoftware watchpoint: " << wp.expr << " +" << std::dec << offset << std::endl;
+        std::cout << "Old value =" << std::hex;
+        for (std::size_t i = 0; i < n; i++) std::cout << " " << std::setw(2) << std::setfill('0') << (int)wp.old_data[offset + i];
+        std::cout << std::endl << "New value =";
+        for (std::size_t i = 0; i < n; i++) std::cout << " " << std::setw(2) << std::setfill('0') << (int)new_data[offset + i];
+        std::cout << std::endl;
+
+        wp.old_data = std::move(new_data);
+        stopped = true;
+    }
+
+    event.reason = stop_reason::watchpoint;
+    event.resume = !stopped;
+    return true;
 }
 
 
 
-/**
- * 1. 首先，通过对 m_dwarf 的迭代器访问 compilation_units，遍历所有的编译单元（Compilation Units）。
- * 2. 对于每个编译单元 cu，检查它的根 DIE（Debugging Information Entry）的地址范围是否包含给定的指令地址 pc。
+std::vector<uint8_t> debugger::read_memory_block(std::uintptr_t addr, std::size_t len) {
+    std::vector<uint8_t> data(len);
+    iovec local {data.data(), len};
+    iovec remote {reinterpret_cast<void*>(addr), len};
+    if (process_vm_readv(m_pid, &local, 1, &remote, 1, 0) != (ssize_t)len) {
+        // 退化为逐字读取
+        for (std::size_t i = 0; i < len; i += 8) {
+            auto word = read_memory(addr + i);
+            memcpy(data.data() + i, &word, std::min<std::size_t>(8, len - i));
+        }
+    }
+    return data;
+}
+
+
+
+void debugger::report_watchpoint_hit(int slot) {
+    auto it = std::find_if(m_watchpoints.begin(), m_watchpoints.end(),
+                           [slot](const watchpoint& wp) { return wp.slot == slot; });
+    if (it == m_watchpoints.end()) return;
+
+    uint64_t mask = it->len == 8 ? ~uint64_t{0} : (uint64_t{1} << (it->len * 8)) - 1;
+    auto new_value = read_memory(it->addr) & mask;
+
+    std::cout << "\nHardware watchpoint " << std::dec << slot << ": " << it->expr << std::endl;
+    if (new_value != it->old_value) {
+        std::cout << "Old value = 0x" << std::hex << it->old_value << std::endl
+                  << "New value = 0x" << std::hex << new_value << std::endl;
+    } else {
+        std::cout << "Value = 0x" << std::hex << new_value << std::endl;
+    }
+    it->old_value = new_value;
+}
+
+
+
+/**
+ * @brief: 硬件断点不修改代码，命中后也不需要 disable -> single step -> enable。
+ *         已有软件断点的地址，先禁用其int3，避免同一位置触发两次。
+ */
+bool debugger::set_hw_breakpoint_at_address(std::intptr_t addr) {
+    if (m_hw_breakpoints.count(addr)) return true;
+
+    int slot = m_debug_registers.set(addr, dr_condition::execute, 1);
+    if (slot < 0) return false;
+
+    m_hw_breakpoints[addr] = slot;
+    if (m_breakpoints.count(addr)) {
+        m_breakpoints.disable(addr);
+        m_breakpoints.flush();
+    }
+    return true;
+}
+
+
+
+void debugger::remove_hw_breakpoint_at_address(std::intptr_t addr) {
+    auto it = m_hw_breakpoints.find(addr);
+    if (it == m_hw_breakpoints.end()) return;
+
+    m_debug_registers.clear(it->second);
+    m_hw_breakpoints.erase(it);
+    m_auto_hw_breakpoints.erase(addr);
+
+    // 恢复对应的软件断点
+    if (m_breakpoints.count(addr)) {
+        m_breakpoints.enable(addr);
+        m_breakpoints.flush();
+    }
+}
+
+
+
+/**
+ * @brief: 热点断点自动使用硬件slot
+ *         命中次数达到[m_hw_promote_threshold]的软件断点转换为硬件断点；
+ *         没有空闲slot时，替换命中次数最少的自动转换的硬件断点。
+ *         用户通过[hbreak]设置的硬件断点不会被替换。
+ */
+void debugger::promote_hot_breakpoint(std::intptr_t addr) {
+    if (m_hw_promote_threshold == 0 || m_hw_breakpoints.count(addr) || !m_breakpoints.count(addr)) return;
+
+    auto hits = m_breakpoints.at(addr).get_trap_count();
+    if (hits < m_hw_promote_threshold) return;
+
+    if (m_debug_registers.free_slots() == 0) {
+        std::intptr_t coldest = 0;
+        uint64_t coldest_hits = hits;
+        for (auto auto_addr : m_auto_hw_breakpoints) {
+            auto auto_hits = m_breakpoints.count(auto_addr) ? m_breakpoints.at(auto_addr).get_trap_count() : 0;
+            if (auto_hits < coldest_hits) {
+                coldest = auto_addr;
+                coldest_hits = auto_hits;
+            }
+        }
+        if (coldest == 0) return;
+        remove_hw_breakpoint_at_address(coldest);
+    }
+
+    if (set_hw_breakpoint_at_address(addr)) {
+        m_auto_hw_breakpoints.insert(addr);
+    }
+}
+
+
+
+
+
+/**
+ * @brief: 条件在设置断点时编译一次，变量按断点所在的函数解析
+ *         命中时只需执行字节码，不再遍历DWARF
+ */
+void debugger::set_breakpoint_condition(std::intptr_t addr, const std::string& text) {
+    auto pc = offset_load_address(addr);
+    auto resolver = [this, pc](const std::string& name, variable_info& var) {
+        return resolve_variable(pc, name, var);
+    };
+    auto cond = std::make_shared<compiled_expr>(compiled_expr::compile(text, resolver));
+    m_breakpoints.at(addr).set_condition(std::move(cond));
+}
+
+
+
+bool debugger::check_breakpoint_condition(std::intptr_t addr) {
+    if (!m_breakpoints.count(addr)) return true;
+    auto& cond = m_breakpoints.at(addr).get_condition();
+    if (!cond) return true;
+
+    try {
+        expr_eval_context context {m_tid};
+        return cond->evaluate(context) != 0;
+    } catch (std::exception& e) {
+        // 求值失败时停下来，交给用户处理
+        std::cerr << "Error in condition '" << cond->get_text() << "': " << e.what() << std::endl;
+        return true;
+    }
+}
+
+
+
+void debugger::print_breakpoints() {
+    std::cout << std::left << std::setfill(' ')
+              << std::setw(5) << "Num" << std::setw(20) << "Address" << std::setw(6) << "Type"
+              << std::setw(10) << "Hits" << "What" << std::endl;
+    for (const auto& [addr, bp] : m_breakpoints) {
+        if (bp.get_number() == 0) continue;
+        std::cout << std::setw(5) << std::dec << bp.get_number()
+                  << "0x" << std::setw(18) << std::hex << addr << std::dec
+                  << std::setw(6) << (m_hw_breakpoints.count(addr) ? "hw" : "sw")
+                  << std::setw(10) << bp.get_hit_count();
+        if (auto& format = bp.get_dprintf()) {
+            std::cout << "dprintf " << format->get_text();
+        }
+        std::cout << std::endl;
+
+        if (auto& cond = bp.get_condition()) {
+            std::cout << "\tstop only if " << cond->get_text();
+            if (cond->get_eval_count()) {
+                std::cout << "  (" << cond->get_eval_count() << " evals, "
+                          << cond->get_eval_time_ns() / cond->get_eval_count() << " ns/eval)";
+            }
+            std::cout << std::endl;
+        }
+        if (bp.get_thread()) {
+            std::cout << "\tstop only in thread " << bp.get_thread() << std::endl;
+        }
+        if (bp.get_ignore_count()) {
+            std::cout << "\tignore next " << bp.get_ignore_count() << " hits" << std::endl;
+        }
+        for (const auto& command : bp.get_commands()) {
+            std::cout << "\t    " << command << std::endl;
+        }
+    }
+    std::cout << std::right;
+}
+
+
+
+breakpoint* debugger::find_breakpoint_by_number(int number) {
+    for (auto& [addr, bp] : m_breakpoints) {
+        if (bp.get_number() == number) return &bp;
+    }
+    return nullptr;
+}
+
+
+
+/**
+ * @brief: 断点命中后依次检查：条件 -> ignore计数 -> dprintf -> 命令列表
+ *         返回false时不回到命令行，由[continue_execution]继续运行
+ */
+bool debugger::handle_breakpoint_hit(std::intptr_t addr) {
+    auto& bp = m_breakpoints.at(addr);
+    bp.trap();
+    // 调试器内部的临时断点，由设置它的操作处理
+    if (bp.get_number() == 0) return true;
+    if (!check_breakpoint_condition(addr)) return false;
+    bp.hit();
+    if (bp.consume_ignore()) return false;
+
+    // dprintf只打印，不调用[print_source]
+    if (auto format = bp.get_dprintf()) {
+        try {
+            expr_eval_context context {m_tid};
+            std::cout << format->format(context) << std::flush;
+        } catch (std::exception& e) {
+            std::cerr << "dprintf: " << e.what() << std::endl;
+        }
+        return false;
+    }
+
+    // 命令以continue结尾时在这里执行后继续运行，否则在[report_stop]中执行
+    const auto& commands = bp.get_commands();
+    bool resume = !commands.empty() && (commands.back() == "c" || commands.back() == "continue");
+    if (!resume) return true;
+    run_breakpoint_commands(bp);
+    return false;
+}
+
+
+
+void debugger::run_breakpoint_commands(const breakpoint& bp) {
+    // 命令可能修改断点，先复制一份
+    auto commands = bp.get_commands();
+    bool silent = !commands.empty() && commands.front() == "silent";
+    bool resume = !commands.empty() && (commands.back() == "c" || commands.back() == "continue");
+
+    if (!silent) {
+        std::cout << "Breakpoint " << std::dec << bp.get_number() << ", ";
+        print_current_location();
+    }
+    for (size_t i = silent ? 1 : 0; i < commands.size() - (resume ? 1 : 0); i++) {
+        try {
+            handle_command(commands[i]);
+        } catch (std::exception& e) {
+            std::cerr << commands[i] << ": " << e.what() << std::endl;
+        }
+    }
+}
+
+
+
+/**
+ * @brief: 以gdb的方式读取命令列表，直到输入"end"
+ */
+void debugger::read_breakpoint_commands(int number) {
+    auto bp = find_breakpoint_by_number(number);
+    if (!bp) {
+        std::cerr << "No breakpoint number " << number << std::endl;
+        return;
+    }
+
+    std::cout << "Type commands for breakpoint " << number << ", one per line." << std::endl
+              << "End with a line saying just \"end\"." << std::endl;
+    std::vector<std::string> commands;
+    char* line = nullptr;
+    while ((line = linenoise(">")) != nullptr) {
+        std::string command {line};
+        linenoiseFree(line);
+        if (command == "end") break;
+        if (!command.empty()) commands.push_back(command);
+    }
+    // 以continue结尾的命令在判断断点命中时执行，此时其他线程仍在运行、外层的继续或单步尚未结束，
+    // 其中不能再有让被调试进程执行的命令
+    bool resume = !commands.empty() && (commands.back() == "c" || commands.back() == "continue");
+    for (size_t i = 0; resume && i + 1 < commands.size(); i++) {
+        if (is_execution_command(commands[i])) {
+            std::cerr << "\"" << commands[i] << "\" can't be used in commands that end with \"continue\"; "
+                      << "commands for breakpoint " << number << " not changed." << std::endl;
+            return;
+        }
+    }
+    bp->set_commands(std::move(commands));
+}
+
+
+
+/**
+ * @brief: dprintf <location> "format", args...
+ *         格式串与参数按断点所在的函数编译，命中时打印后继续运行
+ */
+void debugger::set_dprintf(const std::string& location, const std::string& text) {
+    for (auto addr : resolve_location(location)) {
+        auto pc = offset_load_address(addr);
+        auto resolver = [this, pc](const std::string& name, variable_info& var) {
+            return resolve_variable(pc, name, var);
+        };
+        auto format = std::make_shared<dprintf_format>(dprintf_format::parse(text, resolver));
+
+        set_breakpoint_at_address(addr);
+        auto& bp = m_breakpoints.at(addr);
+        bp.set_dprintf(std::move(format));
+        std::cout << "Dprintf " << bp.get_number() << " at 0x" << std::hex << addr << std::dec << std::endl;
+    }
+}
+
+
+
+void debugger::print_expression(const std::string& text) {
+    auto pc = get_frame_pc_offset_address();
+    auto resolver = [this, pc](const std::string& name, variable_info& var) {
+        return resolve_variable(pc, name, var);
+    };
+    auto expr = compiled_expr::compile(text, resolver);
+    auto context = make_frame_context();
+    auto value = expr.evaluate(context);
+    std::cout << std::dec << value << " (0x" << std::hex << value << ")" << std::dec << std::endl;
+}
+
+
+
+
+
+void debugger::remove_breakpoint_at_address(std::intptr_t addr) {
+    // 自动转换的硬件断点随软件断点一起删除
+    if (m_auto_hw_breakpoints.count(addr)) {
+        remove_hw_breakpoint_at_address(addr);
+    }
+    // 恢复原数据后，删除断点
+    m_breakpoints.remove(addr);
+    m_breakpoints.flush();
+}
+
+
+
+void debugger::dump_register() {
+    for (const auto& rd : g_register_descriptors) {
+        std::cout << std::setw(10) << std::setfill(' ')
+                  << rd.reg_name 
+                  << " 0x"
+                  << std::setfill('0') << std::setw(16) << std::hex
+                  << get_current_register(rd.reg_index) << std::endl;
+    }
+}
+
+
+
+uint64_t debugger::read_memory(std::intptr_t addr) {
+   return ptrace(PTRACE_PEEKDATA, m_tid, addr, nullptr);
+}
+
+
+void debugger::write_memory(std::intptr_t addr, uint64_t value) {
+    ptrace(PTRACE_POKEDATA, m_tid, addr, value);
+    invalidate_frames();
+    // 覆盖了某条指令时，丢弃其位移单步的副本与解码缓存
+    for (std::intptr_t a = addr - 15; a < addr + 8; a++) m_displaced.invalidate(a);
+    invalidate_code(addr, 8);
+}
+
+
+
+
+uint64_t debugger::get_pc() {
+    return get_current_register(reg_x86_64::rip);
+}
+
+void debugger::set_pc(std::intptr_t pc) {
+    set_current_register(reg_x86_64::rip, pc);
+}
+
+
+
+uint64_t debugger::get_current_register(reg_x86_64 r) {
+    auto it = m_threads.find(m_tid);
+    if (it == m_threads.end() || !it->second.stopped) return get_register_value(m_tid, r);
+    return *(reinterpret_cast<const uint64_t*>(&get_thread_regs(it->second)) + (int)r);
+}
+
+
+void debugger::set_current_register(reg_x86_64 r, uint64_t value) {
+    set_register_value(m_tid, r, value);
+    auto it = m_threads.find(m_tid);
+    if (it != m_threads.end() && it->second.regs_valid) {
+        *(reinterpret_cast<uint64_t*>(&it->second.regs) + (int)r) = value;
+    }
+}
+
+
+void debugger::invalidate_current_regs() {
+    auto it = m_threads.find(m_tid);
+    if (it != m_threads.end()) it->second.regs_valid = false;
+}
+
+
+
+bool debugger::step_over_breakpoint() {
+    uint64_t possiable_breakpoint_location = get_pc();
+    // 停在硬件断点处时，设置eflags中的RF位，恢复执行时不会再次触发
+    if (m_hw_breakpoints.count(possiable_breakpoint_location)) {
+        auto eflags = get_current_register(reg_x86_64::eflags);
+        set_current_register(reg_x86_64::eflags, eflags | (1 << 16));
+    }
+    // std::cout << "possiable_breakpoint_location - 0x" 
+    //           << std::hex << possiable_breakpoint_location << std::endl;
+    if (m_breakpoints.count(possiable_breakpoint_location)) {
+        auto& bp = m_breakpoints.at(possiable_breakpoint_location);
+        // std::cout << "Step over breakpoint at 0x" << std::hex << bp.get_address() << std::endl;
+
+        if (!bp.is_enabled()) return false;
+        // 记录时必须逐条单步（位移执行的副本中的syscall无法记录）
+        if (m_recording || !displaced_step_over_breakpoint(bp.get_address())) {
+            // 退化为移除int3、单步、再写回。int3不在时其他线程会越过断点，先停下所有线程
+            stop_all_threads();
+            auto decoded = decode_instruction(bp.get_address());
+            bool rep = decoded != nullptr && decoded->rep;
+            m_breakpoints.disable(bp.get_address());
+            m_breakpoints.flush();
+            single_step_instruction();
+            // rep串操作每次单步只执行一轮，继续单步直到rip离开断点，否则写回的int3会再次命中
+            while (rep && m_last_stop.reason == stop_reason::single_step && get_pc() == possiable_breakpoint_location) {
+                single_step_instruction();
+            }
+            // std::cout << "Parent process recieve the signal." << std::endl;
+            if (m_last_stop.reason != stop_reason::exited) {
+                m_breakpoints.enable(bp.get_address());
+                m_breakpoints.flush();
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief: 原指令的字节从内存中读取，并把其中的int3还原为断点保存的字节；
+ *         副本只在第一次经过该断点时写入，之后的命中只需修改寄存器
+ */
+bool debugger::displaced_step_over_breakpoint(std::intptr_t addr) {
+    std::vector<uint8_t> code;
+    if (!m_displaced.has_copy(addr)) code = read_original_code(addr, 16);
+
+    user_regs_struct regs;
+    ptrace(PTRACE_GETREGS, m_tid, nullptr, &regs);
+    m_displaced.set_thread(m_tid);
+    try {
+        if (!m_displaced.prepare(addr, code.data(), code.size(), regs)) return false;
+    } catch (std::runtime_error&) {
+        return false;
+    }
+
+    resume_thread(current_thread(), PTRACE_SINGLESTEP, false);
+    wait_for_signal();
+    if (m_last_stop.reason == stop_reason::exited) return true;
+    m_displaced.finish();
+    invalidate_current_regs();
+    m_last_stop.pc = get_pc();
+    return true;
+}
+
+
+
+/**
+ * @brief: 解码缓存按页读取原始代码；读取在不可访问的页处截断，其中的int3还原为断点保存的字节
+ */
+const x86_insn* debugger::decode_instruction(std::uintptr_t addr) {
+    auto reader = [this](std::uintptr_t base, uint8_t* buf, std::size_t len) -> std::size_t {
+        iovec local {buf, len};
+        iovec remote {reinterpret_cast<void*>(base), len};
+        auto n = process_vm_readv(m_pid, &local, 1, &remote, 1, 0);
+        if (n <= 0) return 0;
+        for (auto& [bp_addr, bp] : m_breakpoints) {
+            std::uintptr_t a = bp_addr;
+            if (a >= base && a < base + n && bp.is_enabled()) buf[a - base] = bp.get_saved_data();
+        }
+        return n;
+    };
+    return m_decode_cache.decode(addr, reader);
+}
+
+
+
+std::vector<uint8_t> debugger::read_original_code(std::intptr_t addr, std::size_t len) {
+    auto code = read_memory_block(addr, len);
+    for (std::size_t i = 0; i < code.size(); i++) {
+        auto it = m_breakpoints.find(addr + i);
+        if (it != m_breakpoints.end() && it->second.is_enabled()) code[i] = it->second.get_saved_data();
+    }
+    return code;
+}
+
+
+
+void debugger::invalidate_code(std::uintptr_t addr, std::size_t len) {
+    m_decode_cache.invalidate(addr, len);
+    // 函数互不重叠，按入口排序后从最后一个入口不晚于修改末尾的函数向前检查
+    auto it = m_cfgs.upper_bound(addr + len - 1);
+    while (it != m_cfgs.begin()) {
+        --it;
+        if (it->second.get_high() <= addr) break;
+        it = m_cfgs.erase(it);
+    }
+}
+
+
+
+const function_cfg* debugger::get_function_cfg(uint64_t pc) {
+    auto it = m_cfgs.upper_bound(pc);
+    if (it != m_cfgs.begin() && pc < std::prev(it)->second.get_high()) return &std::prev(it)->second;
+
+    function_symbol func;
+    if (!symbolize_pc(pc, func) || func.high_pc <= func.low_pc) return nullptr;
+    auto code = read_original_code(func.low_pc, func.high_pc - func.low_pc);
+    if (code.empty()) return nullptr;
+    auto& cfg = m_cfgs[func.low_pc];
+    cfg.build(func.low_pc, std::move(code));
+    return &cfg;
+}
+
+
+
+void debugger::parse_code_range(const std::string& spec, std::uintptr_t& low, std::uintptr_t& high) {
+    function_symbol func;
+    auto function_at = [&](uint64_t pc) {
+        if (!symbolize_pc(pc, func)) throw std::runtime_error{"No function contains the specified address."};
+        low = func.low_pc;
+        high = func.high_pc;
+    };
+
+    if (spec.empty()) {
+        function_at(offset_dwarf_address(get_frame_pc_offset_address()));
+    } else if (spec.compare(0, 2, "0x") == 0) {
+        auto comma = spec.find(',');
+        auto addr = std::stoull(spec.substr(0, comma), nullptr, 16);
+        if (comma == std::string::npos) {
+            function_at(addr);
+        } else {
+            auto len = spec.substr(comma + 1);
+            if (!len.empty() && len[0] == '+') len.erase(0, 1);
+            low = addr;
+            high = addr + std::stoull(len, nullptr, 0);
+        }
+    } else {
+        for (const auto& sym : lookup_symbol(spec)) {
+            if (sym.type == symbol_type::func && sym.addr) {
+                function_at(offset_dwarf_address(sym.addr));
+                return;
+            }
+        }
+        throw std::runtime_error{"No symbol \"" + spec + "\" in current context."};
+    }
+}
+
+
+
+const std::string* debugger::get_source_line(const std::string& file, uint64_t line) {
+    auto it = m_source_files.find(file);
+    if (it == m_source_files.end()) {
+        std::vector<std::string> lines;
+        std::ifstream in {file};
+        std::string text;
+        while (std::getline(in, text)) lines.push_back(text);
+        it = m_source_files.emplace(file, std::move(lines)).first;
+    }
+    if (line == 0 || line > it->second.size()) return nullptr;
+    return &it->second[line - 1];
+}
+
+
+
+/**
+ * @brief: 格式类似gdb的 disassemble /s:
+ *         源代码行在其第一条指令前打印，=> 标出选中栈帧的pc，循环头以注释标出。
+ *         行号表只扫描一次得到范围内的 地址 -> 行，跳转目标的符号化结果在本次输出中缓存，
+ *         所有输出先写入缓冲区再一次性打印。
+ */
+void debugger::disassemble(std::uintptr_t low, std::uintptr_t high) {
+    if (high <= low) return;
+
+    // 范围恰好从函数中的某条指令开始时使用缓存的控制流图，否则临时解码这一段
+    const function_cfg* cfg = get_function_cfg(low);
+    function_cfg range_cfg;
+    if (cfg == nullptr || high > cfg->get_high() || cfg->find_insn(low) < 0) {
+        auto code = read_original_code(low, high - low);
+        range_cfg.build(low, std::move(code));
+        cfg = &range_cfg;
+    }
+
+    // 地址 -> (文件, 行)，end_sequence的行号为0
+    std::map<std::uintptr_t, std::pair<std::string, uint64_t>> lines;
+    if (m_dwarf.valid() && low >= m_load_address) {
+        auto dwarf_low = offset_load_address(low);
+        auto dwarf_high = offset_load_address(high);
+        for (const auto& cu : m_dwarf.compilation_units()) {
+            if (!die_pc_range(cu.root()).contains(dwarf_low)) continue;
+            uint64_t before = 0;
+            for (const auto& row : cu.get_line_table()) {
+                if (row.address >= dwarf_high) continue;
+                if (row.address < dwarf_low) {
+                    // 范围开始之前的最后一行覆盖[low]
+                    if (row.end_sequence || row.address < before) continue;
+                    before = row.address;
+                    lines[low] = {row.file->path, row.line};
+                    continue;
+                }
+                lines[offset_dwarf_address(row.address)] =
+                    row.end_sequence ? std::make_pair(std::string{}, uint64_t{0}) : std::make_pair(row.file->path, (uint64_t)row.line);
+            }
+            break;
+        }
+    }
+
+    function_symbol func;
+    bool has_func = symbolize_pc(low, func);
+    std::unordered_map<std::uintptr_t, std::string> names;
+    auto describe = [&](std::uintptr_t addr) -> const std::string& {
+        auto it = names.find(addr);
+        if (it != names.end()) return it->second;
+        std::stringstream ss;
+        function_symbol target;
+        bool found = has_func && addr >= func.low_pc && addr < func.high_pc;
+        if (found) target = func;
+        else found = symbolize_pc(addr, target);
+        if (found) {
+            ss << " <" << target.name;
+            if (addr != target.low_pc) ss << "+" << std::dec << addr - target.low_pc;
+            ss << ">";
+        }
+        return names.emplace(addr, ss.str()).first->second;
+    };
+
+    std::uintptr_t current = m_selected_frame == 0 ? get_pc() : get_frames()[m_selected_frame].pc;
+
+    std::stringstream out;
+    if (has_func && low == func.low_pc) out << "Dump of assembler code for function " << func.name << ":\n";
+    else out << "Dump of assembler code from 0x" << std::hex << low << " to 0x" << high << ":\n";
+
+    const std::pair<std::string, uint64_t>* last_line = nullptr;
+    const auto& insns = cfg->get_insns();
+    for (auto i = cfg->find_insn(low); i >= 0 && (std::size_t)i < insns.size() && insns[i].addr < high; i++) {
+        const auto& item = insns[i];
+
+        auto line = lines.upper_bound(item.addr);
+        if (line != lines.begin() && std::prev(line)->second.second != 0) {
+            const auto& where = std::prev(line)->second;
+            if (last_line == nullptr || *last_line != where) {
+                auto text = get_source_line(where.first, where.second);
+                if (text) out << std::dec << where.second << "\t" << *text << "\n";
+                else out << where.first << ":" << std::dec << where.second << "\n";
+            }
+            last_line = &where;
+        }
+
+        x86_disasm disasm {};
+        if (item.decoded) {
+            disasm = format_x86(cfg->code_at(item.addr), item.insn, item.addr, m_disas_syntax);
+        } else {
+            std::stringstream byte;
+            byte << ".byte 0x" << std::hex << std::setw(2) << std::setfill('0') << (int)*cfg->code_at(item.addr);
+            disasm.text = byte.str();
+        }
+
+        out << (item.addr == current ? "=> " : "   ") << "0x" << std::hex << item.addr;
+        if (has_func && item.addr >= func.low_pc && item.addr < func.high_pc) {
+            out << " <+" << std::dec << item.addr - func.low_pc << ">";
+        }
+        out << ":\t" << disasm.text;
+        if (disasm.target) out << describe(disasm.target);
+        if (disasm.rip_ref) out << "\t# 0x" << std::hex << disasm.rip_ref << describe(disasm.rip_ref);
+
+        auto block = cfg->find_block(item.addr);
+        if (block >= 0 && cfg->get_blocks()[block].start == item.addr && cfg->get_blocks()[block].is_loop_header) {
+            out << "\t# loop header";
+        }
+        out << "\n";
+    }
+    out << "End of assembler dump.\n";
+    std::cout << out.str() << std::flush;
+}
+
+
+
+void debugger::print_cfg(std::uintptr_t low) {
+    auto cfg = get_function_cfg(low);
+    if (cfg == nullptr) {
+        std::cerr << "No function contains the specified address." << std::endl;
+        return;
+    }
+
+    const auto& blocks = cfg->get_blocks();
+    auto loops = std::count_if(blocks.begin(), blocks.end(), [](const basic_block& b) {return b.is_loop_header;});
+    function_symbol func;
+    std::stringstream out;
+    out << "Function " << (symbolize_pc(cfg->get_low(), func) ? func.name : std::string{"??"})
+        << " [0x" << std::hex << cfg->get_low() << ", 0x" << cfg->get_high() << "): " << std::dec
+        << blocks.size() << " blocks, " << cfg->get_insns().size() << " instructions, "
+        << loops << " loop headers\n";
+    for (std::size_t b = 0; b < blocks.size(); b++) {
+        const auto& block = blocks[b];
+        out << "  B" << std::dec << b << " [0x" << std::hex << block.start << ", 0x" << block.end << ") "
+            << std::dec << block.n_insns << " insns";
+        if (block.is_loop_header) out << ", loop header";
+        out << "\n    preds:";
+        for (auto p : block.preds) out << " B" << p;
+        out << "\n    succs:";
+        for (auto s : block.succs) out << " B" << s << (cfg->dominates(s, b) ? " (back edge)" : "");
+        if (block.terminator == x86_branch::indirect_jump) out << " (indirect)";
+        if (block.terminator == x86_branch::ret) out << " (return)";
+        out << "\n";
+    }
+    std::cout << out.str() << std::flush;
+}
+
+
+
+/**
+ * @brief: 函数名：在符号表中的函数入口处安装，允许搬移多条指令；
+ *         0xADDRESS / <file>:<line>：只有该处的指令不短于5字节时才能安装
+ */
+void debugger::set_fast_tracepoint(const std::string& location, const std::string& collect) {
+    if (m_recording) {
+        std::cerr << "Fast tracepoints are not supported while recording." << std::endl;
+        return;
+    }
+    std::vector<std::pair<std::intptr_t, bool>> sites;
+    if (location.find(':') == std::string::npos && location.compare(0, 2, "0x") != 0) {
+        for (const auto& sym : lookup_symbol(location)) {
+            if (sym.type == symbol_type::func && sym.addr) sites.emplace_back(offset_dwarf_address(sym.addr), true);
+        }
+    }
+    if (sites.empty()) {
+        for (auto addr : resolve_location(location)) {
+            function_symbol func;
+            sites.emplace_back(addr, symbolize_pc(addr, func) && func.low_pc == (uint64_t)addr);
+        }
+    }
+    if (sites.empty()) {
+        std::cerr << "No location " << location << std::endl;
+        return;
+    }
+
+    for (auto [addr, at_entry] : sites) {
+        try {
+            for (std::intptr_t a = addr; a < addr + 16; a++) {
+                if (m_breakpoints.count(a)) throw std::runtime_error{"Remove the breakpoint at this location first"};
+            }
+            auto capture = parse_trace_capture(collect, addr);
+            auto id = m_tracepoints.install(addr, read_original_code(addr, 16), at_entry, capture);
+            invalidate_code(addr, m_tracepoints.get_tracepoints().at(id).saved.size());
+            std::cout << "Fast tracepoint " << id << " at 0x" << std::hex << addr << " (trampoline 0x"
+                      << m_tracepoints.get_tracepoints().at(id).trampoline << ")" << std::dec << std::endl;
+        } catch (std::exception& e) {
+            std::cerr << "Can't set fast tracepoint at 0x" << std::hex << addr << std::dec << ": " << e.what() << std::endl;
+        }
+    }
+}
+
+
+
+std::optional<trace_capture> debugger::parse_trace_capture(const std::string& text, std::intptr_t addr) {
+    if (text.empty()) return std::nullopt;
+
+    auto at = text.find('@');
+    auto what = text.substr(0, at);
+    uint32_t len = at == std::string::npos ? 0 : std::stoul(text.substr(at + 1), nullptr, 0);
+
+    // 寄存器在trampoline中使用x86编码的序号
+    auto encoding_of = [](const std::string& name) {
+        for (int i = 0; i < trace_n_regs; i++) {
+            if (name == g_trace_reg_names[i]) return i;
+        }
+        throw std::invalid_argument{"Can't collect relative to " + name};
+    };
+
+    trace_capture capture {false, 0, 0, len ? len : 8};
+    if (what.compare(0, 2, "0x") == 0) {
+        capture.absolute = true;
+        capture.offset = std::stoull(what, nullptr, 16);
+    } else if (what[0] == '$') {
+        // $reg, $reg+off, $reg-off
+        auto sign = what.find_first_of("+-");
+        capture.reg = encoding_of(what.substr(1, sign == std::string::npos ? std::string::npos : sign - 1));
+        if (sign != std::string::npos) capture.offset = std::stoll(what.substr(sign), nullptr, 0);
+    } else {
+        variable_info var;
+        if (!resolve_variable(offset_load_address(addr), what, var)) {
+            throw std::invalid_argument{"No variable named " + what};
+        }
+        if (var.location == variable_info::kind::absolute) {
+            capture.absolute = true;
+            capture.offset = var.offset;
+        } else if (var.location == variable_info::kind::reg_relative) {
+            auto rd = std::find_if(g_register_descriptors.begin(), g_register_descriptors.end(),
+                                   [&var](const reg_descriptor& d) { return d.reg_index == var.reg; });
+            // 不在寄存器表中的DWARF寄存器（例如xmm）
+            if (rd == g_register_descriptors.end()) {
+                throw std::invalid_argument{"Can't collect " + what + ": its base register is not supported"};
+            }
+            capture.reg = encoding_of(rd->reg_name);
+            capture.offset = var.offset;
+        } else {
+            throw std::invalid_argument{what + " is not in memory here; its register is recorded anyway"};
+        }
+        if (!len) capture.len = var.size;
+    }
+    return capture;
+}
+
+
+
+void debugger::print_trace_status() {
+    const auto& tracepoints = m_tracepoints.get_tracepoints();
+    if (tracepoints.empty()) {
+        std::cout << "No fast tracepoints." << std::endl;
+        return;
+    }
+    std::cout << std::left << std::setfill(' ')
+              << std::setw(5) << "Num" << std::setw(20) << "Address" << std::setw(12) << "Hits" << "Where" << std::endl;
+    for (const auto& [id, tp] : tracepoints) {
+        std::cout << std::setw(5) << std::dec << id
+                  << "0x" << std::setw(18) << std::hex << tp.addr << std::dec
+                  << std::setw(12) << m_tracepoints.get_hit_count(id);
+        function_symbol func;
+        if (symbolize_pc(tp.addr, func)) std::cout << func.name << "+" << tp.addr - func.low_pc;
+        std::cout << std::endl;
+    }
+    std::cout << std::right << "Records lost (buffer overrun): " << m_tracepoints.get_lost_count() << std::endl;
+}
+
+
+
+void debugger::print_trace_records(std::size_t n) {
+    // 只打印参数寄存器与rsp
+    const int shown[] = {7, 6, 2, 1, 8, 9, 0, 4};
+    for (const auto& record : m_tracepoints.get_records(n)) {
+        std::cout << "#" << std::dec << record.id << " tsc=" << record.tsc << std::hex;
+        for (auto r : shown) std::cout << " " << g_trace_reg_names[r] << "=0x" << record.regs[r];
+        if (record.mem_len) {
+            std::cout << " mem=";
+            for (uint32_t i = 0; i < record.mem_len; i++) {
+                std::cout << std::setw(2) << std::setfill('0') << (int)record.mem[i];
+            }
+        }
+        std::cout << std::dec << std::endl;
+    }
+}
+
+
+
+stop_event debugger::wait_for_signal() {
+    int status;
+    auto tid = wait_thread(m_tid, status);
+    return handle_wait_status(tid, status, false);
+}
+
+
+
+stop_event debugger::wait_for_any_thread() {
+    int status;
+    if (auto thread = find_pending_stop()) {
+        status = thread->pending_status;
+        thread->pending_status = 0;
+        return handle_wait_status(thread->tid, status, true);
+    }
+    auto tid = wait_thread(-1, status);
+    return handle_wait_status(tid, status, true);
+}
+
+
+
+/**
+ * @brief: 总是用waitpid(-1, __WALL)等待：只等待一个线程时，其他线程的退出不会被回收，
+ *         而线程组长的退出要等其他线程都被回收后才报告。
+ *         新线程的第一次停止可能先于clone事件到达，此时直接加入线程表；检查点等其他进程的事件被忽略。
+ */
+pid_t debugger::wait_thread(pid_t tid, int& status) {
+    while (true) {
+        auto waited = waitpid(-1, &status, __WALL);
+        if (waited < 0) {
+            if (errno == EINTR) continue;
+            // 没有可以等待的线程：进程已经退出并被回收
+            status = 0;
+            return m_pid;
+        }
+
+        auto it = m_threads.find(waited);
+        if (it == m_threads.end()) {
+            auto task = "/proc/" + std::to_string(m_pid) + "/task/" + std::to_string(waited);
+            if (WIFSTOPPED(status) && access(task.c_str(), F_OK) == 0) {
+                auto& thread = add_thread(waited, true);
+                if (tid == -1) resume_thread(thread, PTRACE_CONT, false);
+            }
+            continue;
+        }
+        if (!WIFSTOPPED(status)) {
+            if (waited == tid || tid == -1 || waited == m_pid) return waited;
+            remove_thread(waited);
+            continue;
+        }
+
+        auto& thread = it->second;
+        thread.stopped = true;
+        thread.regs_valid = false;
+        auto event = status >> 16;
+        if (event == PTRACE_EVENT_CLONE) {
+            // 继续运行时新线程一起运行；单步类操作只让当前线程运行，新线程保持停止
+            auto child = attach_new_thread(waited);
+            if (child != nullptr && tid == -1) resume_thread(*child, PTRACE_CONT, false);
+            resume_thread(thread, thread.last_request, false);
+            continue;
+        }
+        if (event == PTRACE_EVENT_STOP || event == PTRACE_EVENT_EXEC) {
+            // 上一次all-stop残留的中断（停止之前线程已经因为其他原因停下）、group-stop或exec，按原来的方式恢复
+            resume_thread(thread, thread.last_request, false);
+            continue;
+        }
+        if (waited == tid || tid == -1) return waited;
+        // 只等待[tid]时其他线程可能仍在运行（继续执行时越过断点之前没有all-stop）：
+        // 保留其信号与断点命中，下次继续执行时报告
+        if (WSTOPSIG(status) != SIGTRAP) thread.pending_signal = WSTOPSIG(status);
+        else if (event == 0) keep_trap_of_other_thread(thread, status);
+    }
+}
+
+
+
+stop_event debugger::handle_wait_status(pid_t tid, int status, bool continuing) {
+    stop_event event {stop_reason::signal, tid, 0, 0, 0, false};
+    if (WIFEXITED(status) || WIFSIGNALED(status)) {
+        event.signal = WIFEXITED(status) ? WEXITSTATUS(status) : -WTERMSIG(status);
+        // 线程组长最后被回收，它退出即进程退出
+        if (tid == m_pid) {
+            event.reason = stop_reason::exited;
+            invalidate_frames();
+            m_last_stop = event;
+            return event;
+        }
+        remove_thread(tid);
+        if (tid == m_tid) m_tid = m_threads.begin()->first;
+        invalidate_frames();
+        event.reason = stop_reason::thread_exited;
+        event.tid = m_tid;
+        if (current_thread().stopped) event.pc = get_pc();
+        event.resume = continuing;
+        m_last_stop = event;
+        return event;
+    }
+
+    m_tid = tid;
+    invalidate_frames();
+    event.pc = get_pc();
+    auto siginfo = get_signal_info();
+    event.signal = siginfo.si_signo;
+
+    switch (siginfo.si_signo) {
+        case SIGTRAP:
+            handle_sigtrap(siginfo, event);
+            break;
+
+        case SIGSEGV:
+            if (handle_page_fault(siginfo, event)) break;
+            // 与页保护断点无关的错误，继续执行时交给程序处理
+            current_thread().pending_signal = SIGSEGV;
+            break;
+
+        default:
+            break;
+    }
+
+    m_last_stop = event;
+    return event;
+}
+
+
+
+thread_info& debugger::add_thread(pid_t tid, bool announce) {
+    auto& thread = m_threads[tid];
+    thread = thread_info{m_next_thread_number++, tid, true, 0, 0, PTRACE_CONT, false, {}};
+    m_debug_registers.add_thread(tid);
+    if (announce) std::cout << "[New Thread " << tid << "]" << std::endl;
+    return thread;
+}
+
+
+
+/**
+ * @brief: 新线程在执行任何指令之前以PTRACE_EVENT_STOP停下；
+ *         clone事件也报告没有CLONE_THREAD的子进程，它们不在/proc/<pid>/task中，不跟踪
+ */
+thread_info* debugger::attach_new_thread(pid_t parent) {
+    unsigned long msg = 0;
+    ptrace(PTRACE_GETEVENTMSG, parent, nullptr, &msg);
+    pid_t tid = msg;
+    auto it = m_threads.find(tid);
+    if (it != m_threads.end()) return &it->second;
+
+    int status;
+    waitpid(tid, &status, __WALL);
+    if (!WIFSTOPPED(status)) return nullptr;
+    auto task = "/proc/" + std::to_string(m_pid) + "/task/" + std::to_string(tid);
+    if (access(task.c_str(), F_OK) != 0) {
+        ptrace(PTRACE_DETACH, tid, nullptr, nullptr);
+        return nullptr;
+    }
+    // 记录与重放按单线程的指令数进行
+    if (m_recording) {
+        std::cout << "The program created a thread; recording supports single-threaded programs only." << std::endl;
+        stop_recording();
+    }
+    return &add_thread(tid, true);
+}
+
+
+
+void debugger::remove_thread(pid_t tid) {
+    m_threads.erase(tid);
+    m_debug_registers.remove_thread(tid);
+    std::cout << "[Thread " << tid << " exited]" << std::endl;
+}
+
+
+
+thread_info& debugger::current_thread() {
+    return m_threads.at(m_tid);
+}
+
+
+
+thread_info* debugger::find_thread_by_number(int number) {
+    for (auto& [tid, thread] : m_threads) {
+        if (thread.number == number) return &thread;
+    }
+    return nullptr;
+}
+
+
+
+const user_regs_struct& debugger::get_thread_regs(thread_info& thread) {
+    if (!thread.regs_valid) {
+        ptrace(PTRACE_GETREGS, thread.tid, nullptr, &thread.regs);
+        thread.regs_valid = true;
+    }
+    return thread.regs;
+}
+
+
+
+bool debugger::resume_thread(thread_info& thread, __ptrace_request request, bool with_signal) {
+    if (ptrace(request, thread.tid, nullptr, with_signal ? thread.pending_signal : 0) < 0) return false;
+    if (with_signal) thread.pending_signal = 0;
+    // 单独恢复有挂起停止的线程（例如切换线程后单步）时，挂起的停止不再报告
+    thread.pending_status = 0;
+    thread.stopped = false;
+    thread.regs_valid = false;
+    thread.last_request = request;
+    return true;
+}
+
+
+
+void debugger::resume_all_threads() {
+    for (auto& [tid, thread] : m_threads) {
+        if (thread.stopped) resume_thread(thread, PTRACE_CONT, true);
+    }
+}
+
+
+
+/**
+ * @brief: 先向所有运行中的线程发送PTRACE_INTERRUPT，再统一等待，各线程的停止并行进行。
+ *         线程可能在中断到达之前因为其他原因停下：
+ *         1. 执行了调试器的int3：pc退回断点处，恢复执行时再次命中并报告
+ *         2. 数据断点命中：保存为挂起的停止，下次继续执行时报告
+ *         3. 其他信号：保存为挂起的信号，恢复执行时传递
+ *         这时中断仍然有效，线程恢复后立即以PTRACE_EVENT_STOP停下，由[wait_thread]恢复
+ */
+void debugger::stop_all_threads() {
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    int running = 0;
+    for (auto& [tid, thread] : m_threads) {
+        if (thread.stopped) continue;
+        // 线程可能已经退出，其退出状态由下面的waitpid回收
+        ptrace(PTRACE_INTERRUPT, tid, nullptr, nullptr);
+        running++;
+    }
+    if (running == 0) return;
+
+    auto all_stopped = [this]() {
+        return std::all_of(m_threads.begin(), m_threads.end(),
+                           [](const std::pair<const pid_t, thread_info>& t) { return t.second.stopped; });
+    };
+    while (!all_stopped()) {
+        int status;
+        auto tid = waitpid(-1, &status, __WALL);
+        if (tid < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        auto it = m_threads.find(tid);
+        if (it == m_threads.end()) {
+            // 先于clone事件到达的新线程
+            auto task = "/proc/" + std::to_string(m_pid) + "/task/" + std::to_string(tid);
+            if (WIFSTOPPED(status) && access(task.c_str(), F_OK) == 0) add_thread(tid, true);
+            continue;
+        }
+        if (!WIFSTOPPED(status)) {
+            // 线程组长的退出在其他线程都被回收后才报告
+            if (tid != m_pid) remove_thread(tid);
+            continue;
+        }
+
+        auto& thread = it->second;
+        thread.stopped = true;
+        thread.regs_valid = false;
+        auto event = status >> 16;
+        if (event == PTRACE_EVENT_CLONE) {
+            attach_new_thread(tid);
+        } else if (event == 0 && WSTOPSIG(status) == SIGTRAP) {
+            keep_trap_of_other_thread(thread, status);
+        } else if (event == 0) {
+            thread.pending_signal = WSTOPSIG(status);
+        }
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start);
+    m_all_stop.count++;
+    m_all_stop.last = elapsed;
+    m_all_stop.max = std::max(m_all_stop.max, elapsed);
+    m_all_stop.total += elapsed;
+}
+
+
+
+/**
+ * @brief: 数据断点是trap，写入已经完成，恢复后不会再次触发，保存wait状态（DR6与siginfo在线程恢复之前保持不变）；
+ *         调试器的int3把pc退回断点处，恢复执行时再次命中并报告
+ */
+void debugger::keep_trap_of_other_thread(thread_info& thread, int status) {
+    siginfo_t info;
+    if (ptrace(PTRACE_GETSIGINFO, thread.tid, nullptr, &info) == 0 && info.si_code == TRAP_HWBKPT
+        && m_debug_registers.has_data_hit(thread.tid)) {
+        thread.pending_status = status;
+        return;
+    }
+    auto regs = get_thread_regs(thread);
+    auto bp = m_breakpoints.find(regs.rip - 1);
+    if (bp != m_breakpoints.end() && bp->second.is_enabled()) {
+        regs.rip--;
+        ptrace(PTRACE_SETREGS, thread.tid, nullptr, &regs);
+        thread.regs = regs;
+    }
+}
+
+
+thread_info* debugger::find_pending_stop() {
+    for (auto& [tid, thread] : m_threads) {
+        if (thread.pending_status) return &thread;
+    }
+    return nullptr;
+}
+
+
+
+void debugger::print_threads() {
+    if (m_last_stop.reason == stop_reason::exited) {
+        std::cerr << "The program is not being run." << std::endl;
+        return;
+    }
+    std::vector<thread_info*> threads;
+    for (auto& [tid, thread] : m_threads) threads.push_back(&thread);
+    std::sort(threads.begin(), threads.end(),
+              [](const thread_info* a, const thread_info* b) { return a->number < b->number; });
+
+    std::cout << "  Id   Tid      Name              Location" << std::endl;
+    for (auto thread : threads) {
+        std::ifstream comm {"/proc/" + std::to_string(m_pid) + "/task/" + std::to_string(thread->tid) + "/comm"};
+        std::string name;
+        std::getline(comm, name);
+        // 当前线程的寄存器可能被命令修改过，直接读取
+        auto pc = thread->tid == m_tid ? get_pc() : get_thread_regs(*thread).rip;
+
+        std::cout << (thread->tid == m_tid ? "* " : "  ") << std::left << std::setw(5) << thread->number
+                  << std::setw(9) << thread->tid << std::setw(18) << name << std::right
+                  << "0x" << std::hex << pc << std::dec;
+        function_symbol func;
+        if (symbolize_pc(pc, func)) std::cout << " in " << func.name << "+" << pc - func.low_pc;
+        if (thread->pending_signal) std::cout << " (pending " << strsignal(thread->pending_signal) << ")";
+        std::cout << std::endl;
+    }
+
+    if (m_all_stop.count) {
+        auto us = [](std::chrono::nanoseconds d) { return std::chrono::duration<double, std::micro>(d).count(); };
+        std::cout << std::fixed << std::setprecision(1) << "All-stop: " << m_all_stop.count << " stops, last "
+                  << us(m_all_stop.last) << " us, max " << us(m_all_stop.max) << " us, average "
+                  << us(m_all_stop.total) / m_all_stop.count << " us" << std::defaultfloat << std::endl;
+    }
+}
+
+
+
+void debugger::select_thread(int number) {
+    auto thread = find_thread_by_number(number);
+    if (!thread) {
+        std::cerr << "Unknown thread " << number << "." << std::endl;
+        return;
+    }
+    // 离开的线程的寄存器可能在它是当前线程时被修改过
+    current_thread().regs_valid = false;
+    m_tid = thread->tid;
+    m_reported_tid = m_tid;
+    invalidate_frames();
+    std::cout << "[Switching to thread " << number << " (" << m_tid << ")]" << std::endl;
+    print_current_location();
+}
+
+
+
+void debugger::report_stop(const stop_event& event) {
+    // 停在与上一次报告不同的线程中
+    if (event.reason != stop_reason::exited && m_tid != m_reported_tid) {
+        std::cout << "[Switching to thread " << current_thread().number << " (" << m_tid << ")]" << std::endl;
+    }
+    m_reported_tid = m_tid;
+
+    switch (event.reason) {
+        case stop_reason::exited:
+            std::cout << "Process " << std::dec << event.tid << " exited";
+            if (event.signal < 0) std::cout << " with signal " << strsignal(-event.signal);
+            else std::cout << " with code " << event.signal;
+            std::cout << std::endl;
+            return;
+
+        case stop_reason::breakpoint:
+            if (event.breakpoint != 0) {
+                if (auto bp = find_breakpoint_by_number(event.breakpoint)) {
+                    run_breakpoint_commands(*bp);
+                    return;
+                }
+            }
+            std::cout << "Hardware breakpoint, ";
+            break;
+
+        case stop_reason::signal:
+            std::cout << "Program received signal " << strsignal(event.signal) << std::endl;
+            break;
+
+        default:
+            break;
+    }
+    print_current_location();
+}
+
+
+
+/**
+ * 1. 首先，通过对 m_dwarf 的迭代器访问 compilation_units，遍历所有的编译单元（Compilation Units）。
+ * 2. 对于每个编译单元 cu，检查它的根 DIE（Debugging Information Entry）的地址范围是否包含给定的指令地址 pc。
  * 3. 如果包含，就遍历该编译单元中的所有 DIE，找到 tag 为 subprogram 的 DIE。
  * 4. 对于每个 subprogram DIE，再次检查其地址范围是否包含给定的指令地址 pc。
  * 5. 如果包含，就返回该 subprogram DIE，表示找到了包含该指令地址的函数信息。
@@ -370,7 +2519,1382 @@ void debugger::wait_for_signal() {
  * 7. 若遍历完所有的单元都没有找到，则抛出错误
 */
 dwarf::die debugger::get_function_from_pc(uint64_t pc) {
+    if (!m_dwarf.valid()) {
+        throw std::out_of_range{"Can't find function: no debug info"};
+    }
+    const std::vector<dwarf::compilation_unit> &uints = m_dwarf.compilation_units();
+    for (const auto& cu : uints) {
+        // Compilation Unit包含多个IDEs，如果pc在某个CU中，则需要遍历该Cu的IDEs，判断其tag
+        if (dwarf::die_pc_range(cu.root()).contains(pc)) {
+            // 命名空间与类中的函数不是CU的直接子节点，[for_each_subprogram]会进入这些DIE
+            dwarf::die found;
+            bool ok = for_each_subprogram(cu.root(), [&](const dwarf::die& die) {
+                // function的IDE的tag一定是subprogram，但是
+                // 库函数是不包含 DW_AT_Low_pc的，需要添加
+                // 一个条件进行判断。
+                // main函数不需要排除
+                if (die.has(dwarf::DW_AT::prototyped) && dwarf::at_name(die)!= "main") {
+                    return false;
+                }
+                if (!dwarf::die_pc_range(die).contains(pc)) return false;
+                found = die;
+                return true;
+            });
+            if (ok) return found;
+        }
+    }
+    throw std::out_of_range{"Can't find function"};
+}
+
+/**
+ * @biref: 根据pc地址找到[line_table]中对应的行数
+ * 
+ * 1. 通过对 m_dwarf 的迭代器访问 compilation units，遍历所有编译单元
+ * 2. 检查 Cu 的 die 的地址是否包含给定的指令地址pc，如果包含，就获取该编译单元的 line talbe
+ * 3. 通过对 line table 的迭代器，调用其成员函数 find_address，找到地址pc对应的行数
+ * 4. 如果 find_address 的返回值为 line table 的最后一个，说明没有找到，超出范围
+ * 5. 否则，将 fine_address 的返回值作为 get_line_entry_from_pc 的返回值并进行返回
+ */
+dwarf::line_table::iterator debugger::get_line_entry_from_pc(uint64_t pc) {
+    if (!m_dwarf.valid()) {
+        throw std::out_of_range{"Can't find line entry: no debug info"};
+    }
+    const std::vector<dwarf::compilation_unit> &uints = m_dwarf.compilation_units();
+    for (const auto& cu : uints) {
+        // cu 有问题，掉用 cu 的成员函数会报错
+        if (die_pc_range(cu.root()).contains(pc)) {
+            auto &It = cu.get_line_table();
+            auto it = It.find_address(pc);
+            if (it == It.end()) {
+                throw std::out_of_range{"Can't find line entry"};
+            } else {
+                return it;
+            }
+        }
+    }
+    throw std::out_of_range{"Can't find line entry"};
+}
+
+
+
+/**
+ * @brief: 在[pc]所在编译单元的行号表中收集与其同一文件、同一行的所有行，
+ *         每行的范围到下一行的地址为止。只扫描一次行号表，之后判断pc是否离开本行不再查询DWARF。
+ */
+bool debugger::get_line_range(uint64_t pc, line_range& range) {
+    if (!m_dwarf.valid()) return false;
+    auto dwarf_pc = offset_load_address(pc);
+    for (const auto& cu : m_dwarf.compilation_units()) {
+        if (!die_pc_range(cu.root()).contains(dwarf_pc)) continue;
+
+        const auto& table = cu.get_line_table();
+        auto current = table.find_address(dwarf_pc);
+        if (current == table.end()) return false;
+
+        range.file = current->file->path;
+        range.line = current->line;
+        range.ranges.clear();
+        for (auto it = table.begin(); it != table.end(); ) {
+            auto row = it;
+            ++it;
+            if (row->end_sequence || it == table.end()) continue;
+            if (row->line != range.line || row->file->path != range.file) continue;
+            if (it->address > row->address) {
+                range.ranges.emplace_back(offset_dwarf_address(row->address), offset_dwarf_address(it->address));
+            }
+        }
+        return !range.ranges.empty();
+    }
+    return false;
+}
+
+
+/**
+ * 二进制文件是有其加载地址(loaded address)，而 dwarf 中所给出的地址都是基于加载地址
+ * 为了在正确的地址设置断点，我们需要在 dwarf 的基础上偏执一个 loaded address
+ * loaded address 可由 "proc/<pid>/maps" 的第一行获得
+ */
+void debugger::initialise_load_address() {
+    if (m_elf.get_hdr().type == elf::et::dyn) {
+        std::ifstream map("/proc/" + std::to_string(m_pid) + "/maps");
+        // 读取file第一行中的地址
+        std::string addr;
+        std::getline(map, addr, '-');
+
+        m_load_address = std::stol(addr, 0, 16);
+    }
+}
+
+
+
+/**
+ * @brief: 生产环境中的可执行文件往往是被strip过的，调试信息单独存放。
+ *         1. 可执行文件自身含有[.debug_info]，直接使用
+ *         2. 根据build-id与debuglink在本地查找分离的调试文件
+ *         3. 配置了[DEBUGINFOD_URLS]时，在后台线程中从debuginfod服务器下载
+ */
+void debugger::load_debug_info() {
+    if (m_elf.get_section(".debug_info").valid()) {
+        m_dwarf = dwarf::dwarf{dwarf::elf::create_loader(m_elf)};
+        m_debug_file = m_prog_name;
+        return;
+    }
+
+    auto path = find_separate_debuginfo(m_prog_name, m_elf);
+    if (path.empty()) {
+        auto build_id = read_build_id(m_elf);
+        if (!build_id.empty() && m_debuginfod.is_enabled()) {
+            std::cout << "Downloading separate debug info for " << m_prog_name
+                      << " (build-id " << build_id << ") in background" << std::endl;
+            m_debuginfo_fetch = m_debuginfod.fetch_async(build_id);
+        } else {
+            std::cerr << "No debug info found for " << m_prog_name << std::endl;
+        }
+        return;
+    }
+
+    int fd = open(path.c_str(), O_RDONLY);
+    m_debug_elf = elf::elf{elf::create_mmap_loader(fd)};
+    m_dwarf = dwarf::dwarf{dwarf::elf::create_loader(m_debug_elf)};
+    m_debug_file = path;
+    std::cout << "Reading debug info from " << path << std::endl;
+}
+
+
+
+void debugger::poll_debug_info() {
+    if (!m_debuginfo_fetch.valid()) return;
+    if (m_debuginfo_fetch.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return;
+
+    auto path = m_debuginfo_fetch.get();
+    if (path.empty()) {
+        std::cerr << "debuginfod: download failed" << std::endl;
+        return;
+    }
+
+    int fd = open(path.c_str(), O_RDONLY);
+    m_debug_elf = elf::elf{elf::create_mmap_loader(fd)};
+    m_dwarf = dwarf::dwarf{dwarf::elf::create_loader(m_debug_elf)};
+    m_debug_file = path;
+    std::cout << "Reading debug info from " << path << std::endl;
+}
+
+
+
+void debugger::print_debug_info_status() {
+    auto build_id = read_build_id(m_elf);
+    std::cout << "build-id:   " << (build_id.empty() ? "<none>" : build_id) << std::endl;
+
+    auto link = read_debuglink(m_elf);
+    if (!link.name.empty()) {
+        std::cout << "debuglink:  " << link.name << " (crc 0x" << std::hex << link.crc << ")" << std::endl;
+    }
+
+    if (!m_debug_file.empty()) {
+        std::cout << "debug info: " << m_debug_file << std::endl;
+    } else if (m_debuginfo_fetch.valid()) {
+        std::cout << "debug info: downloading into " << m_debuginfod.get_cache_path() << std::endl;
+    } else {
+        std::cout << "debug info: <none>" << std::endl;
+    }
+}
+
+
+
+uint64_t debugger::offset_load_address(uint64_t addr) {
+    if (addr >= m_load_address) {
+        return addr - m_load_address;
+    } else {
+        std::cerr << "Addr should greater or equal to m_load_address!";
+    }
+    return -1;
+}
+
+
+uint64_t debugger::offset_dwarf_address(uint64_t addr) {
+    return addr + m_load_address;
+}
+
+
+
+uint64_t debugger::get_current_pc_offset_address() {
+    return offset_load_address(get_pc());
+}
+
+
+
+
+
+
+
+/**
+ * 在指定文件[file_name]中，根据指定行数[line]及其周围上下文行数[n_lines_context]
+ * 打印代码内容，并在指定行号处添加标记，显示当前行
+ */
+void debugger::print_source(const std::string& file_name, uint64_t specify_line) {
+    std::ifstream file {file_name};
+    uint64_t current_line = 0;
+    std::string line;
+
+    while (current_line < specify_line && std::getline(file, line)) {
+        current_line ++;
+    }
+
+    if (current_line == specify_line) {
+        printf("%ld %s\n", current_line, line.c_str());
+    } else {
+        throw std::out_of_range{"print_source(): specify_line is out of range!"};
+    }
+}
+
+
+/**
+ * 通过结构体[siginfo_t]与函数[ptrace]获取信号量的具体信息
+ */ 
+siginfo_t debugger::get_signal_info() {
+    siginfo_t info;
+    ptrace(PTRACE_GETSIGINFO, m_tid, nullptr, &info);
+    return info;
+}
+
+
+/**
+ * @breif: 根据不同的[info.si_signo]执行不同的任务
+ */
+void debugger::handle_sigtrap(siginfo_t info, stop_event& event) {
+    switch (info.si_code) {
+
+        // 当运行到断点处时，会接受到如下信号了
+        case SI_KERNEL:
+        case TRAP_BRKPT: {
+            // put the pc back where it should be
+            // 不是调试器设置的int3（程序自身的int3）时pc保持不变，作为信号报告
+            auto pc = event.pc - 1;
+            if (!m_breakpoints.count(pc)) return;
+            set_pc(pc);
+            event.pc = pc;
+
+            auto number = classify_breakpoint_hit(pc, event);
+            // 内部的临时断点很快会被删除，不转换为硬件断点
+            if (number) promote_hot_breakpoint(pc);
+            return;
+        }
+
+        // 硬件断点是fault，触发时pc指向断点处的指令，不需要回退
+        // 数据断点是trap，触发时写入已经完成
+        case TRAP_HWBKPT: {
+            int slot = m_debug_registers.get_triggered_slot(m_tid);
+            if (slot >= 0 && m_debug_registers.get_condition(slot) != dr_condition::execute) {
+                report_watchpoint_hit(slot);
+                event.reason = stop_reason::watchpoint;
+                return;
+            }
+            if (slot >= 0) {
+                auto addr = m_debug_registers.get_address(slot);
+                event.reason = stop_reason::breakpoint;
+                if (m_breakpoints.count(addr)) classify_breakpoint_hit(addr, event);
+                return;
+            }
+            // 单步与数据断点同时触发时DR6中只有BS位
+            event.reason = stop_reason::single_step;
+            return;
+        }
+
+        // This will be set if the signal was sent by single stepping
+        case TRAP_TRACE:
+            event.reason = stop_reason::single_step;
+            return;
+        default:
+            return;
+    }
+}
+
+
+
+/**
+ * @brief: 用户断点条件成立时是用户可见的停止；否则（内部断点，或单步操作等待的地址上
+ *         条件不满足的用户断点）是内部停止，由单步操作处理；其余情况继续运行。
+ *         返回断点编号。
+ */
+int debugger::classify_breakpoint_hit(std::intptr_t addr, stop_event& event) {
+    auto& bp = m_breakpoints.at(addr);
+    auto number = bp.get_number();
+    // 单步类操作等待的停止只属于进行该操作的线程；线程断点在其他线程中不计数
+    bool stepping_thread = m_step_thread == 0 || event.tid == m_step_thread;
+    auto thread = m_threads.find(event.tid);
+    bool thread_matches = bp.get_thread() == 0
+                          || (thread != m_threads.end() && thread->second.number == bp.get_thread());
+    auto stop = thread_matches && (number || stepping_thread) && handle_breakpoint_hit(addr);
+    event.breakpoint = number;
+    if (number && stop) {
+        event.reason = stop_reason::breakpoint;
+    } else if ((!number || m_step_targets.count(addr)) && stepping_thread) {
+        event.reason = stop_reason::internal;
+        event.breakpoint = 0;
+    } else {
+        // 条件不满足、被忽略或dprintf时由[continue_execution]继续运行
+        event.reason = stop_reason::breakpoint;
+        event.resume = true;
+    }
+    return number;
+}
+
+
+
+/*
+ * @brief: 在不检查当前位置是否有断点的情况下，让子进程单步执行指令。
+ * @note: 本函数与single_step_instruction_with_breakpoint_check函数都是
+ *        指令级操作（instruction)，更加的底层。
+ *        而step_over, step_in, step_out函数都是以代码段为操作，相对来说
+ *        更上层一些。
+ **/
+stop_event debugger::single_step_instruction() {
+    if (m_recording) return recorded_single_step();
+    // PTRACE_SINGLESTEP: single step the process
+    // 因此，当被监视的进程执行完[single step]后，就会向
+    // 父进程发送信号量。所以父进程要调用[wait_for_signal];
+    resume_thread(current_thread(), PTRACE_SINGLESTEP, false);
+    return wait_for_signal();
+}
+
+
+
+/**
+ * @brief: 块单步。断点处的指令先单独执行（位移执行或移除int3），它本身是分支时本块已经结束。
+ *         支持情况在第一次可以判断时确定：从一条非分支指令开始的块停在下一条指令，
+ *         说明BTF被忽略（常见于虚拟机），之后直接单步。
+ */
+stop_event debugger::block_step() {
+    // 记录时按单条指令计数
+    if (m_recording || !m_block_step_enabled || m_block_step_support == block_step_support::unsupported) {
+        return single_step_instruction_with_breakpoint_check();
+    }
+
+    while (true) {
+        auto pc = get_pc();
+        auto decoded = decode_instruction(pc);
+        bool straight = decoded != nullptr && decoded->branch == x86_branch::none;
+        std::uintptr_t next = straight ? pc + decoded->length : 0;
+
+        if (step_over_breakpoint()) {
+            if (m_last_stop.reason != stop_reason::single_step || !straight) return m_last_stop;
+            continue;
+        }
+
+        if (!resume_thread(current_thread(), PTRACE_SINGLEBLOCK, true)) {
+            m_block_step_support = block_step_support::unsupported;
+            return single_step_instruction();
+        }
+        auto event = wait_for_signal();
+
+        if (m_block_step_support == block_step_support::unknown && straight
+            && event.reason == stop_reason::single_step) {
+            if (event.pc == next) m_block_step_support = block_step_support::unsupported;
+            else if (event.pc != pc) m_block_step_support = block_step_support::supported;
+        }
+        if (!event.resume) return event;
+    }
+}
+
+
+
+/**
+ * @brief: 每次块单步停下时解码得到发生跳转的分支指令；退化为单步时顺序执行的停止不记录，
+ *         [n]仍按记录到的分支计数
+ */
+stop_event debugger::record_branches(std::size_t n) {
+    using clock = std::chrono::steady_clock;
+    auto decode = [this](std::uintptr_t addr) { return decode_instruction(addr); };
+
+    auto start_time = clock::now();
+    std::uintptr_t start = get_pc();
+    std::size_t recorded = 0, stops = 0;
+    stop_event event = m_last_stop;
+    while (recorded < n) {
+        event = block_step();
+        if (event.reason != stop_reason::single_step) break;
+        stops++;
+        auto from = find_branch_source(start, event.pc, decode);
+        if (from != 0) {
+            m_branch_trace.record(from, event.pc);
+            recorded++;
+        }
+        start = event.pc;
+    }
+
+    auto ms = std::chrono::duration<double, std::milli>(clock::now() - start_time).count();
+    std::cout << "Recorded " << std::dec << recorded << " branches in " << stops << " stops, "
+              << ms << " ms ("
+              << (m_block_step_support == block_step_support::supported ? "block-step" : "single-step")
+              << ")" << std::endl;
+    return event;
+}
+
+
+
+void debugger::print_branch_trace(std::size_t n) {
+    auto records = m_branch_trace.last(n);
+    if (records.empty()) {
+        std::cout << "No branches recorded." << std::endl;
+        return;
+    }
+
+    auto describe = [this](std::uintptr_t addr) {
+        std::stringstream ss;
+        ss << "0x" << std::hex << addr;
+        function_symbol func;
+        if (addr != 0 && symbolize_pc(addr, func)) ss << " <" << func.name << "+" << std::dec << addr - func.low_pc << ">";
+        return ss.str();
+    };
+    auto index = m_branch_trace.get_total() - records.size();
+    for (const auto& record : records) {
+        std::cout << "#" << std::dec << index++ << "  "
+                  << (record.from ? describe(record.from) : std::string{"?"}) << " -> "
+                  << describe(record.to) << std::endl;
+    }
+}
+
+
+
+/*
+ * 在检查当前位置是否为断点，随后让子进程单步执行
+ **/
+stop_event debugger::single_step_instruction_with_breakpoint_check() {
+    // 运行到断点出，如要继续单步执行需要step over断点
+    if (step_over_breakpoint()) return m_last_stop;
+    return single_step_instruction();
+}
+
+
+
+
+/**
+ * @brief: 通过CFI回溯得到调用者：返回地址为第1帧的pc，返回后rsp等于第0帧的CFA。
+ *         递归调用中更深的栈帧返回到同一地址时rsp低于CFA，继续运行。
+ */
+stop_event debugger::step_out() {
+    auto frames = unwind_stack(2);
+    if (frames.size() < 2) {
+        throw std::runtime_error{"\"finish\" not meaningful in the outermost frame."};
+    }
+    auto return_address = frames[1].pc;
+    auto cfa = frames[0].cfa;
+
+    // 临时断点不分配编号；地址上已有用户断点时只登记
+    std::vector<std::intptr_t> planted;
+    add_step_target(return_address, planted);
+    m_breakpoints.flush();
+
+    stop_event event;
+    do {
+        event = continue_execution();
+    } while (event.reason == stop_reason::internal && event.pc == return_address
+             && get_current_register(reg_x86_64::rsp) < cfa);
+
+    clear_step_targets(planted, event.reason == stop_reason::exited);
+    return event;
+}
+
+
+
+/** 
+ * @brief: 单步步进(逐语句)
+ *         一直调用[single_step_instruction]，直到代码运行到新的一行
+ * 
+ **/
+stop_event debugger::step_in() {
+    // 当前行的地址范围只计算一次，每次停下只需比较停止事件中的pc
+    // 没有行号信息的代码（libc等）只执行一条指令
+    line_range range;
+    bool has_line = get_line_range(get_pc(), range);
+    std::uintptr_t pc = get_pc();
+
+    // 块单步只在发生跳转的分支后停下，顺序执行离开本行时不会停，
+    // 因此在每段地址范围的结束处设置临时断点
+    std::vector<std::intptr_t> planted;
+    if (has_line) {
+        for (const auto& [start, end] : range.ranges) add_step_target(end, planted);
+        m_breakpoints.flush();
+    }
+
+    // [ret]之前的指令是本行（或没有行号时当前指令）中的call
+    auto returns_from_call = [&](std::uintptr_t ret) {
+        auto scan = [&](std::uintptr_t addr, std::uintptr_t end) {
+            while (addr < end) {
+                auto insn = decode_instruction(addr);
+                if (insn == nullptr) return false;
+                auto next = addr + insn->length;
+                if (next == ret) {
+                    return insn->branch == x86_branch::call || insn->branch == x86_branch::indirect_call;
+                }
+                addr = next;
+            }
+            return false;
+        };
+        if (!has_line) return scan(pc, pc + 1);
+        for (const auto& [start, end] : range.ranges) {
+            if (ret > start && ret <= end && scan(start, end)) return true;
+        }
+        return false;
+    };
+
+    stop_event event;
+    while (true) {
+        // 单步之外的停止（断点、数据断点、信号、退出）直接返回
+        event = has_line ? block_step() : single_step_instruction_with_breakpoint_check();
+        if (event.reason != stop_reason::single_step && event.reason != stop_reason::internal) break;
+
+        // call进入没有行号信息或被skip的代码（PLT、libc、动态链接器）时不逐条执行，
+        // 在返回地址设置一个临时断点后运行，栈指针回到call之前的值才算返回
+        if (event.reason == stop_reason::single_step && !(has_line && range.contains(event.pc))) {
+            auto sp = get_current_register(reg_x86_64::rsp);
+            std::uintptr_t ret = read_memory(sp);
+            if (returns_from_call(ret) && is_step_skipped(event.pc)) {
+                add_step_target(ret, planted);
+                m_breakpoints.flush();
+                do {
+                    event = continue_execution();
+                } while (event.reason == stop_reason::internal
+                         && !(event.pc == ret && get_current_register(reg_x86_64::rsp) > sp));
+                if (event.reason != stop_reason::internal) break;
+            }
+        }
+
+        if (!has_line || !range.contains(event.pc)) break;
+    }
+
+    clear_step_targets(planted, event.reason == stop_reason::exited);
+    return event;
+}
+
+
+
+/**
+ * @brief: 依次检查：行号信息、skip file（完整路径或文件名）、
+ *         skip function（符号化得到的函数名）、skip library（完整路径或文件名）
+ */
+bool debugger::is_step_skipped(uint64_t pc) {
+    line_range range;
+    if (!get_line_range(pc, range)) return true;
+    if (m_skips.empty()) return false;
+
+    auto matches = [](const skip_entry& skip, const std::string& path) {
+        auto slash = path.rfind('/');
+        return std::regex_match(path, skip.re)
+            || (slash != std::string::npos && std::regex_match(path.substr(slash + 1), skip.re));
+    };
+
+    function_symbol func;
+    bool has_func = false, func_resolved = false;
+    for (const auto& skip : m_skips) {
+        switch (skip.kind) {
+        case skip_kind::file:
+            if (matches(skip, range.file)) return true;
+            break;
+        case skip_kind::function:
+            if (!func_resolved) {
+                has_func = symbolize_pc(pc, func);
+                func_resolved = true;
+            }
+            if (has_func && std::regex_match(func.name, skip.re)) return true;
+            break;
+        case skip_kind::library:
+            if (auto so = find_shared_object(pc); so != nullptr && matches(skip, so->path)) return true;
+            break;
+        }
+    }
+    return false;
+}
+
+
+
+void debugger::add_skip(skip_kind kind, const std::string& pattern) {
+    m_skips.push_back(skip_entry{m_next_skip_number++, kind, pattern, glob_to_regex(pattern)});
+    std::cout << "Skip " << m_skips.back().number << ": " << pattern << std::endl;
+}
+
+
+
+void debugger::remove_skip(int number) {
+    if (number == 0) {
+        m_skips.clear();
+        return;
+    }
+    auto it = std::find_if(m_skips.begin(), m_skips.end(),
+                           [number](const skip_entry& skip) { return skip.number == number; });
+    if (it == m_skips.end()) {
+        std::cerr << "No skip number " << number << std::endl;
+        return;
+    }
+    m_skips.erase(it);
+}
+
+
+
+void debugger::print_skips() {
+    if (m_skips.empty()) {
+        std::cout << "No skips." << std::endl;
+        return;
+    }
+    static const char* kinds[] = {"file", "function", "library"};
+    std::cout << "Num  Type      Pattern" << std::endl;
+    for (const auto& skip : m_skips) {
+        std::cout << std::left << std::setw(5) << skip.number
+                  << std::setw(10) << kinds[static_cast<int>(skip.kind)]
+                  << skip.pattern << std::right << std::endl;
+    }
+}
+
+
+
+
+/**
+ * @brief: 检查点中的代码必须与原程序一致：快照里的int3被恢复，重新启动时按当时的断点重新写入。
+ *         tracepoint的跳转与页保护断点修改了代码或页权限，有它们时不支持检查点。
+ */
+void debugger::create_checkpoint() {
+    if (m_last_stop.reason == stop_reason::exited) {
+        std::cerr << "The program is not being run." << std::endl;
+        return;
+    }
+    if (!m_tracepoints.get_tracepoints().empty() || !m_page_watchpoints.empty()) {
+        std::cerr << "Delete fast tracepoints and page watchpoints before taking a checkpoint." << std::endl;
+        return;
+    }
+    // fork出的进程中只有调用fork的线程
+    if (m_threads.size() > 1) {
+        std::cerr << "Checkpoints support single-threaded programs only." << std::endl;
+        return;
+    }
+    try {
+        auto pid = inject_fork(m_tid, g_ptrace_options);
+        m_breakpoints.write_original_code(pid);
+        m_checkpoints.push_back(checkpoint{m_next_checkpoint_id++, pid, get_pc()});
+        std::cout << "Checkpoint " << m_checkpoints.back().id << ": fork returned pid " << pid << "." << std::endl;
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+    }
+}
+
+
+
+void debugger::restart_checkpoint(int id) {
+    auto it = std::find_if(m_checkpoints.begin(), m_checkpoints.end(),
+                           [id](const checkpoint& c) { return c.id == id; });
+    if (it == m_checkpoints.end()) {
+        std::cerr << "No checkpoint number " << id << "." << std::endl;
+        return;
+    }
+    if (!m_tracepoints.get_tracepoints().empty() || !m_page_watchpoints.empty()) {
+        std::cerr << "Delete fast tracepoints and page watchpoints before restarting a checkpoint." << std::endl;
+        return;
+    }
+    // 检查点不在记录的历史中
+    if (m_recording) stop_recording();
+
+    pid_t pid;
+    try {
+        pid = inject_fork(it->pid, g_ptrace_options);
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return;
+    }
+    // 检查点（CLONE_PARENT）是调试器的子进程，结束当前进程不影响它们，仍由调试器跟踪与回收
+    if (m_last_stop.reason != stop_reason::exited) kill_inferior();
+    switch_process(pid);
+    m_last_stop = stop_event{stop_reason::signal, pid, it->pc, 0, 0, false};
+    std::cout << "Switching to process " << pid << " (checkpoint " << id << ")" << std::endl;
+    print_current_location();
+}
+
+
+
+void debugger::switch_process(pid_t pid) {
+    m_pid = pid;
+    m_tid = pid;
+    m_threads.clear();
+    m_next_thread_number = 1;
+    m_breakpoints.rearm(pid);
+    m_debug_registers.set_pid(pid);
+    add_thread(pid, false);
+    m_reported_tid = pid;
+    m_displaced.set_pid(pid);
+    m_tracepoints.set_pid(pid);
+    m_decode_cache.clear();
+    m_step_targets.clear();
+    m_step_thread = 0;
+    invalidate_frames();
+}
+
+
+
+void debugger::kill_inferior() {
+    kill(m_pid, SIGKILL);
+    int status;
+    for (const auto& [tid, thread] : m_threads) {
+        if (tid != m_pid) waitpid(tid, &status, __WALL);
+    }
+    waitpid(m_pid, &status, __WALL);
+}
+
+
+
+void debugger::delete_checkpoint(int id) {
+    auto it = std::find_if(m_checkpoints.begin(), m_checkpoints.end(),
+                           [id](const checkpoint& c) { return c.id == id; });
+    if (it == m_checkpoints.end()) {
+        std::cerr << "No checkpoint number " << id << "." << std::endl;
+        return;
+    }
+    kill(it->pid, SIGKILL);
+    int status;
+    waitpid(it->pid, &status, __WALL);
+    m_checkpoints.erase(it);
+}
+
+
+
+void debugger::print_checkpoints() {
+    if (m_checkpoints.empty()) {
+        std::cout << "No checkpoints." << std::endl;
+        return;
+    }
+    std::cout << "Id   Pid      Location" << std::endl;
+    for (const auto& c : m_checkpoints) {
+        std::cout << std::left << std::setw(5) << c.id << std::setw(9) << c.pid << std::right
+                  << "0x" << std::hex << c.pc << std::dec;
+        function_symbol func;
+        if (symbolize_pc(c.pc, func)) std::cout << " in " << func.name << "+" << c.pc - func.low_pc;
+        std::cout << std::endl;
+    }
+}
+
+
+
+
+// 结束一个被跟踪的进程（重放起点或被替换的进程）并回收
+static void kill_traced_process(pid_t pid) {
+    kill(pid, SIGKILL);
+    int status;
+    waitpid(pid, &status, __WALL);
+}
+
+
+
+/**
+ * @brief: 记录从当前位置开始：第0个重放起点是当前进程的fork。之后的执行逐条单步并计数，
+ *         tracepoint的跳转与页保护断点修改了代码或页权限，记录时不支持它们。
+ *         只支持单线程程序；异步信号与rdtsc等不经过系统调用的不确定性不被记录。
+ */
+void debugger::start_recording() {
+    if (m_last_stop.reason == stop_reason::exited) {
+        std::cerr << "The program is not being run." << std::endl;
+        return;
+    }
+    if (m_recording) {
+        std::cerr << "The process is already being recorded." << std::endl;
+        return;
+    }
+    if (!m_tracepoints.get_tracepoints().empty() || !m_page_watchpoints.empty()) {
+        std::cerr << "Delete fast tracepoints and page watchpoints before recording." << std::endl;
+        return;
+    }
+    // 指令数与重放起点（fork）都只对单线程有意义
+    if (m_threads.size() > 1) {
+        std::cerr << "Recording supports single-threaded programs only." << std::endl;
+        return;
+    }
+    // vDSO中的时间函数改为系统调用，才能被记录并确定地重放；记录停止后仍保持改写
+    if (patch_vdso(m_tid) > 0) {
+        m_decode_cache.clear();
+        m_cfgs.clear();
+    }
+    m_exec_log.clear();
+    m_icount = 0;
+    if (!add_replay_point()) return;
+    m_recording = true;
+    std::cout << "Recording from 0x" << std::hex << get_pc() << std::dec << "." << std::endl;
+}
+
+
+
+void debugger::stop_recording() {
+    if (!m_recording) {
+        std::cerr << "The process is not being recorded." << std::endl;
+        return;
+    }
+    for (const auto& point : m_exec_log.get_points()) kill_traced_process(point.pid);
+    m_exec_log.clear();
+    m_recording = false;
+    m_icount = 0;
+    std::cout << "Recording stopped, execution log deleted." << std::endl;
+}
+
+
+
+void debugger::print_record_status() {
+    if (!m_recording) {
+        std::cout << "The process is not being recorded." << std::endl;
+        return;
+    }
+    std::cout << "Recorded " << std::dec << m_exec_log.get_end() << " instructions, current position "
+              << m_icount << std::endl
+              << m_exec_log.get_points().size() << " replay points, " << m_exec_log.get_syscall_count()
+              << " system calls logged" << std::endl
+              << "Step rate " << static_cast<uint64_t>(m_exec_log.get_rate()) << "/s, replay point every "
+              << m_exec_log.checkpoint_interval() << " instructions (latency bound "
+              << m_exec_log.get_latency_bound().count() << " ms)" << std::endl;
+}
+
+
+
+bool debugger::add_replay_point() {
+    // 重放起点太多时，较早的一半隔一个删掉
+    constexpr std::size_t max_replay_points = 64;
+    try {
+        auto pid = inject_fork(m_tid, g_ptrace_options);
+        m_breakpoints.write_original_code(pid);
+        m_exec_log.add_point(replay_point{m_icount, pid});
+    } catch (std::exception& e) {
+        std::cerr << "Can't create a replay point: " << e.what() << std::endl;
+        return false;
+    }
+    for (auto pid : m_exec_log.thin(max_replay_points)) kill_traced_process(pid);
+    return true;
+}
+
+
+
+/**
+ * @brief: 指令数只在指令真正执行完时增加：信号、硬件断点的fault与退出不计数。
+ *         历史的末尾执行的系统调用被记录（单步越过syscall后读取返回值与内核写入的内存）；
+ *         回到过去后再向前执行时，除了改变地址空间等必须真正执行的调用，都按日志模拟
+ */
+stop_event debugger::recorded_single_step() {
+    auto pc = get_pc();
+    auto insn = decode_instruction(pc);
+    bool at_syscall = insn != nullptr && insn->branch == x86_branch::syscall
+                      && read_original_code(pc, 2) == std::vector<uint8_t>{0x0f, 0x05};
+    user_regs_struct before;
+    if (at_syscall) ptrace(PTRACE_GETREGS, m_tid, nullptr, &before);
+    bool at_end = m_icount >= m_exec_log.get_end();
+
+    stop_event event;
+    auto logged = at_syscall && !at_end ? m_exec_log.find_syscall(m_icount) : nullptr;
+    if (logged && !syscall_replays_natively(logged->nr)) {
+        apply_syscall_record(m_tid, *logged);
+        invalidate_current_regs();
+        invalidate_frames();
+        event = stop_event{stop_reason::single_step, m_tid, get_pc(), 0, 0, false};
+        m_last_stop = event;
+    } else {
+        resume_thread(current_thread(), PTRACE_SINGLESTEP, false);
+        event = wait_for_signal();
+        if (at_syscall && event.reason == stop_reason::signal && event.signal == SIGTRAP && event.pc == pc + 2) {
+            // 单步越过syscall时内核以TRAP_BRKPT报告
+            event.reason = stop_reason::single_step;
+            m_last_stop = event;
+        }
+    }
+    if (event.reason != stop_reason::single_step && event.reason != stop_reason::watchpoint) return event;
+    // 这条指令创建了线程，记录已经停止
+    if (!m_recording) return event;
+
+    if (at_syscall && at_end) {
+        user_regs_struct after;
+        ptrace(PTRACE_GETREGS, m_tid, nullptr, &after);
+        syscall_record record {before.rax, static_cast<int64_t>(after.rax), {}};
+        if (!syscall_replays_natively(record.nr)) {
+            uint64_t args[6] = {before.rdi, before.rsi, before.rdx, before.r10, before.r8, before.r9};
+            auto read = [this](std::uintptr_t addr, void* buf, std::size_t len) {
+                iovec local {buf, len};
+                iovec remote {reinterpret_cast<void*>(addr), len};
+                return process_vm_readv(m_pid, &local, 1, &remote, 1, 0) == (ssize_t)len;
+            };
+            for (const auto& [addr, len] : syscall_output_regions(record.nr, args, record.result, read)) {
+                record.writes.push_back(memory_write{addr, read_memory_block(addr, len)});
+            }
+        }
+        // 必须真正执行的调用也记下返回值，重放时用于检查是否一致
+        m_exec_log.add_syscall(m_icount, std::move(record));
+    }
+
+    m_icount++;
+    if (m_icount > m_exec_log.get_end()) {
+        m_exec_log.set_end(m_icount);
+        if (m_icount - m_exec_log.get_points().back().icount >= m_exec_log.checkpoint_interval()) add_replay_point();
+    }
+    return event;
+}
+
+
+
+/**
+ * @brief: 断点处的int3不会被执行：每一步之后检查新的pc上是否有启用的断点或硬件断点，
+ *         按命中处理（条件、ignore计数与内部断点）
+ */
+stop_event debugger::recorded_continue() {
+    using clock = std::chrono::steady_clock;
+    auto start_time = clock::now();
+    auto start = m_icount;
+
+    stop_event event;
+    while (true) {
+        event = single_step_instruction_with_breakpoint_check();
+        if (event.reason != stop_reason::single_step) break;
+
+        auto pc = event.pc;
+        if (m_hw_breakpoints.count(pc)) {
+            event.reason = stop_reason::breakpoint;
+            if (m_breakpoints.count(pc)) classify_breakpoint_hit(pc, event);
+        } else if (m_breakpoints.count(pc) && m_breakpoints.at(pc).is_enabled()) {
+            classify_breakpoint_hit(pc, event);
+        } else {
+            continue;
+        }
+        m_last_stop = event;
+        if (!event.resume) break;
+    }
+    m_exec_log.update_rate(m_icount - start, clock::now() - start_time);
+    return event;
+}
+
+
+
+/**
+ * @brief: 重放起点中没有int3与调试寄存器，直接用ptrace单步；记录过的系统调用按日志模拟，
+ *         必须真正执行的调用检查其返回值与记录的是否相同
+ */
+pid_t debugger::replay_from(const replay_point& point, uint64_t target,
+                            const std::function<void(uint64_t, pid_t, const user_regs_struct&)>& visit) {
+    using clock = std::chrono::steady_clock;
+    auto start_time = clock::now();
+    auto pid = inject_fork(point.pid, g_ptrace_options);
+    auto diverged = [pid](uint64_t icount, const std::string& why) {
+        kill_traced_process(pid);
+        throw std::runtime_error{"Replay diverged at instruction " + std::to_string(icount) + ": " + why};
+    };
+
+    user_regs_struct regs;
+    for (auto icount = point.icount; icount < target; icount++) {
+        auto logged = m_exec_log.find_syscall(icount);
+        if (visit || logged) ptrace(PTRACE_GETREGS, pid, nullptr, &regs);
+        if (visit) visit(icount, pid, regs);
+        if (logged && regs.rax != logged->nr) diverged(icount, "expected system call " + std::to_string(logged->nr));
+        if (logged && !syscall_replays_natively(logged->nr)) {
+            apply_syscall_record(pid, *logged);
+            continue;
+        }
+
+        int status;
+        ptrace(PTRACE_SINGLESTEP, pid, nullptr, nullptr);
+        waitpid(pid, &status, __WALL);
+        if (!WIFSTOPPED(status)) diverged(icount, "process exited");
+        if (WSTOPSIG(status) != SIGTRAP) diverged(icount, strsignal(WSTOPSIG(status)));
+        if (logged) {
+            ptrace(PTRACE_GETREGS, pid, nullptr, &regs);
+            if (static_cast<int64_t>(regs.rax) != logged->result) diverged(icount, "system call returned a different value");
+        }
+    }
+    m_exec_log.update_rate(target - point.icount, clock::now() - start_time);
+    return pid;
+}
+
+
+
+void debugger::goto_instruction(uint64_t icount) {
+    switch_to_replay(replay_from(*m_exec_log.find_point(icount), icount, nullptr), icount);
+}
+
+
+
+void debugger::switch_to_replay(pid_t pid, uint64_t icount) {
+    if (m_last_stop.reason != stop_reason::exited) kill_inferior();
+    switch_process(pid);
+    m_icount = icount;
+    m_last_stop = stop_event{stop_reason::single_step, pid, get_pc(), 0, 0, false};
+}
+
+
+
+stop_event debugger::reverse_stepi() {
+    if (m_icount == 0) {
+        std::cout << "No more reverse-execution history." << std::endl;
+        return m_last_stop;
+    }
+    goto_instruction(m_icount - 1);
+    return m_last_stop;
+}
+
+
+
+/**
+ * @brief: 从当前位置向前一段一段地重放（每段从一个重放起点到上一段的开始），记录每条指令的pc与CFA，
+ *         再从后向前扫描：CFA更小（或未知）的是被调用的函数，跳过；同一帧中仍在当前行的位置也跳过，
+ *         并记下最早的一个。遇到同一帧的其他行（或CFA更大，即回到了调用者）时：
+ *         已经记下了当前行的位置则停在那里，否则当前位置就是行首，改为在那一行中继续找它最早的位置。
+ */
+stop_event debugger::reverse_next() {
+    user_regs_struct regs;
+    ptrace(PTRACE_GETREGS, m_tid, nullptr, &regs);
+    auto frame = m_unwinder.frame_cfa(regs);
+    line_range line;
+    if (frame == 0 || !get_line_range(regs.rip, line)) return reverse_stepi();
+
+    struct position {
+        uint64_t icount;
+        std::uintptr_t pc;
+        uint64_t cfa;
+    };
+    std::vector<position> window;
+    bool found = false, done = false;
+    uint64_t target = 0;
+    auto end = m_icount;
+    while (!done && end > 0) {
+        auto point = *m_exec_log.find_point(end - 1);
+        window.clear();
+        kill_traced_process(replay_from(point, end, [&](uint64_t icount, pid_t, const user_regs_struct& r) {
+            window.push_back(position{icount, r.rip, m_unwinder.frame_cfa(r)});
+        }));
+
+        for (auto it = window.rbegin(); it != window.rend(); ++it) {
+            if (it->cfa == 0 || it->cfa < frame) continue;
+            if (it->cfa == frame && line.contains(it->pc)) {
+                target = it->icount;
+                found = true;
+                continue;
+            }
+            if (found) {
+                done = true;
+                break;
+            }
+            frame = it->cfa;
+            target = it->icount;
+            found = true;
+            if (!get_line_range(it->pc, line)) {
+                done = true;
+                break;
+            }
+        }
+        end = point.icount;
+    }
+
+    if (!found) {
+        std::cout << "No more reverse-execution history." << std::endl;
+        goto_instruction(0);
+        return m_last_stop;
+    }
+    if (!done) std::cout << "No more reverse-execution history." << std::endl;
+    goto_instruction(target);
+    return m_last_stop;
+}
+
+
+
+/**
+ * @brief: 一段一段地向前重放，找到当前位置之前最后一次停在用户断点（软件或硬件）上的位置；
+ *         断点的条件不求值
+ */
+stop_event debugger::reverse_continue() {
+    auto end = m_icount;
+    while (end > 0) {
+        auto point = *m_exec_log.find_point(end - 1);
+        uint64_t hit = 0;
+        bool found = false;
+        kill_traced_process(replay_from(point, end, [&](uint64_t icount, pid_t, const user_regs_struct& regs) {
+            auto it = m_breakpoints.find(regs.rip);
+            bool user_bp = it != m_breakpoints.end() && it->second.get_number() != 0 && it->second.is_enabled();
+            if (user_bp || m_hw_breakpoints.count(regs.rip)) {
+                hit = icount;
+                found = true;
+            }
+        }));
+
+        if (found) {
+            goto_instruction(hit);
+            auto pc = m_last_stop.pc;
+            m_last_stop.reason = stop_reason::breakpoint;
+            m_last_stop.breakpoint = m_breakpoints.count(pc) ? m_breakpoints.at(pc).get_number() : 0;
+            return m_last_stop;
+        }
+        end = point.icount;
+    }
+
+    std::cout << "No more reverse-execution history." << std::endl;
+    goto_instruction(0);
+    return m_last_stop;
+}
+
+
+
+
+/**
+ * @brief: 表达式中的局部变量按选中栈帧现在的地址固定下来（与watch -location相同），
+ *         全局变量、指针解引用与寄存器在每个位置重新读取；读取失败视为不成立。
+ *         1. 探测当前位置之前的每个重放起点（只需fork，不需要单步），得到条件在各起点上的值。
+ *            某个起点成立而之后的起点又不成立时，条件在历史中多次变化
+ *         2. 默认：在最后一个不成立的起点之后的一段中二分，得到当前位置之前最近的一次变化，
+ *            条件多次变化时打印提示；
+ *            [first]：从第一个成立的起点之前的一段的起点逐条执行，得到该段中第一条使条件成立的指令。
+ *            在两个都不成立的起点之间短暂成立又恢复的变化看不到
+ */
+void debugger::bisect(const std::string& text, bool first) {
+    if (!m_recording) {
+        std::cerr << "Target is not being recorded; use \"record\" first." << std::endl;
+        return;
+    }
+    using clock = std::chrono::steady_clock;
+    auto start_time = clock::now();
+
+    auto pc = get_frame_pc_offset_address();
+    auto frame_context = make_frame_context();
+    auto resolver = [&](const std::string& name, variable_info& var) {
+        if (!resolve_variable(pc, name, var)) return false;
+        switch (var.location) {
+            case variable_info::kind::absolute:
+                break;
+            case variable_info::kind::reg_relative:
+                var.offset = frame_context.get_reg(var.reg) + var.offset;
+                break;
+            case variable_info::kind::in_register:
+                throw std::invalid_argument{name + " is kept in a register, bisect needs a memory location"};
+            case variable_info::kind::dwarf_expr: {
+                auto result = var.expr->evaluate(&frame_context);
+                if (result.location_type != dwarf::expr_result::type::address) {
+                    throw std::invalid_argument{name + " is kept in a register, bisect needs a memory location"};
+                }
+                var.offset = result.value;
+                var.expr.reset();
+                break;
+            }
+        }
+        var.location = variable_info::kind::absolute;
+        return true;
+    };
+    auto expr = compiled_expr::compile(text, resolver);
+
+    auto holds = [&expr](pid_t pid) {
+        try {
+            expr_eval_context context {pid};
+            return expr.evaluate(context) != 0;
+        } catch (std::exception&) {
+            return false;
+        }
+    };
+    std::size_t probes = 0;
+    // 第[icount]条指令执行之前条件是否成立
+    auto probe = [&](uint64_t icount) {
+        probes++;
+        auto pid = replay_from(*m_exec_log.find_point(icount), icount, nullptr);
+        bool result = holds(pid);
+        kill_traced_process(pid);
+        return result;
+    };
+
+    if (!holds(m_tid)) {
+        std::cout << "Condition '" << text << "' does not hold at the current position." << std::endl;
+        return;
+    }
+    if (probe(0)) {
+        std::cout << "Condition '" << text << "' already holds at the start of the recording." << std::endl;
+        return;
+    }
+
+    // 1. 当前位置之前的重放起点。第0个起点是记录的开始，已知不成立
+    const auto& points = m_exec_log.get_points();
+    std::size_t n = 0;
+    while (n < points.size() && points[n].icount <= m_icount) n++;
+    std::vector<bool> results(n, false);
+    for (std::size_t i = 1; i < n; i++) results[i] = probe(points[i].icount);
+
+    std::size_t first_true = n, last_false = 0;
+    for (std::size_t i = 0; i < n; i++) {
+        if (results[i] && first_true == n) first_true = i;
+        if (!results[i]) last_false = i;
+    }
+    bool monotonic = first_true > last_false;
+
+    // 2. 一段之内查找。不变式: [lo]处不成立，[hi]处成立
+    auto a = first ? first_true - 1 : last_false;
+    uint64_t lo = points[a].icount;
+    uint64_t hi = a + 1 < n ? points[a + 1].icount : m_icount;
+    if (first) {
+        // 逐条执行该段，每条指令之前求值；条件只在段的终点成立时[hi]不变
+        probes++;
+        uint64_t found = hi;
+        kill_traced_process(replay_from(points[a], hi, [&](uint64_t icount, pid_t pid, const user_regs_struct& regs) {
+            if (found != hi || icount == lo) return;
+            try {
+                expr_eval_context context {pid, regs, 0};
+                if (expr.evaluate(context) != 0) found = icount;
+            } catch (std::exception&) {}
+        }));
+        hi = found;
+        lo = hi - 1;
+    }
+    while (hi - lo > 1) {
+        auto mid = lo + (hi - lo) / 2;
+        if (probe(mid)) hi = mid;
+        else lo = mid;
+    }
+
+    // 重放到变化之后，经过的最后一条指令使条件成立
+    std::uintptr_t changed_by = 0;
+    auto pid = replay_from(*m_exec_log.find_point(lo), hi, [&changed_by](uint64_t, pid_t, const user_regs_struct& regs) {
+        changed_by = regs.rip;
+    });
+    switch_to_replay(pid, hi);
+
+    auto ms = std::chrono::duration<double, std::milli>(clock::now() - start_time).count();
+    std::cout << "Condition '" << text << "' became true at instruction " << std::dec << hi
+              << " (" << probes << " probes, " << ms << " ms)." << std::endl;
+    std::cout << "Changed by the instruction at 0x" << std::hex << changed_by;
+    function_symbol func;
+    if (symbolize_pc(changed_by, func)) std::cout << " in " << func.name << "+0x" << changed_by - func.low_pc;
+    std::cout << std::dec << std::endl;
+    if (!monotonic && !first) {
+        std::cout << "Note: the condition changed more than once: it held at instruction " << points[first_true].icount
+                  << " and was false again at " << points[last_false].icount
+                  << ". This is the latest change; use \"bisect first\" for the earliest." << std::endl;
+    }
+    print_current_location();
+    print_backtrace();
+}
+
+
+
+
+/**
+ * @brief: 逐过程调试。遇到子函数时会执行子函数，但是不会进入子函数内部
+ *         而是直接返回。
+ *         只解码当前行的地址范围，不再在整个函数的每一行设置断点：
+ *           1. 直线代码：向前解码到下一条控制流指令（或本行结束），在该处设置临时断点后运行
+ *           2. call：只在返回地址设置一个临时断点，rsp回到调用前的值才算返回
+ *              （递归调用中更深的栈帧也会经过该地址）
+ *           3. jmp/jcc/ret/syscall：单步执行，离开本行的范围即停止
+ *         临时断点在同一次next中可以反复使用（例如循环），结束时一起删除。
+ **/
+stop_event debugger::step_over() {
+    // 当前位置没有行号信息（libc或被strip的代码），退化为指令级的逐过程
+    line_range range;
+    if (!get_line_range(get_pc(), range)) return step_over_instruction();
+
+    std::vector<std::intptr_t> planted;
+    auto plant = [&](std::intptr_t addr) {
+        add_step_target(addr, planted);
+        m_breakpoints.flush();
+    };
+
+    stop_event event = m_last_stop;
+    std::uintptr_t pc = get_pc();
+    while (true) {
+        auto decoded = decode_instruction(pc);
+        auto branch = decoded ? decoded->branch : x86_branch::none;
+        std::uintptr_t next_pc = decoded ? pc + decoded->length : 0;
+
+        if (decoded == nullptr) {
+            event = single_step_instruction_with_breakpoint_check();
+        } else if (branch == x86_branch::call || branch == x86_branch::indirect_call) {
+            auto return_address = next_pc;
+            auto sp = get_current_register(reg_x86_64::rsp);
+            plant(return_address);
+            do {
+                event = continue_execution();
+            } while (event.reason == stop_reason::internal
+                     && !(event.pc == return_address && get_current_register(reg_x86_64::rsp) >= sp));
+        } else if (branch == x86_branch::none) {
+            // 找到直线代码的终点：本行中的下一条控制流指令，或本行的结束地址
+            // 函数的控制流图已缓存时直接在其指令表上扫描
+            auto target = pc;
+            auto cfg = get_function_cfg(pc);
+            auto index = cfg ? cfg->find_insn(pc) : -1;
+            if (index >= 0) {
+                const auto& insns = cfg->get_insns();
+                while ((std::size_t)index < insns.size() && range.contains(insns[index].addr)
+                       && insns[index].decoded && insns[index].insn.branch == x86_branch::none) {
+                    index++;
+                }
+                target = (std::size_t)index < insns.size() ? insns[index].addr : cfg->get_high();
+            } else {
+                while (range.contains(target)) {
+                    auto insn = decode_instruction(target);
+                    if (insn == nullptr || insn->branch != x86_branch::none) break;
+                    target += insn->length;
+                }
+            }
+            if (target == next_pc) {
+                event = single_step_instruction_with_breakpoint_check();
+            } else {
+                plant(target);
+                event = continue_execution();
+            }
+        } else {
+            event = single_step_instruction_with_breakpoint_check();
+        }
+
+        // 断点、数据断点、信号或退出交给用户
+        if (event.reason != stop_reason::single_step && event.reason != stop_reason::internal) break;
+        pc = event.pc;
+        if (!range.contains(pc)) break;
+    }
+
+    clear_step_targets(planted, event.reason == stop_reason::exited);
+    return event;
+}
+
+
+
+void debugger::add_step_target(std::intptr_t addr, std::vector<std::intptr_t>& planted) {
+    m_step_targets.insert(addr);
+    m_step_thread = m_tid;
+    if (!m_breakpoints.count(addr)) {
+        m_breakpoints.add(addr);
+        planted.push_back(addr);
+    }
+}
+
+
+
+void debugger::clear_step_targets(const std::vector<std::intptr_t>& planted, bool exited) {
+    m_step_targets.clear();
+    m_step_thread = 0;
+    if (exited) return;
+    for (auto addr : planted) {
+        m_breakpoints.remove(addr);
+    }
+    m_breakpoints.flush();
+}
+
+
+
+
+
+std::vector<symbol> debugger::lookup_symbol(const std::string& name) {
+    std::vector<symbol> syms;
+    for (auto &sec : m_elf.sections()) {
+        if (sec.get_hdr().type != elf::sht::symtab && sec.get_hdr().type != elf::sht::dynsym)
+            continue;
+
+        for (auto sym : sec.as_symtab()) {
+            if (sym.get_name() == name) {
+                auto &d = sym.get_data();
+                syms.push_back(symbol{to_symbol_type(d.type()), sym.get_name(), d.value});
+            }
+        }
+    }
+    return syms;
+}
+
+
+
+
+
+void debugger::dwarf_function_information(const std::string& file_name) {
+    if (!m_dwarf.valid()) return;
+    std::ofstream write_file;
+    write_file.open(file_name, std::ios::app);
     const std::vector<dwarf::compilation_unit> &uints = m_dwarf.compilation_units();
+    std::intptr_t pc = get_current_pc_offset_address();
     for (const auto& cu : uints) {
         // Compilation Unit包含多个IDEs，如果pc在某个CU中，则需要遍历该Cu的IDEs，判断其tag
         if (dwarf::die_pc_range(cu.root()).contains(pc)) {
@@ -382,388 +3906,466 @@ dwarf::die debugger::get_function_from_pc(uint64_t pc) {
                     // function的IDE的tag一定是subprogram，但是
                     // 库函数是不包含 DW_AT_Low_pc的，需要添加
                     // 一个条件进行判断。
-                    // main函数不需要排除
-                    if (die.has(dwarf::DW_AT::prototyped) && dwarf::at_name(die)!= "main") {
+                    if (die.has(dwarf::DW_AT::prototyped)) {
                         continue;
                     }
-                    if (dwarf::die_pc_range(die).contains(pc)) {
-                        return die;
-                    }
+
+                    std::cout << dwarf::at_name(die) << " "
+                              << std::hex << dwarf::at_low_pc(die)
+                              << "\t" << dwarf::at_high_pc(die) << std::endl;
                 }
             }
         }
     }
-    throw std::out_of_range{"Can't find function"};
+    write_file.close();
 }
 
+
+
 /**
- * @biref: 根据pc地址找到[line_table]中对应的行数
- * 
- * 1. 通过对 m_dwarf 的迭代器访问 compilation units，遍历所有编译单元
- * 2. 检查 Cu 的 die 的地址是否包含给定的指令地址pc，如果包含，就获取该编译单元的 line talbe
- * 3. 通过对 line table 的迭代器，调用其成员函数 find_address，找到地址pc对应的行数
- * 4. 如果 find_address 的返回值为 line table 的最后一个，说明没有找到，超出范围
- * 5. 否则，将 fine_address 的返回值作为 get_line_entry_from_pc 的返回值并进行返回
+ * @brief: 符号化的顺序
+ *         1. 可执行文件的DWARF，得到准确的函数名与范围
+ *         2. [pc]所在ELF文件的符号索引（[.symtab]/[.dynsym]/[.gnu_debugdata]/[.eh_frame]）
+ *         返回的[func]中的地址均为运行时地址
  */
-dwarf::line_table::iterator debugger::get_line_entry_from_pc(uint64_t pc) {
-    const std::vector<dwarf::compilation_unit> &uints = m_dwarf.compilation_units();
-    for (const auto& cu : uints) {
-        // cu 有问题，掉用 cu 的成员函数会报错
-        if (die_pc_range(cu.root()).contains(pc)) {
-            auto &It = cu.get_line_table();
-            auto it = It.find_address(pc);
-            if (it == It.end()) {
-                throw std::out_of_range{"Can't find line entry"};
-            } else {
-                return it;
-            }
-        }
+bool debugger::symbolize_pc(uint64_t pc, function_symbol& func) {
+    if (m_dwarf.valid() && pc >= m_load_address) {
+        try {
+            auto die = get_function_from_pc(pc - m_load_address);
+            func = function_symbol{offset_dwarf_address(dwarf::at_low_pc(die)),
+                                   offset_dwarf_address(dwarf::at_high_pc(die)),
+                                   dwarf::at_name(die)};
+            return true;
+        } catch (std::out_of_range&) {}
     }
-    throw std::out_of_range{"Can't find line entry"};
+
+    uint64_t bias;
+    auto index = find_symbol_index(pc, bias);
+    if (index == nullptr) return false;
+
+    auto sym = index->find(pc - bias);
+    if (sym == nullptr) return false;
+    func = function_symbol{sym->low_pc + bias, sym->high_pc + bias, sym->name};
+    return true;
 }
 
 
-/**
- * 二进制文件是有其加载地址(loaded address)，而 dwarf 中所给出的地址都是基于加载地址
- * 为了在正确的地址设置断点，我们需要在 dwarf 的基础上偏执一个 loaded address
- * loaded address 可由 "proc/<pid>/maps" 的第一行获得
- */
-void debugger::initialise_load_address() {
-    if (m_elf.get_hdr().type == elf::et::dyn) {
-        std::ifstream map("/proc/" + std::to_string(m_pid) + "/maps");
-        // 读取file第一行中的地址
-        std::string addr;
-        std::getline(map, addr, '-');
 
-        m_load_address = std::stol(addr, 0, 16);
+symbol_index* debugger::find_symbol_index(uint64_t pc, uint64_t& bias) {
+    auto so = find_shared_object(pc);
+    if (so == nullptr) return nullptr;
+
+    // 可执行文件使用[m_symbol_index]，其地址需要减去[m_load_address]
+    char resolved[PATH_MAX];
+    bool is_main = realpath(m_prog_name.c_str(), resolved) && so->path == resolved;
+    auto& index = is_main ? m_symbol_index : so->index;
+    bias = is_main ? m_load_address : so->load_bias;
+    if (!index.is_built()) {
+        if (is_main) {
+            index.build(m_elf);
+        } else {
+            try {
+                int fd = open(so->path.c_str(), O_RDONLY);
+                index.build(elf::elf{elf::create_mmap_loader(fd)});
+            } catch (std::exception& e) {
+                std::cerr << "Can't read symbols from " << so->path << ": " << e.what() << std::endl;
+                index.build(elf::elf{});
+            }
+        }
     }
+    return &index;
 }
 
 
 
-uint64_t debugger::offset_load_address(uint64_t addr) {
-    if (addr >= m_load_address) {
-        return addr - m_load_address;
-    } else {
-        std::cerr << "Addr should greater or equal to m_load_address!";
-    }
-    return -1;
-}
+bool debugger::find_call_frame_info(uint64_t pc, const call_frame_info*& cfi, const fde*& f, uint64_t& bias) {
+    auto index = find_symbol_index(pc, bias);
+    if (index == nullptr) return false;
 
+    cfi = &index->get_eh_frame();
+    f = cfi->find_fde(pc - bias);
+    if (f != nullptr || index != &m_symbol_index) return f != nullptr;
 
-uint64_t debugger::offset_dwarf_address(uint64_t addr) {
-    return addr + m_load_address;
+    // [.debug_frame]没有被加载，其中的指针是文件中的地址
+    if (!m_debug_frame_parsed) {
+        m_debug_frame_parsed = true;
+        const auto& sec = m_elf.get_section(".debug_frame");
+        if (sec.valid() && sec.get_hdr().type != elf::sht::nobits) {
+            try {
+                m_debug_frame.parse(sec.data(), sec.size(), 0, false);
+            } catch (std::exception& e) {
+                std::cerr << "Invalid .debug_frame: " << e.what() << std::endl;
+            }
+        }
+    }
+    cfi = &m_debug_frame;
+    f = cfi->find_fde(pc - bias);
+    return f != nullptr;
 }
 
 
 
-uint64_t debugger::get_current_pc_offset_address() {
-    return offset_load_address(get_pc());
+/**
+ * @brief: 从rsp开始一次读入64KiB的栈，回溯中的读取大多在其中完成，
+ *         超出范围（很深的栈或其他内存中的表达式）时再逐字读取
+ */
+std::vector<unwind_frame> debugger::unwind_stack(std::size_t max_frames) {
+    constexpr std::size_t stack_snapshot_size = 64 * 1024;
+
+    user_regs_struct regs;
+    ptrace(PTRACE_GETREGS, m_tid, nullptr, &regs);
+    stack_snapshot stack;
+    stack.read(m_pid, regs.rsp, stack_snapshot_size);
+
+    auto read = [this, &stack](uint64_t addr, uint64_t& value) {
+        if (stack.get(addr, value)) return true;
+        errno = 0;
+        value = ptrace(PTRACE_PEEKDATA, m_tid, addr, nullptr);
+        return errno == 0;
+    };
+    return m_unwinder.unwind(regs, read, max_frames);
 }
 
 
 
-
+shared_object* debugger::find_shared_object(uint64_t pc) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        for (auto& so : m_shared_objects) {
+            if (pc >= so.low_addr && pc < so.high_addr) return &so;
+        }
+        // 程序可能通过dlopen加载了新的共享库
+        if (attempt == 0) load_shared_objects();
+    }
+    return nullptr;
+}
 
 
 
 /**
- * 在指定文件[file_name]中，根据指定行数[line]及其周围上下文行数[n_lines_context]
- * 打印代码内容，并在指定行号处添加标记，显示当前行
+ * @brief: /proc/<pid>/maps的每一行: start-end perms offset dev inode path
+ *         同一文件的多个映射合并为一项，偏移为0的映射起始地址即为[load_bias]
+ *         已存在的项保留其索引，只更新地址范围
  */
-void debugger::print_source(const std::string& file_name, uint64_t specify_line) {
-    std::ifstream file {file_name};
-    uint64_t current_line = 0;
+void debugger::load_shared_objects() {
+    std::ifstream maps("/proc/" + std::to_string(m_pid) + "/maps");
     std::string line;
-
-    while (current_line < specify_line && std::getline(file, line)) {
-        current_line ++;
-    }
-
-    if (current_line == specify_line) {
-        printf("%ld %s\n", current_line, line.c_str());
-    } else {
-        throw std::out_of_range{"print_source(): specify_line is out of range!"};
+    while (std::getline(maps, line)) {
+        std::istringstream ss {line};
+        std::string range, perms, offset, dev, inode, path;
+        ss >> range >> perms >> offset >> dev >> inode >> path;
+        if (path.empty() || path[0] == '[') continue;
+
+        auto addrs = split(range, '-');
+        uint64_t low = std::stoul(addrs[0], nullptr, 16);
+        uint64_t high = std::stoul(addrs[1], nullptr, 16);
+
+        auto it = std::find_if(m_shared_objects.begin(), m_shared_objects.end(),
+                               [&path](const shared_object& so) { return so.path == path; });
+        if (it == m_shared_objects.end()) {
+            m_shared_objects.push_back(shared_object{path, low, high, low, symbol_index{}});
+            it = std::prev(m_shared_objects.end());
+        }
+        it->low_addr = std::min(it->low_addr, low);
+        it->high_addr = std::max(it->high_addr, high);
+        if (std::stoul(offset, nullptr, 16) == 0) it->load_bias = low;
     }
+    m_unwinder.clear();
 }
 
 
-/**
- * 通过结构体[siginfo_t]与函数[ptrace]获取信号量的具体信息
- */ 
-siginfo_t debugger::get_signal_info() {
-    siginfo_t info;
-    ptrace(PTRACE_GETSIGINFO, m_pid, nullptr, &info);
-    return info;
-}
-
 
 /**
- * @breif: 根据不同的[info.si_signo]执行不同的任务
+ * @brief: 有行号信息时打印源代码，否则打印 0xADDRESS in function+offset
  */
-void debugger::handle_sigtrap(siginfo_t info) {
-    switch (info.si_code) {
+void debugger::print_current_location() {
+    auto pc = get_pc();
+    try {
+        auto line_entry = get_line_entry_from_pc(offset_load_address(pc));
+        print_source(line_entry->file->path, line_entry->line);
+        return;
+    } catch (std::out_of_range&) {}
 
-        // 当运行到断点处时，会接受到如下信号了
-        case SI_KERNEL:
-        case TRAP_BRKPT: {
-            // put the pc back where it should be
-            set_pc(get_pc() - 1);
-
-            // std::cout << "Hit breakpoint at address 0x" 
-            //           << std::hex << std::setfill('0') << get_pc() << std::endl;
-            //
-
-            // [get_pc]的返回地址是栈地址，而[dwarf]里的地址信息都是以
-            // loaded address的相对地址。因此，从[get_pc]得到的地址需要 
-            // 减去loadded address.
-            // auto offset_pc = offset_load_address(get_pc()); 
-            // auto line_entry = get_line_entry_from_pc(offset_pc);
-            
-            // std::cout << "123213" << std::endl;
-            auto line_entry = get_line_entry_from_pc(get_current_pc_offset_address());
-            
-            print_source(line_entry->file->path, line_entry->line);
-            return;
+    function_symbol func;
+    if (symbolize_pc(pc, func)) {
+        std::cout << "0x" << std::hex << pc << " in " << func.name << "+0x" << pc - func.low_pc << std::endl;
+    } else {
+        std::cout << "0x" << std::hex << pc << " in ??" << std::endl;
+    }
+}
 
-        }
 
-        // This will be set if the signal was sent by single stepping
-        case TRAP_TRACE:
-            return;
-        default:
-            std::cout << "Unknown SIGTRAP code " << info.si_code << std::endl;
-            return;
+
+/**
+ * @brief: 单步执行一条指令。若执行的是call指令（栈指针减8，且栈顶的返回地址
+ *         紧跟在该指令之后），则在返回地址处设置断点并运行到该处。
+ *         返回地址处的断点在递归调用中可能被更深的栈帧命中，需根据栈指针判断。
+ */
+stop_event debugger::step_over_instruction() {
+    auto pc = get_pc();
+    auto sp = get_current_register(reg_x86_64::rsp);
+    auto insn = decode_instruction(pc);
+    bool decoded_call = insn && (insn->branch == x86_branch::call || insn->branch == x86_branch::indirect_call);
+    std::uintptr_t next_pc = insn ? pc + insn->length : 0;
+    auto event = single_step_instruction_with_breakpoint_check();
+    if (event.reason != stop_reason::single_step) return event;
+
+    // 能解码时根据指令类型判断，否则根据栈指针与栈顶的返回地址推测
+    auto new_sp = get_current_register(reg_x86_64::rsp);
+    std::uintptr_t return_address;
+    bool is_call;
+    if (insn) {
+        return_address = next_pc;
+        is_call = decoded_call && event.pc != return_address;
+    } else {
+        return_address = read_memory(new_sp);
+        is_call = new_sp == sp - 8 && return_address > pc && return_address <= pc + 15
+                  && event.pc != return_address;
     }
-}
+    if (!is_call) return event;
 
+    std::vector<std::intptr_t> planted;
+    add_step_target(return_address, planted);
+    m_breakpoints.flush();
 
+    do {
+        event = continue_execution();
+    } while (event.reason == stop_reason::internal && event.pc == return_address
+             && get_current_register(reg_x86_64::rsp) <= new_sp);
 
-/*
- * @brief: 在不检查当前位置是否有断点的情况下，让子进程单步执行指令。
- * @note: 本函数与single_step_instruction_with_breakpoint_check函数都是
- *        指令级操作（instruction)，更加的底层。
- *        而step_over, step_in, step_out函数都是以代码段为操作，相对来说
- *        更上层一些。
- **/
-void debugger::single_step_instruction() {
-    // PTRACE_SINGLESTEP: single step the process
-    // 因此，当被监视的进程执行完[single step]后，就会向
-    // 父进程发送信号量。所以父进程要调用[wait_for_signal];
-    ptrace(PTRACE_SINGLESTEP, m_pid, nullptr, nullptr);
-    wait_for_signal();
+    clear_step_targets(planted, event.reason == stop_reason::exited);
+    return event;
 }
 
 
 
-/*
- * 在检查当前位置是否为断点，随后让子进程单步执行
- **/
-void debugger::single_step_instruction_with_breakpoint_check() {
-    if(m_breakpoints.count(get_pc())) { 
-        // 运行到断点出，如要继续单步执行需要step over断点
-        step_over_breakpoint();
-    } else {
-        single_step_instruction();
+/**
+ * @brief: 打印当前函数所在堆栈链
+ */
+const std::vector<unwind_frame>& debugger::get_frames() {
+    if (!m_frames_valid) {
+        m_frames = unwind_stack();
+        m_frames_valid = true;
     }
+    return m_frames;
 }
 
 
 
+void debugger::invalidate_frames() {
+    m_frames_valid = false;
+    m_frames.clear();
+    m_selected_frame = 0;
+}
 
-void debugger::step_out() {
-    auto frame_point = get_register_value(m_pid, reg_x86_64::rbp);
-    // 使用[read_memory]读取函数返回地址
-    auto return_address = read_memory(frame_point + 8);
-
-
-    // 有两种情况需要讨论
-    // 1. return_address 所在的地址本身就有一个断点，则不需要打断点，直接
-    //    [continue_execution]函数即可
-    // 2. return_address 所在的地址本身没有断点。
-    //    （1）打断点   set_break_at_address()
-    //    （2）执行     continue_exeuction()
-    //    （3）消除断点 remove_breakpoint_at_address()
-    bool should_remove_breakpoint = false;
-    if (!m_breakpoints.count(return_address)) {
-        set_breakpoint_at_address(return_address);
-        should_remove_breakpoint = true;
-    }
 
-    continue_execution();
 
-    if (should_remove_breakpoint) {
-        remove_breakpoint_at_address(return_address);
+void debugger::select_frame(std::size_t n) {
+    const auto& frames = get_frames();
+    if (n >= frames.size()) {
+        std::cerr << "Initial frame selected; you cannot go up." << std::endl;
+        n = frames.size() - 1;
     }
+    m_selected_frame = n;
+    print_frame(n);
 }
 
 
 
-/** 
- * @brief: 单步步进(逐语句)
- *         一直调用[single_step_instruction]，直到代码运行到新的一行
- * 
- **/
-void debugger::step_in() {
-    auto line = get_line_entry_from_pc(get_current_pc_offset_address())->line;
+void debugger::print_frame(std::size_t n) {
+    const auto& frames = get_frames();
+    if (n >= frames.size()) return;
+    auto pc = frames[n].pc;
+    auto lookup_pc = n == 0 ? pc : pc - 1;
 
-    // 如果当前行数等于最开始的行数，执行指令级单步步进
-    while(get_line_entry_from_pc(get_current_pc_offset_address())->line == line) {
-        single_step_instruction_with_breakpoint_check();
-    }
+    std::cout << "#" << std::dec << n << "  0x" << std::hex << pc;
+    function_symbol func;
+    if (symbolize_pc(lookup_pc, func)) std::cout << " in " << func.name << "+0x" << pc - func.low_pc;
+    std::cout << std::endl;
 
-    // 获取去偏置后的pc地址，在[DWARF - line_table]中查找对应的代码行
-    // 并打印对应的文本信息
-    auto line_entry = get_line_entry_from_pc(get_current_pc_offset_address());
-    print_source(line_entry->file->path, line_entry->line);
+    try {
+        auto line_entry = get_line_entry_from_pc(offset_load_address(lookup_pc));
+        print_source(line_entry->file->path, line_entry->line);
+    } catch (std::out_of_range&) {}
 }
 
 
 
+uint64_t debugger::get_frame_pc_offset_address() {
+    if (m_selected_frame == 0) return get_current_pc_offset_address();
+    return offset_load_address(get_frames()[m_selected_frame].pc - 1);
+}
+
+
 
 /**
- * @brief: 逐过程调试。遇到子函数时会执行子函数，但是不会进入子函数内部
- *         而是直接返回。
- **/
-void debugger::step_over() {
-    // Get the low pc and high pc values for the given function DIE.
-    auto func = get_function_from_pc(get_current_pc_offset_address()); // 当前所在函数
-    auto func_entry = dwarf::at_low_pc(func);                          // 当前所在函数起始地址
-    auto func_end = dwarf::at_high_pc(func);                           // 当前所在函数结束地址
-
-    auto line = get_line_entry_from_pc(func_entry);       // 函数入口对应的行数
-    auto start_line = get_line_entry_from_pc(func_entry); // 当前pc对应的行数
-    
+ * @brief: 外层栈帧的寄存器来自回溯：callee-saved寄存器与rsp由CFI恢复，
+ *         其他寄存器没有被保存，求值时访问它们会报错；段寄存器与fs_base（TLS）与第0帧相同
+ */
+expr_eval_context debugger::make_frame_context() {
+    if (m_selected_frame == 0) return expr_eval_context{m_tid};
 
-    // 创建一个向量，用于保存添加的地址。用于最后的删除。
-    std::vector<std::intptr_t> to_delete{};
-    
-    // 为了设置断点，从[dwarf]得到的地址都要先进行偏置
-    // 从[line]开始设置断点，跳过[start_line]，直到[func_end];
+    const auto& frame = get_frames()[m_selected_frame];
+    user_regs_struct regs;
+    ptrace(PTRACE_GETREGS, m_tid, nullptr, &regs);
 
-    while (line->address < func_end) {
-        // 对地址进行偏置
-        auto load_address = offset_dwarf_address(line->address);
-        if (line->address != start_line->address && !m_breakpoints.count(load_address)) {
-            // line不等于[start_line]且本身不为断点
-            set_breakpoint_at_address(load_address);
-            to_delete.push_back(load_address);
+    uint32_t unknown = 0;
+    for (const auto& rd : g_register_descriptors) {
+        auto dwarf_reg = rd.reg_dwarf_number;
+        if (dwarf_reg < 0 || dwarf_reg >= dwarf_reg_ra) continue;
+        auto slot = reinterpret_cast<uint64_t*>(&regs) + static_cast<int>(rd.reg_index);
+        if (frame.has(dwarf_reg)) {
+            *slot = frame.regs[dwarf_reg];
+        } else {
+            unknown |= 1u << static_cast<int>(rd.reg_index);
         }
-        line ++;
-    }
-    // Setting a breakpiont on the return address of the funcion, just like in [step_out]
-    auto frame_pointer = get_register_value(m_pid, reg_x86_64::rbp);
-    auto return_address = read_memory(frame_pointer + 8);
-    if (!m_breakpoints.count(return_address)) {
-        set_breakpoint_at_address(return_address);
-        to_delete.push_back(return_address);
     }
+    regs.rip = frame.pc;
+    return expr_eval_context{m_tid, regs, unknown};
+}
 
 
-    // 继续执行程序，直到某个断点被命中，则消除掉所有添加的断点
-    continue_execution();
 
-    for (auto addr : to_delete) {
-        remove_breakpoint_at_address(addr);
+void debugger::print_backtrace() {
+    auto frames = unwind_stack();
+    for (std::size_t i = 0; i < frames.size(); i++) {
+        auto pc = frames[i].pc;
+        std::cout << "frame #" << std::dec << i << ":0x" << std::hex << pc;
+        function_symbol func;
+        // 返回地址可能已经是下一个函数的开头（noreturn调用之后），用pc-1符号化
+        if (symbolize_pc(i == 0 ? pc : pc - 1, func)) {
+            std::cout << " " << func.name << "+0x" << pc - func.low_pc;
+        }
+        std::cout << std::endl;
     }
-
 }
 
 
 
 
+std::size_t debugger::get_type_size(const dwarf::die& die) {
+    if (!die.has(dwarf::DW_AT::type)) return 0;
+    auto type = dwarf::at_type(die);
+    while (!type.has(dwarf::DW_AT::byte_size) && type.has(dwarf::DW_AT::type)) {
+        type = dwarf::at_type(type);
+    }
+    if (!type.has(dwarf::DW_AT::byte_size)) return 0;
+    return type[dwarf::DW_AT::byte_size].as_uconstant();
+}
+
 
-std::vector<symbol> debugger::lookup_symbol(const std::string& name) {
-    std::vector<symbol> syms;
-    for (auto &sec : m_elf.sections()) {
-        if (sec.get_hdr().type != elf::sht::symtab && sec.get_hdr().type != elf::sht::dynsym)
-            continue;
 
-        for (auto sym : sec.as_symtab()) {
-            if (sym.get_name() == name) {
-                auto &d = sym.get_data();
-                syms.push_back(symbol{to_symbol_type(d.type()), sym.get_name(), d.value});
-            }
-        }
+bool debugger::is_signed_type(const dwarf::die& die) {
+    if (!die.has(dwarf::DW_AT::type)) return false;
+    auto type = dwarf::at_type(die);
+    while (type.tag != dwarf::DW_TAG::base_type && type.has(dwarf::DW_AT::type)) {
+        if (type.tag == dwarf::DW_TAG::pointer_type) return false;
+        type = dwarf::at_type(type);
     }
-    return syms;
+    if (!type.has(dwarf::DW_AT::encoding)) return false;
+    auto encoding = static_cast<dwarf::DW_ATE>(type[dwarf::DW_AT::encoding].as_uconstant());
+    return encoding == dwarf::DW_ATE::signed_ || encoding == dwarf::DW_ATE::signed_char;
 }
 
 
 
+/**
+ * @brief: 与[find_variable]的查找顺序相同，但不在此时求值，
+ *         只记录变量的位置，供[compiled_expr]在每次命中时读取
+ */
+bool debugger::resolve_variable(uint64_t pc, const std::string& name, variable_info& var) {
+    using namespace dwarf;
+    if (!m_dwarf.valid()) return false;
 
+    auto describe = [&](const die& d) {
+        if (!d.has(DW_AT::location)) return false;
+        auto loc_val = d[DW_AT::location];
+        if (loc_val.get_type() != value::type::exprloc) return false;
 
-void debugger::dwarf_function_information(const std::string& file_name) {
-    std::ofstream write_file;
-    write_file.open(file_name, std::ios::app);
-    const std::vector<dwarf::compilation_unit> &uints = m_dwarf.compilation_units();
-    std::intptr_t pc = get_current_pc_offset_address();
-    for (const auto& cu : uints) {
-        // Compilation Unit包含多个IDEs，如果pc在某个CU中，则需要遍历该Cu的IDEs，判断其tag
-        if (dwarf::die_pc_range(cu.root()).contains(pc)) {
-            for (const auto& die : cu.root()) {
-                // std::cout << die.tag << std::endl;
-                if (die.tag == dwarf::DW_TAG::subprogram) {
-                    // std::cout << dwarf::at_name(die) << std::endl;
+        classify_location(loc_val.as_exprloc(), var);
+        // 全局变量的地址需要加上加载地址
+        if (var.location == variable_info::kind::absolute) {
+            var.offset = offset_dwarf_address(var.offset);
+        }
+        var.size = get_type_size(d);
+        var.is_signed = is_signed_type(d);
+        return var.size > 0;
+    };
 
-                    // function的IDE的tag一定是subprogram，但是
-                    // 库函数是不包含 DW_AT_Low_pc的，需要添加
-                    // 一个条件进行判断。
-                    if (die.has(dwarf::DW_AT::prototyped)) {
-                        continue;
-                    }
+    try {
+        auto func = get_function_from_pc(pc);
+        for (const auto& d : func) {
+            if ((d.tag == DW_TAG::variable || d.tag == DW_TAG::formal_parameter)
+                && d.has(DW_AT::name) && at_name(d) == name && describe(d)) {
+                return true;
+            }
+        }
+    } catch (std::out_of_range&) {}
 
-                    std::cout << dwarf::at_name(die) << " "
-                              << std::hex << dwarf::at_low_pc(die)
-                              << "\t" << dwarf::at_high_pc(die) << std::endl;
-                }
+    for (const auto& cu : m_dwarf.compilation_units()) {
+        for (const auto& d : cu.root()) {
+            if (d.tag == DW_TAG::variable && d.has(DW_AT::name) && at_name(d) == name && describe(d)) {
+                return true;
             }
         }
     }
-    write_file.close();
+    return false;
 }
 
 
 
 /**
- * @brief: 打印当前函数所在堆栈链
+ * @brief: 与[read_variables]相同，通过[ptrace_expr_context]对DW_AT_location求值
+ *         先在当前函数中查找，找不到时再查找编译单元中的全局变量
  */
-void debugger::print_backtrace() {
-    // 使用 Lambda 表达式定义一个匿名函数，用于打印堆栈信息
-    auto output_frame = [frame_number = 0] (auto&& func) mutable {
-        std::cout << "frame #" << frame_number++ << ":0x" << dwarf::at_low_pc(func)
-                  << " " << dwarf::at_name(func) << std::endl;
-    };
+bool debugger::find_variable(const std::string& name, std::uintptr_t& addr, std::size_t& size) {
+    using namespace dwarf;
+    if (!m_dwarf.valid()) return false;
 
-    // 通过去偏置后的地址找到对应的函数DIE
-    auto current_func = get_function_from_pc(offset_load_address(get_pc()));
-    output_frame(current_func);
+    auto context = make_frame_context();
+    auto evaluate = [&](const die& var) {
+        if (!var.has(DW_AT::location)) return false;
+        auto loc_val = var[DW_AT::location];
+        if (loc_val.get_type() != value::type::exprloc) return false;
 
-    // 获取堆栈起始地址与返回地址
-    auto frame_pointer = get_register_value(m_pid, reg_x86_64::rbp);
-    auto return_address = read_memory(frame_pointer + 8);
+        auto result = loc_val.as_exprloc().evaluate(&context);
+        if (result.location_type != expr_result::type::address) return false;
 
-    // 打印函数栈信息，直到[main]函数
-    while (dwarf::at_name(current_func) != "main") {
+        // 全局变量的地址需要加上加载地址
+        addr = result.value;
+        if (addr < m_load_address) addr = offset_dwarf_address(addr);
+        size = get_type_size(var);
+        return true;
+    };
 
-        // std::cout << "\t<debug>: return_address - 0x" << std::hex << return_address << std::endl;
-        current_func = get_function_from_pc(offset_load_address(return_address));
-        output_frame(current_func);
+    try {
+        auto func = get_function_from_pc(get_frame_pc_offset_address());
+        for (const auto& die : func) {
+            if ((die.tag == DW_TAG::variable || die.tag == DW_TAG::formal_parameter)
+                && die.has(DW_AT::name) && at_name(die) == name && evaluate(die)) {
+                return true;
+            }
+        }
+    } catch (std::out_of_range&) {}
 
-        // 更新栈指针
-        frame_pointer = read_memory(frame_pointer);
-        return_address = read_memory(frame_pointer + 8);
+    for (const auto& cu : m_dwarf.compilation_units()) {
+        for (const auto& die : cu.root()) {
+            if (die.tag == DW_TAG::variable && die.has(DW_AT::name) && at_name(die) == name
+                && evaluate(die)) {
+                return true;
+            }
+        }
     }
+    return false;
 }
 
 
 
-
 void debugger::read_variables() {
     using namespace dwarf;
 
-    // 找到当前所在行数
-    auto func = get_function_from_pc(get_current_pc_offset_address());
+    // 选中的栈帧所在的函数，所有变量共用同一个求值上下文
+    auto func = get_function_from_pc(get_frame_pc_offset_address());
+    auto context = make_frame_context();
 
     // 在函数的DIE中遍历[entries]，寻找[variables]
     for (const auto& die : func) {
@@ -771,20 +4373,19 @@ void debugger::read_variables() {
             auto loc_val = die[DW_AT::location];
 
             if (loc_val.get_type() == value::type::exprloc) {
-                ptrace_expr_context context {m_pid};
-
                 // Ask [libelfin] to evaluate the expression for us
                 auto result = loc_val.as_exprloc().evaluate(&context);
 
                 switch (result.location_type) {
                     case expr_result::type::address: {
-                        auto value = read_memory(result.value);
-                        std::cout << at_name(die) << " (0x" << std::hex << result.value << ") ="
+                        auto value = context.read(result.value);
+                        std::cout << at_name(die) << " (0x" << std::hex << result.value << ") = "
                                   << value << std::endl;
+                        break;
                     }
 
                     case expr_result::type::reg: {
-                        auto value = get_register_value_from_dwarf_register(m_pid, result.value);
+                        auto value = context.reg(result.value);
                         std::cout << at_name(die)<< " (reg" << result.value << ") = "
                                   << value << std::endl;
                         break;
@@ -796,8 +4397,6 @@ void debugger::read_variables() {
             } 
         }
     }
-
-
 }
 
 
@@ -2,11 +2,15 @@
 #define _DEBUGGER_H
 
 #include <bits/types/siginfo_t.h>
+#include <chrono>
 #include <cstdio>
 #include <iterator>
 #include <pthread.h>
 #include <iostream>
+#include <map>
+#include <regex>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 #include <unistd.h>
@@ -24,6 +28,21 @@
 
 #include "linenoise.h"
 #include "breakpoint.h"
+#include "breakpoint_manager.h"
+#include "debug_registers.h"
+#include "inferior_call.h"
+#include "displaced_step.h"
+#include "tracepoint.h"
+#include "false_sharing.h"
+#include "expression.h"
+#include "debuginfo.h"
+#include "symbol_index.h"
+#include "function_index.h"
+#include "block_step.h"
+#include "unwinder.h"
+#include "x86_disasm.h"
+#include "function_cfg.h"
+#include "reverse_exec.h"
 #include "libelfin/elf/elf++.hh"
 #include "libelfin/dwarf/dwarf++.hh"
 
@@ -47,6 +66,129 @@ struct symbol {
 
 
 
+// 停止的原因
+enum class stop_reason {
+    breakpoint,     // 用户断点（软件或硬件）
+    internal,       // 调试器内部的临时断点（next/finish等），由设置它的操作处理
+    watchpoint,     // 数据断点或页保护断点
+    single_step,    // 单步完成
+    signal,         // 程序收到其他信号
+    thread_exited,  // 当前线程退出（进程中还有其他线程），已切换到另一个线程
+    exited,         // 进程退出
+};
+
+/**
+ * @brief: 一次停止。[wait_for_signal]只做必要的处理（断点计数、条件、数据断点的新旧值），
+ *         不做符号化；内部操作直接消费停止，只有最终返回命令行的停止交给[report_stop]打印。
+ */
+struct stop_event {
+    stop_reason reason;
+    pid_t tid;
+    std::uintptr_t pc;
+    int breakpoint;     // 用户断点编号，没有时为0
+    int signal;         // signal时为信号；exited时为退出码，被信号终止时为负的信号
+    bool resume;        // 与用户无关的停止（条件不满足、dprintf、无关的页错误），应当继续执行
+};
+
+
+
+// 一个源代码行对应的全部地址范围（同一行可能被编译成多段代码，例如循环条件）
+struct line_range {
+    std::string file;
+    uint64_t line = 0;
+    std::vector<std::pair<std::uintptr_t, std::uintptr_t>> ranges;   // 运行时地址 [start, end)
+
+    auto contains(std::uintptr_t pc) const -> bool {
+        for (const auto& [start, end] : ranges) {
+            if (pc >= start && pc < end) return true;
+        }
+        return false;
+    }
+};
+
+
+
+// 程序运行时映射的ELF文件（可执行文件或共享库）
+struct shared_object {
+    std::string path;
+    uint64_t low_addr;      // 映射的地址范围 [low_addr, high_addr)
+    uint64_t high_addr;
+    uint64_t load_bias;     // 运行时地址 = 文件中的地址 + load_bias
+    symbol_index index;     // 第一次查询时才构建
+};
+
+
+
+
+// step不进入的代码：文件、函数或共享库，[pattern]为通配符
+enum class skip_kind {file, function, library};
+
+struct skip_entry {
+    int number;
+    skip_kind kind;
+    std::string pattern;
+    std::regex re;
+};
+
+// 被调试进程中的一个线程
+struct thread_info {
+    int number;                 // 用户看到的编号，按发现的顺序从1开始
+    pid_t tid;
+    bool stopped;               // 处于ptrace-stop
+    int pending_signal;         // 恢复执行时传递给该线程的信号
+    int pending_status;         // 尚未报告的停止（其他线程的数据断点命中）的wait状态，下次继续执行时报告
+    __ptrace_request last_request;  // 最近一次恢复执行的方式，clone事件之后按它继续
+    bool regs_valid;            // [regs]是本次停止后读取的
+    user_regs_struct regs;
+};
+
+// all-stop：停下所有线程的次数与耗时（从发出第一个PTRACE_INTERRUPT到最后一个线程停下）
+struct all_stop_stats {
+    uint64_t count = 0;
+    std::chrono::nanoseconds last {0};
+    std::chrono::nanoseconds max {0};
+    std::chrono::nanoseconds total {0};
+};
+
+// 被调试进程的ptrace选项：跟踪新线程与exec，调试器退出时结束被调试进程
+constexpr long g_ptrace_options = PTRACE_O_TRACECLONE | PTRACE_O_TRACEEXEC | PTRACE_O_EXITKILL;
+
+
+
+// fork出的检查点：停在创建时的位置，与被调试进程写时复制共享内存，其中的int3已恢复为原数据
+struct checkpoint {
+    int id;
+    pid_t pid;
+    std::uintptr_t pc;
+};
+
+
+
+
+// 硬件数据断点
+struct watchpoint {
+    std::string expr;           // 用户输入的变量名或地址
+    std::uintptr_t addr;
+    int len;                    // 1/2/4/8字节
+    dr_condition cond;
+    int slot;                   // DR0-DR3中的slot
+    uint64_t old_value;         // 上一次命中时的值
+};
+
+
+
+
+// 基于页保护的软件数据断点，可以监视任意长度的内存
+struct page_watchpoint {
+    std::string expr;
+    std::uintptr_t addr;
+    std::size_t len;
+    std::vector<uint8_t> old_data;  // 上一次命中时的内容
+};
+
+
+
+
 // 根据分割符[delimeter]分割字符串[s]
 std::vector<std::string> split (const std::string &s, char delimeter);
 // 判断字符串[s]与字符串[of]是否相等
@@ -69,12 +211,15 @@ class debugger {
 public:
     // 初始化函数
     debugger (std::string prog_name, pid_t pid) 
-        : m_prog_name{std::move(prog_name)}, m_pid{pid} {
+        : m_prog_name{std::move(prog_name)}, m_pid{pid}, m_tid{pid}, m_breakpoints{pid}, m_debug_registers{pid}, m_displaced{pid}, m_tracepoints{pid},
+          m_unwinder{[this](uint64_t pc, const call_frame_info*& cfi, const fde*& f, uint64_t& bias) {
+              return find_call_frame_info(pc, cfi, f, bias);
+          }} {
 
         // 根据可执行文件路径实例化[m_elf]与[m_drawf];
         int fd = open(m_prog_name.c_str(), O_RDONLY);
         m_elf = elf::elf{elf::create_mmap_loader(fd)};
-        m_dwarf = dwarf::dwarf{dwarf::elf::create_loader(m_elf)};
+        load_debug_info();
     }
 
 
@@ -83,15 +228,66 @@ public:
     // 处理用户输入命令[line]
     void handle_command(const std::string& line);
     // 继续执行
-    void continue_execution();
+    stop_event continue_execution();
     // 根据用户输入地址[addr]设置断点
     void set_breakpoint_at_address(std::intptr_t addr);
     // 根据函数名字设置断点
     void set_breakpoint_at_function(const std::string& name);
     // 根据源代码行数设置断点
     void set_breakpoint_at_source_line(const std::string& file, uint64_t line);
+    // 在名字与正则表达式[pattern]匹配的所有函数上设置断点(rbreak)
+    void set_regex_breakpoints(const std::string& pattern);
     // 移除断点
     void remove_breakpoint_at_address(std::intptr_t addr);
+    // 解析位置 0xADDRESS, <file>:<line> 或 <function>，返回加载后的地址
+    std::vector<std::intptr_t> resolve_location(const std::string& location);
+    // 根据函数名找到跳过序言后的地址
+    std::vector<std::intptr_t> get_function_addresses(const std::string& name);
+    // 根据源文件行号找到地址
+    std::vector<std::intptr_t> get_source_line_addresses(const std::string& file, uint64_t line);
+    // 使用调试寄存器设置硬件断点，成功时返回true
+    bool set_hw_breakpoint_at_address(std::intptr_t addr);
+    // 移除硬件断点
+    void remove_hw_breakpoint_at_address(std::intptr_t addr);
+    // 软件断点命中次数达到阈值后，改用硬件断点
+    void promote_hot_breakpoint(std::intptr_t addr);
+    // 为[addr]处的断点编译条件表达式，变量按断点所在函数解析
+    void set_breakpoint_condition(std::intptr_t addr, const std::string& text);
+    // 断点命中后对条件求值，没有条件或条件非0时返回true
+    bool check_breakpoint_condition(std::intptr_t addr);
+    // 打印所有断点、命中次数与条件
+    void print_breakpoints();
+    // 根据编号查找断点，找不到时返回nullptr
+    breakpoint* find_breakpoint_by_number(int number);
+    // 断点命中后处理条件、ignore计数、dprintf与命令列表，需要停下时返回true
+    bool handle_breakpoint_hit(std::intptr_t addr);
+    // 读取断点命中后执行的命令列表
+    void read_breakpoint_commands(int number);
+    // 设置dprintf断点
+    void set_dprintf(const std::string& location, const std::string& text);
+    // 在当前位置对表达式求值并打印
+    void print_expression(const std::string& text);
+    // 设置数据断点，[expr]为变量名或0xADDRESS，[len]为0时使用变量的大小
+    // [soft]为true或长度超过8字节时，使用页保护实现
+    void set_watchpoint(const std::string& expr, int len, dr_condition cond, bool soft);
+    // 设置基于页保护的数据断点
+    void set_page_watchpoint(const std::string& expr, std::uintptr_t addr, std::size_t len);
+    // 根据[m_page_watchpoints]保护或恢复各个页
+    void update_page_protection();
+    // 读取/proc/<pid>/maps中[page]所在映射的权限
+    int get_page_protection(std::uintptr_t page);
+    // 处理页保护断点引起的SIGSEGV，与其无关时返回false
+    bool handle_page_fault(const siginfo_t& info, stop_event& event);
+    // 一次读取一段内存
+    std::vector<uint8_t> read_memory_block(std::uintptr_t addr, std::size_t len);
+    // 删除数据断点
+    void remove_watchpoint(const std::string& expr);
+    // 在[targets]所在的cache line上采样各线程的写入，打印每个字段的争用情况
+    void detect_false_sharing(const std::vector<std::string>& targets, std::chrono::milliseconds duration);
+    void print_false_sharing(const false_sharing_sampler& sampler,
+                             const std::vector<std::tuple<std::string, std::uintptr_t, std::size_t>>& targets);
+    // 数据断点命中后，打印新旧值与源代码行
+    void report_watchpoint_hit(int slot);
     // 打印寄存器信息
     void dump_register();
     // 读取内存数据
@@ -102,10 +298,62 @@ public:
     uint64_t get_pc();
     // 写程序计数器PC
     void set_pc(std::intptr_t pc);
+    // 当前线程的寄存器：每次停止后第一次读取时PTRACE_GETREGS一次，同一次停止中之后的读取使用线程表中的缓存
+    uint64_t get_current_register(reg_x86_64 r);
+    // 写入当前线程的寄存器并更新缓存
+    void set_current_register(reg_x86_64 r, uint64_t value);
+    // 寄存器被绕过缓存修改（直接的ptrace、位移单步的修正、模拟的系统调用）后丢弃缓存
+    void invalidate_current_regs();
     // step over a breakpoint - 执行光标所对应的行的代码，不会进入到子函数中。
-    void step_over_breakpoint();
-    // 调用waitpid函数，等待信号
-    void wait_for_signal();
+    // 当前位置有启用的断点并执行了单步时返回true，停止事件保存在[m_last_stop]
+    bool step_over_breakpoint();
+    // 在scratch页中执行断点处的原指令，int3留在原处；不能位移执行时返回false
+    bool displaced_step_over_breakpoint(std::intptr_t addr);
+    // 解码[addr]处的指令（通过[m_decode_cache]缓存），不能解码时返回nullptr
+    const x86_insn* decode_instruction(std::uintptr_t addr);
+    // 读取[addr]处的代码，其中的int3还原为断点保存的原字节
+    std::vector<uint8_t> read_original_code(std::intptr_t addr, std::size_t len);
+    // 代码[addr, addr + len)被修改：丢弃解码缓存以及与其重叠的控制流图
+    void invalidate_code(std::uintptr_t addr, std::size_t len);
+    // [pc]所在函数的控制流图，第一次使用时构建并缓存；没有函数符号时返回nullptr
+    const function_cfg* get_function_cfg(uint64_t pc);
+    // 解析disas/cfg的位置: 空（选中栈帧所在的函数）、函数名、0xADDR（所在的函数）或 0xADDR,len
+    void parse_code_range(const std::string& spec, std::uintptr_t& low, std::uintptr_t& high);
+    // 反汇编[low, high)，穿插源代码行并符号化跳转目标与rip相对引用
+    void disassemble(std::uintptr_t low, std::uintptr_t high);
+    // 打印[low]所在函数的基本块、边与循环头
+    void print_cfg(std::uintptr_t low);
+    // 源文件[file]的第[line]行，文件第一次使用时整体读入；不存在时返回nullptr
+    const std::string* get_source_line(const std::string& file, uint64_t line);
+    // 设置快速tracepoint，[collect]为空或 变量名/$reg[+off]/0xADDRESS，可加@len
+    void set_fast_tracepoint(const std::string& location, const std::string& collect);
+    // 解析tracepoint要复制的内存，变量按[addr]所在的函数解析
+    std::optional<trace_capture> parse_trace_capture(const std::string& text, std::intptr_t addr);
+    // 打印tracepoint的命中次数与丢失的记录数
+    void print_trace_status();
+    // 打印最近的[n]条tracepoint记录
+    void print_trace_records(std::size_t n);
+    // 等待当前线程停下（单步类操作只让当前线程运行），返回停止事件
+    stop_event wait_for_signal();
+    // 等待任意线程停下，当前线程切换为它，返回停止事件
+    stop_event wait_for_any_thread();
+    /**
+     * @brief: 等待线程[tid]（为-1时任意线程）的下一次需要处理的停止或退出，返回其tid与[status]。
+     *         期间处理与用户无关的事件：clone（新线程）、残留的中断与group-stop、其他线程的退出
+     */
+    pid_t wait_thread(pid_t tid, int& status);
+    // 处理线程[tid]的停止或退出[status]：分类信号、断点与数据断点，[continuing]时其他线程仍在运行
+    stop_event handle_wait_status(pid_t tid, int status, bool continuing);
+    // 根据断点编号、条件与[m_step_targets]设置[event]的停止原因，返回断点编号
+    int classify_breakpoint_hit(std::intptr_t addr, stop_event& event);
+    // 单步类操作等待停在[addr]：登记到[m_step_targets]，没有断点时插入临时断点并记入[planted]
+    void add_step_target(std::intptr_t addr, std::vector<std::intptr_t>& planted);
+    // 操作结束，删除临时断点（进程已退出时只清空登记）
+    void clear_step_targets(const std::vector<std::intptr_t>& planted, bool exited);
+    // 打印最终返回命令行的停止：位置、断点编号与命令、信号或退出码
+    void report_stop(const stop_event& event);
+    // 打印位置并执行断点的命令列表，跳过开头的silent与结尾的continue
+    void run_breakpoint_commands(const breakpoint& bp);
 
 
 
@@ -114,10 +362,18 @@ public:
     dwarf::die get_function_from_pc(uint64_t pc);
     // 根据pc判断目前地址对应的源代码行数
     dwarf::line_table::iterator get_line_entry_from_pc(uint64_t pc);
+    // 找到运行时地址[pc]所在源代码行的所有地址范围，没有行号信息时返回false
+    bool get_line_range(uint64_t pc, line_range& range);
     // 初始化加载地址
     void initialise_load_address();
     // 进行加载地址偏置
     uint64_t offset_dwarf_address(uint64_t addr);
+    // 加载调试信息：优先使用可执行文件自身的[.debug_info]，其次是分离的调试文件
+    void load_debug_info();
+    // 检查后台下载的调试信息是否就绪，就绪则加载
+    void poll_debug_info();
+    // 打印调试信息的来源与下载状态
+    void print_debug_info_status();
     // 去掉加载地址偏偏置
     uint64_t  offset_load_address(uint64_t addr);
     // 封装，得到去偏置后的PC地址
@@ -129,22 +385,126 @@ public:
     // 获取信号量相关信息
     siginfo_t get_signal_info();
     // 信号量处理函数
-    void handle_sigtrap(siginfo_t info);
+    void handle_sigtrap(siginfo_t info, stop_event& event);
 
     // 指令级单步步进
-    void single_step_instruction();
+    stop_event single_step_instruction();
     // 带有短的检查的指令级单步步进
-    void single_step_instruction_with_breakpoint_check();
+    stop_event single_step_instruction_with_breakpoint_check();
+    // 块单步：运行到下一条发生跳转的分支之后，不支持时退化为单步
+    stop_event block_step();
+    // 块单步[n]次，记录每次跳转到[m_branch_trace]
+    stop_event record_branches(std::size_t n);
+    // 打印最近的[n]条分支记录
+    void print_branch_trace(std::size_t n);
     // 跳出
-    void step_out();
+    stop_event step_out();
     // 单步执行(逐语句)
-    void step_in();
+    stop_event step_in();
     // 逐过程
-    void step_over();
+    stop_event step_over();
+    // step进入的代码没有行号信息或在skip列表中时返回true，step直接运行到返回地址
+    bool is_step_skipped(uint64_t pc);
+    // skip列表: 添加、删除（[number]为0时全部删除）、打印
+    void add_skip(skip_kind kind, const std::string& pattern);
+    void remove_skip(int number);
+    void print_skips();
+    // 检查点: 在被调试进程中注入fork，子进程作为快照停住
+    void create_checkpoint();
+    // 从检查点[id]再fork出一个进程并切换调试它，原来的进程被结束；检查点本身可以反复使用
+    void restart_checkpoint(int id);
+    void delete_checkpoint(int id);
+    void print_checkpoints();
+    // 被调试进程换成[pid]：各组件切换到新进程，重新写入断点与调试寄存器
+    void switch_process(pid_t pid);
+    // 结束被调试进程并回收其所有线程（线程组长最后回收）
+    void kill_inferior();
+    // 反向执行: 从当前位置开始记录，当前位置为第0条指令
+    void start_recording();
+    // 停止记录，结束所有重放起点
+    void stop_recording();
+    void print_record_status();
+    // 在当前位置创建重放起点，较早的起点超过上限时被稀疏化
+    bool add_replay_point();
+    // 记录模式下的单步：系统调用的结果写入日志，回到过去后按日志模拟；按间隔创建重放起点
+    stop_event recorded_single_step();
+    // 记录模式下的继续执行：逐条单步，停在断点处
+    stop_event recorded_continue();
+    /**
+     * @brief: 从重放起点[point]fork出新进程并执行到第[target]条指令之前，每条指令执行前以新进程与当时的寄存器调用[visit]；
+     *         返回停在该位置的新进程（没有int3），与日志不一致时结束它并抛出异常
+     */
+    pid_t replay_from(const replay_point& point, uint64_t target,
+                      const std::function<void(uint64_t, pid_t, const user_regs_struct&)>& visit);
+    // 回到第[icount]条指令执行之前：重放到该位置并切换到新进程
+    void goto_instruction(uint64_t icount);
+    // 被调试进程换成停在第[icount]条指令之前的重放进程[pid]，原来的进程被结束
+    void switch_to_replay(pid_t pid, uint64_t icount);
+    // 反向执行一条指令
+    stop_event reverse_stepi();
+    // 反向逐过程：回到同一栈帧中上一行的开始（当前不在行首时为当前行的开始），跳过其中的函数调用
+    stop_event reverse_next();
+    // 反向继续：回到最近一次经过的用户断点，没有时回到记录的开始
+    stop_event reverse_continue();
+    // 在记录的历史中二分查找表达式[text]从不成立变为成立的位置，停在那里并打印回溯；
+    // [first]时找最早的一次变化，否则找当前位置之前最近的一次
+    void bisect(const std::string& text, bool first);
+
+    // 线程: 加入线程表并写入调试寄存器，[announce]时打印
+    thread_info& add_thread(pid_t tid, bool announce);
+    // 线程[parent]的clone事件：等待新线程的第一次停止并加入线程表；不是线程（没有CLONE_THREAD）时分离
+    thread_info* attach_new_thread(pid_t parent);
+    // 线程退出：从线程表与调试寄存器中移除
+    void remove_thread(pid_t tid);
+    thread_info& current_thread();
+    thread_info* find_thread_by_number(int number);
+    // 线程停止后的寄存器，第一次使用时读取
+    const user_regs_struct& get_thread_regs(thread_info& thread);
+    // 恢复线程的执行，[with_signal]时传递并清除挂起的信号；失败时返回false
+    bool resume_thread(thread_info& thread, __ptrace_request request, bool with_signal);
+    // 恢复所有已停止的线程，各自传递挂起的信号
+    void resume_all_threads();
+    // all-stop：PTRACE_INTERRUPT所有运行中的线程并等待它们停下，记录耗时
+    void stop_all_threads();
+    // 非当前线程报告的SIGTRAP：数据断点命中保存为挂起的停止，int3命中退回rip，恢复后再次命中
+    void keep_trap_of_other_thread(thread_info& thread, int status);
+    // 有挂起停止的线程，没有时返回nullptr
+    thread_info* find_pending_stop();
+    // info threads: 线程编号、tid、名字与位置，以及all-stop的耗时
+    void print_threads();
+    // thread N: 切换当前线程并打印位置
+    void select_thread(int number);
 
 
     // symbol file
     std::vector<symbol> lookup_symbol(const std::string& name);
+    // 对运行时地址[pc]进行符号化，DWARF缺失时使用[.symtab]/[.eh_frame]构建的索引
+    bool symbolize_pc(uint64_t pc, function_symbol& func);
+    // [pc]所在ELF文件的符号索引（第一次使用时构建）与其加载偏置
+    symbol_index* find_symbol_index(uint64_t pc, uint64_t& bias);
+    // [pc]的FDE：先查所在ELF文件的[.eh_frame]，可执行文件再查[.debug_frame]
+    bool find_call_frame_info(uint64_t pc, const call_frame_info*& cfi, const fde*& f, uint64_t& bias);
+    // 从当前寄存器开始回溯，栈内存一次性读入
+    std::vector<unwind_frame> unwind_stack(std::size_t max_frames = 256);
+    // 本次停止的栈帧，第一次使用时回溯，之后直到下一次停止都使用缓存
+    const std::vector<unwind_frame>& get_frames();
+    // 进程停止或寄存器、内存被修改后丢弃缓存的栈帧，并选择第0帧
+    void invalidate_frames();
+    // frame/up/down: 选择第[n]帧并打印
+    void select_frame(std::size_t n);
+    void print_frame(std::size_t n);
+    // 选中的栈帧的pc（减去加载地址）；外层帧使用返回地址-1，即call指令所在的行与函数
+    uint64_t get_frame_pc_offset_address();
+    // 选中的栈帧上的表达式求值上下文，第0帧直接读取寄存器
+    expr_eval_context make_frame_context();
+    // 找到[pc]所在的ELF文件，必要时重新读取/proc/<pid>/maps
+    shared_object* find_shared_object(uint64_t pc);
+    // 读取/proc/<pid>/maps，更新[m_shared_objects]
+    void load_shared_objects();
+    // 打印当前位置：有行号信息时打印源代码，否则打印函数名与偏移
+    void print_current_location();
+    // 没有行号信息时的逐过程：单步执行一条指令，遇到call则运行到返回地址
+    stop_event step_over_instruction();
     // 获取函数信息
     void dwarf_function_information(const std::string& file_name);
 
@@ -153,20 +513,106 @@ public:
 
     // 查看变量
     void read_variables();
+    // 根据变量名找到变量的地址与大小：先查当前函数，再查全局变量
+    bool find_variable(const std::string& name, std::uintptr_t& addr, std::size_t& size);
+    // [DW_AT_type]所指类型的字节数，跳过typedef/const/volatile
+    std::size_t get_type_size(const dwarf::die& die);
+    // [DW_AT_type]所指的基本类型是否为有符号整数
+    bool is_signed_type(const dwarf::die& die);
+    // 在[pc]所在函数及全局变量中查找[name]，用于编译表达式
+    bool resolve_variable(uint64_t pc, const std::string& name, variable_info& var);
 
 private:
     std::string m_prog_name;    // 可执行二进制文件的名字
-    pid_t m_pid;    
-
-    // 键值哈系表，存储断电与地址的映射关系
-    std::unordered_map<std::intptr_t, breakpoint> m_breakpoints;   
+    // 被调试进程（线程组）与当前线程：寄存器、单步与表达式求值作用于[m_tid]，内存与/proc使用[m_pid]
+    pid_t m_pid;
+    pid_t m_tid;
+    // 线程表，以及下一个线程的编号
+    std::map<pid_t, thread_info> m_threads;
+    int m_next_thread_number = 1;
+    // 单步类操作（next/finish）所在的线程，其他线程经过它的临时断点时继续运行
+    pid_t m_step_thread = 0;
+    // 最近一次报告停止时的当前线程，停在其他线程时打印切换
+    pid_t m_reported_tid = 0;
+    all_stop_stats m_all_stop;
+
+    // 存储断点与地址的映射关系，并负责批量写入int3
+    breakpoint_manager m_breakpoints;
+    // 下一个用户断点的编号
+    int m_next_breakpoint_number = 1;
+
+    // 硬件断点：地址 -> DR0-DR3中的slot
+    debug_registers m_debug_registers;
+    std::unordered_map<std::intptr_t, int> m_hw_breakpoints;
+    // 由软件断点自动转换而来的硬件断点，可以被更热的断点替换
+    std::unordered_set<std::intptr_t> m_auto_hw_breakpoints;
+    // 位移单步：在断点上继续执行时不需要移除int3
+    displaced_stepper m_displaced;
+    // 快速tracepoint：jmp到trampoline，记录写入共享内存，不产生ptrace stop
+    tracepoint_agent m_tracepoints;
+    // 软件断点命中多少次后转换为硬件断点，0表示关闭（默认关闭，由"hbreak auto <N>"打开，
+    // 否则自动转换会悄悄占用调试寄存器，使watch与hbreak失败）
+    uint64_t m_hw_promote_threshold = 0;
+    // 数据断点，与硬件断点共用DR0-DR3
+    std::vector<watchpoint> m_watchpoints;
+    // 页保护断点，以及被保护的页 -> 原来的权限
+    std::vector<page_watchpoint> m_page_watchpoints;
+    std::map<std::uintptr_t, int> m_protected_pages;
+
+    // 按代码页缓存的指令解码结果，[write_memory]修改代码时丢弃对应的页
+    x86_decode_cache m_decode_cache;
+    // 按函数入口缓存的控制流图，由[invalidate_code]丢弃被修改的函数
+    std::map<std::uintptr_t, function_cfg> m_cfgs;
+    // disas使用的语法，以及读入的源文件
+    asm_syntax m_disas_syntax = asm_syntax::att;
+    std::unordered_map<std::string, std::vector<std::string>> m_source_files;
+    // 块单步：用户开关与运行时检测到的内核/CPU支持情况
+    bool m_block_step_enabled = true;
+    block_step_support m_block_step_support = block_step_support::unknown;
+    // btrace记录的分支
+    branch_trace m_branch_trace;
+    // 当前单步类操作（next/finish）等待停下的地址，其上的用户断点条件不满足时也要停下
+    std::unordered_set<std::intptr_t> m_step_targets;
+    // 最近一次停止
+    stop_event m_last_stop {stop_reason::signal, 0, 0, 0, 0, false};
 
     // 使用dwarf和elf
     dwarf::dwarf m_dwarf;
     elf::elf m_elf;
 
+    // 分离的调试文件，[m_dwarf]从中加载时需要保持其生命周期
+    elf::elf m_debug_elf;
+    std::string m_debug_file;
+    debuginfod_client m_debuginfod;
+    std::future<std::string> m_debuginfo_fetch;
+
     // 可执行文件的加载初始地址
-    uint64_t m_load_address;
+    uint64_t m_load_address = 0;
+
+    // 不依赖DWARF的函数索引，分别对应可执行文件与其他共享库
+    symbol_index m_symbol_index;
+    std::vector<shared_object> m_shared_objects;
+    // rbreak使用的函数名索引，第一次使用时构建
+    function_name_index m_function_names;
+    // 可执行文件的[.debug_frame]，[.eh_frame]中没有FDE时使用，第一次使用时解析
+    call_frame_info m_debug_frame;
+    bool m_debug_frame_parsed = false;
+    // 基于CFI的栈回溯，缓存每个pc范围的规则
+    cfi_unwinder m_unwinder;
+    // 本次停止的栈帧与选中的帧
+    std::vector<unwind_frame> m_frames;
+    bool m_frames_valid = false;
+    std::size_t m_selected_frame = 0;
+    // step跳过的文件、函数与共享库
+    std::vector<skip_entry> m_skips;
+    int m_next_skip_number = 1;
+    // fork检查点
+    std::vector<checkpoint> m_checkpoints;
+    int m_next_checkpoint_id = 1;
+    // 反向执行：是否在记录、当前位置的指令数，以及系统调用与重放起点的日志
+    bool m_recording = false;
+    uint64_t m_icount = 0;
+    execution_log m_exec_log;
     
 };
 
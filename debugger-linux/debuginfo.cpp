@@ -0,0 +1,293 @@
+#include "debuginfo.h"
+#include <cstdio>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+
+
+// [.note.gnu.build-id]中note的类型
+constexpr uint32_t nt_gnu_build_id = 3;
+
+
+std::string read_build_id(const elf::elf& f) {
+    const auto& sec = f.get_section(".note.gnu.build-id");
+    if (!sec.valid()) return "";
+
+    // note格式: namesz(4) descsz(4) type(4) name(按4字节对齐) desc(按4字节对齐)
+    auto data = static_cast<const unsigned char*>(sec.data());
+    size_t size = sec.size();
+    size_t pos = 0;
+    auto align4 = [](size_t n) { return (n + 3) & ~size_t{3}; };
+
+    while (pos + 12 <= size) {
+        uint32_t namesz, descsz, type;
+        memcpy(&namesz, data + pos, 4);
+        memcpy(&descsz, data + pos + 4, 4);
+        memcpy(&type, data + pos + 8, 4);
+        pos += 12;
+
+        auto name_pos = pos;
+        auto desc_pos = pos + align4(namesz);
+        pos = desc_pos + align4(descsz);
+        if (pos > size) break;
+
+        if (type == nt_gnu_build_id && namesz == 4 && !memcmp(data + name_pos, "GNU", 4)) {
+            std::ostringstream ss;
+            for (uint32_t i = 0; i < descsz; i++) {
+                ss << std::hex << std::setw(2) << std::setfill('0') << (int)data[desc_pos + i];
+            }
+            return ss.str();
+        }
+    }
+    return "";
+}
+
+
+
+debuglink read_debuglink(const elf::elf& f) {
+    const auto& sec = f.get_section(".gnu_debuglink");
+    if (!sec.valid()) return debuglink{"", 0};
+
+    // 以'\0'结尾的文件名，按4字节对齐后紧跟4字节的CRC
+    auto data = static_cast<const char*>(sec.data());
+    size_t size = sec.size();
+    size_t len = strnlen(data, size);
+    size_t crc_pos = (len + 1 + 3) & ~size_t{3};
+    if (crc_pos + 4 > size) return debuglink{"", 0};
+
+    uint32_t crc;
+    memcpy(&crc, data + crc_pos, 4);
+    return debuglink{std::string{data, len}, crc};
+}
+
+
+
+uint32_t gnu_debuglink_crc32(uint32_t crc, const unsigned char* buf, size_t len) {
+    static uint32_t table[256];
+    static bool initialised = false;
+    if (!initialised) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        initialised = true;
+    }
+
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc = table[(crc ^ buf[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+
+
+static bool file_exists(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+
+// 计算整个文件的CRC，用于校验debuglink指向的文件
+static bool check_debuglink_crc(const std::string& path, uint32_t crc) {
+    std::ifstream file {path, std::ios::binary};
+    if (!file) return false;
+
+    uint32_t value = 0;
+    std::vector<char> buf(1 << 16);
+    while (file) {
+        file.read(buf.data(), buf.size());
+        value = gnu_debuglink_crc32(value, reinterpret_cast<unsigned char*>(buf.data()), file.gcount());
+    }
+    return value == crc;
+}
+
+
+
+/**
+ * @brief: 按照gdb的查找顺序寻找分离的调试文件
+ *         1. /usr/lib/debug/.build-id/xx/yyyy.debug
+ *         2. debuglink: <dir>/<name>, <dir>/.debug/<name>, /usr/lib/debug/<dir>/<name>
+ */
+std::string find_separate_debuginfo(const std::string& prog_name, const elf::elf& f) {
+    auto build_id = read_build_id(f);
+    if (build_id.size() > 2) {
+        auto path = std::string{g_debug_file_directory} + "/.build-id/"
+                  + build_id.substr(0, 2) + "/" + build_id.substr(2) + ".debug";
+        if (file_exists(path)) return path;
+    }
+
+    auto link = read_debuglink(f);
+    if (link.name.empty()) return "";
+
+    // 可执行文件所在目录的绝对路径
+    char resolved[PATH_MAX];
+    std::string dir = ".";
+    if (realpath(prog_name.c_str(), resolved)) {
+        dir = resolved;
+        dir = dir.substr(0, dir.rfind('/'));
+    }
+
+    for (const auto& path : {dir + "/" + link.name,
+                             dir + "/.debug/" + link.name,
+                             std::string{g_debug_file_directory} + dir + "/" + link.name}) {
+        if (file_exists(path) && check_debuglink_crc(path, link.crc)) {
+            return path;
+        }
+    }
+    return "";
+}
+
+
+
+
+
+debuginfod_client::debuginfod_client() {
+    if (auto urls = getenv("DEBUGINFOD_URLS")) {
+        std::istringstream ss {urls};
+        std::string url;
+        while (ss >> url) {
+            if (url.compare(0, 7, "http://") != 0) {
+                std::cerr << "debuginfod: only http:// is supported, ignore " << url << std::endl;
+                continue;
+            }
+            while (url.size() > 7 && url.back() == '/') url.pop_back();
+            m_urls.push_back(url);
+        }
+    }
+
+    if (auto path = getenv("DEBUGINFOD_CACHE_PATH")) {
+        m_cache_path = path;
+    } else if (auto xdg = getenv("XDG_CACHE_HOME")) {
+        m_cache_path = std::string{xdg} + "/minidebug/debuginfod";
+    } else if (auto home = getenv("HOME")) {
+        m_cache_path = std::string{home} + "/.cache/minidebug/debuginfod";
+    } else {
+        m_cache_path = "/tmp/minidebug-debuginfod";
+    }
+}
+
+
+
+std::string debuginfod_client::cached_path(const std::string& build_id) const {
+    return m_cache_path + "/" + build_id + "/debuginfo";
+}
+
+
+
+// 逐级创建目录，相当于 mkdir -p
+static void make_directories(const std::string& path) {
+    for (size_t pos = 1; pos != std::string::npos; ) {
+        pos = path.find('/', pos + 1);
+        mkdir(path.substr(0, pos).c_str(), 0755);
+    }
+}
+
+
+
+/**
+ * @brief: 以HTTP/1.0请求[url]，把响应体写入[dest]
+ *         HTTP/1.0下服务器在发送完毕后关闭连接，因此不需要处理chunked编码
+ */
+static bool http_get_to_file(const std::string& url, const std::string& dest) {
+    // url格式: http://host[:port]/path
+    auto rest = url.substr(7);
+    auto slash = rest.find('/');
+    auto hostport = rest.substr(0, slash);
+    auto path = slash == std::string::npos ? "/" : rest.substr(slash);
+    auto colon = hostport.find(':');
+    auto host = hostport.substr(0, colon);
+    auto port = colon == std::string::npos ? "80" : hostport.substr(colon + 1);
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0) return false;
+
+    int sock = -1;
+    for (auto ai = res; ai; ai = ai->ai_next) {
+        sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (sock < 0) continue;
+        if (connect(sock, ai->ai_addr, ai->ai_addrlen) == 0) break;
+        close(sock);
+        sock = -1;
+    }
+    freeaddrinfo(res);
+    if (sock < 0) return false;
+
+    timeval timeout {30, 0};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    auto request = "GET " + path + " HTTP/1.0\r\nHost: " + hostport
+                 + "\r\nUser-Agent: minidebug\r\nAccept: */*\r\n\r\n";
+    if (send(sock, request.data(), request.size(), MSG_NOSIGNAL) != (ssize_t)request.size()) {
+        close(sock);
+        return false;
+    }
+
+    // 先读到响应头结束，检查状态码
+    std::string header;
+    char buf[1 << 16];
+    ssize_t n = 0;
+    size_t header_end = std::string::npos;
+    while (header_end == std::string::npos && (n = recv(sock, buf, sizeof(buf), 0)) > 0) {
+        header.append(buf, n);
+        header_end = header.find("\r\n\r\n");
+    }
+    if (header_end == std::string::npos || header.compare(0, 5, "HTTP/") != 0
+        || header.find(" 200 ") > header.find("\r\n")) {
+        close(sock);
+        return false;
+    }
+
+    std::ofstream out {dest, std::ios::binary | std::ios::trunc};
+    out.write(header.data() + header_end + 4, header.size() - header_end - 4);
+    while ((n = recv(sock, buf, sizeof(buf), 0)) > 0) {
+        out.write(buf, n);
+    }
+    close(sock);
+    return n == 0 && out.good();
+}
+
+
+
+std::string debuginfod_client::fetch(const std::string& build_id) const {
+    auto dest = cached_path(build_id);
+    if (file_exists(dest)) return dest;
+
+    make_directories(m_cache_path + "/" + build_id);
+    // 先写入临时文件，完成后再重命名，避免留下不完整的缓存
+    auto tmp = dest + ".tmp." + std::to_string(getpid());
+    for (const auto& url : m_urls) {
+        if (http_get_to_file(url + "/buildid/" + build_id + "/debuginfo", tmp)
+            && rename(tmp.c_str(), dest.c_str()) == 0) {
+            return dest;
+        }
+    }
+    unlink(tmp.c_str());
+    return "";
+}
+
+
+
+std::future<std::string> debuginfod_client::fetch_async(const std::string& build_id) const {
+    // 以值捕获，后台线程不依赖[this]的生命周期
+    return std::async(std::launch::async, [client = *this, build_id]() {
+        return client.fetch(build_id);
+    });
+}
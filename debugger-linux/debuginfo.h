@@ -0,0 +1,63 @@
+#ifndef _DEBUGINFO_H
+#define _DEBUGINFO_H
+
+
+#include <cstdint>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "libelfin/elf/elf++.hh"
+
+
+// 存放分离调试信息的系统目录
+constexpr const char* g_debug_file_directory = "/usr/lib/debug";
+
+
+// [.gnu_debuglink]中记录的调试文件名及其CRC32校验值
+struct debuglink {
+    std::string name;
+    uint32_t crc;
+};
+
+
+// 读取[.note.gnu.build-id]，以十六进制字符串返回。不存在时返回空字符串
+std::string read_build_id(const elf::elf& f);
+// 读取[.gnu_debuglink]，不存在时[name]为空
+debuglink read_debuglink(const elf::elf& f);
+// 与[.gnu_debuglink]兼容的CRC32
+uint32_t gnu_debuglink_crc32(uint32_t crc, const unsigned char* buf, size_t len);
+
+// 根据build-id与debuglink在本地查找分离的调试文件，找不到时返回空字符串
+std::string find_separate_debuginfo(const std::string& prog_name, const elf::elf& f);
+
+
+/**
+ * @brief: 兼容debuginfod协议的简易HTTP客户端
+ *         服务器地址来自环境变量[DEBUGINFOD_URLS]（以空格分隔，仅支持http://），
+ *         下载的文件以build-id为键存放在本地缓存目录：<cache>/<build-id>/debuginfo
+ */
+class debuginfod_client {
+public:
+    debuginfod_client();
+
+    // 是否配置了可用的服务器
+    auto is_enabled() const -> bool {return !m_urls.empty();}
+    // 缓存目录
+    auto get_cache_path() const -> const std::string& {return m_cache_path;}
+
+    // [build_id]在缓存中的路径
+    std::string cached_path(const std::string& build_id) const;
+    // 同步下载，依次尝试各个服务器，返回缓存中的文件路径；失败时返回空字符串
+    std::string fetch(const std::string& build_id) const;
+    // 在后台线程中下载，避免阻塞命令行
+    std::future<std::string> fetch_async(const std::string& build_id) const;
+
+private:
+    std::vector<std::string> m_urls;
+    std::string m_cache_path;
+};
+
+
+
+#endif /* _DEBUGINFO_H */
@@ -0,0 +1,199 @@
+/**
+ * @brief: debuginfod客户端的测试
+ *         在127.0.0.1上启动一个简易的debuginfod服务器代替真实的服务器，
+ *         它只认识一个build-id，并在发送响应体之前等待一段时间，模拟大文件的下载。
+ *         依次检查：异步下载不阻塞调用方、下载的内容与缓存路径、第二次命中缓存不再请求、
+ *         未知的build-id返回空字符串且不留下临时文件、不可用的服务器被跳过。
+ *
+ *         debuginfod_harness [delay_ms]
+ */
+#include "debuginfo.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+
+constexpr const char* known_build_id = "0123456789abcdef0123456789abcdef01234567";
+
+
+/**
+ * @brief: 只处理 GET /buildid/<id>/debuginfo 的HTTP/1.0服务器，每个连接处理一个请求后关闭
+ */
+class stand_in_server {
+public:
+    stand_in_server(std::string body, std::chrono::milliseconds delay) : m_body{std::move(body)}, m_delay{delay} {
+        m_sock = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        socklen_t len = sizeof(addr);
+        if (m_sock < 0 || bind(m_sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0
+            || listen(m_sock, 8) < 0 || getsockname(m_sock, reinterpret_cast<sockaddr*>(&addr), &len) < 0) {
+            throw std::runtime_error{"Can't start the stand-in server"};
+        }
+        m_port = ntohs(addr.sin_port);
+        m_thread = std::thread{&stand_in_server::serve, this};
+    }
+
+    ~stand_in_server() {
+        m_running = false;
+        shutdown(m_sock, SHUT_RDWR);
+        close(m_sock);
+        m_thread.join();
+    }
+
+    auto get_url() const -> std::string {return "http://127.0.0.1:" + std::to_string(m_port);}
+    auto get_requests() const -> int {return m_requests;}
+
+private:
+    void serve() {
+        while (m_running) {
+            int conn = accept(m_sock, nullptr, nullptr);
+            if (conn < 0) continue;
+            handle(conn);
+            close(conn);
+        }
+    }
+
+    void handle(int conn) {
+        std::string request;
+        char buf[4096];
+        ssize_t n;
+        while (request.find("\r\n\r\n") == std::string::npos && (n = recv(conn, buf, sizeof(buf), 0)) > 0) {
+            request.append(buf, n);
+        }
+        m_requests++;
+
+        std::istringstream ss {request};
+        std::string method, path;
+        ss >> method >> path;
+        if (method != "GET" || path != std::string{"/buildid/"} + known_build_id + "/debuginfo") {
+            send_all(conn, "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+            return;
+        }
+
+        send_all(conn, "HTTP/1.0 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: "
+                       + std::to_string(m_body.size()) + "\r\n\r\n");
+        std::this_thread::sleep_for(m_delay);
+        send_all(conn, m_body);
+    }
+
+    static void send_all(int conn, const std::string& data) {
+        for (std::size_t sent = 0; sent < data.size(); ) {
+            auto n = send(conn, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) return;
+            sent += n;
+        }
+    }
+
+    std::string m_body;
+    std::chrono::milliseconds m_delay;
+    int m_sock = -1;
+    int m_port = 0;
+    std::atomic<bool> m_running {true};
+    std::atomic<int> m_requests {0};
+    std::thread m_thread;
+};
+
+
+
+static int g_failures = 0;
+
+static void check(bool ok, const std::string& what) {
+    std::cout << (ok ? "PASS " : "FAIL ") << what << std::endl;
+    if (!ok) g_failures++;
+}
+
+
+static std::string read_file(const std::string& path) {
+    std::ifstream file {path, std::ios::binary};
+    std::ostringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+
+// [dir]中除了.与..之外的文件数
+static int count_entries(const std::string& dir) {
+    int count = 0;
+    if (auto d = opendir(dir.c_str())) {
+        while (auto entry = readdir(d)) {
+            if (std::strcmp(entry->d_name, ".") != 0 && std::strcmp(entry->d_name, "..") != 0) count++;
+        }
+        closedir(d);
+    }
+    return count;
+}
+
+
+
+int main(int argc, char* argv[]) {
+    std::chrono::milliseconds delay {argc > 1 ? std::stoi(argv[1]) : 300};
+
+    // 4 MiB的伪调试文件，内容可以校验
+    std::string body(4 << 20, '\0');
+    for (std::size_t i = 0; i < body.size(); i++) body[i] = static_cast<char>(i * 2654435761u >> 24);
+
+    char cache_template[] = "/tmp/minidebug-debuginfod-XXXXXX";
+    if (!mkdtemp(cache_template)) {
+        std::cerr << "Can't create the cache directory" << std::endl;
+        return 1;
+    }
+    std::string cache = cache_template;
+
+    stand_in_server server {body, delay};
+    // 第一个地址拒绝连接（端口1），第二个地址不是http://，都应该被跳过
+    auto urls = "http://127.0.0.1:1 https://example.invalid " + server.get_url();
+    setenv("DEBUGINFOD_URLS", urls.c_str(), 1);
+    setenv("DEBUGINFOD_CACHE_PATH", cache.c_str(), 1);
+    std::cout << "stand-in server: " << server.get_url() << ", cache: " << cache << std::endl;
+
+    debuginfod_client client;
+    check(client.is_enabled(), "client is enabled by DEBUGINFOD_URLS");
+    check(client.get_cache_path() == cache, "cache path comes from DEBUGINFOD_CACHE_PATH");
+
+    // 1. 异步下载：服务器在发送响应体前等待[delay]，调用方应当立即返回
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    auto future = client.fetch_async(known_build_id);
+    auto returned = clock::now() - start;
+    bool pending = future.wait_for(std::chrono::milliseconds{0}) == std::future_status::timeout;
+    auto path = future.get();
+    auto total = clock::now() - start;
+    auto ms = [](clock::duration d) {return std::chrono::duration<double, std::milli>(d).count();};
+    std::cout << "fetch_async returned after " << ms(returned) << " ms, download finished after "
+              << ms(total) << " ms" << std::endl;
+    check(pending && returned < delay / 2, "fetch_async does not block while the file downloads");
+    check(path == client.cached_path(known_build_id), "file is stored under <cache>/<build-id>/debuginfo");
+    check(read_file(path) == body, "downloaded content matches");
+    check(count_entries(cache + "/" + known_build_id) == 1, "no temporary file is left next to the cached file");
+
+    // 2. 命中缓存时不再请求服务器
+    auto requests = server.get_requests();
+    check(client.fetch(known_build_id) == path && server.get_requests() == requests, "second fetch is served from the cache");
+
+    // 3. 服务器返回404
+    std::string unknown = "ffffffffffffffffffffffffffffffffffffffff";
+    check(client.fetch_async(unknown).get().empty(), "unknown build-id returns an empty path");
+    check(count_entries(cache + "/" + unknown) == 0, "failed fetch leaves no file in the cache");
+
+    std::string cleanup = "rm -rf '" + cache + "'";
+    if (system(cleanup.c_str()) != 0) std::cerr << "Can't remove " << cache << std::endl;
+
+    std::cout << (g_failures ? "FAILED: " + std::to_string(g_failures) + " check(s)" : std::string{"all checks passed"}) << std::endl;
+    return g_failures ? 1 : 0;
+}
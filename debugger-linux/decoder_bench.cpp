@@ -0,0 +1,159 @@
+/**
+ * @brief: x86-64解码器的吞吐量测试
+ *         用<elf.h>解析共享库（默认为libc），从.text开头线性解码到结尾，
+ *         不能解码的字节跳过1字节继续。分别测试直接解码与经过[x86_decode_cache]的解码。
+ *
+ *         decoder_bench [path] [runs]
+ */
+#include "x86_decoder.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <elf.h>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+
+// 在ELF文件中找到.text，返回其内容与虚拟地址
+static bool find_text(const uint8_t* file, std::size_t size, const uint8_t*& text,
+                      std::size_t& text_size, uint64_t& text_addr) {
+    if (size < sizeof(Elf64_Ehdr) || std::memcmp(file, ELFMAG, SELFMAG) != 0) return false;
+    auto ehdr = reinterpret_cast<const Elf64_Ehdr*>(file);
+    if (ehdr->e_ident[EI_CLASS] != ELFCLASS64 || ehdr->e_shoff == 0) return false;
+    if (ehdr->e_shoff + ehdr->e_shnum * sizeof(Elf64_Shdr) > size) return false;
+
+    auto shdrs = reinterpret_cast<const Elf64_Shdr*>(file + ehdr->e_shoff);
+    auto strtab = file + shdrs[ehdr->e_shstrndx].sh_offset;
+    for (int i = 0; i < ehdr->e_shnum; i++) {
+        if (shdrs[i].sh_type != SHT_PROGBITS) continue;
+        if (std::strcmp(reinterpret_cast<const char*>(strtab + shdrs[i].sh_name), ".text") != 0) continue;
+        if (shdrs[i].sh_offset + shdrs[i].sh_size > size) return false;
+        text = file + shdrs[i].sh_offset;
+        text_size = shdrs[i].sh_size;
+        text_addr = shdrs[i].sh_addr;
+        return true;
+    }
+    return false;
+}
+
+
+
+struct sweep_result {
+    uint64_t insns = 0;
+    uint64_t unsupported = 0;
+    uint64_t branches[8] = {};
+    uint64_t memory = 0;
+    uint64_t vex = 0;
+    uint64_t evex = 0;
+};
+
+
+int main(int argc, char* argv[]) {
+    std::string path = argc > 1 ? argv[1] : "/lib/x86_64-linux-gnu/libc.so.6";
+    int runs = argc > 2 ? std::stoi(argv[2]) : 5;
+
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        std::cerr << "Can't open " << path << std::endl;
+        return 1;
+    }
+    auto file = static_cast<const uint8_t*>(mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0));
+    close(fd);
+    if (file == MAP_FAILED) {
+        std::cerr << "Can't map " << path << std::endl;
+        return 1;
+    }
+
+    const uint8_t* text;
+    std::size_t text_size;
+    uint64_t text_addr;
+    if (!find_text(file, st.st_size, text, text_size, text_addr)) {
+        std::cerr << "No .text in " << path << std::endl;
+        return 1;
+    }
+    std::cout << path << ": .text " << text_size << " bytes at 0x" << std::hex << text_addr << std::dec << std::endl;
+
+    using clock = std::chrono::steady_clock;
+    auto ms = [](clock::duration d) {return std::chrono::duration<double, std::milli>(d).count();};
+
+    // 1. 直接解码
+    sweep_result result;
+    double best = 1e30;
+    for (int run = 0; run < runs; run++) {
+        sweep_result r;
+        auto start = clock::now();
+        for (std::size_t pos = 0; pos < text_size; ) {
+            x86_insn insn;
+            if (!decode_x86(text + pos, text_size - pos, insn)) {
+                r.unsupported++;
+                pos++;
+                continue;
+            }
+            r.insns++;
+            r.branches[static_cast<int>(insn.branch)]++;
+            r.memory += insn.memory;
+            r.vex += insn.encoding == x86_encoding::vex;
+            r.evex += insn.encoding == x86_encoding::evex;
+            pos += insn.length;
+        }
+        best = std::min(best, ms(clock::now() - start));
+        result = r;
+    }
+
+    std::cout << "decode_x86:  " << result.insns << " instructions, " << result.unsupported << " undecodable bytes" << std::endl
+              << "  best of " << runs << ": " << best << " ms, "
+              << text_size / best / 1000 << " MB/s, " << result.insns / best / 1000 << " M insn/s" << std::endl
+              << "  call " << result.branches[int(x86_branch::call)]
+              << ", indirect call " << result.branches[int(x86_branch::indirect_call)]
+              << ", jmp " << result.branches[int(x86_branch::jump)]
+              << ", indirect jmp " << result.branches[int(x86_branch::indirect_jump)]
+              << ", jcc " << result.branches[int(x86_branch::cond_jump)]
+              << ", ret " << result.branches[int(x86_branch::ret)]
+              << ", syscall " << result.branches[int(x86_branch::syscall)]
+              << ", memory " << result.memory
+              << ", VEX " << result.vex << ", EVEX " << result.evex << std::endl;
+
+    // 2. 经过缓存：读取函数模拟从被调试进程中按页读取
+    auto reader = [&](std::uintptr_t addr, uint8_t* buf, std::size_t len) -> std::size_t {
+        if (addr < text_addr || addr >= text_addr + text_size) {
+            // .text开头所在页中不属于.text的部分
+            auto start = std::max<std::uintptr_t>(addr, text_addr);
+            if (start >= addr + len || start >= text_addr + text_size) return 0;
+            std::memset(buf, 0, start - addr);
+            auto n = std::min<std::size_t>(addr + len - start, text_addr + text_size - start);
+            std::memcpy(buf + (start - addr), text + (start - text_addr), n);
+            return start - addr + n;
+        }
+        auto n = std::min<std::size_t>(len, text_addr + text_size - addr);
+        std::memcpy(buf, text + (addr - text_addr), n);
+        return n;
+    };
+    x86_decode_cache cache {(text_size + decode_page_size - 1) / decode_page_size + 1};
+    auto cached_sweep = [&]() {
+        uint64_t n = 0;
+        for (auto addr = text_addr; addr < text_addr + text_size; ) {
+            auto insn = cache.decode(addr, reader);
+            addr += insn ? insn->length : 1;
+            n++;
+        }
+        return n;
+    };
+    auto start = clock::now();
+    cached_sweep();
+    auto cold = ms(clock::now() - start);
+    start = clock::now();
+    auto n = cached_sweep();
+    auto warm = ms(clock::now() - start);
+    std::cout << "decode cache: cold " << cold << " ms, warm " << warm << " ms ("
+              << n / warm / 1000 << " M lookups/s), hits " << cache.get_hits()
+              << ", misses " << cache.get_misses() << std::endl;
+
+    munmap(const_cast<uint8_t*>(file), st.st_size);
+    return 0;
+}
@@ -0,0 +1,143 @@
+#include "displaced_step.h"
+#include "inferior_call.h"
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/ptrace.h>
+#include <unistd.h>
+
+
+#ifdef __x86_64__
+
+
+// 每个slot的大小：最长的指令为15字节
+constexpr std::size_t slot_size = 16;
+constexpr std::size_t scratch_page_size = 4096;
+
+
+
+displaced_stepper::displaced_stepper(pid_t pid) : m_pid{pid}, m_tid{pid}, m_mem_fd{-1} {
+    set_pid(pid);
+}
+
+
+displaced_stepper::~displaced_stepper() {
+    if (m_mem_fd >= 0) close(m_mem_fd);
+}
+
+
+
+void displaced_stepper::set_pid(pid_t pid) {
+    if (m_mem_fd >= 0) close(m_mem_fd);
+    m_pid = pid;
+    m_tid = pid;
+    m_mem_fd = open(("/proc/" + std::to_string(pid) + "/mem").c_str(), O_RDWR);
+    m_pages.clear();
+    m_slots.clear();
+    m_active_slot = nullptr;
+}
+
+
+
+void displaced_stepper::invalidate(std::uintptr_t addr) {
+    // slot本身不回收，scratch页只会增长到断点数量 * 16 字节
+    m_slots.erase(addr);
+}
+
+
+
+std::uintptr_t displaced_stepper::allocate_slot(std::uintptr_t addr) {
+    for (auto& page : m_pages) {
+        if (page.used + slot_size <= scratch_page_size && within_rel32(page.base, addr)) {
+            auto copy = page.base + page.used;
+            page.used += slot_size;
+            return copy;
+        }
+    }
+
+    auto base = inject_mmap_near(m_tid, addr, scratch_page_size, PROT_READ | PROT_EXEC);
+    if (base == 0) return 0;
+    m_pages.push_back(scratch_page{base, slot_size});
+    return base;
+}
+
+
+
+bool displaced_stepper::prepare(std::uintptr_t addr, const uint8_t* code, std::size_t size,
+                                user_regs_struct& regs) {
+    if (m_mem_fd < 0) return false;
+
+    auto it = m_slots.find(addr);
+    if (it == m_slots.end()) {
+        x86_insn insn;
+        if (!code || !decode_x86(code, size, insn)) return false;
+        // syscall把返回地址写入rcx，fork/clone的子进程会从副本之后开始执行
+        if (insn.branch == x86_branch::syscall) return false;
+        // rep串操作单步一次只执行一轮，rip留在副本上，与没有执行无法区分
+        if (insn.rep) return false;
+
+        auto copy = allocate_slot(addr);
+        if (copy == 0) return false;
+
+        // 修正 [rip + disp32]：副本中的rip与原来相差 addr - copy
+        uint8_t buf[slot_size];
+        std::memcpy(buf, code, insn.length);
+        if (insn.rip_relative) {
+            int32_t disp;
+            std::memcpy(&disp, buf + insn.disp_offset, 4);
+            auto fixed = static_cast<int64_t>(disp) + static_cast<int64_t>(addr - copy);
+            if (fixed < INT32_MIN || fixed > INT32_MAX) return false;
+            disp = static_cast<int32_t>(fixed);
+            std::memcpy(buf + insn.disp_offset, &disp, 4);
+        }
+        if (pwrite(m_mem_fd, buf, insn.length, copy) != insn.length) return false;
+
+        it = m_slots.emplace(addr, slot{copy, insn}).first;
+    }
+
+    m_active_addr = addr;
+    m_active_slot = &it->second;
+    regs.rip = it->second.copy;
+    ptrace(PTRACE_SETREGS, m_tid, nullptr, &regs);
+    return true;
+}
+
+
+
+/**
+ * @brief: 副本执行后的rip：
+ *         1. 等于副本地址：指令没有执行（被信号打断或产生异常），回到原地址
+ *         2. 等于副本末尾：顺序执行，跳到原指令之后
+ *         3. 相对跳转被执行：目标是按副本地址计算的，加上 addr - copy
+ *         4. 间接跳转与ret：目标是绝对地址，不需要修正
+ *         call 压栈的返回地址指向副本，需要改为原指令之后
+ */
+void displaced_stepper::finish() {
+    if (!m_active_slot) return;
+    auto& s = *m_active_slot;
+    m_active_slot = nullptr;
+
+    user_regs_struct regs;
+    ptrace(PTRACE_GETREGS, m_tid, nullptr, &regs);
+    auto next = m_active_addr + s.insn.length;
+
+    bool executed = regs.rip != s.copy;
+    if (!executed) {
+        regs.rip = m_active_addr;
+    } else if (regs.rip == s.copy + s.insn.length) {
+        regs.rip = next;
+    } else if (s.insn.branch == x86_branch::jump || s.insn.branch == x86_branch::cond_jump
+               || s.insn.branch == x86_branch::call) {
+        regs.rip = regs.rip - s.copy + m_active_addr;
+    }
+
+    if (executed && (s.insn.branch == x86_branch::call || s.insn.branch == x86_branch::indirect_call)) {
+        ptrace(PTRACE_POKEDATA, m_tid, regs.rsp, next);
+    }
+    ptrace(PTRACE_SETREGS, m_tid, nullptr, &regs);
+    m_step_count++;
+}
+
+
+#endif /* __x86_64__ */
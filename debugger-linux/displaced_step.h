@@ -0,0 +1,83 @@
+#ifndef _DISPLACED_STEP_H
+#define _DISPLACED_STEP_H
+
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+#include <sys/user.h>
+
+#include "x86_decoder.h"
+
+
+#ifdef __x86_64__
+
+/**
+ * @brief: 位移单步（displaced stepping）
+ *         断点处的原指令被复制到被调试进程中的scratch页上执行，int3始终留在原处：
+ *           1. [prepare]: 复制指令，修正 [rip + disp32] 的位移，把rip指向副本
+ *           2. 调用者执行 PTRACE_SINGLESTEP
+ *           3. [finish]: 根据副本执行后的rip计算原位置上的rip，修正call压栈的返回地址
+ *         scratch页通过注入mmap分配在原指令附近（±2GB以内），每个断点地址占用一个slot，
+ *         副本写入一次后可以反复使用，之后的命中不再读写被调试进程的代码。
+ */
+class displaced_stepper {
+public:
+    explicit displaced_stepper(pid_t pid);
+    ~displaced_stepper();
+
+    displaced_stepper(const displaced_stepper&) = delete;
+    displaced_stepper& operator=(const displaced_stepper&) = delete;
+
+    // 切换到新的进程，旧进程中的scratch页不再使用
+    void set_pid(pid_t pid);
+    // 之后的位移单步在线程[tid]中进行；scratch页与副本由进程中的所有线程共用
+    void set_thread(pid_t tid) {m_tid = tid;}
+
+    // [addr]处的指令是否已有副本，有副本时[prepare]不需要原指令的字节
+    auto has_copy(std::uintptr_t addr) const -> bool {return m_slots.count(addr);}
+
+    // 准备在scratch中执行[addr]处的指令，[code]为原指令的字节（已去掉int3）
+    // [regs]为当前寄存器，成功时修改其rip并写回；不能位移执行时返回false
+    bool prepare(std::uintptr_t addr, const uint8_t* code, std::size_t size, user_regs_struct& regs);
+    // 单步执行后修正寄存器
+    void finish();
+
+    // [addr]处的代码已改变，丢弃缓存的副本
+    void invalidate(std::uintptr_t addr);
+
+    auto get_step_count() const -> uint64_t {return m_step_count;}
+
+private:
+    struct slot {
+        std::uintptr_t copy;    // 副本在scratch中的地址
+        x86_insn insn;
+    };
+
+    // 找到或分配与[addr]距离在±2GB以内的空闲slot
+    std::uintptr_t allocate_slot(std::uintptr_t addr);
+
+    pid_t m_pid;
+    pid_t m_tid;
+    int m_mem_fd;
+
+    // 已分配的scratch页，以及每页中下一个空闲slot的偏移
+    struct scratch_page {
+        std::uintptr_t base;
+        std::size_t used;
+    };
+    std::vector<scratch_page> m_pages;
+    std::unordered_map<std::uintptr_t, slot> m_slots;
+
+    // 正在进行的位移单步
+    std::uintptr_t m_active_addr = 0;
+    const slot* m_active_slot = nullptr;
+
+    uint64_t m_step_count = 0;
+};
+
+#endif /* __x86_64__ */
+
+
+#endif /* _DISPLACED_STEP_H */
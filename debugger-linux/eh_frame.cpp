@@ -0,0 +1,218 @@
+#include "eh_frame.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+
+
+uint64_t read_uleb128(const uint8_t*& p, const uint8_t* end) {
+    uint64_t result = 0;
+    int shift = 0;
+    while (p < end) {
+        uint8_t byte = *p++;
+        if (shift < 64) result |= uint64_t(byte & 0x7f) << shift;
+        shift += 7;
+        if (!(byte & 0x80)) break;
+    }
+    return result;
+}
+
+
+int64_t read_sleb128(const uint8_t*& p, const uint8_t* end) {
+    int64_t result = 0;
+    int shift = 0;
+    uint8_t byte = 0;
+    while (p < end) {
+        byte = *p++;
+        if (shift < 64) result |= int64_t(byte & 0x7f) << shift;
+        shift += 7;
+        if (!(byte & 0x80)) break;
+    }
+    // 符号扩展
+    if (shift < 64 && (byte & 0x40)) {
+        result |= -(int64_t(1) << shift);
+    }
+    return result;
+}
+
+
+
+template <typename T>
+static T read_value(const uint8_t*& p, const uint8_t* end) {
+    if (p + sizeof(T) > end) {
+        throw std::out_of_range{"call frame information is truncated"};
+    }
+    T value;
+    memcpy(&value, p, sizeof(T));
+    p += sizeof(T);
+    return value;
+}
+
+
+
+uint64_t call_frame_info::read_encoded_pointer(const uint8_t*& p, const uint8_t* end,
+                                               uint8_t encoding) const {
+    if (encoding == dw_eh_pe_omit) return 0;
+
+    // pc相对编码以字段本身的地址为基准
+    uint64_t field_addr = m_section_addr + (p - m_data);
+    uint64_t value = 0;
+
+    switch (encoding & 0x0f) {
+        case dw_eh_pe_absptr:   value = read_value<uint64_t>(p, end); break;
+        case dw_eh_pe_uleb128:  value = read_uleb128(p, end); break;
+        case dw_eh_pe_udata2:   value = read_value<uint16_t>(p, end); break;
+        case dw_eh_pe_udata4:   value = read_value<uint32_t>(p, end); break;
+        case dw_eh_pe_udata8:   value = read_value<uint64_t>(p, end); break;
+        case dw_eh_pe_sleb128:  value = read_sleb128(p, end); break;
+        case dw_eh_pe_sdata2:   value = read_value<int16_t>(p, end); break;
+        case dw_eh_pe_sdata4:   value = read_value<int32_t>(p, end); break;
+        case dw_eh_pe_sdata8:   value = read_value<int64_t>(p, end); break;
+        default:
+            throw std::runtime_error{"Unknown pointer encoding " + std::to_string(encoding)};
+    }
+
+    switch (encoding & 0x70) {
+        case 0:                 break;
+        case dw_eh_pe_pcrel:    value += field_addr; break;
+        // datarel/textrel/funcrel只出现在其他架构上
+        default: break;
+    }
+    return value;
+}
+
+
+
+size_t call_frame_info::parse_cie(const uint8_t* p, const uint8_t* end) {
+    cie c{};
+    c.fde_encoding = dw_eh_pe_absptr;
+
+    uint8_t version = read_value<uint8_t>(p, end);
+    std::string augmentation {reinterpret_cast<const char*>(p)};
+    p += augmentation.size() + 1;
+
+    if (!m_is_eh_frame && version >= 4) {
+        p += 2;     // address_size, segment_size
+    }
+
+    c.code_align = read_uleb128(p, end);
+    c.data_align = read_sleb128(p, end);
+    c.return_reg = version == 1 ? read_value<uint8_t>(p, end) : read_uleb128(p, end);
+
+    if (!augmentation.empty() && augmentation[0] == 'z') {
+        c.has_augmentation_data = true;
+        auto aug_len = read_uleb128(p, end);
+        auto aug_end = p + aug_len;
+        for (size_t i = 1; i < augmentation.size(); i++) {
+            switch (augmentation[i]) {
+                case 'L': read_value<uint8_t>(p, end); break;
+                case 'R': c.fde_encoding = read_value<uint8_t>(p, end); break;
+                case 'S': c.signal_frame = true; break;
+                case 'P': {
+                    auto enc = read_value<uint8_t>(p, end);
+                    read_encoded_pointer(p, end, enc & ~dw_eh_pe_indirect);
+                    break;
+                }
+                default: break;
+            }
+        }
+        p = aug_end;
+    }
+
+    c.instructions = p;
+    c.instructions_size = end - p;
+    m_cies.push_back(c);
+    return m_cies.size() - 1;
+}
+
+
+
+/**
+ * @brief: 依次解析每一条记录
+ *         length(4字节，0xffffffff表示其后为8字节长度) id(4或8字节)
+ *         [.eh_frame]中id为0表示CIE，否则为当前位置到CIE的距离；
+ *         [.debug_frame]中id为全1表示CIE，否则为CIE在section中的偏移
+ */
+void call_frame_info::parse(const void* data, size_t size, uint64_t section_addr, bool is_eh_frame) {
+    m_data = static_cast<const uint8_t*>(data);
+    m_size = size;
+    m_section_addr = section_addr;
+    m_is_eh_frame = is_eh_frame;
+    m_cies.clear();
+    m_fdes.clear();
+
+    // CIE在section中的偏移 -> [m_cies]下标
+    std::unordered_map<size_t, size_t> cie_offsets;
+
+    const uint8_t* p = m_data;
+    const uint8_t* section_end = m_data + m_size;
+    while (p + 4 <= section_end) {
+        const uint8_t* entry_start = p;
+        uint64_t length = read_value<uint32_t>(p, section_end);
+        if (length == 0) {
+            // [.eh_frame]以长度为0的记录结束
+            if (m_is_eh_frame) break;
+            continue;
+        }
+
+        bool is_64 = length == 0xffffffff;
+        if (is_64) length = read_value<uint64_t>(p, section_end);
+        const uint8_t* entry_end = p + length;
+        if (entry_end > section_end) break;
+
+        // 只有64位[.debug_frame]的id为8字节
+        bool id_64 = is_64 && !m_is_eh_frame;
+        const uint8_t* id_pos = p;
+        uint64_t id = id_64 ? read_value<uint64_t>(p, entry_end) : read_value<uint32_t>(p, entry_end);
+        uint64_t cie_id = m_is_eh_frame ? 0 : (id_64 ? ~uint64_t{0} : 0xffffffff);
+
+        if (id == cie_id) {
+            cie_offsets[entry_start - m_data] = parse_cie(p, entry_end);
+        } else {
+            size_t cie_offset = m_is_eh_frame ? (id_pos - id) - m_data : id;
+            auto it = cie_offsets.find(cie_offset);
+            if (it == cie_offsets.end()) {
+                // CIE可能位于FDE之后
+                const uint8_t* q = m_data + cie_offset;
+                uint64_t cie_length = read_value<uint32_t>(q, section_end);
+                if (cie_length == 0xffffffff) cie_length = read_value<uint64_t>(q, section_end);
+                const uint8_t* cie_end = std::min(q + cie_length, section_end);
+                q += id_64 ? 8 : 4;
+                it = cie_offsets.emplace(cie_offset, parse_cie(q, cie_end)).first;
+            }
+
+            fde f{};
+            f.cie_index = it->second;
+            const auto& c = m_cies[f.cie_index];
+            f.low_pc = read_encoded_pointer(p, entry_end, m_is_eh_frame ? c.fde_encoding : dw_eh_pe_absptr);
+            // 地址范围不含pc相对的部分
+            f.high_pc = f.low_pc + read_encoded_pointer(p, entry_end,
+                                        m_is_eh_frame ? (c.fde_encoding & 0x0f) : dw_eh_pe_absptr);
+            if (c.has_augmentation_data) {
+                auto aug_len = read_uleb128(p, entry_end);
+                p += aug_len;
+            }
+            f.instructions = p;
+            f.instructions_size = entry_end - p;
+            if (f.high_pc > f.low_pc) m_fdes.push_back(f);
+        }
+
+        p = entry_end;
+    }
+
+    std::sort(m_fdes.begin(), m_fdes.end(),
+              [](const fde& a, const fde& b) { return a.low_pc < b.low_pc; });
+}
+
+
+
+const fde* call_frame_info::find_fde(uint64_t pc) const {
+    // 找到第一个[low_pc] > pc的FDE，它的前一个可能包含pc
+    auto it = std::upper_bound(m_fdes.begin(), m_fdes.end(), pc,
+                               [](uint64_t pc, const fde& f) { return pc < f.low_pc; });
+    if (it == m_fdes.begin()) return nullptr;
+    --it;
+    return pc < it->high_pc ? &*it : nullptr;
+}
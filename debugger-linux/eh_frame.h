@@ -0,0 +1,90 @@
+#ifndef _EH_FRAME_H
+#define _EH_FRAME_H
+
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// [.eh_frame]中指针的编码方式 (DW_EH_PE_*)
+enum dw_eh_pe : uint8_t {
+    dw_eh_pe_absptr   = 0x00,
+    dw_eh_pe_uleb128  = 0x01,
+    dw_eh_pe_udata2   = 0x02,
+    dw_eh_pe_udata4   = 0x03,
+    dw_eh_pe_udata8   = 0x04,
+    dw_eh_pe_sleb128  = 0x09,
+    dw_eh_pe_sdata2   = 0x0a,
+    dw_eh_pe_sdata4   = 0x0b,
+    dw_eh_pe_sdata8   = 0x0c,
+    dw_eh_pe_pcrel    = 0x10,
+    dw_eh_pe_datarel  = 0x30,
+    dw_eh_pe_indirect = 0x80,
+    dw_eh_pe_omit     = 0xff,
+};
+
+
+// Common Information Entry: 多个FDE共享的信息
+struct cie {
+    uint64_t code_align;
+    int64_t data_align;
+    uint64_t return_reg;
+    uint8_t fde_encoding;
+    bool has_augmentation_data;     // 增强字符串以'z'开头
+    bool signal_frame;              // 增强字符串中含有'S'
+    const uint8_t* instructions;    // 初始CFA指令，指向section数据
+    size_t instructions_size;
+};
+
+
+// Frame Description Entry: 描述一个函数的地址范围 [low_pc, high_pc) 及其CFA指令
+struct fde {
+    uint64_t low_pc;
+    uint64_t high_pc;
+    size_t cie_index;
+    const uint8_t* instructions;
+    size_t instructions_size;
+};
+
+
+// 读取LEB128编码的整数，[p]会前进到下一个字段
+uint64_t read_uleb128(const uint8_t*& p, const uint8_t* end);
+int64_t read_sleb128(const uint8_t*& p, const uint8_t* end);
+
+
+
+/**
+ * @brief: 解析[.eh_frame]或[.debug_frame]中的CIE与FDE
+ *         section数据本身不会被拷贝，调用者需要保证其生命周期
+ */
+class call_frame_info {
+public:
+    call_frame_info() = default;
+
+    // [section_addr]为section的加载地址，用于解析pc相对编码的指针
+    void parse(const void* data, size_t size, uint64_t section_addr, bool is_eh_frame);
+
+    // 根据pc查找FDE，找不到时返回nullptr
+    const fde* find_fde(uint64_t pc) const;
+
+    auto get_fdes() const -> const std::vector<fde>& {return m_fdes;}
+    auto get_cie(const fde& f) const -> const cie& {return m_cies[f.cie_index];}
+    auto empty() const -> bool {return m_fdes.empty();}
+
+private:
+    uint64_t read_encoded_pointer(const uint8_t*& p, const uint8_t* end, uint8_t encoding) const;
+    size_t parse_cie(const uint8_t* p, const uint8_t* end);
+
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    uint64_t m_section_addr = 0;
+    bool m_is_eh_frame = true;
+
+    std::vector<cie> m_cies;
+    std::vector<fde> m_fdes;    // 按[low_pc]排序
+};
+
+
+
+#endif /* _EH_FRAME_H */
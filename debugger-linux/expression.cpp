@@ -0,0 +1,552 @@
+#include "expression.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <sys/ptrace.h>
+
+
+
+/**
+ * @brief: 对location表达式求值时记录访问了哪些寄存器，
+ *         用于判断变量的地址是否为 固定地址 或 寄存器+偏移
+ */
+class probe_expr_context : public dwarf::expr_context {
+public:
+    explicit probe_expr_context(uint64_t reg_value) : m_reg_value{reg_value} {}
+
+    dwarf::taddr reg(unsigned regnum) override {
+        m_regs.push_back(regnum);
+        return m_reg_value;
+    }
+    dwarf::taddr deref_size(dwarf::taddr address, unsigned size) override {
+        throw dwarf::expr_error{"location depends on memory"};
+    }
+
+    auto get_regs() const -> const std::vector<unsigned>& {return m_regs;}
+
+private:
+    uint64_t m_reg_value;
+    std::vector<unsigned> m_regs;
+};
+
+
+
+// DWARF寄存器编号 -> [reg_x86_64]
+static bool dwarf_to_reg(unsigned regnum, reg_x86_64& reg) {
+    auto it = std::find_if(g_register_descriptors.begin(), g_register_descriptors.end(),
+                           [regnum](const reg_descriptor& rd) { return rd.reg_dwarf_number == (int)regnum; });
+    if (it == g_register_descriptors.end()) return false;
+    reg = it->reg_index;
+    return true;
+}
+
+
+
+/**
+ * @brief: 用两组不同的寄存器值对location表达式求值：
+ *         1. 没有访问寄存器: 固定地址
+ *         2. 只访问了一个寄存器，且结果随寄存器值线性变化: 寄存器 + 偏移
+ *         3. 结果类型为寄存器: 变量在寄存器中
+ *         其他情况在命中时再用libelfin求值
+ */
+void classify_location(const dwarf::expr& loc, variable_info& var) {
+    var.expr = loc;
+    var.location = variable_info::kind::dwarf_expr;
+
+    try {
+        constexpr uint64_t base = 0x10000000;
+        probe_expr_context zero {0}, shifted {base};
+        auto r0 = loc.evaluate(&zero);
+        auto r1 = loc.evaluate(&shifted);
+
+        if (r0.location_type == dwarf::expr_result::type::reg) {
+            if (dwarf_to_reg(r0.value, var.reg)) var.location = variable_info::kind::in_register;
+            return;
+        }
+        if (r0.location_type != dwarf::expr_result::type::address) return;
+
+        if (zero.get_regs().empty()) {
+            var.location = variable_info::kind::absolute;
+            var.offset = r0.value;
+        } else if (zero.get_regs().size() == 1 && r1.value - r0.value == base
+                   && dwarf_to_reg(zero.get_regs()[0], var.reg)) {
+            var.location = variable_info::kind::reg_relative;
+            var.offset = r0.value;
+        }
+    } catch (std::exception&) {
+        // 保持dwarf_expr，命中时求值
+    }
+}
+
+
+
+expr_eval_context::expr_eval_context(pid_t pid) : m_pid{pid} {
+    ptrace(PTRACE_GETREGS, m_pid, nullptr, &m_regs);
+}
+
+
+expr_eval_context::expr_eval_context(pid_t pid, const user_regs_struct& regs, uint32_t unknown)
+    : m_pid{pid}, m_regs{regs}, m_unknown{unknown} {}
+
+
+uint64_t expr_eval_context::read(std::uintptr_t addr) {
+    auto it = m_memory.find(addr);
+    if (it != m_memory.end()) return it->second;
+
+    errno = 0;
+    uint64_t value = ptrace(PTRACE_PEEKDATA, m_pid, addr, nullptr);
+    if (errno != 0) {
+        throw std::out_of_range{"Can't access memory at address"};
+    }
+    m_memory[addr] = value;
+    return value;
+}
+
+
+dwarf::taddr expr_eval_context::reg(unsigned regnum) {
+    reg_x86_64 r;
+    if (!dwarf_to_reg(regnum, r)) {
+        throw std::out_of_range{"Unknown dwarf register"};
+    }
+    return get_reg(r);
+}
+
+
+dwarf::taddr expr_eval_context::deref_size(dwarf::taddr address, unsigned size) {
+    auto value = read(address);
+    return size >= 8 ? value : value & ((uint64_t{1} << (size * 8)) - 1);
+}
+
+
+
+// 截断为[size]字节，必要时进行符号扩展
+static int64_t truncate_value(uint64_t value, std::size_t size, bool is_signed) {
+    if (size >= 8) return value;
+    auto shift = 64 - size * 8;
+    return is_signed ? (int64_t)(value << shift) >> shift : (int64_t)((value << shift) >> shift);
+}
+
+
+
+
+
+/**
+ * @brief: 递归下降解析，优先级从低到高：
+ *         ||  &&  |  ^  &  == !=  < <= > >=  << >>  + -  * / %  一元(- ! ~ *)
+ *         基本单元：整数(十进制/0x十六进制)、变量名、$寄存器、括号
+ */
+class expr_parser {
+public:
+    expr_parser(const std::string& text, const variable_resolver& resolver, compiled_expr& out)
+        : m_text{text}, m_pos{0}, m_resolver{resolver}, m_out{out} {}
+
+    void parse() {
+        parse_binary(0);
+        skip_space();
+        if (m_pos != m_text.size()) error("unexpected '" + m_text.substr(m_pos) + "'");
+    }
+
+private:
+    struct binary_op {
+        const char* token;
+        int precedence;
+        opcode op;
+    };
+
+    void error(const std::string& msg) {
+        throw std::invalid_argument{"Bad expression: " + msg};
+    }
+
+    void skip_space() {
+        while (m_pos < m_text.size() && isspace(m_text[m_pos])) m_pos++;
+    }
+
+    bool accept(const char* token) {
+        skip_space();
+        auto len = strlen(token);
+        if (m_text.compare(m_pos, len, token) != 0) return false;
+        m_pos += len;
+        return true;
+    }
+
+    void emit(opcode op, int64_t operand = 0, uint8_t size = 8, bool is_signed = true,
+              reg_x86_64 reg = reg_x86_64::rax) {
+        m_out.m_code.push_back(instruction{op, size, is_signed, reg, operand});
+    }
+
+    // 查找下一个二元运算符（较长的符号优先匹配）
+    const binary_op* peek_binary() {
+        static const binary_op ops[] = {
+            {"||", 1, opcode::or_else},  {"&&", 2, opcode::and_then},
+            {"==", 6, opcode::eq},       {"!=", 6, opcode::ne},
+            {"<=", 7, opcode::le},       {">=", 7, opcode::ge},
+            {"<<", 8, opcode::shl},      {">>", 8, opcode::shr},
+            {"<", 7, opcode::lt},        {">", 7, opcode::gt},
+            {"|", 3, opcode::bit_or},    {"^", 4, opcode::bit_xor},
+            {"&", 5, opcode::bit_and},
+            {"+", 9, opcode::add},       {"-", 9, opcode::sub},
+            {"*", 10, opcode::mul},      {"/", 10, opcode::div},
+            {"%", 10, opcode::mod},
+        };
+        skip_space();
+        for (const auto& op : ops) {
+            if (m_text.compare(m_pos, strlen(op.token), op.token) == 0) return &op;
+        }
+        return nullptr;
+    }
+
+    void parse_binary(int min_precedence) {
+        parse_unary();
+        const binary_op* op;
+        while ((op = peek_binary()) && op->precedence > min_precedence) {
+            m_pos += strlen(op->token);
+
+            if (op->op == opcode::and_then || op->op == opcode::or_else) {
+                // 短路求值：跳转目标在右侧表达式编译完成后回填
+                auto jump = m_out.m_code.size();
+                emit(op->op);
+                parse_binary(op->precedence);
+                emit(opcode::to_bool);
+                m_out.m_code[jump].operand = m_out.m_code.size();
+            } else {
+                parse_binary(op->precedence);
+                emit(op->op);
+            }
+        }
+    }
+
+    void parse_unary() {
+        if (accept("-")) { parse_unary(); emit(opcode::neg); return; }
+        if (accept("!")) { parse_unary(); emit(opcode::log_not); return; }
+        if (accept("~")) { parse_unary(); emit(opcode::bit_not); return; }
+        if (accept("*")) { parse_unary(); emit(opcode::deref, 0, 8, false); return; }
+        parse_primary();
+    }
+
+    void parse_primary() {
+        skip_space();
+        if (m_pos >= m_text.size()) error("unexpected end");
+
+        if (accept("(")) {
+            parse_binary(0);
+            if (!accept(")")) error("missing ')'");
+            return;
+        }
+
+        char c = m_text[m_pos];
+        if (isdigit(c)) {
+            size_t len;
+            auto value = std::stoull(m_text.substr(m_pos), &len, 0);
+            m_pos += len;
+            emit(opcode::push_const, value);
+            return;
+        }
+
+        if (c == '$' || isalpha(c) || c == '_') {
+            auto start = m_pos++;
+            while (m_pos < m_text.size() && (isalnum(m_text[m_pos]) || m_text[m_pos] == '_')) m_pos++;
+            auto name = m_text.substr(start, m_pos - start);
+
+            if (name[0] == '$') {
+                auto it = std::find_if(g_register_descriptors.begin(), g_register_descriptors.end(),
+                                       [&name](const reg_descriptor& rd) { return rd.reg_name == name.substr(1); });
+                if (it == g_register_descriptors.end()) error("unknown register " + name);
+                emit(opcode::load_reg, 0, 8, false, it->reg_index);
+                return;
+            }
+            emit_variable(name);
+            return;
+        }
+
+        error("unexpected '" + std::string{c} + "'");
+    }
+
+    void emit_variable(const std::string& name) {
+        variable_info var;
+        if (!m_resolver(name, var)) error("no variable named " + name);
+        if (var.size == 0 || var.size > 8) error(name + " is not a scalar");
+
+        auto size = static_cast<uint8_t>(var.size);
+        switch (var.location) {
+            case variable_info::kind::absolute:
+                emit(opcode::load_mem, var.offset, size, var.is_signed);
+                break;
+            case variable_info::kind::reg_relative:
+                emit(opcode::load_reg_rel, var.offset, size, var.is_signed, var.reg);
+                break;
+            case variable_info::kind::in_register:
+                emit(opcode::load_reg, 0, size, var.is_signed, var.reg);
+                break;
+            case variable_info::kind::dwarf_expr:
+                m_out.m_dwarf_vars.push_back(var);
+                emit(opcode::load_dwarf, m_out.m_dwarf_vars.size() - 1, size, var.is_signed);
+                break;
+        }
+    }
+
+    const std::string& m_text;
+    size_t m_pos;
+    const variable_resolver& m_resolver;
+    compiled_expr& m_out;
+};
+
+
+
+compiled_expr compiled_expr::compile(const std::string& text, const variable_resolver& resolver) {
+    compiled_expr out;
+    out.m_text = text;
+    expr_parser parser {text, resolver, out};
+    parser.parse();
+    return out;
+}
+
+
+
+int64_t compiled_expr::evaluate(expr_eval_context& ctx) {
+    auto start = std::chrono::steady_clock::now();
+
+    int64_t stack[64];
+    int sp = 0;
+    auto push = [&](int64_t v) {
+        if (sp == 64) throw std::overflow_error{"expression stack overflow"};
+        stack[sp++] = v;
+    };
+
+    for (size_t pc = 0; pc < m_code.size(); pc++) {
+        const auto& ins = m_code[pc];
+        switch (ins.op) {
+            case opcode::push_const:
+                push(ins.operand);
+                break;
+            case opcode::load_reg:
+                push(truncate_value(ctx.get_reg(ins.reg), ins.size, ins.is_signed));
+                break;
+            case opcode::load_mem:
+                push(truncate_value(ctx.read(ins.operand), ins.size, ins.is_signed));
+                break;
+            case opcode::load_reg_rel:
+                push(truncate_value(ctx.read(ctx.get_reg(ins.reg) + ins.operand), ins.size, ins.is_signed));
+                break;
+            case opcode::load_dwarf: {
+                const auto& var = m_dwarf_vars[ins.operand];
+                auto result = var.expr->evaluate(&ctx);
+                uint64_t value = result.location_type == dwarf::expr_result::type::address
+                               ? ctx.read(result.value) : ctx.reg(result.value);
+                push(truncate_value(value, ins.size, ins.is_signed));
+                break;
+            }
+            case opcode::deref:
+                stack[sp - 1] = ctx.read(stack[sp - 1]);
+                break;
+
+            case opcode::neg:     stack[sp - 1] = -stack[sp - 1]; break;
+            case opcode::log_not: stack[sp - 1] = !stack[sp - 1]; break;
+            case opcode::bit_not: stack[sp - 1] = ~stack[sp - 1]; break;
+            case opcode::to_bool: stack[sp - 1] = stack[sp - 1] != 0; break;
+
+            case opcode::and_then:
+                if (stack[sp - 1] == 0) { pc = ins.operand - 1; } else { sp--; }
+                break;
+            case opcode::or_else:
+                if (stack[sp - 1] != 0) { stack[sp - 1] = 1; pc = ins.operand - 1; } else { sp--; }
+                break;
+
+            default: {
+                auto b = stack[--sp];
+                auto& a = stack[sp - 1];
+                switch (ins.op) {
+                    case opcode::add:     a = a + b; break;
+                    case opcode::sub:     a = a - b; break;
+                    case opcode::mul:     a = a * b; break;
+                    // INT64_MIN / -1 溢出，x86的idiv产生SIGFPE：商按64位回绕，余数为0
+                    case opcode::div:
+                        if (b == 0) throw std::domain_error{"division by zero"};
+                        a = (b == -1 && a == INT64_MIN) ? INT64_MIN : a / b; break;
+                    case opcode::mod:
+                        if (b == 0) throw std::domain_error{"division by zero"};
+                        a = (b == -1) ? 0 : a % b; break;
+                    // 移位数在[0, 64)之外是未定义行为；左移在无符号数上进行，负数左移也有定义
+                    case opcode::shl:
+                        if (b < 0 || b >= 64) throw std::domain_error{"shift count out of range"};
+                        a = static_cast<int64_t>(static_cast<uint64_t>(a) << b); break;
+                    case opcode::shr:
+                        if (b < 0 || b >= 64) throw std::domain_error{"shift count out of range"};
+                        a = a >> b; break;
+                    case opcode::bit_and: a = a & b; break;
+                    case opcode::bit_or:  a = a | b; break;
+                    case opcode::bit_xor: a = a ^ b; break;
+                    case opcode::eq:      a = a == b; break;
+                    case opcode::ne:      a = a != b; break;
+                    case opcode::lt:      a = a < b; break;
+                    case opcode::le:      a = a <= b; break;
+                    case opcode::gt:      a = a > b; break;
+                    case opcode::ge:      a = a >= b; break;
+                    default: throw std::logic_error{"bad opcode"};
+                }
+            }
+        }
+    }
+
+    m_eval_count++;
+    m_eval_time_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now() - start).count();
+    return sp > 0 ? stack[sp - 1] : 0;
+}
+
+
+
+// 按最外层的逗号拆分，忽略括号与引号中的逗号
+static std::vector<std::string> split_arguments(const std::string& text) {
+    std::vector<std::string> out;
+    std::string current;
+    int depth = 0;
+    bool quoted = false;
+    for (size_t i = 0; i < text.size(); i++) {
+        char c = text[i];
+        if (quoted) {
+            current += c;
+            if (c == '\\' && i + 1 < text.size()) current += text[++i];
+            else if (c == '"') quoted = false;
+            continue;
+        }
+        if (c == '"') quoted = true;
+        if (c == '(') depth++;
+        if (c == ')') depth--;
+        if (c == ',' && depth == 0) {
+            out.push_back(current);
+            current.clear();
+            continue;
+        }
+        current += c;
+    }
+    out.push_back(current);
+    return out;
+}
+
+
+static std::string trim(const std::string& s) {
+    auto first = s.find_first_not_of(" \t");
+    if (first == std::string::npos) return "";
+    auto last = s.find_last_not_of(" \t");
+    return s.substr(first, last - first + 1);
+}
+
+
+
+dprintf_format dprintf_format::parse(const std::string& text, const variable_resolver& resolver) {
+    auto args = split_arguments(text);
+    auto fmt = trim(args[0]);
+    if (fmt.size() < 2 || fmt.front() != '"' || fmt.back() != '"') {
+        throw std::invalid_argument{"Format string must be quoted"};
+    }
+
+    // 处理转义字符
+    std::string unescaped;
+    for (size_t i = 1; i + 1 < fmt.size(); i++) {
+        if (fmt[i] != '\\' || i + 2 >= fmt.size()) {
+            unescaped += fmt[i];
+            continue;
+        }
+        switch (fmt[++i]) {
+            case 'n': unescaped += '\n'; break;
+            case 't': unescaped += '\t'; break;
+            default:  unescaped += fmt[i]; break;
+        }
+    }
+
+    dprintf_format out;
+    out.m_text = text;
+    segment seg {"", "", 0};
+    for (size_t i = 0; i < unescaped.size(); i++) {
+        if (unescaped[i] != '%') {
+            seg.literal += unescaped[i];
+            continue;
+        }
+        if (i + 1 < unescaped.size() && unescaped[i + 1] == '%') {
+            seg.literal += '%';
+            i++;
+            continue;
+        }
+
+        // %[flags][width][.precision][length]conversion
+        auto j = i + 1;
+        while (j < unescaped.size() && strchr("-+ #0123456789.", unescaped[j])) j++;
+        seg.spec = "%" + unescaped.substr(i + 1, j - i - 1);
+        while (j < unescaped.size() && strchr("hlLqjzt", unescaped[j])) j++;
+        if (j >= unescaped.size() || !strchr("diuxXocps", unescaped[j])) {
+            throw std::invalid_argument{"Unsupported conversion in format string"};
+        }
+        seg.conversion = unescaped[j];
+        out.m_segments.push_back(seg);
+        seg = segment{"", "", 0};
+        i = j;
+    }
+    if (!seg.literal.empty()) out.m_segments.push_back(seg);
+
+    for (size_t i = 1; i < args.size(); i++) {
+        out.m_args.push_back(compiled_expr::compile(trim(args[i]), resolver));
+    }
+
+    auto conversions = std::count_if(out.m_segments.begin(), out.m_segments.end(),
+                                     [](const segment& s) { return s.conversion != 0; });
+    if ((size_t)conversions != out.m_args.size()) {
+        throw std::invalid_argument{"Format string expects " + std::to_string(conversions)
+                                    + " arguments, got " + std::to_string(out.m_args.size())};
+    }
+    return out;
+}
+
+
+
+std::string dprintf_format::read_string(expr_eval_context& ctx, std::uintptr_t addr) {
+    constexpr size_t max_length = 256;
+    std::string out;
+    while (out.size() < max_length) {
+        auto word = ctx.read(addr + out.size());
+        for (int i = 0; i < 8; i++) {
+            char c = (word >> (i * 8)) & 0xff;
+            if (c == '\0') return out;
+            out += c;
+        }
+    }
+    return out + "...";
+}
+
+
+
+std::string dprintf_format::format(expr_eval_context& ctx) {
+    std::string out;
+    char buf[512];
+    size_t arg = 0;
+
+    for (const auto& seg : m_segments) {
+        out += seg.literal;
+        if (!seg.conversion) continue;
+
+        auto value = m_args[arg++].evaluate(ctx);
+        auto spec = seg.spec;
+        switch (seg.conversion) {
+            case 'd': case 'i':
+                snprintf(buf, sizeof(buf), (spec + "lld").c_str(), (long long)value);
+                break;
+            case 'u': case 'x': case 'X': case 'o':
+                snprintf(buf, sizeof(buf), (spec + "ll" + seg.conversion).c_str(), (unsigned long long)value);
+                break;
+            case 'c':
+                snprintf(buf, sizeof(buf), (spec + "c").c_str(), (int)(char)value);
+                break;
+            case 'p':
+                snprintf(buf, sizeof(buf), (spec + "#llx").c_str(), (unsigned long long)value);
+                break;
+            case 's':
+                snprintf(buf, sizeof(buf), (spec + "s").c_str(), read_string(ctx, value).c_str());
+                break;
+        }
+        out += buf;
+    }
+    return out;
+}
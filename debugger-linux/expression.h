@@ -0,0 +1,167 @@
+#ifndef _EXPRESSION_H
+#define _EXPRESSION_H
+
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+#include <sys/user.h>
+
+#include "register.h"
+#include "libelfin/dwarf/dwarf++.hh"
+
+
+
+// 变量在运行时的位置，编译表达式时根据DWARF确定一次
+struct variable_info {
+    enum class kind {
+        absolute,       // 固定地址（全局变量、静态变量）
+        reg_relative,   // 寄存器 + 偏移（栈上的局部变量）
+        in_register,    // 变量的值就在寄存器中
+        dwarf_expr,     // 其他情况，命中时再对location表达式求值
+    };
+
+    kind location;
+    int64_t offset;         // absolute: 地址; reg_relative: 偏移
+    reg_x86_64 reg;         // reg_relative / in_register
+    std::size_t size;
+    bool is_signed;
+    std::optional<dwarf::expr> expr;
+};
+
+// 根据变量名查找变量的位置，找不到时返回false
+using variable_resolver = std::function<bool(const std::string&, variable_info&)>;
+
+// 分析DW_AT_location表达式，尽量把它化简为固定地址或寄存器+偏移
+void classify_location(const dwarf::expr& loc, variable_info& var);
+
+
+
+/**
+ * @brief: 表达式求值的上下文。寄存器在构造时一次性读取，
+ *         内存按8字节缓存，同一次求值中重复读取同一地址不会再次调用ptrace
+ */
+class expr_eval_context : public dwarf::expr_context {
+public:
+    explicit expr_eval_context(pid_t pid);
+    // 外层栈帧：寄存器由栈回溯得到，[unknown]中（按[reg_x86_64]编号）的寄存器没有被保存
+    expr_eval_context(pid_t pid, const user_regs_struct& regs, uint32_t unknown);
+
+    auto get_reg(reg_x86_64 r) const -> uint64_t {
+        if (m_unknown & (1u << (int)r)) throw std::out_of_range{"Register " + get_register_name(r) + " not saved in this frame"};
+        return *(reinterpret_cast<const uint64_t*>(&m_regs) + (uint64_t)r);
+    }
+    auto get_regs() const -> const user_regs_struct& {return m_regs;}
+    uint64_t read(std::uintptr_t addr);
+
+    // 供libelfin对location表达式求值
+    dwarf::taddr reg(unsigned regnum) override;
+    dwarf::taddr deref_size(dwarf::taddr address, unsigned size) override;
+
+private:
+    pid_t m_pid;
+    user_regs_struct m_regs;
+    uint32_t m_unknown = 0;
+    std::unordered_map<std::uintptr_t, uint64_t> m_memory;
+};
+
+
+
+// 字节码的操作码
+enum class opcode : uint8_t {
+    push_const,     // operand
+    load_reg,       // reg
+    load_mem,       // *(operand)
+    load_reg_rel,   // *(reg + operand)
+    load_dwarf,     // m_dwarf_vars[operand]
+    deref,          // *(pop)
+    neg, log_not, bit_not,
+    add, sub, mul, div, mod, shl, shr,
+    bit_and, bit_or, bit_xor,
+    eq, ne, lt, le, gt, ge,
+    and_then,       // 栈顶为0时跳转到operand，否则弹出
+    or_else,        // 栈顶非0时置1并跳转到operand，否则弹出
+    to_bool,
+};
+
+// 一条字节码指令
+struct instruction {
+    opcode op;
+    uint8_t size;       // 读取内存的字节数
+    bool is_signed;     // 是否符号扩展
+    reg_x86_64 reg;
+    int64_t operand;
+};
+
+
+
+/**
+ * @brief: 编译后的表达式
+ *         表达式只解析一次，变量的位置与类型在编译时确定，
+ *         每次断点命中时只需在缓存的寄存器与内存上执行字节码
+ */
+class compiled_expr {
+public:
+    compiled_expr() = default;
+
+    // 解析[text]，变量通过[resolver]查找。语法错误时抛出std::invalid_argument
+    static compiled_expr compile(const std::string& text, const variable_resolver& resolver);
+
+    // 执行字节码，返回表达式的值
+    int64_t evaluate(expr_eval_context& ctx);
+
+    auto get_text() const -> const std::string& {return m_text;}
+    auto get_code() const -> const std::vector<instruction>& {return m_code;}
+    auto get_eval_count() const -> uint64_t {return m_eval_count;}
+    auto get_eval_time_ns() const -> uint64_t {return m_eval_time_ns;}
+
+private:
+    friend class expr_parser;
+
+    std::string m_text;
+    std::vector<instruction> m_code;
+    std::vector<variable_info> m_dwarf_vars;   // 需要在命中时求值的变量
+
+    uint64_t m_eval_count = 0;
+    uint64_t m_eval_time_ns = 0;
+};
+
+/**
+ * @brief: dprintf的格式串与参数："fmt", expr1, expr2, ...
+ *         格式串在设置断点时拆分为若干段，参数编译为[compiled_expr]，
+ *         命中时只需求值并拼接，支持 %d %i %u %x %X %o %c %p %s %%
+ */
+class dprintf_format {
+public:
+    // 解析[text]，语法错误时抛出std::invalid_argument
+    static dprintf_format parse(const std::string& text, const variable_resolver& resolver);
+
+    // 对参数求值并格式化
+    std::string format(expr_eval_context& ctx);
+
+    auto get_text() const -> const std::string& {return m_text;}
+
+private:
+    // 一段字面文本，后跟一个转换说明（最后一段可以没有）
+    struct segment {
+        std::string literal;
+        std::string spec;   // 去掉长度修饰后的 flags/width/precision
+        char conversion;    // 0表示没有转换
+    };
+
+    // 读取被调试进程中以'\0'结尾的字符串
+    static std::string read_string(expr_eval_context& ctx, std::uintptr_t addr);
+
+    std::string m_text;
+    std::vector<segment> m_segments;
+    std::vector<compiled_expr> m_args;
+};
+
+
+
+#endif /* _EXPRESSION_H */
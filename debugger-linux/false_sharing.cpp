@@ -0,0 +1,284 @@
+#include "false_sharing.h"
+#include "debug_registers.h"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstddef>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+#include <sys/ptrace.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+#ifdef __x86_64__
+
+
+bool false_sharing_sampler::run(const std::vector<std::uintptr_t>& lines, std::chrono::milliseconds duration,
+                                std::chrono::milliseconds slice, std::map<pid_t, int>& threads) {
+    using clock = std::chrono::steady_clock;
+
+    m_samples.clear();
+    for (auto addr : lines) {
+        m_samples.push_back(cache_line_sample{addr & ~(cache_line_size - 1), {}, {}, {}});
+    }
+    if (m_samples.empty()) return true;
+
+    take_threads(threads);
+
+    auto deadline = clock::now() + duration;
+    std::size_t window = 0;
+    try {
+        while (!m_exited && clock::now() < deadline) {
+            arm(window);
+            auto start = clock::now();
+            auto end = std::min(start + slice, deadline);
+            for (auto& thread : m_threads) resume(thread);
+
+            // 命中的线程记录后立即恢复，其他线程不受影响；clone出的新线程也一起恢复
+            while (!m_exited && clock::now() < end) {
+                int status;
+                auto tid = waitpid(-1, &status, __WALL | WNOHANG);
+                if (tid == 0) {
+                    std::this_thread::sleep_for(std::chrono::microseconds{100});
+                    continue;
+                }
+                if (tid < 0) {
+                    if (errno == EINTR) continue;
+                    m_exited = true;
+                    break;
+                }
+                if (handle_stop(tid, status) != nullptr) {
+                    for (auto& thread : m_threads) resume(thread);
+                }
+            }
+
+            if (!m_exited) stop_all();
+            m_samples[window / 2].watched[window % 2] +=
+                std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start);
+            window = (window + 1) % (2 * m_samples.size());
+        }
+        if (!m_exited) disarm();
+        release_threads(threads);
+    } catch (...) {
+        if (!m_exited) {
+            try {
+                stop_all();
+                disarm();
+            } catch (std::exception&) {}
+        }
+        release_threads(threads);
+        throw;
+    }
+    return !m_exited;
+}
+
+
+
+void false_sharing_sampler::take_threads(const std::map<pid_t, int>& threads) {
+    m_threads.clear();
+    m_thread_names.clear();
+    m_exited = false;
+    m_exit_status = 0;
+    for (const auto& [tid, signal] : threads) {
+        m_threads.push_back(thread_state{tid, true, false, signal});
+        read_name(tid);
+    }
+}
+
+
+
+void false_sharing_sampler::read_name(pid_t tid) {
+    std::ifstream comm {"/proc/" + std::to_string(m_pid) + "/task/" + std::to_string(tid) + "/comm"};
+    std::string name;
+    std::getline(comm, name);
+    m_thread_names[tid] = name;
+}
+
+
+
+void false_sharing_sampler::release_threads(std::map<pid_t, int>& threads) {
+    threads.clear();
+    for (const auto& thread : m_threads) threads[thread.tid] = thread.signal;
+    m_threads.clear();
+}
+
+
+
+/**
+ * @brief: 新线程在执行任何指令之前以PTRACE_EVENT_STOP停下，这次停止可能先于clone事件被waitpid取得，
+ *         此时它已经在[handle_stop]中加入
+ */
+void false_sharing_sampler::add_new_thread(pid_t parent) {
+    unsigned long tid = 0;
+    ptrace(PTRACE_GETEVENTMSG, parent, nullptr, &tid);
+    if (find_thread(tid) != nullptr) return;
+    int status;
+    waitpid(tid, &status, __WALL);
+    if (!WIFSTOPPED(status)) return;
+    m_threads.push_back(thread_state{static_cast<pid_t>(tid), true, false, 0});
+    read_name(tid);
+    arm_thread(tid);
+}
+
+
+
+/**
+ * @brief: 四个slot都是8字节的写数据断点
+ *         DR7: L_i = 1, RW_i = 01(写), LEN_i = 10(8字节)
+ */
+void false_sharing_sampler::arm(std::size_t window) {
+    m_window = window;
+    auto base = m_samples[window / 2].addr + (window % 2) * false_share_window;
+
+    uint64_t dr7 = 0;
+    for (int i = 0; i < n_debug_slots; i++) {
+        dr7 |= uint64_t{1} << (2 * i);
+        dr7 |= uint64_t(dr_condition::write) << (16 + 4 * i);
+        dr7 |= uint64_t{0b10} << (18 + 4 * i);
+    }
+    m_dr7 = dr7;
+    m_base = base;
+    for (const auto& thread : m_threads) arm_thread(thread.tid);
+}
+
+
+
+void false_sharing_sampler::arm_thread(pid_t tid) {
+    for (int i = 0; i < n_debug_slots; i++) {
+        set_debug_register(tid, i, m_base + i * false_share_field_size);
+    }
+    set_debug_register(tid, 6, 0);
+    set_debug_register(tid, 7, m_dr7);
+}
+
+
+
+void false_sharing_sampler::disarm() {
+    for (const auto& thread : m_threads) {
+        set_debug_register(thread.tid, 7, 0);
+        set_debug_register(thread.tid, 6, 0);
+    }
+}
+
+
+
+/**
+ * @brief: 请求的停止到达之前线程可能因为其他原因停下（例如命中），此时记录后恢复并继续等待，
+ *         保证返回时没有残留的中断请求
+ */
+void false_sharing_sampler::stop_all() {
+    for (auto& thread : m_threads) {
+        if (thread.stopped || thread.stop_requested) continue;
+        ptrace(PTRACE_INTERRUPT, thread.tid, nullptr, nullptr);
+        thread.stop_requested = true;
+    }
+
+    auto pending = [this]() {
+        return std::any_of(m_threads.begin(), m_threads.end(),
+                           [](const thread_state& t) { return !t.stopped || t.stop_requested; });
+    };
+    while (!m_exited && pending()) {
+        int status;
+        auto tid = waitpid(-1, &status, __WALL);
+        if (tid < 0) {
+            if (errno == EINTR) continue;
+            m_exited = true;
+            break;
+        }
+        auto thread = handle_stop(tid, status);
+        if (thread != nullptr && thread->stop_requested) resume(*thread);
+    }
+}
+
+
+
+void false_sharing_sampler::resume(thread_state& thread) {
+    if (!thread.stopped) return;
+    ptrace(PTRACE_CONT, thread.tid, nullptr, thread.signal);
+    thread.signal = 0;
+    thread.stopped = false;
+}
+
+
+
+false_sharing_sampler::thread_state* false_sharing_sampler::handle_stop(pid_t tid, int status) {
+    auto thread = find_thread(tid);
+    if (thread == nullptr) {
+        // 先于clone事件到达的新线程的第一次停止
+        auto task = "/proc/" + std::to_string(m_pid) + "/task/" + std::to_string(tid);
+        if (!WIFSTOPPED(status) || access(task.c_str(), F_OK) != 0) return nullptr;
+        m_threads.push_back(thread_state{tid, true, false, 0});
+        read_name(tid);
+        arm_thread(tid);
+        return &m_threads.back();
+    }
+
+    if (WIFEXITED(status) || WIFSIGNALED(status)) {
+        if (tid == m_pid) {
+            m_exited = true;
+            m_exit_status = status;
+        }
+        m_threads.erase(m_threads.begin() + (thread - m_threads.data()));
+        return nullptr;
+    }
+
+    thread->stopped = true;
+    auto sig = WSTOPSIG(status);
+    auto event = status >> 16;
+    if (event == PTRACE_EVENT_CLONE) {
+        add_new_thread(tid);
+        // [m_threads]可能已经重新分配
+        thread = find_thread(tid);
+    } else if (event == PTRACE_EVENT_STOP) {
+        // PTRACE_INTERRUPT或group-stop
+        thread->stop_requested = false;
+    } else if (event != 0) {
+        // 其他ptrace事件（exec）与采样无关
+    } else if (sig == SIGTRAP) {
+        record_hit(*thread);
+    } else {
+        thread->signal = sig;
+    }
+    return thread;
+}
+
+
+
+/**
+ * @brief: DR6的B0-B3给出触发的slot，即半行中的字段；数据断点在写入指令执行后触发，
+ *         rip为下一条指令的地址
+ */
+void false_sharing_sampler::record_hit(thread_state& thread) {
+    auto dr6 = get_debug_register(thread.tid, 6);
+    set_debug_register(thread.tid, 6, 0);
+    if ((dr6 & dr6_trap_bits) == 0) {
+        // 不是数据断点，交给程序处理
+        thread.signal = SIGTRAP;
+        return;
+    }
+
+    std::uintptr_t pc = ptrace(PTRACE_PEEKUSER, thread.tid, offsetof(user_regs_struct, rip), nullptr);
+    auto& sample = m_samples[m_window / 2];
+    for (int i = 0; i < n_debug_slots; i++) {
+        if ((dr6 & (1 << i)) == 0) continue;
+        int field = (m_window % 2) * n_debug_slots + i;
+        sample.writes[thread.tid][field]++;
+        sample.writers[std::make_tuple(thread.tid, field, pc)]++;
+        m_hit_count++;
+    }
+}
+
+
+
+false_sharing_sampler::thread_state* false_sharing_sampler::find_thread(pid_t tid) {
+    for (auto& thread : m_threads) {
+        if (thread.tid == tid) return &thread;
+    }
+    return nullptr;
+}
+
+
+#endif /* __x86_64__ */
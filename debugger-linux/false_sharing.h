@@ -0,0 +1,106 @@
+#ifndef _FALSE_SHARING_H
+#define _FALSE_SHARING_H
+
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <sys/types.h>
+
+
+#ifdef __x86_64__
+
+constexpr std::size_t cache_line_size = 64;
+// 每个调试寄存器监视8字节，四个寄存器一次覆盖半个cache line
+constexpr std::size_t false_share_field_size = 8;
+constexpr std::size_t false_share_fields = cache_line_size / false_share_field_size;
+constexpr std::size_t false_share_window = 4 * false_share_field_size;
+
+
+// 一个cache line的采样结果
+struct cache_line_sample {
+    std::uintptr_t addr;                                // 64字节对齐
+    std::array<std::chrono::nanoseconds, 2> watched;    // 前后两个半行各自被监视的时间
+    // 每个线程对每个8字节字段的写入次数
+    std::map<pid_t, std::array<uint64_t, false_share_fields>> writes;
+    // (线程, 字段, 写入指令之后的pc) -> 次数
+    std::map<std::tuple<pid_t, int, std::uintptr_t>, uint64_t> writers;
+};
+
+
+
+/**
+ * @brief: 伪共享(false sharing)采样
+ *         DR0-DR3设为8字节的写数据断点，一次覆盖半个cache line；
+ *         每隔[slice]停下所有线程，把调试寄存器轮换到下一个半行，从而在采样期间覆盖
+ *         多于四个寄存器所能同时监视的范围。
+ *         调试寄存器是每个线程独立的，写入调试器跟踪的所有线程；它们都以PTRACE_SEIZE附加，
+ *         用PTRACE_INTERRUPT停下。采样期间新创建的线程（clone事件）也被监视与统计。
+ *         所有线程在采样结束后停下，调试寄存器由调用者恢复。
+ */
+class false_sharing_sampler {
+public:
+    explicit false_sharing_sampler(pid_t pid) : m_pid{pid} {}
+
+    /**
+     * @brief: 对[lines]（64字节对齐）采样[duration]。[threads]为被调试进程的线程（都处于ptrace-stop）
+     *         及其恢复执行时需要传递的信号，返回时更新为仍然存在的线程（包括采样期间新建的）。
+     *         进程在采样期间退出时返回false，线程组长的wait状态由[get_exit_status]得到
+     */
+    bool run(const std::vector<std::uintptr_t>& lines, std::chrono::milliseconds duration,
+             std::chrono::milliseconds slice, std::map<pid_t, int>& threads);
+
+    auto get_samples() const -> const std::vector<cache_line_sample>& {return m_samples;}
+    // 采样过的线程及其名字(/proc/<pid>/task/<tid>/comm)
+    auto get_thread_names() const -> const std::map<pid_t, std::string>& {return m_thread_names;}
+    auto get_hit_count() const -> uint64_t {return m_hit_count;}
+    auto get_exit_status() const -> int {return m_exit_status;}
+
+private:
+    struct thread_state {
+        pid_t tid;
+        bool stopped;
+        bool stop_requested;    // 已发送PTRACE_INTERRUPT，尚未收到对应的停止
+        int signal;             // 恢复执行时传递的信号
+    };
+
+    void take_threads(const std::map<pid_t, int>& threads);
+    // 把线程及其信号交还给调用者
+    void release_threads(std::map<pid_t, int>& threads);
+    // 线程[parent]的clone事件：等待新线程的第一次停止并写入当前的调试寄存器
+    void add_new_thread(pid_t parent);
+    void arm_thread(pid_t tid);
+    void read_name(pid_t tid);
+    // 把DR0-DR3指向第[window]个半行，写入所有线程
+    void arm(std::size_t window);
+    void disarm();
+    // 停下所有线程，期间产生的命中照常记录
+    void stop_all();
+    void resume(thread_state& thread);
+    // 处理waitpid的结果，返回停下的线程；线程已退出时返回nullptr
+    thread_state* handle_stop(pid_t tid, int status);
+    void record_hit(thread_state& thread);
+    thread_state* find_thread(pid_t tid);
+
+    pid_t m_pid;
+    std::vector<thread_state> m_threads;
+    std::map<pid_t, std::string> m_thread_names;
+    std::vector<cache_line_sample> m_samples;
+    std::size_t m_window = 0;
+    // 当前半行的起始地址与对应的DR7
+    std::uintptr_t m_base = 0;
+    uint64_t m_dr7 = 0;
+
+    bool m_exited = false;
+    int m_exit_status = 0;
+    uint64_t m_hit_count = 0;
+};
+
+#endif /* __x86_64__ */
+
+
+#endif /* _FALSE_SHARING_H */
@@ -0,0 +1,194 @@
+#include "function_cfg.h"
+#include <algorithm>
+#include <cstring>
+#include <set>
+
+
+void function_cfg::build(std::uintptr_t low, std::vector<uint8_t> code) {
+    m_low = low;
+    m_code = std::move(code);
+    m_insns.clear();
+    m_blocks.clear();
+    m_idom.clear();
+
+    auto high = get_high();
+    auto inside = [&](std::uintptr_t addr) {return addr >= low && addr < high;};
+
+    // 1. 线性解码，末尾补零以便decode_x86读取最多15字节
+    std::vector<uint8_t> padded = m_code;
+    padded.resize(m_code.size() + 16, 0);
+    std::set<std::uintptr_t> leaders {low};
+    for (std::size_t off = 0; off < m_code.size();) {
+        cfg_insn item {low + off, {}, false};
+        if (decode_x86(padded.data() + off, m_code.size() - off, item.insn) &&
+            item.insn.length <= m_code.size() - off) {
+            item.decoded = true;
+        } else {
+            std::memset(&item.insn, 0, sizeof(item.insn));
+            item.insn.length = 1;
+        }
+        m_insns.push_back(item);
+
+        // 2. 基本块的起点
+        auto next = item.addr + item.insn.length;
+        switch (item.insn.branch) {
+        case x86_branch::jump:
+        case x86_branch::cond_jump: {
+            auto target = next + item.insn.rel;
+            if (inside(target)) leaders.insert(target);
+            leaders.insert(next);
+            break;
+        }
+        case x86_branch::indirect_jump:
+        case x86_branch::ret:
+            leaders.insert(next);
+            break;
+        default:
+            break;
+        }
+        off += item.insn.length;
+    }
+
+    // 3. 划分基本块；跳转到指令中间的目标（重叠指令）被忽略
+    for (std::size_t i = 0; i < m_insns.size(); i++) {
+        if (i == 0 || leaders.count(m_insns[i].addr)) {
+            if (!m_blocks.empty()) m_blocks.back().end = m_insns[i].addr;
+            m_blocks.push_back(basic_block{m_insns[i].addr, 0, i, 0, {}, {}, false, x86_branch::none});
+        }
+        m_blocks.back().n_insns++;
+    }
+    if (!m_blocks.empty()) m_blocks.back().end = high;
+
+    // 4. 边
+    for (std::size_t b = 0; b < m_blocks.size(); b++) {
+        auto& block = m_blocks[b];
+        const auto& last = m_insns[block.first_insn + block.n_insns - 1];
+        block.terminator = last.insn.branch;
+        auto add_edge = [&](std::uintptr_t target) {
+            auto s = find_block(target);
+            if (s < 0 || m_blocks[s].start != target) return;
+            if (std::find(block.succs.begin(), block.succs.end(), (std::size_t)s) != block.succs.end()) return;
+            block.succs.push_back(s);
+            m_blocks[s].preds.push_back(b);
+        };
+        auto next = last.addr + last.insn.length;
+        switch (last.insn.branch) {
+        case x86_branch::jump:
+            add_edge(next + last.insn.rel);
+            break;
+        case x86_branch::cond_jump:
+            add_edge(next + last.insn.rel);
+            add_edge(next);
+            break;
+        case x86_branch::indirect_jump:
+        case x86_branch::ret:
+            break;
+        default:
+            // call/syscall与普通指令落入下一块；ud2/hlt之后一般是填充或下一个入口，同样按顺序连接
+            if (next < high) add_edge(next);
+            break;
+        }
+    }
+
+    compute_dominators();
+
+    // 5. 回边 b -> h 且h支配b时，h为循环头
+    for (std::size_t b = 0; b < m_blocks.size(); b++) {
+        for (auto s : m_blocks[b].succs) {
+            if (dominates(s, b)) m_blocks[s].is_loop_header = true;
+        }
+    }
+}
+
+
+
+/**
+ * @brief: Cooper-Harvey-Kennedy迭代算法求直接支配者：
+ *         按逆后序遍历，idom(b)为其已处理的前驱在支配树上的最近公共祖先，直到不再变化。
+ *         只保存直接支配者，大函数也只需O(块数)的空间；从入口不可达的块（只被间接跳转引用）没有支配者
+ */
+void function_cfg::compute_dominators() {
+    auto n = m_blocks.size();
+    m_idom.assign(n, -1);
+    if (n == 0) return;
+
+    // 逆后序编号，非递归DFS
+    std::vector<long> order(n, -1);
+    std::vector<std::size_t> rpo;
+    std::vector<std::pair<std::size_t, std::size_t>> stack {{0, 0}};
+    std::vector<bool> visited(n, false);
+    visited[0] = true;
+    while (!stack.empty()) {
+        auto& [b, next] = stack.back();
+        if (next < m_blocks[b].succs.size()) {
+            auto s = m_blocks[b].succs[next++];
+            if (!visited[s]) {
+                visited[s] = true;
+                stack.emplace_back(s, 0);
+            }
+        } else {
+            rpo.push_back(b);
+            stack.pop_back();
+        }
+    }
+    std::reverse(rpo.begin(), rpo.end());
+    for (std::size_t i = 0; i < rpo.size(); i++) order[rpo[i]] = i;
+
+    auto intersect = [&](long a, long b) {
+        while (a != b) {
+            while (order[a] > order[b]) a = m_idom[a];
+            while (order[b] > order[a]) b = m_idom[b];
+        }
+        return a;
+    };
+
+    m_idom[0] = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (std::size_t i = 1; i < rpo.size(); i++) {
+            auto b = rpo[i];
+            long idom = -1;
+            for (auto p : m_blocks[b].preds) {
+                if (m_idom[p] < 0) continue;
+                idom = idom < 0 ? (long)p : intersect(p, idom);
+            }
+            if (idom != m_idom[b]) {
+                m_idom[b] = idom;
+                changed = true;
+            }
+        }
+    }
+}
+
+
+
+bool function_cfg::dominates(std::size_t a, std::size_t b) const {
+    if (b >= m_idom.size() || m_idom[b] < 0) return a == b;
+    // 沿支配树向上走到入口
+    while (true) {
+        if (b == a) return true;
+        if (b == 0) return false;
+        b = m_idom[b];
+    }
+}
+
+
+
+long function_cfg::find_block(std::uintptr_t addr) const {
+    auto it = std::upper_bound(m_blocks.begin(), m_blocks.end(), addr,
+                               [](std::uintptr_t a, const basic_block& b) {return a < b.start;});
+    if (it == m_blocks.begin()) return -1;
+    --it;
+    if (addr >= it->end) return -1;
+    return it - m_blocks.begin();
+}
+
+
+
+long function_cfg::find_insn(std::uintptr_t addr) const {
+    auto it = std::lower_bound(m_insns.begin(), m_insns.end(), addr,
+                               [](const cfg_insn& i, std::uintptr_t a) {return i.addr < a;});
+    if (it == m_insns.end() || it->addr != addr) return -1;
+    return it - m_insns.begin();
+}
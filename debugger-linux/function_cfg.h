@@ -0,0 +1,69 @@
+#ifndef _FUNCTION_CFG_H
+#define _FUNCTION_CFG_H
+
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "x86_decoder.h"
+
+
+// 函数中的一条指令
+struct cfg_insn {
+    std::uintptr_t addr;
+    x86_insn insn;      // 不能解码的字节作为长度为1、encoding为legacy、opcode为0的伪指令
+    bool decoded;
+};
+
+// 基本块: [start, end)，指令为[first_insn, first_insn + n_insns)
+struct basic_block {
+    std::uintptr_t start;
+    std::uintptr_t end;
+    std::size_t first_insn;
+    std::size_t n_insns;
+    std::vector<std::size_t> succs;     // 函数内的后继块
+    std::vector<std::size_t> preds;
+    bool is_loop_header;                // 是某条回边（指向支配自己的块）的目标
+    x86_branch terminator;              // 最后一条指令的控制流类型
+};
+
+
+
+/**
+ * @brief: 一个函数的控制流图，由函数的机器码线性解码得到
+ *         基本块的起点为入口、函数内的跳转目标以及跳转/ret之后的指令；
+ *         call不结束基本块。回边（指向支配自己的块）由直接支配者树确定，其目标为循环头。
+ */
+class function_cfg {
+public:
+    // [code]为函数[low, low + code.size())的原始字节（不含int3）
+    void build(std::uintptr_t low, std::vector<uint8_t> code);
+
+    // 包含[addr]的基本块下标，不在函数内时返回-1
+    long find_block(std::uintptr_t addr) const;
+    // 以[addr]开始的指令下标，[addr]不是指令边界时返回-1
+    long find_insn(std::uintptr_t addr) const;
+    // [addr]处指令的字节
+    const uint8_t* code_at(std::uintptr_t addr) const {return m_code.data() + (addr - m_low);}
+
+    auto get_low() const -> std::uintptr_t {return m_low;}
+    auto get_high() const -> std::uintptr_t {return m_low + m_code.size();}
+    auto get_insns() const -> const std::vector<cfg_insn>& {return m_insns;}
+    auto get_blocks() const -> const std::vector<basic_block>& {return m_blocks;}
+    // 块[a]是否支配块[b]
+    bool dominates(std::size_t a, std::size_t b) const;
+
+private:
+    void compute_dominators();
+
+    std::uintptr_t m_low = 0;
+    std::vector<uint8_t> m_code;
+    std::vector<cfg_insn> m_insns;
+    std::vector<basic_block> m_blocks;
+    // 每个块的直接支配者，入口为自身，不可达的块为-1
+    std::vector<long> m_idom;
+};
+
+
+#endif /* _FUNCTION_CFG_H */
@@ -0,0 +1,128 @@
+#include "function_index.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <future>
+#include <thread>
+#include <unordered_set>
+
+
+
+std::string demangle_function_name(const std::string& mangled) {
+    if (mangled.compare(0, 2, "_Z") != 0) return mangled;
+
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(mangled.c_str(), nullptr, nullptr, &status);
+    if (status != 0 || demangled == nullptr) return mangled;
+    std::string name {demangled};
+    free(demangled);
+
+    // 去掉参数列表：第一个不在模板参数中的'('，operator()除外
+    // 模板函数的返回类型在名字前面，以模板参数外的最后一个空格分隔（operator new等除外）
+    int depth = 0;
+    std::size_t begin = 0;
+    for (std::size_t i = 0; i < name.size(); i++) {
+        bool after_operator = i >= 8 && name.compare(i - 8, 8, "operator") == 0;
+        if (name[i] == '<') depth++;
+        else if (name[i] == '>') depth--;
+        else if (name[i] == ' ' && depth == 0 && !after_operator) begin = i + 1;
+        else if (name[i] == '(' && depth == 0) {
+            if (name.compare(i, 2, "()") == 0 && after_operator) {
+                i++;
+                continue;
+            }
+            return name.substr(begin, i - begin);
+        }
+    }
+    return name.substr(begin);
+}
+
+
+
+bool for_each_subprogram(const dwarf::die& parent, const std::function<bool(const dwarf::die&)>& f) {
+    using namespace dwarf;
+    for (const auto& die : parent) {
+        if (die.tag == DW_TAG::subprogram) {
+            if (f(die)) return true;
+        } else if (die.tag == DW_TAG::namespace_ || die.tag == DW_TAG::class_type
+                   || die.tag == DW_TAG::structure_type) {
+            if (for_each_subprogram(die, f)) return true;
+        }
+    }
+    return false;
+}
+
+
+
+// 优先使用DW_AT_linkage_name，定义与声明分开时到DW_AT_specification/DW_AT_abstract_origin中查找
+static std::string qualified_name(const dwarf::die& die) {
+    using namespace dwarf;
+    if (die.has(DW_AT::linkage_name)) return demangle_function_name(die[DW_AT::linkage_name].as_string());
+    for (auto attr : {DW_AT::specification, DW_AT::abstract_origin}) {
+        if (die.has(attr)) return qualified_name(die[attr].as_reference());
+    }
+    return die.has(DW_AT::name) ? at_name(die) : "";
+}
+
+
+
+void function_name_index::build(const dwarf::dwarf& dw, const symbol_index& symbols) {
+    using namespace dwarf;
+    m_functions.clear();
+    std::unordered_set<uint64_t> seen;
+
+    if (dw.valid()) {
+        const auto& units = dw.compilation_units();
+        for (int i = 0; i < static_cast<int>(units.size()); i++) {
+            for_each_subprogram(units[i].root(), [&](const die& die) {
+                if (!die.has(DW_AT::low_pc)) return false;
+                auto name = qualified_name(die);
+                if (name.empty()) return false;
+                auto low_pc = at_low_pc(die);
+                if (seen.insert(low_pc).second) m_functions.push_back(function_name{name, low_pc, i});
+                return false;
+            });
+        }
+    }
+
+    // 没有DWARF的函数（静态链接的库、汇编）使用符号表
+    for (const auto& sym : symbols.get_functions()) {
+        if (sym.name.compare(0, 4, "sub_") == 0) continue;
+        if (seen.insert(sym.low_pc).second) {
+            m_functions.push_back(function_name{demangle_function_name(sym.name), sym.low_pc, -1});
+        }
+    }
+    m_built = true;
+}
+
+
+
+std::vector<const function_name*> function_name_index::match(const std::regex& re, unsigned n_threads) const {
+    if (n_threads == 0) n_threads = std::max(1u, std::thread::hardware_concurrency());
+    // 函数较少时不值得创建线程
+    constexpr std::size_t min_chunk = 2048;
+    n_threads = std::min<std::size_t>(n_threads, m_functions.size() / min_chunk + 1);
+
+    auto match_range = [this, &re](std::size_t first, std::size_t last) {
+        std::vector<const function_name*> out;
+        for (auto i = first; i < last; i++) {
+            if (std::regex_search(m_functions[i].name, re)) out.push_back(&m_functions[i]);
+        }
+        return out;
+    };
+
+    auto chunk = (m_functions.size() + n_threads - 1) / n_threads;
+    std::vector<std::future<std::vector<const function_name*>>> parts;
+    for (unsigned t = 1; t < n_threads; t++) {
+        auto first = std::min(m_functions.size(), t * chunk);
+        auto last = std::min(m_functions.size(), first + chunk);
+        parts.push_back(std::async(std::launch::async, match_range, first, last));
+    }
+
+    auto result = match_range(0, std::min(chunk, m_functions.size()));
+    for (auto& part : parts) {
+        auto matched = part.get();
+        result.insert(result.end(), matched.begin(), matched.end());
+    }
+    return result;
+}
@@ -0,0 +1,60 @@
+#ifndef _FUNCTION_INDEX_H
+#define _FUNCTION_INDEX_H
+
+
+#include <cstdint>
+#include <functional>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "symbol_index.h"
+#include "libelfin/dwarf/dwarf++.hh"
+
+
+// 索引中的一个函数
+struct function_name {
+    std::string name;       // 带命名空间/类名的名字，不含参数列表，例如 dsp::fir::run
+    uint64_t low_pc;        // 函数入口，与DWARF一致，不含加载偏置
+    int cu;                 // 所在编译单元的下标，用于在行号表中跳过序言；来自符号表时为-1
+};
+
+
+// 还原C++的mangled名字并去掉参数列表；不是mangled名字时原样返回
+std::string demangle_function_name(const std::string& mangled);
+
+/**
+ * @brief: 对[parent]之下的每个subprogram依次调用[f]，[f]返回true时停止遍历并返回true
+ *         C++中命名空间里的函数与类的成员函数不是编译单元的直接子节点，
+ *         因此进入namespace、class与structure继续查找
+ */
+bool for_each_subprogram(const dwarf::die& parent, const std::function<bool(const dwarf::die&)>& f);
+
+
+
+/**
+ * @brief: 按名字查找函数的索引，供rbreak使用
+ *         DWARF与符号表只遍历一次；之后每次查询只需在名字数组上匹配正则表达式，
+ *         匹配按数组切分到多个线程并行执行
+ *         （libelfin内部的缓存不是线程安全的，因此遍历DIE只在一个线程中进行）
+ */
+class function_name_index {
+public:
+    function_name_index() = default;
+
+    // 从[dw]的subprogram与[symbols]中的函数符号构建索引，同一地址只保留一项
+    void build(const dwarf::dwarf& dw, const symbol_index& symbols);
+    auto is_built() const -> bool {return m_built;}
+    auto size() const -> std::size_t {return m_functions.size();}
+
+    // 返回名字与[re]匹配(regex_search)的函数，[n_threads]为0时按CPU数量决定
+    std::vector<const function_name*> match(const std::regex& re, unsigned n_threads = 0) const;
+
+private:
+    bool m_built = false;
+    std::vector<function_name> m_functions;
+};
+
+
+
+#endif /* _FUNCTION_INDEX_H */
@@ -0,0 +1,176 @@
+#include "inferior_call.h"
+#include <cerrno>
+#include <csignal>
+#include <stdexcept>
+#include <string>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/ptrace.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+
+
+#ifdef __x86_64__
+
+
+int64_t inject_syscall(pid_t pid, uint64_t nr, std::initializer_list<uint64_t> args) {
+    user_regs_struct saved_regs;
+    ptrace(PTRACE_GETREGS, pid, nullptr, &saved_regs);
+
+    // 在pc处写入 syscall (0f 05)
+    auto addr = saved_regs.rip;
+    errno = 0;
+    auto saved_code = ptrace(PTRACE_PEEKDATA, pid, addr, nullptr);
+    if (errno != 0) {
+        throw std::runtime_error{"inject_syscall: can't read code at pc"};
+    }
+    auto code = (saved_code & ~0xffffL) | 0x050f;
+    ptrace(PTRACE_POKEDATA, pid, addr, code);
+
+    // x86-64系统调用的参数寄存器顺序
+    user_regs_struct regs = saved_regs;
+    unsigned long long* arg_regs[] = {&regs.rdi, &regs.rsi, &regs.rdx, &regs.r10, &regs.r8, &regs.r9};
+    size_t i = 0;
+    for (auto arg : args) {
+        if (i == 6) break;
+        *arg_regs[i++] = arg;
+    }
+    regs.rax = nr;
+    // 避免内核把它当作被中断的系统调用重新执行
+    regs.orig_rax = -1;
+    ptrace(PTRACE_SETREGS, pid, nullptr, &regs);
+
+    ptrace(PTRACE_SINGLESTEP, pid, nullptr, nullptr);
+    int wait_status;
+    waitpid(pid, &wait_status, __WALL);
+
+    ptrace(PTRACE_GETREGS, pid, nullptr, &regs);
+    auto result = static_cast<int64_t>(regs.rax);
+
+    // 恢复原来的指令与寄存器
+    ptrace(PTRACE_POKEDATA, pid, addr, saved_code);
+    ptrace(PTRACE_SETREGS, pid, nullptr, &saved_regs);
+
+    if (!WIFSTOPPED(wait_status)) {
+        throw std::runtime_error{"inject_syscall: process exited during syscall " + std::to_string(nr)};
+    }
+    return result;
+}
+
+
+
+/**
+ * @brief: 单步执行注入的 syscall 时，clone先产生PTRACE_EVENT_CLONE停止，
+ *         再次单步使系统调用返回，停在其后。子进程由内核自动附加，以SIGSTOP停下，
+ *         恢复执行时不传递该信号即被丢弃。
+ *         使用退出信号为0的clone而不是fork：结束检查点时父进程不会收到SIGCHLD，
+ *         否则挂起的SIGCHLD会打断之后的单步与注入。
+ *         CLONE_PARENT使子进程的父进程是[pid]的父进程（即调试器）而不是[pid]：
+ *         被调试的程序不会wait退出信号为0的子进程，调试器的waitpid才能真正回收它，不会留下僵尸进程。
+ * @note:  绕过了glibc的fork，子进程不执行pthread_atfork注册的函数，
+ *         TLS中缓存的线程ID仍是[pid]的（pthread_self()->tid等）
+ */
+pid_t inject_fork(pid_t pid, long options, long child_options) {
+    user_regs_struct saved_regs;
+    ptrace(PTRACE_GETREGS, pid, nullptr, &saved_regs);
+
+    auto addr = saved_regs.rip;
+    errno = 0;
+    auto saved_code = ptrace(PTRACE_PEEKDATA, pid, addr, nullptr);
+    if (errno != 0) {
+        throw std::runtime_error{"inject_fork: can't read code at pc"};
+    }
+    ptrace(PTRACE_POKEDATA, pid, addr, (saved_code & ~0xffffL) | 0x050f);
+
+    user_regs_struct regs = saved_regs;
+    // clone(flags=CLONE_PARENT, stack=0)：与fork相同地复制地址空间，但没有退出信号
+    regs.rax = SYS_clone;
+    regs.rdi = CLONE_PARENT;
+    regs.rsi = 0;
+    regs.rdx = 0;
+    regs.r10 = 0;
+    regs.r8 = 0;
+    regs.orig_rax = -1;
+    ptrace(PTRACE_SETREGS, pid, nullptr, &regs);
+    ptrace(PTRACE_SETOPTIONS, pid, nullptr, options | PTRACE_O_TRACECLONE);
+
+    auto restore = [&] {
+        ptrace(PTRACE_POKEDATA, pid, addr, saved_code);
+        ptrace(PTRACE_SETREGS, pid, nullptr, &saved_regs);
+        ptrace(PTRACE_SETOPTIONS, pid, nullptr, options);
+    };
+
+    int wait_status;
+    ptrace(PTRACE_SINGLESTEP, pid, nullptr, nullptr);
+    waitpid(pid, &wait_status, __WALL);
+    if (!WIFSTOPPED(wait_status)) {
+        throw std::runtime_error{"inject_fork: process exited during fork"};
+    }
+    if (wait_status >> 8 != (SIGTRAP | (PTRACE_EVENT_CLONE << 8))) {
+        // fork失败（例如达到进程数上限），系统调用已经返回
+        ptrace(PTRACE_GETREGS, pid, nullptr, &regs);
+        restore();
+        throw std::runtime_error{"inject_fork: fork failed (" + std::to_string(-(int64_t)regs.rax) + ")"};
+    }
+
+    unsigned long child = 0;
+    ptrace(PTRACE_GETEVENTMSG, pid, nullptr, &child);
+    waitpid(child, &wait_status, __WALL);
+
+    ptrace(PTRACE_POKEDATA, child, addr, saved_code);
+    ptrace(PTRACE_SETREGS, child, nullptr, &saved_regs);
+    ptrace(PTRACE_SETOPTIONS, child, nullptr, options | child_options);
+
+    // 完成父进程中的系统调用
+    ptrace(PTRACE_SINGLESTEP, pid, nullptr, nullptr);
+    waitpid(pid, &wait_status, __WALL);
+    if (!WIFSTOPPED(wait_status)) {
+        kill(child, SIGKILL);
+        waitpid(child, &wait_status, __WALL);
+        throw std::runtime_error{"inject_fork: process exited during fork"};
+    }
+    restore();
+    return child;
+}
+
+
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+
+bool within_rel32(std::uintptr_t a, std::uintptr_t b) {
+    constexpr int64_t margin = 4096;
+    auto diff = static_cast<int64_t>(a - b);
+    return diff > INT32_MIN + margin && diff < INT32_MAX - margin;
+}
+
+
+
+/**
+ * @brief: 依次尝试[addr]附近的地址，使用MAP_FIXED_NOREPLACE避免覆盖已有的映射；
+ *         老内核不认识该标志时会把它当作提示地址，因此仍需检查返回的地址是否足够近
+ */
+std::uintptr_t inject_mmap_near(pid_t pid, std::uintptr_t addr, std::size_t size, int prot) {
+    const int64_t distances[] = {-0x100000, 0x100000, -0x1000000, 0x1000000,
+                                 -0x10000000, 0x10000000, -0x40000000, 0x40000000};
+    auto page = addr & ~std::uintptr_t{4095};
+
+    for (auto distance : distances) {
+        auto hint = page + distance;
+        auto result = inject_syscall(pid, SYS_mmap, {hint, size, (uint64_t)prot,
+                                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE,
+                                     (uint64_t)-1, 0});
+        if (result < 0 && result > -4096) continue;
+
+        auto base = static_cast<std::uintptr_t>(result);
+        if (within_rel32(base, addr) && within_rel32(base + size, addr)) return base;
+        inject_syscall(pid, SYS_munmap, {base, size});
+    }
+    return 0;
+}
+
+
+#endif /* __x86_64__ */
@@ -0,0 +1,41 @@
+#ifndef _INFERIOR_CALL_H
+#define _INFERIOR_CALL_H
+
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <sys/types.h>
+
+
+#ifdef __x86_64__
+
+/**
+ * @brief: 在已停止的进程[pid]中执行系统调用[nr]，返回其返回值（失败时为 -errno）
+ *         在当前pc处临时写入 syscall 指令，设置 rax=nr, rdi/rsi/rdx/r10/r8/r9=args，
+ *         单步执行后恢复原来的指令与所有寄存器。
+ */
+int64_t inject_syscall(pid_t pid, uint64_t nr, std::initializer_list<uint64_t> args);
+
+/**
+ * @brief: 在已停止的进程[pid]中注入fork，返回被跟踪的子进程，失败时抛出异常
+ *         注入期间临时打开PTRACE_O_TRACECLONE，子进程在执行任何指令之前停下，
+ *         其代码与寄存器恢复为注入之前的状态（与父进程写时复制共享内存）；
+ *         [options]为调用者使用的ptrace选项，父进程注入后恢复为它，子进程设置为 [options] | [child_options]；
+ *         子进程的父进程是调试器，结束它后由调试器的waitpid回收
+ */
+pid_t inject_fork(pid_t pid, long options, long child_options = 0);
+
+// [a]与[b]的距离能否用 rel32/disp32 表示（留出一页余量）
+bool within_rel32(std::uintptr_t a, std::uintptr_t b);
+
+/**
+ * @brief: 在进程[pid]中注入mmap，分配与[addr]距离在±2GB以内的匿名私有映射，
+ *         使其中的代码可以用 jmp rel32 / [rip + disp32] 访问[addr]附近。失败时返回0
+ */
+std::uintptr_t inject_mmap_near(pid_t pid, std::uintptr_t addr, std::size_t size, int prot);
+
+#endif /* __x86_64__ */
+
+
+#endif /* _INFERIOR_CALL_H */
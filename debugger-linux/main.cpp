@@ -1,3 +1,4 @@
+#include <csignal>
 #include <iostream>
 #include <string>
 #include <sys/ptrace.h>
@@ -21,14 +22,20 @@ int main(int argc, char* argv[]) {
     auto pid = fork();
     if (pid == 0) {
         personality(ADDR_NO_RANDOMIZE);
-        ptrace(PTRACE_TRACEME, 0, nullptr, nullptr);
+        // 停下等待父进程以PTRACE_SEIZE附加：PTRACE_TRACEME不能在exec之前设置选项（跟踪clone），
+        // 也不支持PTRACE_INTERRUPT
+        raise(SIGSTOP);
 
-        // 由于调用了ptrace函数，子进程调用execl函数后状态发生变化，会马上告知监视的父进程
+        // 子进程调用execl函数后状态发生变化，会马上告知监视的父进程
         execl(prog, prog, nullptr);
     }
 
     else if (pid >= 1)  {
         // 父进程可以监控子进程
+        int status;
+        waitpid(pid, &status, WSTOPPED);
+        ptrace(PTRACE_SEIZE, pid, nullptr, g_ptrace_options);
+        kill(pid, SIGCONT);
         cout << "开始调试的进程ID: " << pid << endl;
         debugger dbg {prog, pid};
         dbg.run();
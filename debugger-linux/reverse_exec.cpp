@@ -0,0 +1,343 @@
+#include "reverse_exec.h"
+#include <algorithm>
+#include <cstring>
+#include <elf.h>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+
+
+#ifdef __x86_64__
+
+
+namespace {
+
+// 内核结构的大小（x86-64）
+constexpr std::size_t stat_size = 144;
+constexpr std::size_t statx_size = 256;
+constexpr std::size_t timespec_size = 16;
+constexpr std::size_t rusage_size = 144;
+constexpr std::size_t sockaddr_max = 128;
+constexpr std::size_t fd_set_size = 128;
+
+}
+
+
+std::vector<std::pair<std::uintptr_t, std::size_t>> syscall_output_regions(uint64_t nr, const uint64_t args[6],
+                                                                          int64_t result, const remote_reader& read) {
+    std::vector<std::pair<std::uintptr_t, std::size_t>> regions;
+    // 出错的调用不写入内存
+    if (result < 0 && result > -4096) return regions;
+
+    auto add = [&regions](uint64_t addr, std::size_t len) {
+        if (addr != 0 && len != 0) regions.emplace_back(addr, len);
+    };
+    // 长度由 socklen_t* 参数给出的输出（accept、recvfrom、getsockopt等），长度本身也被写入
+    auto add_with_length = [&](uint64_t addr, uint64_t len_ptr, std::size_t max) {
+        uint32_t len = 0;
+        if (len_ptr == 0 || !read(len_ptr, &len, sizeof(len))) return;
+        add(len_ptr, sizeof(len));
+        add(addr, std::min<std::size_t>(len, max));
+    };
+    // readv/preadv: 依次填满各个iovec，总共[result]字节
+    auto add_iovecs = [&](uint64_t iov, uint64_t count) {
+        auto remaining = static_cast<std::size_t>(result);
+        for (uint64_t i = 0; i < count && remaining > 0; i++) {
+            iovec vec;
+            if (!read(iov + i * sizeof(iovec), &vec, sizeof(vec))) return;
+            auto len = std::min(remaining, vec.iov_len);
+            add(reinterpret_cast<std::uintptr_t>(vec.iov_base), len);
+            remaining -= len;
+        }
+    };
+
+    switch (nr) {
+    case SYS_read:
+    case SYS_pread64:
+    case SYS_getdents64:
+    case SYS_readlink:
+        add(args[1], result);
+        break;
+    case SYS_readlinkat:
+        add(args[2], result);
+        break;
+    case SYS_getcwd:
+    case SYS_getrandom:
+        add(args[0], result);
+        break;
+    case SYS_readv:
+    case SYS_preadv:
+        add_iovecs(args[1], args[2]);
+        break;
+    case SYS_recvfrom:
+        add(args[1], result);
+        add_with_length(args[4], args[5], sockaddr_max);
+        break;
+    case SYS_accept:
+    case SYS_accept4:
+    case SYS_getsockname:
+    case SYS_getpeername:
+        add_with_length(args[1], args[2], sockaddr_max);
+        break;
+    case SYS_getsockopt:
+        add_with_length(args[3], args[4], 256);
+        break;
+    case SYS_stat:
+    case SYS_fstat:
+    case SYS_lstat:
+        add(args[1], stat_size);
+        break;
+    case SYS_newfstatat:
+        add(args[2], stat_size);
+        break;
+    case SYS_statx:
+        add(args[4], statx_size);
+        break;
+    case SYS_clock_gettime:
+    case SYS_clock_getres:
+    case SYS_getrlimit:
+        add(args[1], timespec_size);
+        break;
+    case SYS_gettimeofday:
+        add(args[0], 16);
+        add(args[1], 8);
+        break;
+    case SYS_time:
+        add(args[0], 8);
+        break;
+    case SYS_nanosleep:
+        add(args[1], timespec_size);
+        break;
+    case SYS_clock_nanosleep:
+        add(args[3], timespec_size);
+        break;
+    case SYS_getrusage:
+        add(args[1], rusage_size);
+        break;
+    case SYS_wait4:
+        add(args[1], sizeof(int));
+        add(args[3], rusage_size);
+        break;
+    case SYS_times:
+        add(args[0], 32);
+        break;
+    case SYS_uname:
+        add(args[0], 390);
+        break;
+    case SYS_sysinfo:
+        add(args[0], 112);
+        break;
+    case SYS_pipe:
+    case SYS_pipe2:
+        add(args[0], 2 * sizeof(int));
+        break;
+    case SYS_socketpair:
+        add(args[3], 2 * sizeof(int));
+        break;
+    case SYS_poll:
+        add(args[0], args[1] * 8);
+        break;
+    case SYS_select:
+        add(args[1], fd_set_size);
+        add(args[2], fd_set_size);
+        add(args[3], fd_set_size);
+        break;
+    case SYS_epoll_wait:
+        add(args[1], result * 12);
+        break;
+    case SYS_prlimit64:
+        add(args[3], 16);
+        break;
+    case SYS_sched_getaffinity:
+        add(args[2], result);
+        break;
+    case SYS_getcpu:
+        add(args[0], sizeof(unsigned));
+        add(args[1], sizeof(unsigned));
+        break;
+    default:
+        break;
+    }
+    return regions;
+}
+
+
+
+bool syscall_replays_natively(uint64_t nr) {
+    switch (nr) {
+    case SYS_mmap:
+    case SYS_munmap:
+    case SYS_mprotect:
+    case SYS_mremap:
+    case SYS_madvise:
+    case SYS_brk:
+    case SYS_rt_sigaction:
+    case SYS_rt_sigprocmask:
+    case SYS_rt_sigreturn:
+    case SYS_sigaltstack:
+    case SYS_arch_prctl:
+    case SYS_set_tid_address:
+    case SYS_set_robust_list:
+    case SYS_exit:
+    case SYS_exit_group:
+    case SYS_execve:
+        return true;
+    default:
+        return false;
+    }
+}
+
+
+
+/**
+ * @brief: vDSO没有对应的文件，从/proc/<pid>/maps找到[vdso]后读出整个映像，在.dynsym中按名字查找；
+ *         同一个函数有 clock_gettime 与 __vdso_clock_gettime 两个名字，只改写一次
+ */
+int patch_vdso(pid_t pid) {
+    static const std::pair<const char*, uint64_t> entries[] = {
+        {"__vdso_clock_gettime", SYS_clock_gettime},
+        {"__vdso_gettimeofday", SYS_gettimeofday},
+        {"__vdso_time", SYS_time},
+        {"__vdso_getcpu", SYS_getcpu},
+        {"__vdso_clock_getres", SYS_clock_getres},
+    };
+
+    std::ifstream maps("/proc/" + std::to_string(pid) + "/maps");
+    std::string line;
+    std::uintptr_t low = 0, high = 0;
+    while (std::getline(maps, line)) {
+        if (line.find("[vdso]") == std::string::npos) continue;
+        std::istringstream ss {line};
+        char dash;
+        ss >> std::hex >> low >> dash >> high;
+        break;
+    }
+    if (low == 0) return 0;
+
+    std::vector<uint8_t> image(high - low);
+    iovec local {image.data(), image.size()};
+    iovec remote {reinterpret_cast<void*>(low), image.size()};
+    if (process_vm_readv(pid, &local, 1, &remote, 1, 0) != (ssize_t)image.size()) return 0;
+
+    auto file = image.data();
+    auto size = image.size();
+    if (size < sizeof(Elf64_Ehdr) || std::memcmp(file, ELFMAG, SELFMAG) != 0) return 0;
+    auto ehdr = reinterpret_cast<const Elf64_Ehdr*>(file);
+    if (ehdr->e_shoff == 0 || ehdr->e_shoff + ehdr->e_shnum * sizeof(Elf64_Shdr) > size) return 0;
+    auto shdrs = reinterpret_cast<const Elf64_Shdr*>(file + ehdr->e_shoff);
+
+    // 符号值是链接地址，减去第一个PT_LOAD的地址得到映像内的偏移
+    uint64_t link_base = 0;
+    auto phdrs = reinterpret_cast<const Elf64_Phdr*>(file + ehdr->e_phoff);
+    for (int i = 0; i < ehdr->e_phnum && ehdr->e_phoff + (i + 1) * sizeof(Elf64_Phdr) <= size; i++) {
+        if (phdrs[i].p_type == PT_LOAD) {
+            link_base = phdrs[i].p_vaddr;
+            break;
+        }
+    }
+
+    std::set<std::uintptr_t> patched;
+    for (int i = 0; i < ehdr->e_shnum; i++) {
+        if (shdrs[i].sh_type != SHT_DYNSYM || shdrs[i].sh_link >= ehdr->e_shnum) continue;
+        const auto& strtab = shdrs[shdrs[i].sh_link];
+        if (shdrs[i].sh_offset + shdrs[i].sh_size > size || strtab.sh_offset + strtab.sh_size > size) return 0;
+        auto syms = reinterpret_cast<const Elf64_Sym*>(file + shdrs[i].sh_offset);
+        auto names = reinterpret_cast<const char*>(file + strtab.sh_offset);
+        for (std::size_t j = 0; j < shdrs[i].sh_size / sizeof(Elf64_Sym); j++) {
+            if (ELF64_ST_TYPE(syms[j].st_info) != STT_FUNC || syms[j].st_name >= strtab.sh_size) continue;
+            auto name = names + syms[j].st_name;
+            for (const auto& [entry, nr] : entries) {
+                // 也匹配去掉__vdso_前缀的别名
+                if (std::strcmp(name, entry) != 0 && std::strcmp(name, entry + 7) != 0) continue;
+                auto addr = low + syms[j].st_value - link_base;
+                if (!patched.insert(addr).second) continue;
+                // b8 imm32: mov $nr, %eax;  0f 05: syscall;  c3: ret
+                uint64_t code = 0xb8 | (nr << 8) | (0x050fULL << 40) | (0xc3ULL << 56);
+                ptrace(PTRACE_POKEDATA, pid, addr, code);
+            }
+        }
+    }
+    return patched.size();
+}
+
+
+
+void apply_syscall_record(pid_t pid, const syscall_record& record) {
+    for (const auto& write : record.writes) {
+        iovec local {const_cast<uint8_t*>(write.data.data()), write.data.size()};
+        iovec remote {reinterpret_cast<void*>(write.addr), write.data.size()};
+        process_vm_writev(pid, &local, 1, &remote, 1, 0);
+    }
+
+    user_regs_struct regs;
+    ptrace(PTRACE_GETREGS, pid, nullptr, &regs);
+    regs.rip += 2;
+    regs.rax = record.result;
+    regs.rcx = regs.rip;
+    regs.r11 = regs.eflags;
+    ptrace(PTRACE_SETREGS, pid, nullptr, &regs);
+}
+
+
+
+void execution_log::clear() {
+    m_syscalls.clear();
+    m_points.clear();
+    m_end = 0;
+}
+
+
+
+const syscall_record* execution_log::find_syscall(uint64_t icount) const {
+    auto it = m_syscalls.find(icount);
+    return it == m_syscalls.end() ? nullptr : &it->second;
+}
+
+
+
+const replay_point* execution_log::find_point(uint64_t icount) const {
+    auto it = std::upper_bound(m_points.begin(), m_points.end(), icount,
+                               [](uint64_t count, const replay_point& p) {return count < p.icount;});
+    if (it == m_points.begin()) return nullptr;
+    return &*std::prev(it);
+}
+
+
+
+std::vector<pid_t> execution_log::thin(std::size_t max_points) {
+    std::vector<pid_t> removed;
+    if (m_points.size() <= max_points) return removed;
+
+    std::vector<replay_point> kept;
+    auto half = m_points.size() / 2;
+    for (std::size_t i = 0; i < m_points.size(); i++) {
+        // 较早一半中的奇数位置被删除
+        if (i < half && i % 2 == 1) removed.push_back(m_points[i].pid);
+        else kept.push_back(m_points[i]);
+    }
+    m_points = std::move(kept);
+    return removed;
+}
+
+
+
+void execution_log::update_rate(uint64_t steps, std::chrono::duration<double> elapsed) {
+    // 太短的测量误差太大
+    if (steps < 1000 || elapsed.count() <= 0) return;
+    m_rate = 0.7 * m_rate + 0.3 * (steps / elapsed.count());
+}
+
+
+
+uint64_t execution_log::checkpoint_interval() const {
+    auto seconds = std::chrono::duration<double>(m_latency_bound).count();
+    return std::max<uint64_t>(1000, static_cast<uint64_t>(m_rate * seconds / 2));
+}
+
+
+#endif /* __x86_64__ */
@@ -0,0 +1,112 @@
+#ifndef _REVERSE_EXEC_H
+#define _REVERSE_EXEC_H
+
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <utility>
+#include <vector>
+#include <sys/types.h>
+
+
+#ifdef __x86_64__
+
+// 系统调用写入的一段用户内存
+struct memory_write {
+    std::uintptr_t addr;
+    std::vector<uint8_t> data;
+};
+
+// 记录下来的一次系统调用
+struct syscall_record {
+    uint64_t nr;
+    int64_t result;
+    std::vector<memory_write> writes;
+};
+
+// 重放的起点：指令数为[icount]时fork出的检查点，其中没有int3
+struct replay_point {
+    uint64_t icount;
+    pid_t pid;
+};
+
+
+// 读取被调试进程的内存，读不到时返回false
+using remote_reader = std::function<bool(std::uintptr_t addr, void* buf, std::size_t len)>;
+
+/**
+ * @brief: 系统调用[nr]返回[result]后，内核写入了哪些用户内存（地址, 长度）
+ *         覆盖常见的读取类调用：read/pread/readv、recvfrom、stat族、getdents、时间、getrandom、poll/select等；
+ *         iovec、socklen等间接参数通过[read]读取
+ */
+std::vector<std::pair<std::uintptr_t, std::size_t>> syscall_output_regions(uint64_t nr, const uint64_t args[6],
+                                                                          int64_t result, const remote_reader& read);
+
+// 重放时必须真正执行的系统调用：改变地址空间、信号状态或线程状态，结果由进程自身决定
+bool syscall_replays_natively(uint64_t nr);
+
+/**
+ * @brief: 把[pid]的vDSO中的时间函数（clock_gettime、gettimeofday、time、getcpu、clock_getres）
+ *         改写为 mov $nr, %eax; syscall; ret。vDSO直接读取内核共享的时钟页，执行的指令数与结果
+ *         每次都不同，改为系统调用后才能被记录与模拟。返回改写的函数个数
+ */
+int patch_vdso(pid_t pid);
+
+/**
+ * @brief: 在停在syscall指令处的[pid]中模拟[record]而不进入内核：写回记录的内存，
+ *         rax为返回值，rcx/r11与真正的syscall一样被覆盖，pc跳过该指令
+ */
+void apply_syscall_record(pid_t pid, const syscall_record& record);
+
+
+
+/**
+ * @brief: 记录执行的日志：按指令数索引的系统调用结果与重放起点
+ *         指令数为单步的次数（rep前缀的每次迭代各算一次），对单线程程序是确定的。
+ *         重放起点的间隔由测得的单步速度决定，使从最近的起点重放到任意位置不超过延迟上限。
+ */
+class execution_log {
+public:
+    void clear();
+
+    void add_syscall(uint64_t icount, syscall_record record) {m_syscalls[icount] = std::move(record);}
+    const syscall_record* find_syscall(uint64_t icount) const;
+
+    void add_point(replay_point point) {m_points.push_back(point);}
+    // 指令数不超过[icount]的最近的重放起点
+    const replay_point* find_point(uint64_t icount) const;
+    auto get_points() const -> const std::vector<replay_point>& {return m_points;}
+    /**
+     * @brief: 起点超过[max_points]时，隔一个删掉较早一半中的起点（保留第一个），返回需要结束的进程；
+     *         较早的历史重放得更慢，最近的历史仍满足延迟上限
+     */
+    std::vector<pid_t> thin(std::size_t max_points);
+
+    // 已记录到的指令数，小于它的位置都可以重放
+    auto get_end() const -> uint64_t {return m_end;}
+    void set_end(uint64_t end) {m_end = end;}
+
+    // 根据一次单步/重放的耗时更新速度估计（指数平均）
+    void update_rate(uint64_t steps, std::chrono::duration<double> elapsed);
+    auto get_rate() const -> double {return m_rate;}
+    void set_latency_bound(std::chrono::milliseconds bound) {m_latency_bound = bound;}
+    auto get_latency_bound() const -> std::chrono::milliseconds {return m_latency_bound;}
+    // 两个重放起点之间的指令数：反向操作最多重放两段（查找 + 定位）
+    uint64_t checkpoint_interval() const;
+    auto get_syscall_count() const -> std::size_t {return m_syscalls.size();}
+
+private:
+    std::map<uint64_t, syscall_record> m_syscalls;
+    std::vector<replay_point> m_points;         // 按指令数递增
+    uint64_t m_end = 0;
+    double m_rate = 100000;                     // 每秒单步数，未测量时的估计
+    std::chrono::milliseconds m_latency_bound {200};
+};
+
+#endif /* __x86_64__ */
+
+
+#endif /* _REVERSE_EXEC_H */
@@ -0,0 +1,170 @@
+#include "symbol_index.h"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <lzma.h>
+
+
+
+/**
+ * @brief: 从内存缓冲区中加载elf，用于解压后的[.gnu_debugdata]
+ */
+class memory_loader : public elf::loader {
+public:
+    explicit memory_loader(std::vector<char> buf) : m_buf{std::move(buf)} {}
+
+    const void* load(off_t offset, size_t size) override {
+        if (offset < 0 || (size_t)offset + size > m_buf.size()) {
+            throw std::range_error{"offset exceeds file size"};
+        }
+        return m_buf.data() + offset;
+    }
+
+private:
+    std::vector<char> m_buf;
+};
+
+
+
+// 解压xz格式的数据，失败时返回空
+static std::vector<char> xz_decompress(const void* data, size_t size) {
+    lzma_stream strm = LZMA_STREAM_INIT;
+    if (lzma_stream_decoder(&strm, UINT64_MAX, 0) != LZMA_OK) return {};
+
+    std::vector<char> out(size * 4);
+    strm.next_in = static_cast<const uint8_t*>(data);
+    strm.avail_in = size;
+
+    lzma_ret ret = LZMA_OK;
+    while (ret == LZMA_OK) {
+        if (strm.total_out == out.size()) out.resize(out.size() * 2);
+        strm.next_out = reinterpret_cast<uint8_t*>(out.data()) + strm.total_out;
+        strm.avail_out = out.size() - strm.total_out;
+        ret = lzma_code(&strm, LZMA_FINISH);
+    }
+    out.resize(strm.total_out);
+    lzma_end(&strm);
+
+    if (ret != LZMA_STREAM_END) return {};
+    return out;
+}
+
+
+
+void symbol_index::build(const elf::elf& f) {
+    m_elf = f;
+    m_functions.clear();
+    m_symbols.clear();
+
+    add_symtab(f);
+    add_gnu_debugdata(f);
+    add_eh_frame(f);
+
+    // 同一地址可能有多个符号（别名），保留第一个有大小的
+    std::stable_sort(m_symbols.begin(), m_symbols.end(),
+                     [](const function_symbol& a, const function_symbol& b) {
+                         if (a.low_pc != b.low_pc) return a.low_pc < b.low_pc;
+                         return a.high_pc > b.high_pc;
+                     });
+    m_symbols.erase(std::unique(m_symbols.begin(), m_symbols.end(),
+                                [](const function_symbol& a, const function_symbol& b) {
+                                    return a.low_pc == b.low_pc;
+                                }),
+                    m_symbols.end());
+
+    // 用FDE补全没有大小的符号，并为没有符号的FDE生成名字
+    for (const auto& entry : m_eh_frame.get_fdes()) {
+        auto it = std::lower_bound(m_symbols.begin(), m_symbols.end(), entry.low_pc,
+                                   [](const function_symbol& s, uint64_t pc) { return s.low_pc < pc; });
+        if (it != m_symbols.end() && it->low_pc == entry.low_pc) {
+            if (it->high_pc == it->low_pc) it->high_pc = entry.high_pc;
+            continue;
+        }
+        // 已被某个有大小的符号覆盖
+        if (it != m_symbols.begin() && entry.low_pc < std::prev(it)->high_pc) continue;
+
+        std::ostringstream name;
+        name << "sub_" << std::hex << entry.low_pc;
+        m_functions.push_back(function_symbol{entry.low_pc, entry.high_pc, name.str()});
+    }
+
+    // 仍然没有大小的符号，延伸到下一个符号的起始地址
+    for (size_t i = 0; i < m_symbols.size(); i++) {
+        auto& s = m_symbols[i];
+        if (s.high_pc == s.low_pc) {
+            s.high_pc = i + 1 < m_symbols.size() ? m_symbols[i + 1].low_pc : s.low_pc + 1;
+        }
+        m_functions.push_back(s);
+    }
+    m_symbols.clear();
+
+    std::sort(m_functions.begin(), m_functions.end(),
+              [](const function_symbol& a, const function_symbol& b) { return a.low_pc < b.low_pc; });
+    m_built = true;
+}
+
+
+
+const function_symbol* symbol_index::find(uint64_t pc) const {
+    auto it = std::upper_bound(m_functions.begin(), m_functions.end(), pc,
+                               [](uint64_t pc, const function_symbol& s) { return pc < s.low_pc; });
+    // 函数可能嵌套（例如冷路径分区），向前查找包含pc的一项
+    while (it != m_functions.begin()) {
+        --it;
+        if (pc < it->high_pc) return &*it;
+        if (pc - it->low_pc > (1 << 20)) break;
+    }
+    return nullptr;
+}
+
+
+
+void symbol_index::add_symtab(const elf::elf& f) {
+    for (const auto& sec : f.sections()) {
+        if (sec.get_hdr().type != elf::sht::symtab && sec.get_hdr().type != elf::sht::dynsym)
+            continue;
+
+        for (auto sym : sec.as_symtab()) {
+            const auto& d = sym.get_data();
+            // 只关心已定义的函数符号
+            if (d.type() != elf::stt::func || d.value == 0 || d.shnxd == 0) continue;
+            m_symbols.push_back(function_symbol{d.value, d.value + d.size, sym.get_name()});
+        }
+    }
+}
+
+
+
+void symbol_index::add_gnu_debugdata(const elf::elf& f) {
+    const auto& sec = f.get_section(".gnu_debugdata");
+    if (!sec.valid()) return;
+
+    auto buf = xz_decompress(sec.data(), sec.size());
+    if (buf.empty()) {
+        std::cerr << "Failed to decompress .gnu_debugdata" << std::endl;
+        return;
+    }
+
+    try {
+        m_minidebuginfo = elf::elf{std::make_shared<memory_loader>(std::move(buf))};
+        add_symtab(m_minidebuginfo);
+    } catch (std::exception& e) {
+        std::cerr << "Invalid .gnu_debugdata: " << e.what() << std::endl;
+    }
+}
+
+
+
+void symbol_index::add_eh_frame(const elf::elf& f) {
+    const auto& sec = f.get_section(".eh_frame");
+    if (!sec.valid() || sec.get_hdr().type == elf::sht::nobits) return;
+
+    try {
+        m_eh_frame.parse(sec.data(), sec.size(), sec.get_hdr().addr, true);
+    } catch (std::exception& e) {
+        std::cerr << "Invalid .eh_frame: " << e.what() << std::endl;
+    }
+}
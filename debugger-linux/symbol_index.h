@@ -0,0 +1,61 @@
+#ifndef _SYMBOL_INDEX_H
+#define _SYMBOL_INDEX_H
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "eh_frame.h"
+#include "libelfin/elf/elf++.hh"
+
+
+// 函数的地址范围 [low_pc, high_pc) 与名字，地址与DWARF一致，不含加载偏置
+struct function_symbol {
+    uint64_t low_pc;
+    uint64_t high_pc;
+    std::string name;
+};
+
+
+
+/**
+ * @brief: 不依赖DWARF的函数地址索引，用于libc或被strip过的程序
+ *         1. [.symtab]/[.dynsym]中的函数符号提供名字
+ *         2. [.gnu_debugdata]中xz压缩的迷你符号表（发行版的二进制文件常带有）
+ *         3. [.eh_frame]中的FDE提供精确的函数边界，没有符号的函数命名为 sub_<addr>
+ *         索引只需构建一次，查询为二分查找
+ */
+class symbol_index {
+public:
+    symbol_index() = default;
+
+    // 根据[f]构建索引
+    void build(const elf::elf& f);
+    auto is_built() const -> bool {return m_built;}
+
+    // 根据pc查找函数，找不到时返回nullptr
+    const function_symbol* find(uint64_t pc) const;
+
+    auto get_functions() const -> const std::vector<function_symbol>& {return m_functions;}
+    // [.eh_frame]的解析结果，可供栈回溯使用
+    auto get_eh_frame() const -> const call_frame_info& {return m_eh_frame;}
+
+private:
+    void add_symtab(const elf::elf& f);
+    void add_gnu_debugdata(const elf::elf& f);
+    void add_eh_frame(const elf::elf& f);
+
+    bool m_built = false;
+    std::vector<function_symbol> m_functions;  // 按[low_pc]排序
+    std::vector<function_symbol> m_symbols;    // 构建过程中收集到的符号
+
+    // 保持section数据的生命周期，[m_eh_frame]直接指向其中的数据
+    elf::elf m_elf;
+    elf::elf m_minidebuginfo;
+    call_frame_info m_eh_frame;
+};
+
+
+
+#endif /* _SYMBOL_INDEX_H */
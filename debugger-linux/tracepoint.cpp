@@ -0,0 +1,490 @@
+#include "tracepoint.h"
+#include "inferior_call.h"
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+#ifdef __x86_64__
+
+
+const char* const g_trace_reg_names[trace_n_regs] = {
+    "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+    "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15",
+};
+
+// 每个trampoline最多占用的字节数，以及每次分配的代码页大小
+constexpr std::size_t trampoline_size = 640;
+constexpr std::size_t code_page_size = 64 * 1024;
+// jmp rel32的长度
+constexpr std::size_t jmp_size = 5;
+
+// trace_entry中各字段的偏移
+constexpr uint32_t entry_regs_offset = offsetof(trace_entry, regs);
+constexpr uint32_t entry_mem_offset = offsetof(trace_entry, mem);
+
+
+
+// 生成机器码时使用的缓冲区
+class code_buffer {
+public:
+    void emit(std::initializer_list<uint8_t> bytes) {m_bytes.insert(m_bytes.end(), bytes);}
+    void emit32(uint32_t value) {append(&value, 4);}
+    void emit64(uint64_t value) {append(&value, 8);}
+    void append(const void* data, std::size_t size) {
+        auto p = static_cast<const uint8_t*>(data);
+        m_bytes.insert(m_bytes.end(), p, p + size);
+    }
+    // 相对跳转的偏移，超出rel32时抛出异常
+    void emit_rel32(std::uintptr_t target, std::uintptr_t next) {
+        if (!within_rel32(target, next)) throw std::runtime_error{"Branch target out of rel32 range"};
+        emit32(static_cast<uint32_t>(target - next));
+    }
+
+    auto size() const -> std::size_t {return m_bytes.size();}
+    auto data() -> uint8_t* {return m_bytes.data();}
+    auto bytes() -> std::vector<uint8_t>& {return m_bytes;}
+
+private:
+    std::vector<uint8_t> m_bytes;
+};
+
+
+
+tracepoint_agent::tracepoint_agent(pid_t pid) : m_pid{pid}, m_mem_fd{-1} {
+    set_pid(pid);
+}
+
+
+tracepoint_agent::~tracepoint_agent() {
+    stop_drain();
+    if (m_ring) munmap(m_ring, m_ring_size);
+    if (m_mem_fd >= 0) close(m_mem_fd);
+}
+
+
+
+void tracepoint_agent::set_pid(pid_t pid) {
+    stop_drain();
+    if (m_ring) munmap(m_ring, m_ring_size);
+    if (m_mem_fd >= 0) close(m_mem_fd);
+
+    m_pid = pid;
+    m_mem_fd = open(("/proc/" + std::to_string(pid) + "/mem").c_str(), O_RDWR);
+    m_ring = nullptr;
+    m_remote_ring = 0;
+    m_tail = 0;
+    m_code_pages.clear();
+    m_tracepoints.clear();
+
+    std::lock_guard<std::mutex> lock {m_mutex};
+    m_records.clear();
+    m_hits.clear();
+    m_lost = 0;
+}
+
+
+
+/**
+ * @brief: 调试器创建 /dev/shm 下的文件并映射，再在被调试进程中注入
+ *         openat + mmap(MAP_SHARED) 映射同一个文件，随后删除该文件
+ */
+void tracepoint_agent::setup_ring() {
+    m_ring_size = (trace_header_size + trace_entry_count * trace_entry_size + 4095) & ~std::size_t{4095};
+    auto path = "/dev/shm/minidebug-" + std::to_string(getpid()) + "-" + std::to_string(m_pid);
+
+    unlink(path.c_str());
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) throw std::runtime_error{"Can't create " + path};
+    if (ftruncate(fd, m_ring_size) < 0) {
+        close(fd);
+        unlink(path.c_str());
+        throw std::runtime_error{"Can't resize " + path};
+    }
+    auto local = mmap(nullptr, m_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (local == MAP_FAILED) {
+        unlink(path.c_str());
+        throw std::runtime_error{"Can't map " + path};
+    }
+
+    // 文件名需要位于被调试进程的内存中
+    int64_t remote = -1;
+    auto scratch = inject_syscall(m_pid, SYS_mmap, {0, 4096, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS, (uint64_t)-1, 0});
+    if (scratch > 0 && pwrite(m_mem_fd, path.c_str(), path.size() + 1, scratch) == (ssize_t)path.size() + 1) {
+        auto remote_fd = inject_syscall(m_pid, SYS_openat, {(uint64_t)AT_FDCWD, (uint64_t)scratch, O_RDWR, 0});
+        if (remote_fd >= 0) {
+            remote = inject_syscall(m_pid, SYS_mmap, {0, m_ring_size, PROT_READ | PROT_WRITE,
+                                    MAP_SHARED | MAP_POPULATE, (uint64_t)remote_fd, 0});
+            inject_syscall(m_pid, SYS_close, {(uint64_t)remote_fd});
+        }
+    }
+    if (scratch > 0) inject_syscall(m_pid, SYS_munmap, {(uint64_t)scratch, 4096});
+    unlink(path.c_str());
+
+    if (remote < 0 && remote > -4096) {
+        munmap(local, m_ring_size);
+        throw std::runtime_error{"Can't map the trace buffer into the inferior"};
+    }
+
+    m_ring = static_cast<uint8_t*>(local);
+    m_remote_ring = remote;
+    auto header = reinterpret_cast<trace_ring_header*>(m_ring);
+    header->magic = trace_magic;
+    header->entry_count = trace_entry_count;
+    header->entry_size = trace_entry_size;
+    m_tail = 0;
+
+    m_running = true;
+    m_drain = std::thread{&tracepoint_agent::drain_loop, this};
+}
+
+
+
+std::uintptr_t tracepoint_agent::allocate_code(std::uintptr_t addr, std::size_t size) {
+    for (auto& page : m_code_pages) {
+        if (page.used + size <= code_page_size && within_rel32(page.base, addr)) {
+            auto code = page.base + page.used;
+            page.used += size;
+            return code;
+        }
+    }
+
+    auto base = inject_mmap_near(m_pid, addr, code_page_size, PROT_READ | PROT_EXEC);
+    if (base == 0) throw std::runtime_error{"Can't allocate trampoline near the tracepoint"};
+    m_code_pages.push_back(code_page{base, size});
+    return base;
+}
+
+
+
+/**
+ * @brief: trampoline的结构
+ *             lea rsp, [rsp-128]          跳过red zone
+ *             pushfq; push rax/rcx/rdx/rbx
+ *             rbx = &entries[lock xadd(head, 1) & mask], rcx = 序号 + 1
+ *             entry->seq = 0, 写入id、rdtsc、16个寄存器与要复制的内存
+ *             entry->seq = rcx             提交（x86的store不会被重排到之前的store之前）
+ *             pop rbx/rdx/rcx/rax; popfq; lea rsp, [rsp+128]
+ *             被搬移的原指令
+ *             jmp tracepoint之后的指令
+ */
+std::vector<uint8_t> tracepoint_agent::build_trampoline(int id, std::uintptr_t site, std::uintptr_t tramp,
+                                                        const uint8_t* code, const std::vector<x86_insn>& insns,
+                                                        const std::optional<trace_capture>& capture) {
+    code_buffer b;
+
+    // 1. 保存会被修改的寄存器
+    b.emit({0x48, 0x8d, 0x64, 0x24, 0x80});             // lea rsp, [rsp-128]
+    b.emit({0x9c});                                     // pushfq
+    b.emit({0x50, 0x51, 0x52, 0x53});                   // push rax; push rcx; push rdx; push rbx
+
+    // 2. 领取序号，计算entry的地址
+    b.emit({0x48, 0xbb}); b.emit64(m_remote_ring);     // movabs rbx, ring
+    b.emit({0xb9}); b.emit32(1);                        // mov ecx, 1
+    b.emit({0xf0, 0x48, 0x0f, 0xc1, 0x0b});             // lock xadd [rbx], rcx
+    b.emit({0x48, 0x89, 0xc8});                         // mov rax, rcx
+    b.emit({0x48, 0x25}); b.emit32(trace_entry_count - 1);  // and rax, mask
+    b.emit({0x48, 0xc1, 0xe0, trace_entry_shift});      // shl rax, 8
+    b.emit({0x48, 0x8d, 0x5c, 0x03, trace_header_size});    // lea rbx, [rbx+rax+64]
+    b.emit({0x48, 0xff, 0xc1});                         // inc rcx
+    b.emit({0x48, 0xc7, 0x03, 0, 0, 0, 0});             // mov qword [rbx], 0
+    b.emit({0xc7, 0x43, 0x08}); b.emit32(id);           // mov dword [rbx+8], id
+    b.emit({0xc7, 0x43, 0x0c}); b.emit32(capture ? capture->len : 0);   // mov dword [rbx+12], len
+
+    // 3. 时间戳
+    b.emit({0x0f, 0x31});                               // rdtsc
+    b.emit({0x48, 0xc1, 0xe2, 0x20});                   // shl rdx, 32
+    b.emit({0x48, 0x09, 0xd0});                         // or rax, rdx
+    b.emit({0x48, 0x89, 0x43, 0x10});                   // mov [rbx+16], rax
+
+    // 4. 寄存器：mov [rbx + regs + 8*slot], src
+    auto store = [&b](int src, int slot) {
+        b.emit({uint8_t(0x48 | (src >= 8 ? 0x04 : 0)), 0x89, uint8_t(0x80 | ((src & 7) << 3) | 3)});
+        b.emit32(entry_regs_offset + 8 * slot);
+    };
+    // rax/rcx/rdx/rbx的原值在栈上
+    const uint8_t pushed_offset[4] = {24, 16, 8, 0};
+    for (int r = 0; r < 4; r++) {
+        b.emit({0x48, 0x8b, 0x44, 0x24, pushed_offset[r]});    // mov rax, [rsp+off]
+        store(0, r);
+    }
+    // 原来的rsp = 当前rsp + 4次push + pushfq + red zone
+    b.emit({0x48, 0x8d, 0x84, 0x24}); b.emit32(5 * 8 + 128);   // lea rax, [rsp+168]
+    store(0, 4);
+    for (int r = 5; r < trace_n_regs; r++) store(r, r);
+
+    // 5. 复制内存：rax = 地址，逐8字节复制，末尾不足8字节时逐字节复制
+    if (capture && capture->len > 0) {
+        if (capture->absolute) {
+            b.emit({0x48, 0xb8}); b.emit64(capture->offset);       // movabs rax, addr
+        } else {
+            b.emit({0x48, 0x8b, 0x83}); b.emit32(entry_regs_offset + 8 * capture->reg);  // mov rax, [rbx+reg]
+            if (capture->offset) {
+                b.emit({0x48, 0x05}); b.emit32(static_cast<uint32_t>(capture->offset));   // add rax, imm32
+            }
+        }
+        uint32_t i = 0;
+        for (; i + 8 <= capture->len; i += 8) {
+            b.emit({0x48, 0x8b, 0x90}); b.emit32(i);                       // mov rdx, [rax+i]
+            b.emit({0x48, 0x89, 0x93}); b.emit32(entry_mem_offset + i);    // mov [rbx+mem+i], rdx
+        }
+        for (; i < capture->len; i++) {
+            b.emit({0x8a, 0x90}); b.emit32(i);                             // mov dl, [rax+i]
+            b.emit({0x88, 0x93}); b.emit32(entry_mem_offset + i);          // mov [rbx+mem+i], dl
+        }
+    }
+
+    // 6. 提交并恢复寄存器
+    b.emit({0x48, 0x89, 0x0b});                         // mov [rbx], rcx
+    b.emit({0x5b, 0x5a, 0x59, 0x58, 0x9d});             // pop rbx; pop rdx; pop rcx; pop rax; popfq
+    b.emit({0x48, 0x8d, 0xa4, 0x24}); b.emit32(128);    // lea rsp, [rsp+128]
+
+    // 7. 搬移原指令
+    auto orig = site;
+    for (const auto& insn : insns) {
+        auto here = tramp + b.size();
+        auto p = code + (orig - site);
+        auto target = orig + insn.length + insn.rel;
+
+        switch (insn.branch) {
+            case x86_branch::jump:
+                b.emit({0xe9});
+                b.emit_rel32(target, here + 5);
+                break;
+
+            case x86_branch::cond_jump: {
+                uint8_t cc = insn.opcode & 0x0f;
+                bool is_jcc = (insn.opcode_map == 0 && insn.opcode >= 0x70 && insn.opcode <= 0x7f)
+                              || insn.opcode_map == 1;
+                if (!is_jcc) throw std::runtime_error{"Can't relocate loop/jrcxz"};
+                b.emit({0x0f, uint8_t(0x80 | cc)});
+                b.emit_rel32(target, here + 6);
+                break;
+            }
+
+            case x86_branch::call: {
+                // 压入原来的返回地址后跳转，被调用的函数直接返回到原处
+                auto ret = orig + insn.length;
+                b.emit({0x48, 0x8d, 0x64, 0x24, 0xf8});                     // lea rsp, [rsp-8]
+                b.emit({0xc7, 0x04, 0x24}); b.emit32(ret & 0xffffffff);      // mov dword [rsp], lo
+                b.emit({0xc7, 0x44, 0x24, 0x04}); b.emit32(ret >> 32);       // mov dword [rsp+4], hi
+                b.emit({0xe9});
+                b.emit_rel32(target, tramp + b.size() + 4);
+                break;
+            }
+
+            case x86_branch::indirect_call:
+                throw std::runtime_error{"Can't relocate an indirect call"};
+
+            default: {
+                auto start = b.size();
+                b.append(p, insn.length);
+                if (insn.rip_relative) {
+                    int32_t disp;
+                    std::memcpy(&disp, p + insn.disp_offset, 4);
+                    auto fixed = static_cast<int64_t>(disp) + static_cast<int64_t>(orig - here);
+                    if (fixed < INT32_MIN || fixed > INT32_MAX) throw std::runtime_error{"RIP-relative operand out of range"};
+                    disp = static_cast<int32_t>(fixed);
+                    std::memcpy(b.data() + start + insn.disp_offset, &disp, 4);
+                }
+                break;
+            }
+        }
+        orig += insn.length;
+    }
+
+    // 8. 跳回tracepoint之后
+    auto last = insns.back().branch;
+    if (last != x86_branch::jump && last != x86_branch::ret && last != x86_branch::indirect_jump
+        && last != x86_branch::call) {
+        b.emit({0xe9});
+        b.emit_rel32(orig, tramp + b.size() + 4);
+    }
+    return std::move(b.bytes());
+}
+
+
+
+int tracepoint_agent::install(std::uintptr_t addr, const std::vector<uint8_t>& code, bool at_entry,
+                              const std::optional<trace_capture>& capture) {
+    if (m_mem_fd < 0) throw std::runtime_error{"Can't open inferior memory"};
+    if (overlaps(addr, jmp_size)) throw std::runtime_error{"A tracepoint is already installed here"};
+    if (capture && capture->len > trace_max_capture) {
+        throw std::runtime_error{"Can't collect more than " + std::to_string(trace_max_capture) + " bytes"};
+    }
+
+    // 解码需要被jmp覆盖的指令
+    std::vector<x86_insn> insns;
+    std::size_t patch_len = 0;
+    while (patch_len < jmp_size) {
+        x86_insn insn;
+        if (!decode_x86(code.data() + patch_len, code.size() - patch_len, insn)) {
+            throw std::runtime_error{"Can't decode the instruction at the tracepoint"};
+        }
+        if (insns.empty() && insn.length < jmp_size && !at_entry) {
+            // 搬移多条指令时，其他代码可能跳到被覆盖的中间位置
+            throw std::runtime_error{"Instruction is shorter than 5 bytes; use a function entry or another line"};
+        }
+        bool terminal = insn.branch == x86_branch::jump || insn.branch == x86_branch::ret
+                        || insn.branch == x86_branch::indirect_jump || insn.branch == x86_branch::call;
+        if (terminal && patch_len + insn.length < jmp_size) {
+            throw std::runtime_error{"Control transfer too close to the tracepoint"};
+        }
+        insns.push_back(insn);
+        patch_len += insn.length;
+    }
+
+    if (!m_ring) setup_ring();
+
+    int id = m_next_id;
+    auto tramp = allocate_code(addr, trampoline_size);
+    auto bytes = build_trampoline(id, addr, tramp, code.data(), insns, capture);
+    if (bytes.size() > trampoline_size) throw std::runtime_error{"Trampoline too large"};
+    if (pwrite(m_mem_fd, bytes.data(), bytes.size(), tramp) != (ssize_t)bytes.size()) {
+        throw std::runtime_error{"Can't write the trampoline"};
+    }
+
+    // jmp rel32，其余被覆盖的字节填充int3
+    std::vector<uint8_t> patch(patch_len, 0xcc);
+    patch[0] = 0xe9;
+    auto rel = static_cast<uint32_t>(tramp - (addr + jmp_size));
+    std::memcpy(patch.data() + 1, &rel, 4);
+    if (pwrite(m_mem_fd, patch.data(), patch.size(), addr) != (ssize_t)patch.size()) {
+        throw std::runtime_error{"Can't patch the tracepoint"};
+    }
+
+    m_tracepoints[id] = tracepoint{addr, std::vector<uint8_t>(code.begin(), code.begin() + patch_len),
+                                   tramp, capture};
+    m_next_id++;
+    return id;
+}
+
+
+
+void tracepoint_agent::remove(int id) {
+    auto it = m_tracepoints.find(id);
+    if (it == m_tracepoints.end()) throw std::out_of_range{"No tracepoint " + std::to_string(id)};
+
+    const auto& tp = it->second;
+    if (pwrite(m_mem_fd, tp.saved.data(), tp.saved.size(), tp.addr) != (ssize_t)tp.saved.size()) {
+        throw std::runtime_error{"Can't restore the code at the tracepoint"};
+    }
+    m_tracepoints.erase(it);
+}
+
+
+
+bool tracepoint_agent::overlaps(std::uintptr_t addr, std::size_t len) const {
+    for (const auto& [id, tp] : m_tracepoints) {
+        if (addr < tp.addr + tp.saved.size() && tp.addr < addr + len) return true;
+    }
+    return false;
+}
+
+
+
+void tracepoint_agent::stop_drain() {
+    m_running = false;
+    if (m_drain.joinable()) m_drain.join();
+}
+
+
+
+void tracepoint_agent::drain_loop() {
+    while (m_running) {
+        if (drain_batch() == 0) std::this_thread::sleep_for(std::chrono::microseconds{200});
+    }
+    // 退出前把剩余的记录读完
+    while (drain_batch()) {}
+}
+
+
+
+/**
+ * @brief: 每批只读取一次head，并只加一次锁，减少与写入方争用同一缓存行
+ *         对序号为[m_tail]的记录：
+ *         seq == m_tail + 1：记录完整；读取后再次检查seq，变化说明读取时被覆盖
+ *         seq <  m_tail + 1：还没有写完（0）或仍是上一圈的记录，等待
+ *         seq >  m_tail + 1：已经被下一圈覆盖，丢失
+ */
+std::size_t tracepoint_agent::drain_batch() {
+    auto header = reinterpret_cast<trace_ring_header*>(m_ring);
+    auto head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+
+    uint64_t lost = 0;
+    if (head - m_tail > trace_entry_count) {
+        lost += head - m_tail - trace_entry_count;
+        m_tail = head - trace_entry_count;
+    }
+
+    auto& batch = m_batch;
+    batch.clear();
+    auto end = std::min<uint64_t>(head, m_tail + trace_entry_count / 4);
+    while (m_tail < end) {
+        auto entry = reinterpret_cast<trace_entry*>(m_ring + trace_header_size
+                                                     + (m_tail & (trace_entry_count - 1)) * trace_entry_size);
+        auto seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+
+        if (seq < m_tail + 1) {
+            // 写入方在写完之前被杀死时，不能一直等下去
+            if (head - m_tail < trace_entry_count / 2) break;
+            lost++;
+        } else if (seq > m_tail + 1) {
+            lost++;
+        } else {
+            auto& record = batch.emplace_back();
+            record.id = entry->id;
+            record.mem_len = std::min<uint32_t>(entry->mem_len, trace_max_capture);
+            record.tsc = entry->tsc;
+            std::memcpy(record.regs, entry->regs, sizeof(record.regs));
+            std::memcpy(record.mem, entry->mem, record.mem_len);
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if (__atomic_load_n(&entry->seq, __ATOMIC_RELAXED) != seq) {
+                batch.pop_back();
+                lost++;
+            }
+        }
+        m_tail++;
+    }
+
+    if (batch.empty() && lost == 0) return 0;
+    std::lock_guard<std::mutex> lock {m_mutex};
+    m_lost += lost;
+    for (const auto& record : batch) {
+        m_hits[record.id]++;
+        m_records.push_back(record);
+    }
+    while (m_records.size() > trace_entry_count) m_records.pop_front();
+    return batch.size() + lost;
+}
+
+
+
+uint64_t tracepoint_agent::get_hit_count(int id) {
+    std::lock_guard<std::mutex> lock {m_mutex};
+    auto it = m_hits.find(id);
+    return it == m_hits.end() ? 0 : it->second;
+}
+
+
+uint64_t tracepoint_agent::get_lost_count() {
+    std::lock_guard<std::mutex> lock {m_mutex};
+    return m_lost;
+}
+
+
+std::vector<trace_record> tracepoint_agent::get_records(std::size_t n) {
+    std::lock_guard<std::mutex> lock {m_mutex};
+    n = std::min(n, m_records.size());
+    return std::vector<trace_record>(m_records.end() - n, m_records.end());
+}
+
+
+#endif /* __x86_64__ */
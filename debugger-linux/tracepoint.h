@@ -0,0 +1,169 @@
+#ifndef _TRACEPOINT_H
+#define _TRACEPOINT_H
+
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+
+#include "x86_decoder.h"
+
+
+#ifdef __x86_64__
+
+/* 共享内存环形缓冲区的布局：被调试进程中的trampoline写入，调试器的后台线程读取 */
+constexpr std::size_t trace_header_size = 64;
+constexpr std::size_t trace_entry_shift = 8;
+constexpr std::size_t trace_entry_size = 1 << trace_entry_shift;
+constexpr std::size_t trace_entry_count = 1 << 14;
+constexpr std::size_t trace_max_capture = 96;
+constexpr int trace_n_regs = 16;
+constexpr uint64_t trace_magic = 0x6d696e6964626774;   // "minidbgt"
+
+
+struct trace_ring_header {
+    uint64_t head;          // 下一个序号，trampoline用 lock xadd 领取
+    uint64_t magic;
+    uint64_t entry_count;
+    uint64_t entry_size;
+    uint64_t reserved[4];
+};
+
+struct trace_entry {
+    uint64_t seq;           // 写完后置为 序号+1；0表示正在写入
+    uint32_t id;            // tracepoint编号
+    uint32_t mem_len;       // [mem]中有效的字节数
+    uint64_t tsc;           // rdtsc
+    uint64_t regs[trace_n_regs];   // 按x86编码顺序: rax rcx rdx rbx rsp rbp rsi rdi r8-r15
+    uint8_t mem[trace_max_capture];
+    uint64_t reserved;
+};
+
+static_assert(sizeof(trace_ring_header) == trace_header_size, "trace ring header layout");
+static_assert(sizeof(trace_entry) == trace_entry_size, "trace entry layout");
+
+
+// x86编码顺序的寄存器名
+extern const char* const g_trace_reg_names[trace_n_regs];
+
+
+// 从环形缓冲区取出的一条记录
+struct trace_record {
+    uint32_t id;
+    uint32_t mem_len;
+    uint64_t tsc;
+    uint64_t regs[trace_n_regs];
+    uint8_t mem[trace_max_capture];
+};
+
+
+// 命中时额外复制的内存：[寄存器 + offset] 或固定地址，共[len]字节
+struct trace_capture {
+    bool absolute;
+    int reg;                // x86编码的寄存器号 0-15
+    int64_t offset;         // absolute时为地址
+    uint32_t len;
+};
+
+
+
+/**
+ * @brief: 快速tracepoint（in-process agent）
+ *         1. 创建 /dev/shm 下的共享内存作为环形缓冲区，并通过注入的openat+mmap映射到被调试进程
+ *         2. 在tracepoint附近分配代码页，生成trampoline：保存寄存器、lock xadd领取序号、
+ *            写入寄存器/rdtsc/内存，最后写入seq提交；然后执行被搬移的原指令并跳回
+ *         3. 把tracepoint处的指令改为 jmp rel32 跳到trampoline
+ *         命中时不会产生ptrace stop，调试器的后台线程异步读取缓冲区。
+ *         缓冲区满时覆盖最旧的记录，读取方根据seq判断丢失的记录。
+ */
+class tracepoint_agent {
+public:
+    explicit tracepoint_agent(pid_t pid);
+    ~tracepoint_agent();
+
+    tracepoint_agent(const tracepoint_agent&) = delete;
+    tracepoint_agent& operator=(const tracepoint_agent&) = delete;
+
+    // 切换到新的进程，旧进程中的tracepoint不再读取
+    void set_pid(pid_t pid);
+
+    // 在[addr]安装tracepoint，[code]为该处原来的字节（已还原int3）
+    // [at_entry]为true时（函数入口）允许搬移多条指令以凑够5字节
+    // 失败时抛出std::runtime_error，成功时返回编号
+    int install(std::uintptr_t addr, const std::vector<uint8_t>& code, bool at_entry,
+                const std::optional<trace_capture>& capture);
+    // 恢复原来的指令；trampoline保留，已经进入的线程可以正常返回
+    void remove(int id);
+
+    struct tracepoint {
+        std::uintptr_t addr;
+        std::vector<uint8_t> saved;     // 被jmp覆盖的原字节
+        std::uintptr_t trampoline;
+        std::optional<trace_capture> capture;
+    };
+    auto get_tracepoints() const -> const std::map<int, tracepoint>& {return m_tracepoints;}
+    // [addr, addr + len)是否与某个tracepoint修改过的字节重叠
+    bool overlaps(std::uintptr_t addr, std::size_t len) const;
+
+    // 后台线程的统计
+    uint64_t get_hit_count(int id);
+    uint64_t get_lost_count();
+    // 最近的[n]条记录
+    std::vector<trace_record> get_records(std::size_t n);
+
+private:
+    // 创建共享内存并映射到两个进程
+    void setup_ring();
+    // 在[addr]附近分配[size]字节的代码空间
+    std::uintptr_t allocate_code(std::uintptr_t addr, std::size_t size);
+    // 生成位于[tramp]的trampoline
+    std::vector<uint8_t> build_trampoline(int id, std::uintptr_t site, std::uintptr_t tramp,
+                                          const uint8_t* code, const std::vector<x86_insn>& insns,
+                                          const std::optional<trace_capture>& capture);
+    // 后台线程：读取环形缓冲区
+    void drain_loop();
+    // 读取一批记录，返回处理的记录数（包括丢失的）
+    std::size_t drain_batch();
+    void stop_drain();
+
+    pid_t m_pid;
+    int m_mem_fd;
+
+    // 环形缓冲区在调试器与被调试进程中的地址
+    uint8_t* m_ring = nullptr;
+    std::uintptr_t m_remote_ring = 0;
+    std::size_t m_ring_size = 0;
+    uint64_t m_tail = 0;
+    std::vector<trace_record> m_batch;     // 后台线程每批读取的记录
+
+    struct code_page {
+        std::uintptr_t base;
+        std::size_t used;
+    };
+    std::vector<code_page> m_code_pages;
+
+    std::map<int, tracepoint> m_tracepoints;
+    int m_next_id = 1;
+
+    // 以下成员由后台线程写入
+    std::mutex m_mutex;
+    std::deque<trace_record> m_records;
+    std::unordered_map<uint32_t, uint64_t> m_hits;
+    uint64_t m_lost = 0;
+
+    std::atomic<bool> m_running {false};
+    std::thread m_drain;
+};
+
+#endif /* __x86_64__ */
+
+
+#endif /* _TRACEPOINT_H */
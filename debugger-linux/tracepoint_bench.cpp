@@ -0,0 +1,119 @@
+/**
+ * @brief: 快速tracepoint每次命中的开销
+ *         fork出的子进程循环调用同一个函数，自己计时后通过管道告知父进程。
+ *         依次测试：没有tracepoint、函数入口处的tracepoint、同时复制栈顶32字节的tracepoint。
+ *         与没有tracepoint相比多出的时间除以调用次数即每次命中的开销，包括后台读取线程占用的CPU。
+ *         还检查读取到的记录数与丢失的记录数之和等于调用次数。
+ *
+ *         tracepoint_bench [iterations] [runs]
+ */
+#include "bench_fixture.h"
+#include "tracepoint.h"
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+
+struct run_result {
+    double ns = 0;          // 子进程中循环的耗时
+    uint64_t hits = 0;
+    uint64_t lost = 0;
+    bool failed = false;
+};
+
+
+static run_result run(long iterations, bool traced, const std::optional<trace_capture>& capture) {
+    int fds[2];
+    if (pipe(fds) < 0) return run_result{0, 0, 0, true};
+
+    auto pid = spawn_traced([&]() {
+        close(fds[0]);
+        auto start = std::chrono::steady_clock::now();
+        bench_workload(iterations);
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        if (write(fds[1], &ns, sizeof(ns)) != sizeof(ns)) _exit(1);
+    });
+    close(fds[1]);
+
+    int status;
+
+    run_result result;
+    std::optional<tracepoint_agent> agent;
+    int id = 0;
+    if (traced) {
+        auto addr = reinterpret_cast<std::uintptr_t>(&bench_hot);
+        std::vector<uint8_t> code(16);
+        for (int i = 0; i < 16; i += 8) {
+            auto word = ptrace(PTRACE_PEEKDATA, pid, addr + i, nullptr);
+            std::memcpy(code.data() + i, &word, 8);
+        }
+        try {
+            agent.emplace(pid);
+            id = agent->install(addr, code, true, capture);
+        } catch (std::exception& e) {
+            std::cerr << "Can't install the tracepoint: " << e.what() << std::endl;
+            result.failed = true;
+            kill(pid, SIGKILL);
+            waitpid(pid, &status, 0);
+            close(fds[0]);
+            return result;
+        }
+    }
+
+    ptrace(PTRACE_CONT, pid, nullptr, nullptr);
+    waitpid(pid, &status, 0);
+    if (read(fds[0], &result.ns, sizeof(result.ns)) != sizeof(result.ns)) result.failed = true;
+    close(fds[0]);
+
+    if (agent) {
+        // 等待后台线程读完剩余的记录
+        for (int i = 0; i < 1000; i++) {
+            result.hits = agent->get_hit_count(id);
+            result.lost = agent->get_lost_count();
+            if (result.hits + result.lost >= static_cast<uint64_t>(iterations)) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds{1});
+        }
+    }
+    return result;
+}
+
+
+
+int main(int argc, char* argv[]) {
+    long iterations = argc > 1 ? std::stol(argv[1]) : 1000000;
+    int runs = argc > 2 ? std::stoi(argv[2]) : 3;
+
+    // 与"ftrace bench_hot collect $rsp@32"相同
+    trace_capture stack {false, 4, 0, 32};
+
+    run_result base, regs, mem;
+    base.ns = regs.ns = mem.ns = 1e30;
+    for (int i = 0; i < runs; i++) {
+        auto r = run(iterations, false, std::nullopt);
+        if (!r.failed && r.ns < base.ns) base = r;
+        r = run(iterations, true, std::nullopt);
+        if (r.failed) return 1;
+        if (r.ns < regs.ns) regs = r;
+        r = run(iterations, true, stack);
+        if (r.failed) return 1;
+        if (r.ns < mem.ns) mem = r;
+    }
+
+    std::cout << "workload: " << iterations << " calls, " << base.ns / iterations << " ns/call without tracepoint" << std::endl;
+    auto print = [&](const char* name, const run_result& r) {
+        std::cout << name << (r.ns - base.ns) / iterations << " ns/hit, "
+                  << r.hits << " records, " << r.lost << " lost"
+                  << (r.hits + r.lost == static_cast<uint64_t>(iterations) ? "" : "  (count mismatch)") << std::endl;
+    };
+    print("registers:           ", regs);
+    print("registers + 32 bytes: ", mem);
+    return 0;
+}
@@ -0,0 +1,523 @@
+#include "unwinder.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <sys/uio.h>
+
+
+#ifdef __x86_64__
+
+
+// 缓存的行数上限，超过时整体丢弃
+constexpr std::size_t max_cached_rows = 1 << 16;
+
+
+namespace {
+
+template <typename T>
+bool read_raw(const uint8_t*& p, const uint8_t* end, T& value) {
+    if (p + sizeof(T) > end) return false;
+    std::memcpy(&value, p, sizeof(T));
+    p += sizeof(T);
+    return true;
+}
+
+
+/**
+ * @brief: CFI中使用的DWARF表达式求值，只支持与栈展开有关的操作
+ *         （常量、寄存器、算术/比较、跳转与解引用）
+ */
+bool evaluate_expression(const uint8_t* expr, std::size_t size, const unwind_frame& frame,
+                         const cfi_unwinder::memory_reader& read, const uint64_t* initial, uint64_t& result) {
+    std::vector<uint64_t> stack;
+    if (initial) stack.push_back(*initial);
+
+    auto pop = [&stack](uint64_t& v) {
+        if (stack.empty()) return false;
+        v = stack.back();
+        stack.pop_back();
+        return true;
+    };
+    auto reg_value = [&frame](uint64_t reg, uint64_t& v) {
+        if (reg >= n_dwarf_regs || !frame.has(reg)) return false;
+        v = frame.regs[reg];
+        return true;
+    };
+
+    const uint8_t* p = expr;
+    const uint8_t* end = expr + size;
+    while (p < end) {
+        uint8_t op = *p++;
+        uint64_t a, b;
+
+        if (op >= 0x30 && op <= 0x4f) {             // DW_OP_lit0-31
+            stack.push_back(op - 0x30);
+            continue;
+        }
+        if (op >= 0x50 && op <= 0x6f) {             // DW_OP_reg0-31
+            if (!reg_value(op - 0x50, a)) return false;
+            stack.push_back(a);
+            continue;
+        }
+        if (op >= 0x70 && op <= 0x8f) {             // DW_OP_breg0-31
+            if (!reg_value(op - 0x70, a)) return false;
+            stack.push_back(a + read_sleb128(p, end));
+            continue;
+        }
+
+        switch (op) {
+        case 0x03: { uint64_t v; if (!read_raw(p, end, v)) return false; stack.push_back(v); break; }   // addr
+        case 0x06:                                  // deref
+            if (!pop(a) || !read(a, b)) return false;
+            stack.push_back(b);
+            break;
+        case 0x08: { uint8_t v;  if (!read_raw(p, end, v)) return false; stack.push_back(v); break; }
+        case 0x09: { int8_t v;   if (!read_raw(p, end, v)) return false; stack.push_back(v); break; }
+        case 0x0a: { uint16_t v; if (!read_raw(p, end, v)) return false; stack.push_back(v); break; }
+        case 0x0b: { int16_t v;  if (!read_raw(p, end, v)) return false; stack.push_back(v); break; }
+        case 0x0c: { uint32_t v; if (!read_raw(p, end, v)) return false; stack.push_back(v); break; }
+        case 0x0d: { int32_t v;  if (!read_raw(p, end, v)) return false; stack.push_back(v); break; }
+        case 0x0e: { uint64_t v; if (!read_raw(p, end, v)) return false; stack.push_back(v); break; }
+        case 0x0f: { int64_t v;  if (!read_raw(p, end, v)) return false; stack.push_back(v); break; }
+        case 0x10: stack.push_back(read_uleb128(p, end)); break;                 // constu
+        case 0x11: stack.push_back(read_sleb128(p, end)); break;                 // consts
+        case 0x12:                                                              // dup
+            if (stack.empty()) return false;
+            stack.push_back(stack.back());
+            break;
+        case 0x13: if (!pop(a)) return false; break;                            // drop
+        case 0x14:                                                              // over
+            if (stack.size() < 2) return false;
+            stack.push_back(stack[stack.size() - 2]);
+            break;
+        case 0x15: {                                                            // pick
+            uint8_t i;
+            if (!read_raw(p, end, i) || i >= stack.size()) return false;
+            stack.push_back(stack[stack.size() - 1 - i]);
+            break;
+        }
+        case 0x16:                                                              // swap
+            if (stack.size() < 2) return false;
+            std::swap(stack[stack.size() - 1], stack[stack.size() - 2]);
+            break;
+        case 0x17:                                                              // rot
+            if (stack.size() < 3) return false;
+            std::rotate(stack.end() - 3, stack.end() - 1, stack.end());
+            break;
+        case 0x19:                                                              // abs
+            if (!pop(a)) return false;
+            stack.push_back(static_cast<int64_t>(a) < 0 ? -a : a);
+            break;
+        case 0x1f:                                                              // neg
+            if (!pop(a)) return false;
+            stack.push_back(-a);
+            break;
+        case 0x20:                                                              // not
+            if (!pop(a)) return false;
+            stack.push_back(~a);
+            break;
+        case 0x23:                                                              // plus_uconst
+            if (!pop(a)) return false;
+            stack.push_back(a + read_uleb128(p, end));
+            break;
+        case 0x1a: case 0x1b: case 0x1c: case 0x1d: case 0x1e:
+        case 0x21: case 0x22: case 0x24: case 0x25: case 0x26: case 0x27:
+        case 0x29: case 0x2a: case 0x2b: case 0x2c: case 0x2d: case 0x2e: {
+            // 二元运算: 次栈顶 op 栈顶
+            if (!pop(b) || !pop(a)) return false;
+            auto sa = static_cast<int64_t>(a), sb = static_cast<int64_t>(b);
+            uint64_t r = 0;
+            switch (op) {
+            case 0x1a: r = a & b; break;
+            case 0x1b: if (sb == 0) return false; r = sa / sb; break;
+            case 0x1c: r = a - b; break;
+            case 0x1d: if (b == 0) return false; r = a % b; break;
+            case 0x1e: r = a * b; break;
+            case 0x21: r = a | b; break;
+            case 0x22: r = a + b; break;
+            case 0x24: r = b < 64 ? a << b : 0; break;
+            case 0x25: r = b < 64 ? a >> b : 0; break;
+            case 0x26: r = b < 64 ? sa >> b : (sa < 0 ? -1 : 0); break;
+            case 0x27: r = a ^ b; break;
+            case 0x29: r = sa == sb; break;
+            case 0x2a: r = sa >= sb; break;
+            case 0x2b: r = sa > sb; break;
+            case 0x2c: r = sa <= sb; break;
+            case 0x2d: r = sa < sb; break;
+            case 0x2e: r = sa != sb; break;
+            }
+            stack.push_back(r);
+            break;
+        }
+        case 0x28: {                                                            // bra
+            int16_t offset;
+            if (!read_raw(p, end, offset) || !pop(a)) return false;
+            if (a != 0) p += offset;
+            if (p < expr || p > end) return false;
+            break;
+        }
+        case 0x2f: {                                                            // skip
+            int16_t offset;
+            if (!read_raw(p, end, offset)) return false;
+            p += offset;
+            if (p < expr || p > end) return false;
+            break;
+        }
+        case 0x90:                                                              // regx
+            if (!reg_value(read_uleb128(p, end), a)) return false;
+            stack.push_back(a);
+            break;
+        case 0x92: {                                                            // bregx
+            auto reg = read_uleb128(p, end);
+            if (!reg_value(reg, a)) return false;
+            stack.push_back(a + read_sleb128(p, end));
+            break;
+        }
+        case 0x96: break;                                                       // nop
+        default:
+            return false;
+        }
+    }
+    return pop(result);
+}
+
+
+} // namespace
+
+
+
+/**
+ * @brief: CFA指令的编码: 高2位非0时为 advance_loc/offset/restore，低6位为操作数；
+ *         否则整个字节为操作码。remember_state/restore_state保存的是整行规则。
+ */
+bool compute_unwind_row(const call_frame_info& cfi, const fde& f, uint64_t pc, unwind_row& row) {
+    const auto& c = cfi.get_cie(f);
+
+    row = unwind_row{};
+    row.low_pc = f.low_pc;
+    row.high_pc = f.high_pc;
+    row.signal_frame = c.signal_frame;
+
+    unwind_row initial{};
+    std::vector<unwind_row> state_stack;
+    uint64_t loc = f.low_pc;
+
+    // 执行一段指令；位置超过[pc]时[done]置为true
+    auto execute = [&](const uint8_t* p, const uint8_t* end, bool is_cie, bool& done) {
+        auto set_reg = [&row](uint64_t reg) -> register_rule* {
+            return reg < n_dwarf_regs ? &row.regs[reg] : nullptr;
+        };
+        auto advance = [&](uint64_t delta) {
+            auto next = loc + delta * c.code_align;
+            if (next > pc) {
+                row.low_pc = loc;
+                row.high_pc = next;
+                done = true;
+                return;
+            }
+            loc = next;
+        };
+
+        while (p < end && !done) {
+            uint8_t op = *p++;
+            uint8_t high = op & 0xc0, low = op & 0x3f;
+
+            if (high == 0x40) {                     // advance_loc
+                advance(low);
+                continue;
+            }
+            if (high == 0x80) {                     // offset
+                auto off = static_cast<int64_t>(read_uleb128(p, end)) * c.data_align;
+                if (auto r = set_reg(low)) *r = register_rule{register_rule::at_offset, 0, off};
+                continue;
+            }
+            if (high == 0xc0) {                     // restore
+                if (auto r = set_reg(low)) *r = initial.regs[low];
+                continue;
+            }
+
+            switch (op) {
+            case 0x00: break;                                       // nop
+            case 0x02: { uint8_t d;  if (!read_raw(p, end, d)) return false; advance(d); break; }
+            case 0x03: { uint16_t d; if (!read_raw(p, end, d)) return false; advance(d); break; }
+            case 0x04: { uint32_t d; if (!read_raw(p, end, d)) return false; advance(d); break; }
+            case 0x05: {                                            // offset_extended
+                auto reg = read_uleb128(p, end);
+                auto off = static_cast<int64_t>(read_uleb128(p, end)) * c.data_align;
+                if (auto r = set_reg(reg)) *r = register_rule{register_rule::at_offset, 0, off};
+                break;
+            }
+            case 0x11: {                                            // offset_extended_sf
+                auto reg = read_uleb128(p, end);
+                auto off = read_sleb128(p, end) * c.data_align;
+                if (auto r = set_reg(reg)) *r = register_rule{register_rule::at_offset, 0, off};
+                break;
+            }
+            case 0x2f: {                                            // GNU_negative_offset_extended
+                auto reg = read_uleb128(p, end);
+                auto off = -static_cast<int64_t>(read_uleb128(p, end)) * c.data_align;
+                if (auto r = set_reg(reg)) *r = register_rule{register_rule::at_offset, 0, off};
+                break;
+            }
+            case 0x06: {                                            // restore_extended
+                auto reg = read_uleb128(p, end);
+                if (auto r = set_reg(reg)) *r = initial.regs[reg];
+                break;
+            }
+            case 0x07: {                                            // undefined
+                if (auto r = set_reg(read_uleb128(p, end))) *r = register_rule{register_rule::undefined};
+                break;
+            }
+            case 0x08: {                                            // same_value
+                if (auto r = set_reg(read_uleb128(p, end))) *r = register_rule{register_rule::same_value};
+                break;
+            }
+            case 0x09: {                                            // register
+                auto reg = read_uleb128(p, end);
+                auto other = read_uleb128(p, end);
+                if (auto r = set_reg(reg)) *r = register_rule{register_rule::in_register, static_cast<int>(other)};
+                break;
+            }
+            case 0x14: case 0x15: {                                 // val_offset(_sf)
+                auto reg = read_uleb128(p, end);
+                auto off = (op == 0x14 ? static_cast<int64_t>(read_uleb128(p, end)) : read_sleb128(p, end))
+                           * c.data_align;
+                if (auto r = set_reg(reg)) *r = register_rule{register_rule::val_offset, 0, off};
+                break;
+            }
+            case 0x10: case 0x16: {                                 // expression, val_expression
+                auto reg = read_uleb128(p, end);
+                auto len = read_uleb128(p, end);
+                if (p + len > end) return false;
+                auto kind = op == 0x10 ? register_rule::at_expression : register_rule::val_expression;
+                if (auto r = set_reg(reg)) *r = register_rule{kind, 0, 0, p, len};
+                p += len;
+                break;
+            }
+            case 0x0a:                                              // remember_state
+                state_stack.push_back(row);
+                break;
+            case 0x0b:                                              // restore_state
+                if (state_stack.empty()) return false;
+                std::copy(std::begin(state_stack.back().regs), std::end(state_stack.back().regs), row.regs);
+                row.cfa = state_stack.back().cfa;
+                state_stack.pop_back();
+                break;
+            case 0x0c:                                              // def_cfa
+                row.cfa.kind = cfa_rule::reg_offset;
+                row.cfa.reg = read_uleb128(p, end);
+                row.cfa.offset = read_uleb128(p, end);
+                break;
+            case 0x12:                                              // def_cfa_sf
+                row.cfa.kind = cfa_rule::reg_offset;
+                row.cfa.reg = read_uleb128(p, end);
+                row.cfa.offset = read_sleb128(p, end) * c.data_align;
+                break;
+            case 0x0d:                                              // def_cfa_register
+                row.cfa.kind = cfa_rule::reg_offset;
+                row.cfa.reg = read_uleb128(p, end);
+                break;
+            case 0x0e:                                              // def_cfa_offset
+                row.cfa.offset = read_uleb128(p, end);
+                break;
+            case 0x13:                                              // def_cfa_offset_sf
+                row.cfa.offset = read_sleb128(p, end) * c.data_align;
+                break;
+            case 0x0f: {                                            // def_cfa_expression
+                auto len = read_uleb128(p, end);
+                if (p + len > end) return false;
+                row.cfa = cfa_rule{cfa_rule::expression, 0, 0, p, len};
+                p += len;
+                break;
+            }
+            case 0x2e:                                              // GNU_args_size
+                read_uleb128(p, end);
+                break;
+            default:
+                // DW_CFA_set_loc等没有出现在x86-64的编译器输出中
+                return false;
+            }
+        }
+        if (is_cie) initial = row;
+        return true;
+    };
+
+    bool done = false;
+    if (!execute(c.instructions, c.instructions + c.instructions_size, true, done)) return false;
+    if (!done && !execute(f.instructions, f.instructions + f.instructions_size, false, done)) return false;
+    if (!done) row.low_pc = loc;
+    return row.cfa.kind != cfa_rule::undefined;
+}
+
+
+
+void stack_snapshot::read(pid_t pid, uint64_t addr, std::size_t size) {
+    m_base = addr;
+    m_data.resize(size);
+    iovec local {m_data.data(), size};
+    iovec remote {reinterpret_cast<void*>(addr), size};
+    auto n = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+    m_data.resize(n > 0 ? n : 0);
+}
+
+
+
+bool stack_snapshot::get(uint64_t addr, uint64_t& value) const {
+    if (addr < m_base || addr + sizeof(value) > m_base + m_data.size()) return false;
+    std::memcpy(&value, m_data.data() + (addr - m_base), sizeof(value));
+    return true;
+}
+
+
+
+const unwind_row* cfi_unwinder::find_row(uint64_t pc) {
+    auto it = m_rows.upper_bound(pc);
+    if (it != m_rows.begin() && pc < std::prev(it)->second.high_pc) {
+        m_hits++;
+        return &std::prev(it)->second;
+    }
+
+    m_misses++;
+    const call_frame_info* cfi;
+    const fde* f;
+    uint64_t bias;
+    if (!m_lookup(pc, cfi, f, bias)) return nullptr;
+
+    unwind_row row;
+    if (!compute_unwind_row(*cfi, *f, pc - bias, row)) return nullptr;
+    row.low_pc += bias;
+    row.high_pc += bias;
+
+    if (m_rows.size() >= max_cached_rows) m_rows.clear();
+    return &m_rows.insert_or_assign(row.low_pc, row).first->second;
+}
+
+
+
+uint64_t cfi_unwinder::frame_cfa(const user_regs_struct& regs) {
+    auto row = find_row(regs.rip);
+    if (row == nullptr || row->cfa.kind != cfa_rule::reg_offset) return 0;
+    switch (row->cfa.reg) {
+    case dwarf_reg_rsp: return regs.rsp + row->cfa.offset;
+    case dwarf_reg_rbp: return regs.rbp + row->cfa.offset;
+    default:            return 0;
+    }
+}
+
+
+
+/**
+ * @brief: 当前帧以外的pc是返回地址，可能已经是下一个函数（noreturn调用之后），
+ *         用pc-1查找规则；信号帧的pc是被中断的指令本身
+ */
+bool cfi_unwinder::step(unwind_frame& frame, bool innermost, const memory_reader& read, unwind_frame& caller) {
+    auto row = find_row(innermost ? frame.pc : frame.pc - 1);
+    if (row && !innermost && row->signal_frame) row = find_row(frame.pc);
+
+    caller = unwind_frame{};
+    if (row == nullptr) {
+        // 没有CFI：假定标准的 push rbp; mov rbp, rsp 序言
+        if (!frame.has(dwarf_reg_rbp) || frame.regs[dwarf_reg_rbp] == 0) return false;
+        auto rbp = frame.regs[dwarf_reg_rbp];
+        uint64_t saved_rbp, ra;
+        if (!read(rbp, saved_rbp) || !read(rbp + 8, ra)) return false;
+        frame.cfa = rbp + 16;
+        caller.pc = ra;
+        caller.cfa = 0;
+        caller.regs[dwarf_reg_rbp] = saved_rbp;
+        caller.regs[dwarf_reg_rsp] = frame.cfa;
+        caller.valid = (1u << dwarf_reg_rbp) | (1u << dwarf_reg_rsp);
+        caller.from_cfi = false;
+        return true;
+    }
+
+    // CFA
+    uint64_t cfa;
+    if (row->cfa.kind == cfa_rule::reg_offset) {
+        if (row->cfa.reg >= n_dwarf_regs || !frame.has(row->cfa.reg)) return false;
+        cfa = frame.regs[row->cfa.reg] + row->cfa.offset;
+    } else if (!evaluate_expression(row->cfa.expr, row->cfa.expr_size, frame, read, nullptr, cfa)) {
+        return false;
+    }
+    frame.cfa = cfa;
+
+    // 只有callee-saved寄存器（rbx rbp r12-r15）在没有规则时保持不变
+    constexpr uint32_t callee_saved = (1u << 3) | (1u << 6) | (1u << 12) | (1u << 13) | (1u << 14) | (1u << 15);
+    std::copy(std::begin(frame.regs), std::end(frame.regs), caller.regs);
+    caller.valid = frame.valid & callee_saved;
+
+    for (int i = 0; i < n_dwarf_regs; i++) {
+        const auto& rule = row->regs[i];
+        uint64_t value = 0;
+        bool known = true;
+        switch (rule.kind) {
+        case register_rule::same_value:
+            continue;
+        case register_rule::undefined:
+            known = false;
+            break;
+        case register_rule::at_offset:
+            known = read(cfa + rule.offset, value);
+            break;
+        case register_rule::val_offset:
+            value = cfa + rule.offset;
+            break;
+        case register_rule::in_register:
+            known = rule.reg < n_dwarf_regs && frame.has(rule.reg);
+            if (known) value = frame.regs[rule.reg];
+            break;
+        case register_rule::at_expression: {
+            uint64_t addr;
+            known = evaluate_expression(rule.expr, rule.expr_size, frame, read, &cfa, addr) && read(addr, value);
+            break;
+        }
+        case register_rule::val_expression:
+            known = evaluate_expression(rule.expr, rule.expr_size, frame, read, &cfa, value);
+            break;
+        }
+        if (known) {
+            caller.regs[i] = value;
+            caller.valid |= 1u << i;
+        } else {
+            caller.valid &= ~(1u << i);
+        }
+    }
+
+    // 返回地址没有定义的是最外层的帧（_start、clone创建的线程入口）
+    if (!caller.has(dwarf_reg_ra)) return false;
+    caller.pc = caller.regs[dwarf_reg_ra];
+    caller.regs[dwarf_reg_rsp] = cfa;
+    caller.valid |= 1u << dwarf_reg_rsp;
+    caller.from_cfi = true;
+    return true;
+}
+
+
+
+std::vector<unwind_frame> cfi_unwinder::unwind(const user_regs_struct& regs, const memory_reader& read,
+                                               std::size_t max_frames) {
+    unwind_frame frame{};
+    frame.pc = regs.rip;
+    const uint64_t values[n_dwarf_regs] = {regs.rax, regs.rdx, regs.rcx, regs.rbx, regs.rsi, regs.rdi,
+                                           regs.rbp, regs.rsp, regs.r8, regs.r9, regs.r10, regs.r11,
+                                           regs.r12, regs.r13, regs.r14, regs.r15, regs.rip};
+    std::copy(std::begin(values), std::end(values), frame.regs);
+    frame.valid = (1u << n_dwarf_regs) - 1;
+    frame.from_cfi = true;
+
+    std::vector<unwind_frame> frames;
+    frames.push_back(frame);
+    while (frames.size() < max_frames) {
+        unwind_frame caller;
+        bool innermost = frames.size() == 1;
+        if (!step(frames.back(), innermost, read, caller)) break;
+        // 栈向低地址增长，调用者的CFA一定更高；否则为损坏的栈或循环
+        if (caller.pc == 0 || frames.back().cfa <= frames.back().regs[dwarf_reg_rsp]) break;
+        if (frames.size() > 1 && frames.back().cfa <= frames[frames.size() - 2].cfa) break;
+        frames.push_back(caller);
+    }
+    return frames;
+}
+
+
+#endif /* __x86_64__ */
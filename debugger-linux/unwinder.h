@@ -0,0 +1,136 @@
+#ifndef _UNWINDER_H
+#define _UNWINDER_H
+
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <vector>
+#include <sys/types.h>
+#include <sys/user.h>
+
+#include "eh_frame.h"
+
+
+#ifdef __x86_64__
+
+// x86-64的DWARF寄存器编号: rax rdx rcx rbx rsi rdi rbp rsp r8-r15，16为返回地址
+constexpr int n_dwarf_regs = 17;
+constexpr int dwarf_reg_rbp = 6;
+constexpr int dwarf_reg_rsp = 7;
+constexpr int dwarf_reg_ra = 16;
+
+
+// CFA的计算方式: 寄存器 + 偏移，或DWARF表达式
+struct cfa_rule {
+    enum kind_t : uint8_t {undefined, reg_offset, expression} kind = undefined;
+    int reg = 0;
+    int64_t offset = 0;
+    const uint8_t* expr = nullptr;      // 指向section数据
+    std::size_t expr_size = 0;
+};
+
+// 调用者的寄存器如何从当前帧恢复
+struct register_rule {
+    enum kind_t : uint8_t {
+        same_value,     // 没有被修改（默认）
+        undefined,
+        at_offset,      // 保存在 [CFA + offset]
+        val_offset,     // 值为 CFA + offset
+        in_register,    // 保存在另一个寄存器中
+        at_expression,  // 保存在表达式计算出的地址（CFA先入栈）
+        val_expression, // 值为表达式的结果
+    } kind = same_value;
+    int reg = 0;
+    int64_t offset = 0;
+    const uint8_t* expr = nullptr;
+    std::size_t expr_size = 0;
+};
+
+// 展开表中的一行：在 [low_pc, high_pc) 内规则不变
+struct unwind_row {
+    uint64_t low_pc;
+    uint64_t high_pc;
+    bool signal_frame;          // CIE的增强字符串含'S'，pc不需要减1
+    cfa_rule cfa;
+    register_rule regs[n_dwarf_regs];
+};
+
+/**
+ * @brief: 执行CIE的初始指令与FDE的指令，直到位置超过[pc]，得到包含[pc]的行
+ *         地址与[cfi]中的一致（不含加载偏置）；遇到不支持的指令时返回false
+ */
+bool compute_unwind_row(const call_frame_info& cfi, const fde& f, uint64_t pc, unwind_row& row);
+
+
+
+// 回溯得到的一个栈帧，寄存器按DWARF编号
+struct unwind_frame {
+    uint64_t pc;
+    uint64_t cfa;               // 本帧的CFA（调用者call之前的rsp），最外层的帧为0
+    uint64_t regs[n_dwarf_regs];
+    uint32_t valid;             // 第i位表示[regs[i]]已知
+    bool from_cfi;              // 通过CFI得到调用者（否则为rbp帧链）
+
+    auto has(int reg) const -> bool {return valid & (1u << reg);}
+};
+
+
+
+/**
+ * @brief: 一次性读入的一段栈内存，回溯时的读取优先从中取值
+ */
+class stack_snapshot {
+public:
+    // 读取[addr, addr + size)，读到的部分可能更短
+    void read(pid_t pid, uint64_t addr, std::size_t size);
+    bool get(uint64_t addr, uint64_t& value) const;
+
+private:
+    uint64_t m_base = 0;
+    std::vector<uint8_t> m_data;
+};
+
+
+
+/**
+ * @brief: 基于DWARF CFI（[.eh_frame]/[.debug_frame]）的栈回溯
+ *         [lookup]根据运行时pc找到所在ELF文件的CFI、FDE与加载偏置；
+ *         计算出的行按运行时地址范围缓存，重复回溯只需一次查表。
+ *         没有FDE的帧退化为rbp帧链。
+ */
+class cfi_unwinder {
+public:
+    using cfi_lookup = std::function<bool(uint64_t pc, const call_frame_info*& cfi, const fde*& f, uint64_t& bias)>;
+    using memory_reader = std::function<bool(uint64_t addr, uint64_t& value)>;
+
+    explicit cfi_unwinder(cfi_lookup lookup) : m_lookup(std::move(lookup)) {}
+
+    // 从[regs]开始回溯，最多[max_frames]帧；第0帧为当前帧
+    std::vector<unwind_frame> unwind(const user_regs_struct& regs, const memory_reader& read,
+                                     std::size_t max_frames = 256);
+    // 包含运行时地址[pc]的行（地址已加上偏置），没有CFI时返回nullptr
+    const unwind_row* find_row(uint64_t pc);
+    // 最内层帧的CFA，只使用 寄存器 + 偏移 的规则，不读内存；不能确定时返回0
+    uint64_t frame_cfa(const user_regs_struct& regs);
+
+    // 共享库被加载或卸载后调用，缓存的行中的表达式指向ELF文件的数据
+    void clear() {m_rows.clear();}
+    auto get_hits() const -> std::size_t {return m_hits;}
+    auto get_misses() const -> std::size_t {return m_misses;}
+
+private:
+    // 由[frame]恢复调用者的帧，[frame.cfa]同时被填入；到达最外层时返回false
+    bool step(unwind_frame& frame, bool innermost, const memory_reader& read, unwind_frame& caller);
+
+    cfi_lookup m_lookup;
+    std::map<uint64_t, unwind_row> m_rows;     // 运行时[low_pc] -> 行
+    std::size_t m_hits = 0;
+    std::size_t m_misses = 0;
+};
+
+
+#endif /* __x86_64__ */
+
+#endif /* _UNWINDER_H */
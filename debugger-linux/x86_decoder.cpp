@@ -0,0 +1,410 @@
+#include "x86_decoder.h"
+#include <array>
+#include <cstring>
+
+
+
+namespace {
+
+// 立即数的类型
+enum imm_kind : uint8_t {
+    imm_none,
+    imm_8,
+    imm_16,
+    imm_z,          // 16位(66前缀)或32位
+    imm_v,          // 16/32位，REX.W时64位 (mov r64, imm64)
+    imm_moffs,      // 地址大小：8字节，67前缀时4字节
+    imm_16_8,       // enter: imm16 + imm8
+    imm_group3,     // F6/F7: 只有 reg=0/1 (test) 带立即数
+};
+
+
+// 操作码表中的一项
+struct opcode_entry {
+    bool valid;         // 64位模式下有效且支持
+    bool modrm;
+    imm_kind imm;
+    x86_branch branch;  // 由操作码本身决定的控制流，FF组在解码时根据ModRM.reg判断
+    bool rel;           // 立即数是相对跳转的偏移
+    bool memory;        // 隐含的内存操作数（moffs、串操作），ModRM寻址内存在解码时判断
+};
+
+
+constexpr opcode_entry make_entry(bool modrm, imm_kind imm = imm_none,
+                                  x86_branch branch = x86_branch::none, bool rel = false) {
+    return opcode_entry{true, modrm, imm, branch, rel, false};
+}
+
+constexpr opcode_entry invalid_entry {false, false, imm_none, x86_branch::none, false, false};
+
+
+
+/**
+ * @brief: 单字节操作码，64位模式下无效的操作码(06/07/27/37/60-62/9A/C4/C5/D4/D5/EA等)为invalid
+ *         C4/C5/62 在解码时作为VEX/EVEX前缀处理
+ */
+constexpr opcode_entry one_byte_entry(uint8_t op) {
+    if (op < 0x40) {
+        // ALU: x0-x3 r/m, x4 al,imm8, x5 eax,imm32
+        auto low = op & 0x7;
+        if (low < 4) return make_entry(true);
+        if (low == 4) return make_entry(false, imm_8);
+        if (low == 5) return make_entry(false, imm_z);
+        return invalid_entry;
+    }
+    if (op >= 0x50 && op <= 0x5f) return make_entry(false);
+    if (op >= 0x70 && op <= 0x7f) return make_entry(false, imm_8, x86_branch::cond_jump, true);
+    if (op >= 0x84 && op <= 0x8f) return make_entry(true);
+    if (op >= 0x90 && op <= 0x99) return make_entry(false);
+    if (op >= 0x9b && op <= 0x9f) return make_entry(false);
+    if ((op >= 0xa4 && op <= 0xa7) || (op >= 0xaa && op <= 0xaf)) {
+        auto entry = make_entry(false);
+        entry.memory = true;
+        return entry;
+    }
+    if (op >= 0xb0 && op <= 0xb7) return make_entry(false, imm_8);
+    if (op >= 0xb8 && op <= 0xbf) return make_entry(false, imm_v);
+    if (op >= 0xd0 && op <= 0xd3) return make_entry(true);
+    if (op >= 0xd8 && op <= 0xdf) return make_entry(true);
+    if (op >= 0xe0 && op <= 0xe3) return make_entry(false, imm_8, x86_branch::cond_jump, true);
+    if (op >= 0xe4 && op <= 0xe7) return make_entry(false, imm_8);
+    if (op >= 0xec && op <= 0xef) return make_entry(false);
+    if (op >= 0xf8 && op <= 0xfd) return make_entry(false);
+
+    switch (op) {
+        case 0x63: return make_entry(true);
+        case 0x68: return make_entry(false, imm_z);
+        case 0x69: return make_entry(true, imm_z);
+        case 0x6a: return make_entry(false, imm_8);
+        case 0x6b: return make_entry(true, imm_8);
+        case 0x6c: case 0x6d: case 0x6e: case 0x6f: case 0xd7: {
+            auto entry = make_entry(false);
+            entry.memory = true;
+            return entry;
+        }
+        case 0x80: case 0x83: return make_entry(true, imm_8);
+        case 0x81: return make_entry(true, imm_z);
+        case 0xa0: case 0xa1: case 0xa2: case 0xa3: {
+            auto entry = make_entry(false, imm_moffs);
+            entry.memory = true;
+            return entry;
+        }
+        case 0xa8: return make_entry(false, imm_8);
+        case 0xa9: return make_entry(false, imm_z);
+        case 0xc0: case 0xc1: return make_entry(true, imm_8);
+        case 0xc2: case 0xca: return make_entry(false, imm_16, x86_branch::ret);
+        case 0xc3: case 0xcb: case 0xcf: return make_entry(false, imm_none, x86_branch::ret);
+        case 0xc9: case 0xcc: return make_entry(false);
+        case 0xc6: return make_entry(true, imm_8);
+        case 0xc7: return make_entry(true, imm_z);
+        case 0xc8: return make_entry(false, imm_16_8);
+        case 0xcd: return make_entry(false, imm_8);
+        // 64位模式下相对跳转的偏移总是32位，66前缀不改变长度
+        case 0xe8: return make_entry(false, imm_z, x86_branch::call, true);
+        case 0xe9: return make_entry(false, imm_z, x86_branch::jump, true);
+        case 0xeb: return make_entry(false, imm_8, x86_branch::jump, true);
+        case 0xf1: case 0xf4: case 0xf5: return make_entry(false);
+        case 0xf6: case 0xf7: return make_entry(true, imm_group3);
+        case 0xfe: case 0xff: return make_entry(true);
+    }
+    return invalid_entry;
+}
+
+
+
+// 0F xx 两字节操作码
+constexpr opcode_entry two_byte_entry(uint8_t op) {
+    switch (op) {
+        case 0x04: case 0x0a: case 0x0c: case 0x24: case 0x25: case 0x26: case 0x27:
+        case 0x36: case 0x39: case 0x3b: case 0x3c: case 0x3d: case 0x3e: case 0x3f:
+        case 0x7a: case 0x7b: case 0xa6: case 0xa7:
+            return invalid_entry;
+        case 0x05: case 0x34:
+            return make_entry(false, imm_none, x86_branch::syscall);
+        // 没有ModRM的指令
+        case 0x06: case 0x07: case 0x08: case 0x09: case 0x0b: case 0x0e:
+        case 0x30: case 0x31: case 0x32: case 0x33: case 0x35: case 0x37:
+        case 0x77: case 0xa0: case 0xa1: case 0xa2: case 0xa8: case 0xa9: case 0xaa:
+            return make_entry(false);
+        // 带imm8的指令
+        case 0x0f: case 0x70: case 0x71: case 0x72: case 0x73: case 0xa4: case 0xac:
+        case 0xba: case 0xc2: case 0xc4: case 0xc5: case 0xc6:
+            return make_entry(true, imm_8);
+    }
+    if (op >= 0x80 && op <= 0x8f) return make_entry(false, imm_z, x86_branch::cond_jump, true);
+    if (op >= 0xc8 && op <= 0xcf) return make_entry(false);
+    return make_entry(true);
+}
+
+
+
+// 0F 38 xx: 都带ModRM；0F 3A xx: 都带ModRM与imm8
+constexpr opcode_entry map_0f38_entry(uint8_t) {return make_entry(true);}
+constexpr opcode_entry map_0f3a_entry(uint8_t) {return make_entry(true, imm_8);}
+
+
+/**
+ * @brief: VEX/EVEX的0F映射：除vzeroupper/vzeroall(77)外都带ModRM，
+ *         立即数与legacy编码相同(pshufd/移位/cmpps/pinsrw/pextrw/shufps)
+ */
+constexpr opcode_entry vex_0f_entry(uint8_t op) {
+    if (op == 0x77) return make_entry(false);
+    switch (op) {
+        case 0x70: case 0x71: case 0x72: case 0x73:
+        case 0xc2: case 0xc4: case 0xc5: case 0xc6:
+            return make_entry(true, imm_8);
+    }
+    return make_entry(true);
+}
+
+
+
+template <typename F>
+constexpr std::array<opcode_entry, 256> make_table(F entry) {
+    std::array<opcode_entry, 256> table {};
+    for (int op = 0; op < 256; op++) table[op] = entry(static_cast<uint8_t>(op));
+    return table;
+}
+
+// 编译期生成的操作码表
+constexpr auto g_one_byte = make_table(one_byte_entry);
+constexpr auto g_two_byte = make_table(two_byte_entry);
+constexpr auto g_0f38 = make_table(map_0f38_entry);
+constexpr auto g_0f3a = make_table(map_0f3a_entry);
+constexpr auto g_vex_0f = make_table(vex_0f_entry);
+
+static_assert(g_one_byte[0xe8].branch == x86_branch::call && g_one_byte[0xe8].rel, "call rel32");
+static_assert(!g_one_byte[0x62].valid && !g_one_byte[0xc4].valid, "VEX/EVEX are prefixes");
+static_assert(g_two_byte[0x05].branch == x86_branch::syscall, "syscall");
+
+
+// VEX/EVEX的操作码映射：1: 0F, 2: 0F 38, 3: 0F 3A, 5/6: EVEX MAP5/MAP6 (AVX512-FP16)
+constexpr const opcode_entry* vex_entry(uint8_t map, uint8_t op) {
+    switch (map) {
+        case 1: return &g_vex_0f[op];
+        case 2: case 5: case 6: return &g_0f38[op];
+        case 3: return &g_0f3a[op];
+    }
+    return nullptr;
+}
+
+} // namespace
+
+
+
+bool decode_x86(const uint8_t* code, std::size_t size, x86_insn& insn) {
+    std::memset(&insn, 0, sizeof(insn));
+    if (size > 15) size = 15;
+
+    std::size_t pos = 0;
+    bool opsize_16 = false;
+    bool addrsize_32 = false;
+    bool mandatory_prefix = false;      // 66/F2/F3/F0不能出现在VEX/EVEX之前
+    bool rep_prefix = false;
+    bool rex = false;
+    bool rex_w = false;
+
+    // legacy前缀
+    for (; pos < size; pos++) {
+        auto b = code[pos];
+        if (b == 0x66) opsize_16 = mandatory_prefix = true;
+        else if (b == 0x67) addrsize_32 = true;
+        else if (b == 0xf2 || b == 0xf3) mandatory_prefix = rep_prefix = true;
+        else if (b == 0xf0) mandatory_prefix = true;
+        else if (b == 0x2e || b == 0x36 || b == 0x3e || b == 0x26 || b == 0x64 || b == 0x65) continue;
+        else break;
+    }
+    // REX必须紧挨着操作码
+    if (pos < size && (code[pos] & 0xf0) == 0x40) {
+        rex = true;
+        rex_w = code[pos] & 0x08;
+        pos++;
+    }
+    if (pos >= size) return false;
+
+    const opcode_entry* entry = nullptr;
+    auto op = code[pos++];
+    if (op == 0xc4 || op == 0xc5 || op == 0x62) {
+        // 64位模式下 C4/C5 总是VEX，62 总是EVEX
+        if (rex || mandatory_prefix) return false;
+        std::size_t prefix_len = op == 0xc5 ? 1 : (op == 0xc4 ? 2 : 3);
+        if (pos + prefix_len >= size) return false;
+        uint8_t map = 1;
+        if (op == 0xc4) {
+            map = code[pos] & 0x1f;
+            insn.encoding = x86_encoding::vex;
+        } else if (op == 0x62) {
+            // P1的bit 2固定为1
+            if ((code[pos + 1] & 0x04) == 0) return false;
+            map = code[pos] & 0x07;
+            insn.encoding = x86_encoding::evex;
+        } else {
+            insn.encoding = x86_encoding::vex;
+        }
+        pos += prefix_len;
+        entry = vex_entry(map, code[pos]);
+        if (entry == nullptr) return false;
+        insn.opcode_map = map;
+        op = code[pos++];
+    } else if (op == 0x0f) {
+        if (pos >= size) return false;
+        op = code[pos++];
+        if (op == 0x38 || op == 0x3a) {
+            insn.opcode_map = op == 0x38 ? 2 : 3;
+            if (pos >= size) return false;
+            op = code[pos++];
+            entry = insn.opcode_map == 2 ? &g_0f38[op] : &g_0f3a[op];
+        } else {
+            insn.opcode_map = 1;
+            entry = &g_two_byte[op];
+        }
+    } else {
+        entry = &g_one_byte[op];
+    }
+    if (!entry->valid) return false;
+    insn.opcode = op;
+    // ins/outs、movs/cmps、stos/lods/scas
+    if (rep_prefix && insn.encoding == x86_encoding::legacy && insn.opcode_map == 0) {
+        insn.rep = (op >= 0x6c && op <= 0x6f) || (op >= 0xa4 && op <= 0xa7) || (op >= 0xaa && op <= 0xaf);
+    }
+
+    // ModRM / SIB / 位移
+    if (entry->modrm) {
+        if (pos >= size) return false;
+        insn.has_modrm = true;
+        insn.modrm = code[pos++];
+        auto mod = insn.modrm >> 6;
+        auto rm = insn.modrm & 0x7;
+
+        if (mod != 3) {
+            std::size_t disp = 0;
+            if (rm == 4) {
+                if (pos >= size) return false;
+                auto sib = code[pos++];
+                if (mod == 0 && (sib & 0x7) == 5) disp = 4;
+            }
+            if (mod == 0 && rm == 5) {
+                disp = 4;
+                insn.rip_relative = true;
+            }
+            if (mod == 1) disp = 1;
+            if (mod == 2) disp = 4;
+
+            insn.disp_offset = pos;
+            insn.disp_size = disp;
+            insn.memory = true;
+            pos += disp;
+        }
+    }
+    if (entry->memory) insn.memory = true;
+
+    // 立即数
+    std::size_t imm_size = 0;
+    switch (entry->imm) {
+        case imm_none:   break;
+        case imm_8:      imm_size = 1; break;
+        case imm_16:     imm_size = 2; break;
+        case imm_z:      imm_size = (opsize_16 && !entry->rel) ? 2 : 4; break;
+        case imm_v:      imm_size = rex_w ? 8 : (opsize_16 ? 2 : 4); break;
+        case imm_moffs:  imm_size = addrsize_32 ? 4 : 8; break;
+        case imm_16_8:   imm_size = 3; break;
+        case imm_group3:
+            if (((insn.modrm >> 3) & 0x7) < 2) imm_size = (op == 0xf6) ? 1 : (opsize_16 ? 2 : 4);
+            break;
+    }
+
+    insn.imm_offset = pos;
+    insn.imm_size = imm_size;
+    pos += imm_size;
+    if (pos > size) return false;
+    insn.length = pos;
+
+    // 控制流
+    insn.branch = entry->branch;
+    if (entry->rel) {
+        if (imm_size == 1) {
+            insn.rel = static_cast<int8_t>(code[insn.imm_offset]);
+        } else {
+            int32_t rel;
+            std::memcpy(&rel, code + insn.imm_offset, 4);
+            insn.rel = rel;
+        }
+    }
+    if (insn.encoding == x86_encoding::legacy && insn.opcode_map == 0 && op == 0xff) {
+        auto reg = (insn.modrm >> 3) & 0x7;
+        if (reg == 2 || reg == 3) insn.branch = x86_branch::indirect_call;
+        else if (reg == 4 || reg == 5) insn.branch = x86_branch::indirect_jump;
+    }
+    return true;
+}
+
+
+
+x86_decode_cache::x86_decode_cache(std::size_t max_pages) : m_max_pages{max_pages} {}
+
+
+
+/**
+ * @brief: 页第一次被访问时读取整页（以及其后最多15字节，供跨页的指令使用），
+ *         之后同一页上的指令只在页内的缓冲区上解码，不再读取被调试进程的内存
+ */
+const x86_insn* x86_decode_cache::decode(std::uintptr_t addr, const reader& read) {
+    auto base = addr & ~(decode_page_size - 1);
+    auto offset = static_cast<uint16_t>(addr - base);
+
+    auto it = m_pages.find(base);
+    if (it == m_pages.end()) {
+        code_page page {base, std::vector<uint8_t>(decode_page_size + 15), 0, {}};
+        page.valid = read(base, page.code.data(), page.code.size());
+        // 整页都读不到时不缓存：之后映射到这里的代码（dlopen、JIT）仍然可以解码
+        if (page.valid == 0) {
+            m_misses++;
+            return nullptr;
+        }
+        if (m_lru.size() >= m_max_pages) {
+            m_pages.erase(m_lru.back().base);
+            m_lru.pop_back();
+        }
+        m_lru.push_front(std::move(page));
+        it = m_pages.emplace(base, m_lru.begin()).first;
+    } else if (it->second != m_lru.begin()) {
+        m_lru.splice(m_lru.begin(), m_lru, it->second);
+    }
+
+    auto& page = *it->second;
+    auto found = page.insns.find(offset);
+    if (found != page.insns.end()) {
+        m_hits++;
+        return found->second.length ? &found->second : nullptr;
+    }
+
+    // 读取失败的部分按不能解码处理，length为0表示无效
+    m_misses++;
+    x86_insn insn;
+    if (offset >= page.valid || !decode_x86(page.code.data() + offset, page.valid - offset, insn)) {
+        std::memset(&insn, 0, sizeof(insn));
+    }
+    auto& cached = page.insns.emplace(offset, insn).first->second;
+    return cached.length ? &cached : nullptr;
+}
+
+
+
+void x86_decode_cache::invalidate(std::uintptr_t addr, std::size_t len) {
+    // 前一页末尾的指令可能延伸到被修改的页
+    auto first = (addr >= 15 ? addr - 15 : 0) & ~(decode_page_size - 1);
+    auto last = (addr + (len ? len : 1) - 1) & ~(decode_page_size - 1);
+    for (auto base = first; base <= last; base += decode_page_size) {
+        auto it = m_pages.find(base);
+        if (it == m_pages.end()) continue;
+        m_lru.erase(it->second);
+        m_pages.erase(it);
+    }
+}
+
+
+
+void x86_decode_cache::clear() {
+    m_lru.clear();
+    m_pages.clear();
+}
@@ -0,0 +1,104 @@
+#ifndef _X86_DECODER_H
+#define _X86_DECODER_H
+
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+
+// 指令对控制流的影响
+enum class x86_branch : uint8_t {
+    none,
+    jump,           // jmp rel
+    cond_jump,      // jcc/loop/jrcxz rel
+    call,           // call rel32
+    indirect_jump,  // jmp r/m
+    indirect_call,  // call r/m
+    ret,
+    syscall,
+};
+
+
+// 指令的编码方式
+enum class x86_encoding : uint8_t {
+    legacy,         // legacy前缀 + REX
+    vex,            // C4/C5
+    evex,           // 62
+};
+
+
+// 解码得到的x86-64指令信息
+struct x86_insn {
+    uint8_t length;
+    x86_encoding encoding;
+    uint8_t opcode_map;     // 0: 单字节, 1: 0F, 2: 0F 38, 3: 0F 3A, 5/6: EVEX MAP5/MAP6
+    uint8_t opcode;
+    bool has_modrm;
+    uint8_t modrm;
+    uint8_t disp_offset;    // 位移在指令中的偏移
+    uint8_t disp_size;
+    bool rip_relative;      // 使用 [rip + disp32] 寻址
+    uint8_t imm_offset;     // 立即数在指令中的偏移
+    uint8_t imm_size;
+    bool memory;            // 有内存操作数：ModRM寻址内存、moffs或串操作
+    bool rep;               // 带F2/F3前缀的串操作，单步时每次只执行一轮，rip停在指令开头
+    x86_branch branch;
+    int64_t rel;            // 相对跳转的偏移，目标为 地址 + length + rel
+};
+
+
+/**
+ * @brief: 解码[code]处的一条x86-64指令，只计算长度与各字段的位置，不做反汇编
+ *         各操作码映射的属性在编译期生成为constexpr表，解码时只需查表；
+ *         支持legacy前缀、REX、VEX(C4/C5)、EVEX(62)，单字节/0F/0F 38/0F 3A与EVEX MAP5/6；
+ *         不认识的指令返回false
+ */
+bool decode_x86(const uint8_t* code, std::size_t size, x86_insn& insn);
+
+
+
+constexpr std::size_t decode_page_size = 4096;
+
+
+/**
+ * @brief: 按地址缓存解码结果，以代码页为单位做LRU淘汰
+ *         页第一次被访问时整页读入，之后在缓冲区上解码；代码被修改时调用[invalidate]丢弃整页。
+ *         [reader]读取被调试进程的原始代码（不含int3），返回读到的字节数。
+ */
+class x86_decode_cache {
+public:
+    using reader = std::function<std::size_t(std::uintptr_t addr, uint8_t* buf, std::size_t len)>;
+
+    explicit x86_decode_cache(std::size_t max_pages = 64);
+
+    // 返回[addr]处的指令，不能解码时返回nullptr；返回的指针在下一次[decode]/[invalidate]之前有效
+    const x86_insn* decode(std::uintptr_t addr, const reader& read);
+    // [addr, addr + len)被修改，丢弃其所在的页（以及可能有指令跨入的前一页）
+    void invalidate(std::uintptr_t addr, std::size_t len);
+    void clear();
+
+    auto get_hits() const -> uint64_t {return m_hits;}
+    auto get_misses() const -> uint64_t {return m_misses;}
+
+private:
+    struct code_page {
+        std::uintptr_t base;
+        std::vector<uint8_t> code;      // 整页以及之后的15字节
+        std::size_t valid;              // [code]中读取成功的字节数
+        std::unordered_map<uint16_t, x86_insn> insns;   // 页内偏移 -> 指令，length为0表示不能解码
+    };
+
+    std::size_t m_max_pages;
+    std::list<code_page> m_lru;         // 最近使用的在前
+    std::unordered_map<std::uintptr_t, std::list<code_page>::iterator> m_pages;
+
+    uint64_t m_hits = 0;
+    uint64_t m_misses = 0;
+};
+
+
+#endif /* _X86_DECODER_H */
@@ -0,0 +1,657 @@
+#include "x86_disasm.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+
+namespace {
+
+const char* const g_reg64[16] = {"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+                                 "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"};
+const char* const g_reg32[16] = {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+                                 "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"};
+const char* const g_reg16[16] = {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di",
+                                 "r8w", "r9w", "r10w", "r11w", "r12w", "r13w", "r14w", "r15w"};
+const char* const g_reg8_rex[16] = {"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+                                    "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"};
+const char* const g_reg8_legacy[8] = {"al", "cl", "dl", "bl", "ah", "ch", "dh", "bh"};
+
+const char* const g_cc[16] = {"o", "no", "b", "ae", "e", "ne", "be", "a",
+                              "s", "ns", "p", "np", "l", "ge", "le", "g"};
+const char* const g_group1[8] = {"add", "or", "adc", "sbb", "and", "sub", "xor", "cmp"};
+const char* const g_group2[8] = {"rol", "ror", "rcl", "rcr", "shl", "shr", "shl", "sar"};
+const char* const g_group3[8] = {"test", "test", "not", "neg", "mul", "imul", "div", "idiv"};
+
+// 操作数大小，16表示xmm
+constexpr int sz_none = 0;
+constexpr int sz_xmm = 16;
+
+
+// 一个格式化好的操作数，按Intel顺序（目的在前）保存
+struct operand {
+    std::string text;
+    bool is_reg;
+};
+
+
+/**
+ * @brief: 格式化一条指令：前缀与ModRM/SIB从字节中重新解析，
+ *         位移与立即数的位置使用[x86_insn]中的结果
+ */
+class formatter {
+public:
+    formatter(const uint8_t* code, const x86_insn& insn, std::uintptr_t addr, asm_syntax syntax)
+        : m_code(code), m_insn(insn), m_addr(addr), m_att(syntax == asm_syntax::att) {
+        std::size_t pos = 0;
+        for (; pos < insn.length; pos++) {
+            auto b = code[pos];
+            if (b == 0x66) m_p66 = true;
+            else if (b == 0x67) m_addr32 = true;
+            else if (b == 0xf2) m_pf2 = true;
+            else if (b == 0xf3) m_pf3 = true;
+            else if (b == 0xf0) m_lock = true;
+            else if (b == 0x64) m_seg = "fs";
+            else if (b == 0x65) m_seg = "gs";
+            else if (b == 0x2e || b == 0x36 || b == 0x3e || b == 0x26) continue;
+            else break;
+        }
+        if (pos < insn.length && (code[pos] & 0xf0) == 0x40) m_rex = code[pos];
+        m_modrm = insn.modrm;
+        // 有SIB时它紧挨着ModRM，位移（或立即数）之前
+        if (insn.has_modrm && (m_modrm >> 6) != 3 && (m_modrm & 7) == 4) {
+            auto after = insn.disp_size ? insn.disp_offset : insn.imm_offset;
+            m_sib = code[after - 1];
+        }
+    }
+
+    x86_disasm run();
+
+private:
+    // 操作数大小：REX.W为8字节，66前缀为2字节，否则为4字节；[d64]为默认64位的指令（push/pop等）
+    int osize(bool d64 = false) const {return (m_rex & 8) ? 8 : (m_p66 ? 2 : (d64 ? 8 : 4));}
+    int reg_field() const {return ((m_modrm >> 3) & 7) | ((m_rex & 4) ? 8 : 0);}
+    int rm_field() const {return (m_modrm & 7) | ((m_rex & 1) ? 8 : 0);}
+    bool is_reg_form() const {return (m_modrm >> 6) == 3;}
+
+    std::string reg_name(int n, int size) const;
+    operand reg(int n, int size) const {return {(m_att ? "%" : "") + reg_name(n, size), true};}
+    operand xmm(int n) const {return reg(n, sz_xmm);}
+    operand mem(int size);
+    operand E(int size) {return is_reg_form() ? reg(rm_field(), size) : mem(size);}
+    operand G(int size) const {return reg(reg_field(), size);}
+    operand W(int mem_size) {return is_reg_form() ? xmm(rm_field()) : mem(mem_size);}
+    operand V() const {return xmm(reg_field());}
+    // 立即数按[size]截断后以无符号十六进制输出，与objdump一致
+    operand imm(int64_t value, int size) const;
+    int64_t imm_value(bool sign_extend = true) const;
+    operand rel();
+
+    // 输出: AT&T按源在前的顺序，没有寄存器操作数时加大小后缀
+    void emit(const std::string& mnemonic, std::vector<operand> ops, int size = sz_none, bool suffix = true);
+    // 只在AT&T中加后缀的助记符，例如 movzbl、cltq
+    void emit_att_name(const char* att, const char* intel, std::vector<operand> ops) {
+        emit(m_att ? att : intel, std::move(ops), sz_none, false);
+    }
+
+    bool one_byte();
+    bool two_byte();
+    const char* sse_suffix(bool packed_only = false) const;
+
+    const uint8_t* m_code;
+    const x86_insn& m_insn;
+    std::uintptr_t m_addr;
+    bool m_att;
+
+    bool m_p66 = false, m_pf2 = false, m_pf3 = false, m_lock = false, m_addr32 = false;
+    const char* m_seg = nullptr;
+    uint8_t m_rex = 0;
+    uint8_t m_modrm = 0;
+    uint8_t m_sib = 0;
+
+    x86_disasm m_out {};
+};
+
+
+
+std::string formatter::reg_name(int n, int size) const {
+    switch (size) {
+    case 1:  return m_rex ? g_reg8_rex[n] : (n < 8 ? g_reg8_legacy[n] : g_reg8_rex[n]);
+    case 2:  return g_reg16[n];
+    case 4:  return g_reg32[n];
+    case 8:  return g_reg64[n];
+    case sz_xmm: return "xmm" + std::to_string(n);
+    default: return "?";
+    }
+}
+
+
+
+static std::string hex(uint64_t value) {
+    char buf[24];
+    std::snprintf(buf, sizeof(buf), "0x%llx", static_cast<unsigned long long>(value));
+    return buf;
+}
+
+static std::string signed_hex(int64_t value) {
+    return value < 0 ? "-" + hex(-static_cast<uint64_t>(value)) : hex(value);
+}
+
+
+
+/**
+ * @brief: Intel: dword ptr fs:[base+index*scale+disp]
+ *         AT&T:  %fs:disp(base,index,scale)
+ *         rip相对寻址时记录引用的地址，由调用者在注释中给出
+ */
+operand formatter::mem(int size) {
+    int64_t disp = 0;
+    if (m_insn.disp_size == 1) disp = static_cast<int8_t>(m_code[m_insn.disp_offset]);
+    else if (m_insn.disp_size == 4) {
+        int32_t d;
+        std::memcpy(&d, m_code + m_insn.disp_offset, 4);
+        disp = d;
+    }
+
+    auto name = [this](int n) {
+        return std::string{m_att ? "%" : ""} + (m_addr32 ? g_reg32[n] : g_reg64[n]);
+    };
+
+    std::string base, index;
+    int scale = 1;
+    auto mod = m_modrm >> 6;
+    if (m_insn.rip_relative) {
+        base = m_att ? "%rip" : "rip";
+        m_out.rip_ref = m_addr + m_insn.length + disp;
+    } else if ((m_modrm & 7) == 4) {
+        auto sib_base = (m_sib & 7) | ((m_rex & 1) ? 8 : 0);
+        auto sib_index = ((m_sib >> 3) & 7) | ((m_rex & 2) ? 8 : 0);
+        scale = 1 << (m_sib >> 6);
+        if (!(mod == 0 && (m_sib & 7) == 5)) base = name(sib_base);
+        if (sib_index != 4) index = name(sib_index);
+    } else {
+        base = name(rm_field());
+    }
+
+    std::string out;
+    if (m_att) {
+        if (m_seg) out += std::string{"%"} + m_seg + ":";
+        if (disp != 0 || (base.empty() && index.empty()) || m_insn.disp_size) out += signed_hex(disp);
+        if (!base.empty() || !index.empty()) {
+            out += "(" + base;
+            if (!index.empty()) out += "," + index + "," + std::to_string(scale);
+            out += ")";
+        }
+    } else {
+        static const char* const ptr[] = {"", "byte ptr ", "word ptr ", "", "dword ptr ",
+                                          "", "", "", "qword ptr "};
+        if (size > 0 && size <= 8) out += ptr[size];
+        if (size == sz_xmm) out += "xmmword ptr ";
+        if (m_seg) out += std::string{m_seg} + ":";
+        out += "[" + base;
+        if (!index.empty()) out += (base.empty() ? "" : "+") + index + "*" + std::to_string(scale);
+        if (disp != 0 || m_insn.disp_size || (base.empty() && index.empty())) {
+            if (base.empty() && index.empty()) out += hex(disp);
+            else out += (disp < 0 ? "-" : "+") + hex(disp < 0 ? -static_cast<uint64_t>(disp) : disp);
+        }
+        out += "]";
+    }
+    return {out, false};
+}
+
+
+
+int64_t formatter::imm_value(bool sign_extend) const {
+    auto p = m_code + m_insn.imm_offset;
+    switch (m_insn.imm_size) {
+    case 1: return sign_extend ? static_cast<int8_t>(*p) : *p;
+    case 2: { int16_t v; std::memcpy(&v, p, 2); return sign_extend ? int64_t{v} : int64_t{static_cast<uint16_t>(v)}; }
+    case 4: { int32_t v; std::memcpy(&v, p, 4); return sign_extend ? int64_t{v} : int64_t{static_cast<uint32_t>(v)}; }
+    case 8: { int64_t v; std::memcpy(&v, p, 8); return v; }
+    default: return 0;
+    }
+}
+
+
+
+operand formatter::imm(int64_t value, int size) const {
+    uint64_t v = value;
+    if (size > 0 && size < 8) v &= (uint64_t{1} << (size * 8)) - 1;
+    return {(m_att ? "$" : "") + hex(v), false};
+}
+
+
+
+operand formatter::rel() {
+    m_out.target = m_addr + m_insn.length + m_insn.rel;
+    return {hex(m_out.target), false};
+}
+
+
+
+void formatter::emit(const std::string& mnemonic, std::vector<operand> ops, int size, bool suffix) {
+    std::string name = mnemonic;
+    if (m_att && suffix && size > 0 && size <= 8) {
+        bool has_reg = false, has_mem_or_imm = false;
+        for (const auto& op : ops) {
+            has_reg |= op.is_reg;
+            has_mem_or_imm |= !op.is_reg;
+        }
+        static const char suffixes[] = {0, 'b', 'w', 0, 'l', 0, 0, 0, 'q'};
+        if (!has_reg && has_mem_or_imm && suffixes[size]) name += suffixes[size];
+    }
+    if (m_lock) name = "lock " + name;
+
+    std::string text = name;
+    if (!ops.empty()) {
+        if (text.size() < 6) text.resize(6, ' ');
+        text += ' ';
+        if (m_att) {
+            for (auto it = ops.rbegin(); it != ops.rend(); ++it) {
+                text += (it == ops.rbegin() ? "" : ",") + it->text;
+            }
+        } else {
+            for (std::size_t i = 0; i < ops.size(); i++) text += (i ? "," : "") + ops[i].text;
+        }
+    }
+    m_out.text = text;
+}
+
+
+
+const char* formatter::sse_suffix(bool packed_only) const {
+    if (m_p66) return "pd";
+    if (!packed_only && m_pf3) return "ss";
+    if (!packed_only && m_pf2) return "sd";
+    return "ps";
+}
+
+
+
+bool formatter::one_byte() {
+    auto op = m_insn.opcode;
+    auto r = (m_modrm >> 3) & 7;
+    auto v = osize();
+
+    // 00-3D: 8种ALU运算的6种形式
+    if (op < 0x40 && (op & 7) < 6) {
+        const char* name = g_group1[op >> 3];
+        switch (op & 7) {
+        case 0: emit(name, {E(1), G(1)}, 1); break;
+        case 1: emit(name, {E(v), G(v)}, v); break;
+        case 2: emit(name, {G(1), E(1)}, 1); break;
+        case 3: emit(name, {G(v), E(v)}, v); break;
+        case 4: emit(name, {reg(0, 1), imm(imm_value(), 1)}, 1); break;
+        case 5: emit(name, {reg(0, v), imm(imm_value(), v)}, v); break;
+        }
+        return true;
+    }
+
+    if (op >= 0x50 && op <= 0x5f) {
+        auto n = (op & 7) | ((m_rex & 1) ? 8 : 0);
+        emit(op < 0x58 ? "push" : "pop", {reg(n, m_p66 ? 2 : 8)});
+        return true;
+    }
+    if (op >= 0x70 && op <= 0x7f) {
+        emit(std::string{"j"} + g_cc[op & 0xf], {rel()});
+        return true;
+    }
+    if (op >= 0x91 && op <= 0x97) {
+        emit("xchg", {reg((op & 7) | ((m_rex & 1) ? 8 : 0), v), reg(0, v)});
+        return true;
+    }
+    if (op >= 0xb0 && op <= 0xb7) {
+        emit("mov", {reg((op & 7) | ((m_rex & 1) ? 8 : 0), 1), imm(imm_value(false), 1)});
+        return true;
+    }
+    if (op >= 0xb8 && op <= 0xbf) {
+        emit(m_insn.imm_size == 8 ? "movabs" : "mov",
+             {reg((op & 7) | ((m_rex & 1) ? 8 : 0), v), imm(imm_value(false), v)});
+        return true;
+    }
+
+    switch (op) {
+    case 0x63:
+        emit_att_name((m_rex & 8) ? "movslq" : "movsxd", "movsxd", {G(v), E(4)});
+        return true;
+    case 0x68: case 0x6a: emit("push", {imm(imm_value(), 8)}); return true;
+    case 0x69: case 0x6b:
+        emit("imul", {G(v), E(v), imm(imm_value(), v)});
+        return true;
+    case 0x80: emit(g_group1[r], {E(1), imm(imm_value(), 1)}, 1); return true;
+    case 0x81: case 0x83: emit(g_group1[r], {E(v), imm(imm_value(), v)}, v); return true;
+    case 0x84: emit("test", {E(1), G(1)}, 1); return true;
+    case 0x85: emit("test", {E(v), G(v)}, v); return true;
+    case 0x86: emit("xchg", {E(1), G(1)}, 1); return true;
+    case 0x87: emit("xchg", {E(v), G(v)}, v); return true;
+    case 0x88: emit("mov", {E(1), G(1)}, 1); return true;
+    case 0x89: emit("mov", {E(v), G(v)}, v); return true;
+    case 0x8a: emit("mov", {G(1), E(1)}, 1); return true;
+    case 0x8b: emit("mov", {G(v), E(v)}, v); return true;
+    case 0x8d: emit("lea", {G(v), mem(sz_none)}); return true;
+    case 0x8f: emit("pop", {E(osize(true))}); return true;
+    case 0x90:
+        if (m_pf3) emit("pause", {});
+        else if (m_p66) emit("xchg", {reg(0, 2), reg(0, 2)});
+        else if (m_rex & 1) emit("xchg", {reg(8, v), reg(0, v)});
+        else emit("nop", {});
+        return true;
+    case 0x98:
+        if (m_rex & 8) emit_att_name("cltq", "cdqe", {});
+        else if (m_p66) emit_att_name("cbtw", "cbw", {});
+        else emit_att_name("cwtl", "cwde", {});
+        return true;
+    case 0x99:
+        if (m_rex & 8) emit_att_name("cqto", "cqo", {});
+        else if (m_p66) emit_att_name("cwtd", "cwd", {});
+        else emit_att_name("cltd", "cdq", {});
+        return true;
+    case 0xa8: emit("test", {reg(0, 1), imm(imm_value(), 1)}, 1); return true;
+    case 0xa9: emit("test", {reg(0, v), imm(imm_value(), v)}, v); return true;
+    case 0xa4: case 0xa5: case 0xa6: case 0xa7:
+    case 0xaa: case 0xab: case 0xac: case 0xad: case 0xae: case 0xaf: {
+        // 串操作: rep stosq / repz cmpsb
+        static const char* const names[] = {"movs", "movs", "cmps", "cmps", "", "", "stos", "stos",
+                                            "lods", "lods", "scas", "scas"};
+        static const char sizes[] = {0, 'b', 'w', 0, 'l', 0, 0, 0, 'q'};
+        std::string name = names[op - 0xa4];
+        name += (op & 1) ? (v == 4 && !m_att ? 'd' : sizes[v]) : 'b';
+        bool compares = op == 0xa6 || op == 0xa7 || op == 0xae || op == 0xaf;
+        if (m_pf3) name = (compares ? "repz " : "rep ") + name;
+        else if (m_pf2) name = "repnz " + name;
+        emit(name, {});
+        return true;
+    }
+    case 0xc0: emit(g_group2[r], {E(1), imm(imm_value(false), 1)}, 1); return true;
+    case 0xc1: emit(g_group2[r], {E(v), imm(imm_value(false), 1)}, v); return true;
+    case 0xd0: case 0xd1: {
+        auto size = op == 0xd0 ? 1 : v;
+        if (m_att) emit(g_group2[r], {E(size)}, size);
+        else emit(g_group2[r], {E(size), {"1", false}}, size);
+        return true;
+    }
+    case 0xd2: case 0xd3: {
+        auto size = op == 0xd2 ? 1 : v;
+        emit(g_group2[r], {E(size), reg(1, 1)}, size);
+        return true;
+    }
+    case 0xc2: emit(m_pf2 ? "bnd ret" : "ret", {imm(imm_value(false), 2)}); return true;
+    case 0xc3: emit(m_pf2 ? "bnd ret" : (m_pf3 ? "repz ret" : "ret"), {}); return true;
+    case 0xc6: if (r != 0) return false; emit("mov", {E(1), imm(imm_value(), 1)}, 1); return true;
+    case 0xc7: if (r != 0) return false; emit("mov", {E(v), imm(imm_value(), v)}, v); return true;
+    case 0xc9: emit("leave", {}); return true;
+    case 0xcc: emit("int3", {}); return true;
+    case 0xcd: emit("int", {imm(imm_value(false), 1)}); return true;
+    case 0xe0: emit("loopne", {rel()}); return true;
+    case 0xe1: emit("loope", {rel()}); return true;
+    case 0xe2: emit("loop", {rel()}); return true;
+    case 0xe3: emit(m_addr32 ? "jecxz" : "jrcxz", {rel()}); return true;
+    case 0xe8: emit(m_pf2 ? "bnd call" : "call", {rel()}); return true;
+    case 0xe9: case 0xeb: emit(m_pf2 ? "bnd jmp" : "jmp", {rel()}); return true;
+    case 0xf4: emit("hlt", {}); return true;
+    case 0xf5: emit("cmc", {}); return true;
+    case 0xf8: emit("clc", {}); return true;
+    case 0xf9: emit("stc", {}); return true;
+    case 0xfc: emit("cld", {}); return true;
+    case 0xfd: emit("std", {}); return true;
+    case 0xf6: case 0xf7: {
+        auto size = op == 0xf6 ? 1 : v;
+        if (r < 2) emit("test", {E(size), imm(imm_value(), size)}, size);
+        else emit(g_group3[r], {E(size)}, size);
+        return true;
+    }
+    case 0xfe:
+        if (r > 1) return false;
+        emit(r == 0 ? "inc" : "dec", {E(1)}, 1);
+        return true;
+    case 0xff:
+        switch (r) {
+        case 0: emit("inc", {E(v)}, v); return true;
+        case 1: emit("dec", {E(v)}, v); return true;
+        case 2: case 4: {
+            // 间接跳转/调用：AT&T在操作数前加*
+            auto target = E(8);
+            if (m_att) target.text = "*" + target.text;
+            std::string name = r == 2 ? "call" : "jmp";
+            if (m_pf2) name = "bnd " + name;
+            emit(name, {target});
+            return true;
+        }
+        case 6: emit("push", {E(osize(true))}); return true;
+        default: return false;
+        }
+    default:
+        return false;
+    }
+}
+
+
+
+bool formatter::two_byte() {
+    auto op = m_insn.opcode;
+    auto r = (m_modrm >> 3) & 7;
+    auto v = osize();
+
+    if (op >= 0x40 && op <= 0x4f) {
+        emit(std::string{"cmov"} + g_cc[op & 0xf], {G(v), E(v)});
+        return true;
+    }
+    if (op >= 0x80 && op <= 0x8f) {
+        emit(std::string{"j"} + g_cc[op & 0xf], {rel()});
+        return true;
+    }
+    if (op >= 0x90 && op <= 0x9f) {
+        emit(std::string{"set"} + g_cc[op & 0xf], {E(1)});
+        return true;
+    }
+    if (op >= 0xc8 && op <= 0xcf) {
+        emit("bswap", {reg((op & 7) | ((m_rex & 1) ? 8 : 0), v)});
+        return true;
+    }
+
+    // SSE标量/打包运算，后缀由前缀决定
+    switch (op) {
+    case 0x51: case 0x58: case 0x59: case 0x5c: case 0x5d: case 0x5e: case 0x5f: {
+        static const char* const names[] = {"sqrt", "", "", "", "", "", "", "add", "mul", "", "", "sub", "min", "div", "max"};
+        auto s = sse_suffix();
+        int size = (m_pf3 ? 4 : (m_pf2 ? 8 : sz_xmm));
+        emit(std::string{names[op - 0x51]} + s, {V(), W(size)});
+        return true;
+    }
+    case 0x54: case 0x55: case 0x56: case 0x57: {
+        static const char* const names[] = {"and", "andn", "or", "xor"};
+        emit(std::string{names[op - 0x54]} + sse_suffix(true), {V(), W(sz_xmm)});
+        return true;
+    }
+    default: break;
+    }
+
+    switch (op) {
+    case 0x05: emit("syscall", {}); return true;
+    case 0x0b: emit("ud2", {}); return true;
+    case 0x31: emit("rdtsc", {}); return true;
+    case 0xa2: emit("cpuid", {}); return true;
+    case 0x1e:
+        if (m_pf3 && m_modrm == 0xfa) { emit("endbr64", {}); return true; }
+        if (m_pf3 && m_modrm == 0xfb) { emit("endbr32", {}); return true; }
+        emit("nop", {E(v)}, v);
+        return true;
+    case 0x1f: emit("nop", {E(v)}, v); return true;
+    case 0x18:
+        if (is_reg_form() || r > 3) return false;
+        {
+            static const char* const names[] = {"prefetchnta", "prefetcht0", "prefetcht1", "prefetcht2"};
+            emit(names[r], {mem(1)});
+        }
+        return true;
+    case 0x0d:
+        if (is_reg_form()) return false;
+        emit(r == 1 ? "prefetchw" : "prefetch", {mem(1)});
+        return true;
+    case 0xae:
+        if (is_reg_form()) {
+            if (r == 5) { emit("lfence", {}); return true; }
+            if (r == 6) { emit("mfence", {}); return true; }
+            if (r == 7) { emit("sfence", {}); return true; }
+        }
+        return false;
+    case 0x10: case 0x11: {
+        const char* name = m_pf3 ? "movss" : m_pf2 ? "movsd" : m_p66 ? "movupd" : "movups";
+        int size = m_pf3 ? 4 : (m_pf2 ? 8 : sz_xmm);
+        if (op == 0x10) emit(name, {V(), W(size)});
+        else emit(name, {W(size), V()});
+        return true;
+    }
+    case 0x28: case 0x29: {
+        const char* name = m_p66 ? "movapd" : "movaps";
+        if (op == 0x28) emit(name, {V(), W(sz_xmm)});
+        else emit(name, {W(sz_xmm), V()});
+        return true;
+    }
+    case 0x2a:
+        if (!m_pf3 && !m_pf2) return false;
+    {
+        // AT&T中内存源操作数的大小由后缀给出: cvtsi2sdl/cvtsi2sdq
+        std::string name = m_pf3 ? "cvtsi2ss" : "cvtsi2sd";
+        if (m_att && !is_reg_form()) name += (m_rex & 8) ? 'q' : 'l';
+        emit(name, {V(), E((m_rex & 8) ? 8 : 4)});
+        return true;
+    }
+    case 0x2c: case 0x2d: {
+        if (!m_pf3 && !m_pf2) return false;
+        std::string name = op == 0x2c ? "cvtt" : "cvt";
+        name += m_pf3 ? "ss2si" : "sd2si";
+        emit(name, {G((m_rex & 8) ? 8 : 4), W(m_pf3 ? 4 : 8)});
+        return true;
+    }
+    case 0x2e: case 0x2f: {
+        std::string name = op == 0x2e ? "ucomis" : "comis";
+        name += m_p66 ? "d" : "s";
+        emit(name, {V(), W(m_p66 ? 8 : 4)});
+        return true;
+    }
+    case 0x5a: {
+        const char* name = m_pf3 ? "cvtss2sd" : m_pf2 ? "cvtsd2ss" : m_p66 ? "cvtpd2ps" : "cvtps2pd";
+        emit(name, {V(), W(m_pf3 ? 4 : (m_pf2 ? 8 : sz_xmm))});
+        return true;
+    }
+    case 0x6e:
+        if (!m_p66) return false;
+        emit((m_rex & 8) ? "movq" : "movd", {V(), E((m_rex & 8) ? 8 : 4)});
+        return true;
+    case 0x7e:
+        if (m_pf3) { emit("movq", {V(), W(8)}); return true; }
+        if (!m_p66) return false;
+        emit((m_rex & 8) ? "movq" : "movd", {E((m_rex & 8) ? 8 : 4), V()});
+        return true;
+    case 0x6f: case 0x7f: {
+        if (!m_p66 && !m_pf3) return false;
+        const char* name = m_p66 ? "movdqa" : "movdqu";
+        if (op == 0x6f) emit(name, {V(), W(sz_xmm)});
+        else emit(name, {W(sz_xmm), V()});
+        return true;
+    }
+    case 0xd6:
+        if (!m_p66) return false;
+        emit("movq", {W(8), V()});
+        return true;
+    case 0x70:
+        if (!m_p66) return false;
+        emit("pshufd", {V(), W(sz_xmm), imm(imm_value(false), 1)});
+        return true;
+    case 0xd7:
+        if (!m_p66 || !is_reg_form()) return false;
+        emit("pmovmskb", {G(4), W(sz_xmm)});
+        return true;
+    case 0x60: case 0x61: case 0x62: case 0x6c: case 0x74: case 0x75: case 0x76:
+    case 0xd4: case 0xdb: case 0xdf: case 0xeb: case 0xef: case 0xfa: case 0xfb: case 0xfe: {
+        if (!m_p66) return false;
+        const char* name = nullptr;
+        switch (op) {
+        case 0x60: name = "punpcklbw"; break;
+        case 0x61: name = "punpcklwd"; break;
+        case 0x62: name = "punpckldq"; break;
+        case 0x6c: name = "punpcklqdq"; break;
+        case 0x74: name = "pcmpeqb"; break;
+        case 0x75: name = "pcmpeqw"; break;
+        case 0x76: name = "pcmpeqd"; break;
+        case 0xd4: name = "paddq"; break;
+        case 0xdb: name = "pand"; break;
+        case 0xdf: name = "pandn"; break;
+        case 0xeb: name = "por"; break;
+        case 0xef: name = "pxor"; break;
+        case 0xfa: name = "psubd"; break;
+        case 0xfb: name = "psubq"; break;
+        case 0xfe: name = "paddd"; break;
+        }
+        emit(name, {V(), W(sz_xmm)});
+        return true;
+    }
+    case 0xa3: emit("bt", {E(v), G(v)}); return true;
+    case 0xab: emit("bts", {E(v), G(v)}); return true;
+    case 0xb3: emit("btr", {E(v), G(v)}); return true;
+    case 0xbb: emit("btc", {E(v), G(v)}); return true;
+    case 0xba: {
+        if (r < 4) return false;
+        static const char* const names[] = {"bt", "bts", "btr", "btc"};
+        emit(names[r - 4], {E(v), imm(imm_value(false), 1)}, v);
+        return true;
+    }
+    case 0xa4: emit("shld", {E(v), G(v), imm(imm_value(false), 1)}); return true;
+    case 0xa5: emit("shld", {E(v), G(v), reg(1, 1)}); return true;
+    case 0xac: emit("shrd", {E(v), G(v), imm(imm_value(false), 1)}); return true;
+    case 0xad: emit("shrd", {E(v), G(v), reg(1, 1)}); return true;
+    case 0xaf: emit("imul", {G(v), E(v)}); return true;
+    case 0xb0: emit("cmpxchg", {E(1), G(1)}); return true;
+    case 0xb1: emit("cmpxchg", {E(v), G(v)}); return true;
+    case 0xc0: emit("xadd", {E(1), G(1)}); return true;
+    case 0xc1: emit("xadd", {E(v), G(v)}); return true;
+    case 0xb6: case 0xb7: case 0xbe: case 0xbf: {
+        // AT&T: movzbl/movzwq/movsbl...; Intel: movzx/movsx
+        bool zero = op < 0xb8;
+        int src = (op & 1) ? 2 : 1;
+        static const char sizes[] = {0, 'b', 'w', 0, 'l', 0, 0, 0, 'q'};
+        std::string att = std::string{zero ? "movz" : "movs"} + sizes[src] + sizes[v];
+        emit_att_name(att.c_str(), zero ? "movzx" : "movsx", {G(v), E(src)});
+        return true;
+    }
+    case 0xb8:
+        if (!m_pf3) return false;
+        emit("popcnt", {G(v), E(v)});
+        return true;
+    case 0xbc: emit(m_pf3 ? "tzcnt" : "bsf", {G(v), E(v)}); return true;
+    case 0xbd: emit(m_pf3 ? "lzcnt" : "bsr", {G(v), E(v)}); return true;
+    default:
+        return false;
+    }
+}
+
+
+
+x86_disasm formatter::run() {
+    bool ok = false;
+    if (m_insn.encoding == x86_encoding::legacy) {
+        if (m_insn.opcode_map == 0) ok = one_byte();
+        else if (m_insn.opcode_map == 1) ok = two_byte();
+    }
+    if (!ok) {
+        // 不支持的指令输出原始字节，清除可能已经记录的地址
+        m_out = x86_disasm{};
+        std::string text = ".byte ";
+        for (std::size_t i = 0; i < m_insn.length; i++) {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "%s0x%02x", i ? "," : "", m_code[i]);
+            text += buf;
+        }
+        m_out.text = text;
+    }
+    return m_out;
+}
+
+
+} // namespace
+
+
+
+x86_disasm format_x86(const uint8_t* code, const x86_insn& insn, std::uintptr_t addr, asm_syntax syntax) {
+    return formatter{code, insn, addr, syntax}.run();
+}
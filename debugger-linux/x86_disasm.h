@@ -0,0 +1,32 @@
+#ifndef _X86_DISASM_H
+#define _X86_DISASM_H
+
+
+#include <cstdint>
+#include <string>
+
+#include "x86_decoder.h"
+
+
+// 反汇编的语法
+enum class asm_syntax {
+    att,        // mov %rsp,%rbp / movl $0x1,-0x4(%rbp)
+    intel,      // mov rbp,rsp / mov dword ptr [rbp-0x4],0x1
+};
+
+// 一条指令的文本
+struct x86_disasm {
+    std::string text;           // 助记符与操作数
+    std::uintptr_t target;      // 直接跳转/调用的目标，没有时为0
+    std::uintptr_t rip_ref;     // rip相对寻址引用的地址，没有时为0
+};
+
+/**
+ * @brief: 把[decode_x86]解码的指令格式化为文本，[code]为指令的字节，[addr]为其地址
+ *         支持编译器常用的通用整数指令、控制流与常见的SSE标量/移动指令；
+ *         其他指令（x87、VEX/EVEX等）输出为 .byte 0x..
+ */
+x86_disasm format_x86(const uint8_t* code, const x86_insn& insn, std::uintptr_t addr, asm_syntax syntax);
+
+
+#endif /* _X86_DISASM_H */